@@ -45,6 +45,8 @@
 #ifndef HEADER_SIMPLE_OPENGL_IMAGE_LIBRARY
 #define HEADER_SIMPLE_OPENGL_IMAGE_LIBRARY
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -147,12 +149,15 @@ enum
 	SOIL_HDR_RGBE:		RGB * pow( 2.0, A - 128.0 )
 	SOIL_HDR_RGBdivA:	RGB / A
 	SOIL_HDR_RGBdivA2:	RGB / (A*A)
+	SOIL_HDR_RGB16F:	RGB, not fake at all: a GL_RGB16F texture of the
+						decoded values (needs float texture support)
 **/
 enum
 {
 	SOIL_HDR_RGBE = 0,
 	SOIL_HDR_RGBdivA = 1,
-	SOIL_HDR_RGBdivA2 = 2
+	SOIL_HDR_RGBdivA2 = 2,
+	SOIL_HDR_RGB16F = 3
 };
 
 /**
@@ -221,7 +226,7 @@ unsigned int
 /**
 	Loads an HDR image from disk into an OpenGL texture.
 	\param filename the name of the file to upload as a texture
-	\param fake_HDR_format SOIL_HDR_RGBE, SOIL_HDR_RGBdivA, SOIL_HDR_RGBdivA2
+	\param fake_HDR_format SOIL_HDR_RGBE, SOIL_HDR_RGBdivA, SOIL_HDR_RGBdivA2, SOIL_HDR_RGB16F
 	\param reuse_texture_ID 0-generate a new texture ID, otherwise reuse the texture ID (overwriting the old texture)
 	\param flags can be any of SOIL_FLAG_POWER_OF_TWO | SOIL_FLAG_MIPMAPS | SOIL_FLAG_TEXTURE_REPEATS | SOIL_FLAG_MULTIPLY_ALPHA | SOIL_FLAG_INVERT_Y | SOIL_FLAG_COMPRESS_TO_DXT
 	\return 0-failed, otherwise returns the OpenGL texture handle
@@ -393,6 +398,10 @@ unsigned char*
 	the resulting image has force_channels, but *channels may be
 	different (if the original image had a different channel
 	count).
+	If the image cache is on (see SOIL_set_image_cache_size) the
+	pixels may be shared with every other load of the same bytes:
+	treat them as read-only and release them with
+	SOIL_free_image_data.
 	\return 0 if failed, otherwise returns 1
 **/
 unsigned char*
@@ -404,6 +413,83 @@ unsigned char*
 		int force_channels
 	);
 
+/**
+	Turns on the decoded image cache of SOIL_load_image_from_memory,
+	or resizes it.  Images are keyed by a 64 bit hash of the input
+	bytes and force_channels, and the least recently used ones that
+	are not in use are evicted once the decoded pixels go over
+	max_bytes.  The cache is split in 16 separately locked shards,
+	each with a 16th of max_bytes, and an image bigger than that is
+	never cached.  0 turns the cache off and frees what nobody uses.
+	The first call must come before any other thread loads an image;
+	later ones may come from any thread.
+**/
+void
+	SOIL_set_image_cache_size
+	(
+		size_t max_bytes
+	);
+
+/**
+	Counters of the image cache, since it was turned on.
+**/
+typedef struct
+{
+	unsigned long long	hits, misses, evictions;
+	size_t				bytes;
+	int					images;
+}
+SOIL_image_cache_stats;
+
+void
+	SOIL_get_image_cache_stats
+	(
+		SOIL_image_cache_stats *stats
+	);
+
+/**
+	One image for SOIL_load_image_batch: set either filename or
+	buffer and buffer_length.  The rest is filled in by the loader;
+	data is NULL and result says why if the image failed to load.
+**/
+typedef struct
+{
+	const char			*filename;
+	const unsigned char	*buffer;
+	int					buffer_length;
+	unsigned char		*data;
+	int					width, height, channels;
+	const char			*result;
+}
+SOIL_batch_image;
+
+/**
+	Called once for every image, in the order they were submitted.
+	Calls never overlap, but they may come from any of the worker
+	threads.  The callback may take ownership of image->data (set it to
+	NULL and free it later with SOIL_free_image_data), otherwise it is
+	left in the image.
+**/
+typedef void (*SOIL_batch_callback)( void *context, int index, SOIL_batch_image *image );
+
+/**
+	Loads count images concurrently on up to thread_count threads
+	(<= 0 means one per hardware thread).  A decoder only starts once
+	the decoded images that have not yet been passed to the callback
+	fit in memory_budget bytes along with its own (0 means no limit);
+	an image bigger than the whole budget is decoded on its own.
+	callback may be NULL, in which case every image is left in images.
+	\return the number of images that failed to load
+**/
+int
+	SOIL_load_image_batch
+	(
+		SOIL_batch_image *images, int count,
+		int force_channels,
+		int thread_count, size_t memory_budget,
+		SOIL_batch_callback callback, void *context
+	);
+
 /**
 	Saves an image from an array of unsigned chars (RGBA) to disk
 	\param quality parameter only used for SOIL_SAVE_TYPE_JPG files, values accepted between 0 and 100.
@@ -432,6 +518,9 @@ int
 	Frees the image data (note, this is just C's "free()"...this function is
 	present mostly so C++ programmers don't forget to use "free()" and call
 	"delete []" instead [8^)
+	Pixels that came from the image cache only lose a reference, and
+	are freed once they are both unused and evicted.  Anything else
+	goes to the calling thread's image_allocator, if it installed one.
 **/
 void
 	SOIL_free_image_data
@@ -443,6 +532,8 @@ void
 	This function resturn a pointer to a string describing the last thing
 	that happened inside SOIL.  It can be used to determine why an image
 	failed to load.
+	The result is kept per thread, so threads loading at the same time
+	each get their own.
 **/
 const char*
 	SOIL_last_result
@@ -450,6 +541,95 @@ const char*
 		void
 	);
 
+struct image_allocator;
+
+/**
+	The per-call state of the *_ctx variants of the load functions.
+	result is where they leave the result of the call, the string
+	SOIL_last_result would return right after it; a context can be
+	kept with the image, or handed to another thread.
+	allocator, if not NULL, is installed (see image_alloc.h) for the
+	length of the call, so everything the call allocates comes from
+	it: the decoder's working memory, the resampled and MIPmapped
+	copies and the DXT output of the texture loaders, and the pixels
+	the image loaders return.  Those have to be freed with the same
+	allocator, by SOIL_free_image_data_ctx with the same context or,
+	for an image_arena, by resetting it.  Loads with an allocator
+	bypass the image cache.
+**/
+typedef struct
+{
+	const char						*result;
+	const struct image_allocator	*allocator;
+}
+SOIL_context;
+
+/**
+	SOIL_load_image, with its result also set in *context and its
+	memory from context->allocator.
+**/
+unsigned char*
+	SOIL_load_image_ctx
+	(
+		const char *filename,
+		int *width, int *height, int *channels,
+		int force_channels,
+		SOIL_context *context
+	);
+
+/**
+	SOIL_load_image_from_memory, with its result also set in *context
+	and its memory from context->allocator.
+**/
+unsigned char*
+	SOIL_load_image_from_memory_ctx
+	(
+		const unsigned char *const buffer,
+		int buffer_length,
+		int *width, int *height, int *channels,
+		int force_channels,
+		SOIL_context *context
+	);
+
+/**
+	SOIL_load_OGL_texture, with its result also set in *context and
+	its working memory from context->allocator.
+**/
+unsigned int
+	SOIL_load_OGL_texture_ctx
+	(
+		const char *filename,
+		int force_channels,
+		unsigned int reuse_texture_ID,
+		unsigned int flags,
+		SOIL_context *context
+	);
+
+/**
+	SOIL_load_OGL_texture_from_memory, with its result also set in
+	*context and its working memory from context->allocator.
+**/
+unsigned int
+	SOIL_load_OGL_texture_from_memory_ctx
+	(
+		const unsigned char *const buffer,
+		int buffer_length,
+		int force_channels,
+		unsigned int reuse_texture_ID,
+		unsigned int flags,
+		SOIL_context *context
+	);
+
+/**
+	Frees image data loaded with context, with its allocator.
+**/
+void
+	SOIL_free_image_data_ctx
+	(
+		unsigned char *img_data,
+		SOIL_context *context
+	);
+
 /** @return The address of the GL function proc, or NULL if the function is not found. */
 void *
 	SOIL_GL_GetProcAddress
@@ -505,6 +685,204 @@ unsigned int SOIL_direct_load_ETC1_from_memory(const unsigned char *const buffer
 		unsigned int reuse_texture_ID,
 		int flags );
 
+/**
+	The compressed texels of a DDS, PVR or PKM file, left where they are
+	in a read-only mapping of the file so they can be handed to the GPU
+	(or anywhere else) without a copy.
+	header points at the start of the file and data just past the file
+	header; data runs to the end of the file, with every face and MIPmap
+	level in the file's own order.
+	format is the glCompressedTexImage2D internal format, or 0 if the
+	texels aren't in a compressed format SOIL knows about.
+	mipmaps is the number of levels after the first one.
+	Release it with SOIL_free_payload.
+**/
+typedef struct
+{
+	const unsigned char	*header;
+	const unsigned char	*data;
+	int					data_length;
+	int					width, height;
+	int					mipmaps;
+	int					faces;
+	unsigned int		format;
+	void				*file;
+}
+SOIL_payload;
+
+/**
+	Maps a DDS file and points payload at its texels, with no copy.
+	\return 0 if failed, otherwise returns 1
+**/
+int
+	SOIL_direct_load_DDS_payload
+	(
+		const char *filename,
+		SOIL_payload *payload
+	);
+
+/**
+	Maps a PVR file and points payload at its texels, with no copy.
+	\return 0 if failed, otherwise returns 1
+**/
+int
+	SOIL_direct_load_PVR_payload
+	(
+		const char *filename,
+		SOIL_payload *payload
+	);
+
+/**
+	Maps a PKM (ETC1) file and points payload at its texels, with no copy.
+	\return 0 if failed, otherwise returns 1
+**/
+int
+	SOIL_direct_load_ETC1_payload
+	(
+		const char *filename,
+		SOIL_payload *payload
+	);
+
+/**
+	Unmaps the file behind a payload; its pointers are invalid afterwards.
+**/
+void
+	SOIL_free_payload
+	(
+		SOIL_payload *payload
+	);
+
+/**
+	A texture bundle packs many DDS, PVR and PKM files into one file
+	that is opened with a single mapping.  It holds a hash table of the
+	texture names and an index entry per texture (what kind of file it
+	was, its GL format, size, faces and where each MIPmap level starts),
+	then every file as it was, placed so that its texels start on a
+	SOIL_BUNDLE_ALIGNMENT byte boundary.  All numbers are stored little
+	endian, and all offsets are 32 bit, so a bundle is at most 4 GB.
+**/
+#define SOIL_BUNDLE_ALIGNMENT 64
+#define SOIL_BUNDLE_MAX_LEVELS 16
+
+/**
+	The kinds of file a bundle holds.
+**/
+enum
+{
+	SOIL_BUNDLE_DDS = 1,
+	SOIL_BUNDLE_PVR,
+	SOIL_BUNDLE_PKM
+};
+
+/**
+	An open bundle.  Release it with SOIL_close_bundle.
+**/
+typedef struct
+{
+	const unsigned char	*data;
+	unsigned int		size;
+	unsigned int		count;
+	unsigned int		slots;
+	void				*file;
+}
+SOIL_bundle;
+
+/**
+	One texture found in a bundle.
+	payload points into the bundle's mapping (its file is NULL, so
+	SOIL_free_payload leaves it alone) and stays valid until the bundle
+	is closed.  level_offsets[i] is where MIPmap level i of the first
+	face starts, from payload.data; each face is face_size bytes.
+**/
+typedef struct
+{
+	SOIL_payload	payload;
+	const char		*name;
+	int				kind;
+	unsigned int	face_size;
+	unsigned int	level_offsets[SOIL_BUNDLE_MAX_LEVELS];
+}
+SOIL_bundle_texture;
+
+/**
+	Packs count DDS, PVR or PKM files into one bundle file.
+	names are what the textures are found by; if names is NULL the
+	filenames are used as they were given.
+	\return 0 if failed, otherwise returns 1
+**/
+int
+	SOIL_create_bundle
+	(
+		const char *bundle_filename,
+		const char *const *filenames,
+		const char *const *names,
+		int count
+	);
+
+/**
+	Packs every DDS, PVR and PKM file under directory into one bundle
+	file, each named by its path inside directory ("a/b.dds").
+	The files are found with image_index_scan, on up to thread_count
+	threads (<= 0 means one per hardware thread).
+	\return 0 if failed, otherwise returns 1
+**/
+int
+	SOIL_create_bundle_from_directory
+	(
+		const char *bundle_filename,
+		const char *directory,
+		int thread_count
+	);
+
+/**
+	Maps a bundle file and checks its index, once, so lookups don't
+	have to.
+	\return 0 if failed, otherwise returns 1
+**/
+int
+	SOIL_open_bundle
+	(
+		const char *filename,
+		SOIL_bundle *bundle
+	);
+
+/**
+	Finds the texture called name with one hash lookup, and points
+	texture at it in place.
+	\return 0 if it is not in the bundle, otherwise returns 1
+**/
+int
+	SOIL_find_in_bundle
+	(
+		const SOIL_bundle *bundle,
+		const char *name,
+		SOIL_bundle_texture *texture
+	);
+
+/**
+	Finds the texture called name and uploads it straight from the
+	bundle with SOIL_direct_load_DDS/PVR/ETC1_from_memory (a cubemap
+	goes up as a cubemap).
+	\return 0-failed, otherwise returns the OpenGL texture handle
+**/
+unsigned int
+	SOIL_load_OGL_texture_from_bundle
+	(
+		const SOIL_bundle *bundle,
+		const char *name,
+		unsigned int reuse_texture_ID,
+		int flags
+	);
+
+/**
+	Unmaps a bundle; every texture found in it is invalid afterwards.
+**/
+void
+	SOIL_close_bundle
+	(
+		SOIL_bundle *bundle
+	);
+
 #ifdef __cplusplus
 }
 #endif
@@ -116,6 +116,10 @@
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "image_DXT.h"
 #include "image_helper.h"
+#include "image_index.h"
+#include "image_mmap.h"
+#include "image_thread.h"
+#include "image_alloc.h"
 #include "jo_jpeg.h"
 #include "pkm_helper.h"
 #include "pvr_helper.h"
@@ -124,8 +128,8 @@
 #include <stdlib.h>
 #include <string.h>
 
-/*	error reporting	*/
-const char *result_string_pointer = "SOIL initialized";
+/*	error reporting, per thread	*/
+IMAGE_THREAD_LOCAL const char *result_string_pointer = "SOIL initialized";
 
 /*	for loading cube maps	*/
 enum {
@@ -188,6 +192,9 @@ static int has_BGRA8888_capability = SOIL_CAPABILITY_UNKNOWN;
 int query_BGRA8888_capability(void);
 static int has_ETC1_capability = SOIL_CAPABILITY_UNKNOWN;
 int query_ETC1_capability(void);
+static unsigned char *SOIL_decode_image_from_memory(
+    const unsigned char *const buffer, int buffer_length, int *width,
+    int *height, int *channels, int force_channels);
 
 /* GL_IMG_texture_compression_pvrtc */
 #define SOIL_COMPRESSED_RGB_PVRTC_4BPPV1_IMG 0x8C00
@@ -196,6 +203,10 @@ int query_ETC1_capability(void);
 #define SOIL_COMPRESSED_RGBA_PVRTC_2BPPV1_IMG 0x8C03
 #define SOIL_GL_ETC1_RGB8_OES 0x8D64
 
+/* GL 3.0 / ARB_texture_float and ARB_half_float_pixel */
+#define SOIL_RGB16F 0x881B
+#define SOIL_HALF_FLOAT 0x140B
+
 #if defined(SOIL_X11_PLATFORM) || defined(SOIL_PLATFORM_WIN32) || \
     defined(SOIL_PLATFORM_OSX)
 typedef const GLubyte *(APIENTRY *P_SOIL_glGetStringiFunc)(GLenum, GLuint);
@@ -348,6 +359,9 @@ unsigned int SOIL_internal_create_OGL_texture(
     unsigned int reuse_texture_ID, unsigned int flags,
     unsigned int opengl_texture_type, unsigned int opengl_texture_target,
     unsigned int texture_check_size_enum);
+static unsigned int SOIL_internal_create_OGL_half_texture(
+    unsigned short *half_rgb, int width, int height,
+    unsigned int reuse_texture_ID, unsigned int flags);
 
 /*	and the code magic begins here [8^)	*/
 unsigned int SOIL_load_OGL_texture(const char *filename, int force_channels,
@@ -414,35 +428,46 @@ unsigned int SOIL_load_OGL_HDR_texture(const char *filename,
                                        unsigned int flags) {
   /*	variables	*/
   unsigned char *img = NULL;
-  int width, height, channels;
+  int width, height, channels = 4;
   unsigned int tex_id;
   /*	no direct uploading of the image as a DDS file	*/
   /* error check */
   if ((fake_HDR_format != SOIL_HDR_RGBE) &&
       (fake_HDR_format != SOIL_HDR_RGBdivA) &&
-      (fake_HDR_format != SOIL_HDR_RGBdivA2)) {
+      (fake_HDR_format != SOIL_HDR_RGBdivA2) &&
+      (fake_HDR_format != SOIL_HDR_RGB16F)) {
     result_string_pointer = "Invalid fake HDR format specified";
     return 0;
   }
 
-  /* check if the image is HDR */
-  if (stbi_is_hdr(filename)) {
-    /*	try to load the image (only the HDR type) */
-    img = stbi_load(filename, &width, &height, &channels, 4);
-  }
-
-  /*	channels holds the original number of channels, which may have been
-   * forced	*/
+  /*	try to load the image (only the HDR type), as the raw RGBE pixels */
+  img = stbi_load_rgbe(filename, &width, &height);
   if (NULL == img) {
     /*	image loading failed	*/
     result_string_pointer = stbi_failure_reason();
     return 0;
   }
   /* the load worked, do I need to convert it? */
-  if (fake_HDR_format == SOIL_HDR_RGBdivA) {
-    RGBE_to_RGBdivA(img, width, height, rescale_to_max);
+  if (fake_HDR_format == SOIL_HDR_RGB16F) {
+    unsigned short *half_rgb =
+        (unsigned short *)image_malloc(width * height * 3 *
+                                       sizeof(unsigned short));
+    if ((NULL == half_rgb) ||
+        !RGBE_to_RGB16F(img, width, height, half_rgb, 0)) {
+      image_free(half_rgb);
+      SOIL_free_image_data(img);
+      result_string_pointer = "Out of memory";
+      return 0;
+    }
+    SOIL_free_image_data(img);
+    tex_id = SOIL_internal_create_OGL_half_texture(half_rgb, width, height,
+                                                   reuse_texture_ID, flags);
+    image_free(half_rgb);
+    return tex_id;
+  } else if (fake_HDR_format == SOIL_HDR_RGBdivA) {
+    RGBE_to_RGBdivA_parallel(img, width, height, rescale_to_max, 0);
   } else if (fake_HDR_format == SOIL_HDR_RGBdivA2) {
-    RGBE_to_RGBdivA2(img, width, height, rescale_to_max);
+    RGBE_to_RGBdivA2_parallel(img, width, height, rescale_to_max, 0);
   }
   /*	OK, make it a texture!	*/
   tex_id = SOIL_internal_create_OGL_texture(
@@ -494,7 +519,7 @@ unsigned int SOIL_load_OGL_texture_from_memory(
   }
 
   /*	try to load the image	*/
-  img = SOIL_load_image_from_memory(buffer, buffer_length, &width, &height,
+  img = SOIL_decode_image_from_memory(buffer, buffer_length, &width, &height,
                                     &channels, force_channels);
   /*	channels holds the original number of channels, which may have been
    * forced	*/
@@ -693,7 +718,7 @@ unsigned int SOIL_load_OGL_cubemap_from_memory(
     return 0;
   }
   /*	1st face: try to load the image	*/
-  img = SOIL_load_image_from_memory(x_pos_buffer, x_pos_buffer_length, &width,
+  img = SOIL_decode_image_from_memory(x_pos_buffer, x_pos_buffer_length, &width,
                                     &height, &channels, force_channels);
   /*	channels holds the original number of channels, which may have been
    * forced	*/
@@ -715,7 +740,7 @@ unsigned int SOIL_load_OGL_cubemap_from_memory(
   /*	continue?	*/
   if (tex_id != 0) {
     /*	1st face: try to load the image	*/
-    img = SOIL_load_image_from_memory(x_neg_buffer, x_neg_buffer_length, &width,
+    img = SOIL_decode_image_from_memory(x_neg_buffer, x_neg_buffer_length, &width,
                                       &height, &channels, force_channels);
     /*	channels holds the original number of channels, which may have been
      * forced	*/
@@ -737,7 +762,7 @@ unsigned int SOIL_load_OGL_cubemap_from_memory(
   /*	continue?	*/
   if (tex_id != 0) {
     /*	1st face: try to load the image	*/
-    img = SOIL_load_image_from_memory(y_pos_buffer, y_pos_buffer_length, &width,
+    img = SOIL_decode_image_from_memory(y_pos_buffer, y_pos_buffer_length, &width,
                                       &height, &channels, force_channels);
     /*	channels holds the original number of channels, which may have been
      * forced	*/
@@ -759,7 +784,7 @@ unsigned int SOIL_load_OGL_cubemap_from_memory(
   /*	continue?	*/
   if (tex_id != 0) {
     /*	1st face: try to load the image	*/
-    img = SOIL_load_image_from_memory(y_neg_buffer, y_neg_buffer_length, &width,
+    img = SOIL_decode_image_from_memory(y_neg_buffer, y_neg_buffer_length, &width,
                                       &height, &channels, force_channels);
     /*	channels holds the original number of channels, which may have been
      * forced	*/
@@ -781,7 +806,7 @@ unsigned int SOIL_load_OGL_cubemap_from_memory(
   /*	continue?	*/
   if (tex_id != 0) {
     /*	1st face: try to load the image	*/
-    img = SOIL_load_image_from_memory(z_pos_buffer, z_pos_buffer_length, &width,
+    img = SOIL_decode_image_from_memory(z_pos_buffer, z_pos_buffer_length, &width,
                                       &height, &channels, force_channels);
     /*	channels holds the original number of channels, which may have been
      * forced	*/
@@ -803,7 +828,7 @@ unsigned int SOIL_load_OGL_cubemap_from_memory(
   /*	continue?	*/
   if (tex_id != 0) {
     /*	1st face: try to load the image	*/
-    img = SOIL_load_image_from_memory(z_neg_buffer, z_neg_buffer_length, &width,
+    img = SOIL_decode_image_from_memory(z_neg_buffer, z_neg_buffer_length, &width,
                                       &height, &channels, force_channels);
     /*	channels holds the original number of channels, which may have been
      * forced	*/
@@ -960,7 +985,7 @@ unsigned int SOIL_load_OGL_single_cubemap_from_memory(
     return 0;
   }
   /*	1st off, try to load the full image	*/
-  img = SOIL_load_image_from_memory(buffer, buffer_length, &width, &height,
+  img = SOIL_decode_image_from_memory(buffer, buffer_length, &width, &height,
                                     &channels, force_channels);
   /*	channels holds the original number of channels, which may have been
    * forced	*/
@@ -1028,7 +1053,7 @@ unsigned int SOIL_create_OGL_single_cubemap(const unsigned char *const data,
     dh = width;
   }
   sz = dw + dh;
-  sub_img = (unsigned char *)malloc(sz * sz * channels);
+  sub_img = (unsigned char *)image_malloc(sz * sz * channels);
   /*	do the splitting and uploading	*/
   tex_id = reuse_texture_ID;
   for (i = 0; i < 6; ++i) {
@@ -1108,16 +1133,22 @@ static void createMipmaps(const unsigned char *const img, int width, int height,
       query_gen_mipmap_capability() == SOIL_CAPABILITY_PRESENT) {
     soilGlGenerateMipmap(opengl_texture_target);
   } else {
-    int MIPlevel = 1;
-    int MIPwidth = (width + 1) / 2;
-    int MIPheight = (height + 1) / 2;
-    unsigned char *resampled =
-        (unsigned char *)malloc(channels * MIPwidth * MIPheight);
-
-    while (((1 << MIPlevel) <= width) || ((1 << MIPlevel) <= height)) {
-      /*	do this MIPmap level	*/
-      mipmap_image(img, width, height, channels, resampled, (1 << MIPlevel),
-                   (1 << MIPlevel));
+    int MIPlevel, MIPcount = 0;
+    int MIPwidth = width;
+    int MIPheight = height;
+    unsigned char *chain =
+        (unsigned char *)image_malloc(mipmap_chain_size(width, height,
+                                                        channels));
+    unsigned char *resampled = chain;
+
+    /*	build every level in one pass, each from the one above it	*/
+    if (NULL != chain) {
+      MIPcount = mipmap_image_chain(img, width, height, channels, chain,
+                                    IMAGE_FILTER_BOX);
+    }
+    for (MIPlevel = 1; MIPlevel <= MIPcount; ++MIPlevel) {
+      MIPwidth = (MIPwidth > 1) ? MIPwidth / 2 : 1;
+      MIPheight = (MIPheight > 1) ? MIPheight / 2 : 1;
 
       /*  upload the MIPmaps	*/
       if (DXT_mode == SOIL_CAPABILITY_PRESENT) {
@@ -1153,13 +1184,11 @@ static void createMipmaps(const unsigned char *const img, int width, int height,
                      GL_UNSIGNED_BYTE, resampled);
         check_for_GL_errors("glTexImage2D");
       }
-      /*	prep for the next level	*/
-      ++MIPlevel;
-      MIPwidth = (MIPwidth + 1) / 2;
-      MIPheight = (MIPheight + 1) / 2;
+      /*	on to the next level	*/
+      resampled += MIPwidth * MIPheight * channels;
     }
 
-    SOIL_free_image_data(resampled);
+    SOIL_free_image_data(chain);
   }
 }
 
@@ -1180,6 +1209,7 @@ unsigned int SOIL_internal_create_OGL_texture(
   int iwidth = *width;
   int iheight = *height;
   int needCopy;
+  int YCoCg_at_compression = 0;
   GLint unpack_aligment;
 
   /*	how large of a texture can this OpenGL implementation handle?	*/
@@ -1224,13 +1254,24 @@ unsigned int SOIL_internal_create_OGL_texture(
     flags |= SOIL_FLAG_POWER_OF_TWO;
   }
 
+  /*	when the DXT compressor is the only one to see the YCoCg image,
+          it converts each strip of blocks right before compressing it,
+          and leaves the source alone	*/
+  if ((flags & SOIL_FLAG_CoCg_Y) && (channels >= 3) &&
+      (flags & SOIL_FLAG_COMPRESS_TO_DXT) &&
+      !(flags & (SOIL_FLAG_MIPMAPS | SOIL_FLAG_GL_MIPMAPS)) &&
+      (query_DXT_capability() == SOIL_CAPABILITY_PRESENT)) {
+    YCoCg_at_compression = 1;
+  }
+
   needCopy =
       ((flags & SOIL_FLAG_INVERT_Y) || (flags & SOIL_FLAG_NTSC_SAFE_RGB) ||
-       (flags & SOIL_FLAG_MULTIPLY_ALPHA) || (flags & SOIL_FLAG_CoCg_Y));
+       (flags & SOIL_FLAG_MULTIPLY_ALPHA) ||
+       ((flags & SOIL_FLAG_CoCg_Y) && !YCoCg_at_compression));
 
   /*	create a copy the image data only if needed */
   if (needCopy) {
-    img = (unsigned char *)malloc(iwidth * iheight * channels);
+    img = (unsigned char *)image_malloc(iwidth * iheight * channels);
     memcpy(img, data, iwidth * iheight * channels);
   }
 
@@ -1307,7 +1348,7 @@ unsigned int SOIL_internal_create_OGL_texture(
     if ((new_width != iwidth) || (new_height != iheight)) {
       /*	yep, resize	*/
       unsigned char *resampled =
-          (unsigned char *)malloc(channels * new_width * new_height);
+          (unsigned char *)image_malloc(channels * new_width * new_height);
       up_scale_image(NULL != img ? img : data, iwidth, iheight, channels,
                      resampled, new_width, new_height);
 
@@ -1336,7 +1377,8 @@ unsigned int SOIL_internal_create_OGL_texture(
     }
     new_width = iwidth / reduce_block_x;
     new_height = iheight / reduce_block_y;
-    resampled = (unsigned char *)malloc(channels * new_width * new_height);
+    resampled =
+        (unsigned char *)image_malloc(channels * new_width * new_height);
     /*	perform the actual reduction	*/
     mipmap_image(NULL != img ? img : data, iwidth, iheight, channels, resampled,
                  reduce_block_x, reduce_block_y);
@@ -1349,7 +1391,7 @@ unsigned int SOIL_internal_create_OGL_texture(
     iheight = new_height;
   }
   /*	does the user want us to use YCoCg color space?	*/
-  if (flags & SOIL_FLAG_CoCg_Y) {
+  if ((flags & SOIL_FLAG_CoCg_Y) && !YCoCg_at_compression) {
     /*	this will only work with RGB and RGBA images */
     convert_RGB_to_YCoCg(img, iwidth, iheight, channels);
   }
@@ -1421,7 +1463,11 @@ unsigned int SOIL_internal_create_OGL_texture(
       /*	user wants me to do the DXT conversion!	*/
       int DDS_size;
       unsigned char *DDS_data = NULL;
-      if ((channels & 1) == 1) {
+      if (YCoCg_at_compression) {
+        /*	CoYCg uses DXT1, CoCgAY uses DXT5	*/
+        DDS_data = convert_image_to_DXT_YCoCg(NULL != img ? img : data, iwidth,
+                                              iheight, channels, &DDS_size, 1);
+      } else if ((channels & 1) == 1) {
         /*	RGB, use DXT1	*/
         DDS_data = convert_image_to_DXT1(NULL != img ? img : data, iwidth,
                                          iheight, channels, &DDS_size);
@@ -1439,6 +1485,25 @@ unsigned int SOIL_internal_create_OGL_texture(
         /*	printf( "Internal DXT compressor\n" );	*/
       } else {
         /*	my compression failed, try the OpenGL driver's version	*/
+        if (YCoCg_at_compression) {
+          /*	the caller's data is not ours to convert	*/
+          if (NULL == img) {
+            img = (unsigned char *)image_malloc(iwidth * iheight * channels);
+            if (NULL == img) {
+              /*	give back what this call set up	*/
+              if (1 != unpack_aligment) {
+                glPixelStorei(GL_UNPACK_ALIGNMENT, unpack_aligment);
+              }
+              if (0 == reuse_texture_ID) {
+                glDeleteTextures(1, &tex_id);
+              }
+              result_string_pointer = "Out of memory";
+              return 0;
+            }
+            memcpy(img, data, iwidth * iheight * channels);
+          }
+          convert_RGB_to_YCoCg(img, iwidth, iheight, channels);
+        }
         glTexImage2D(opengl_texture_target, 0, internal_texture_format, iwidth,
                      iheight, 0, original_texture_format, GL_UNSIGNED_BYTE,
                      NULL != img ? img : data);
@@ -1522,6 +1587,79 @@ unsigned int SOIL_internal_create_OGL_texture(
   return tex_id;
 }
 
+/*	uploads RGB half floats as is: only the MIPmap, filtering, wrapping
+        and inversion flags apply	*/
+static unsigned int SOIL_internal_create_OGL_half_texture(
+    unsigned short *half_rgb, int width, int height,
+    unsigned int reuse_texture_ID, unsigned int flags) {
+  unsigned int tex_id = reuse_texture_ID;
+  GLint unpack_aligment;
+  /*	does the user want me to invert the image?	*/
+  if (flags & SOIL_FLAG_INVERT_Y) {
+    int i, j;
+    for (j = 0; j * 2 < height; ++j) {
+      int index1 = j * width * 3;
+      int index2 = (height - 1 - j) * width * 3;
+      for (i = width * 3; i > 0; --i) {
+        unsigned short temp = half_rgb[index1];
+        half_rgb[index1] = half_rgb[index2];
+        half_rgb[index2] = temp;
+        ++index1;
+        ++index2;
+      }
+    }
+  }
+  if (tex_id == 0) {
+    glGenTextures(1, &tex_id);
+  }
+  check_for_GL_errors("glGenTextures");
+  if (!tex_id) {
+    result_string_pointer =
+        "Failed to generate an OpenGL texture name; missing OpenGL context?";
+    return 0;
+  }
+  glBindTexture(GL_TEXTURE_2D, tex_id);
+  check_for_GL_errors("glBindTexture");
+  /*	rows are 6 bytes per pixel	*/
+  glGetIntegerv(GL_UNPACK_ALIGNMENT, &unpack_aligment);
+  if (2 != unpack_aligment) {
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+  }
+  glTexImage2D(GL_TEXTURE_2D, 0, SOIL_RGB16F, width, height, 0, GL_RGB,
+               SOIL_HALF_FLOAT, half_rgb);
+  check_for_GL_errors("glTexImage2D");
+  if (2 != unpack_aligment) {
+    glPixelStorei(GL_UNPACK_ALIGNMENT, unpack_aligment);
+  }
+  /*	only OpenGL can build MIPmaps of a float texture	*/
+  if ((flags & (SOIL_FLAG_MIPMAPS | SOIL_FLAG_GL_MIPMAPS)) &&
+      (query_gen_mipmap_capability() == SOIL_CAPABILITY_PRESENT)) {
+    soilGlGenerateMipmap(GL_TEXTURE_2D);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER,
+                    (flags & SOIL_FLAG_NEAREST) ? GL_NEAREST : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                    (flags & SOIL_FLAG_NEAREST) ? GL_NEAREST_MIPMAP_NEAREST
+                                                : GL_LINEAR_MIPMAP_LINEAR);
+  } else {
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER,
+                    (flags & SOIL_FLAG_NEAREST) ? GL_NEAREST : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                    (flags & SOIL_FLAG_NEAREST) ? GL_NEAREST : GL_LINEAR);
+  }
+  check_for_GL_errors("GL_TEXTURE_MIN/MAG_FILTER");
+  /*	does the user want clamping, or wrapping?	*/
+  if (flags & SOIL_FLAG_TEXTURE_REPEATS) {
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  } else {
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, SOIL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, SOIL_CLAMP_TO_EDGE);
+  }
+  check_for_GL_errors("GL_TEXTURE_WRAP_*");
+  result_string_pointer = "Image loaded as an OpenGL texture";
+  return tex_id;
+}
+
 int SOIL_save_screenshot(const char *filename, int image_type, int x, int y,
                          int width, int height) {
   unsigned char *pixel_data;
@@ -1543,7 +1681,7 @@ int SOIL_save_screenshot(const char *filename, int image_type, int x, int y,
   }
 
   /*  Get the data from OpenGL	*/
-  pixel_data = (unsigned char *)malloc(3 * width * height);
+  pixel_data = (unsigned char *)image_malloc(3 * width * height);
   glReadPixels(x, y, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixel_data);
 
   /*	invert the image	*/
@@ -1580,10 +1718,392 @@ unsigned char *SOIL_load_image(const char *filename, int *width, int *height,
   return result;
 }
 
-unsigned char *SOIL_load_image_from_memory(const unsigned char *const buffer,
-                                           int buffer_length, int *width,
-                                           int *height, int *channels,
-                                           int force_channels) {
+/*
+        The decoded image cache.  An image is kept in one of
+        SOIL_IMAGE_CACHE_SHARDS shards, picked by its key, each with its
+        own lock, share of the byte budget and CLOCK ring.  Its pixels
+        are also listed in one of as many pointer shards, picked by their
+        address, so SOIL_free_image_data can tell the cache's pointers
+        from its own.  A key shard lock may be held while a pointer shard
+        is locked, never the other way around.
+*/
+#define SOIL_IMAGE_CACHE_SHARDS 16
+
+typedef struct SOIL_image_cache_entry {
+  unsigned long long hash;
+  int buffer_length, force_channels;
+  int width, height, channels;
+  unsigned char *data;
+  size_t bytes;
+  /*	users holding the pixels, the CLOCK bit, whether the key still
+          finds it, and its place in the ring	*/
+  int refs;
+  int referenced;
+  int cached;
+  int clock_slot;
+  struct SOIL_image_cache_entry *next_by_key;
+  struct SOIL_image_cache_entry *next_by_data;
+} SOIL_image_cache_entry;
+
+typedef struct {
+  image_monitor *lock;
+  SOIL_image_cache_entry **buckets;
+  int bucket_count, count;
+  SOIL_image_cache_entry **clock;
+  int clock_capacity, hand;
+  /*	bytes and budget are both guarded by lock	*/
+  size_t bytes, budget;
+  unsigned long long hits, misses, evictions;
+} SOIL_image_cache_shard;
+
+typedef struct {
+  image_monitor *lock;
+  SOIL_image_cache_entry **buckets;
+  int bucket_count, count;
+} SOIL_image_cache_pointers;
+
+static SOIL_image_cache_shard *SOIL_image_cache = NULL;
+static SOIL_image_cache_pointers *SOIL_image_cache_registry = NULL;
+
+/*	XXH64, seeded	*/
+#define SOIL_XXH_PRIME1 11400714785074694791ULL
+#define SOIL_XXH_PRIME2 14029467366897019727ULL
+#define SOIL_XXH_PRIME3 1609587929392839161ULL
+#define SOIL_XXH_PRIME4 9650029242287828579ULL
+#define SOIL_XXH_PRIME5 2870177450012600261ULL
+
+static unsigned long long SOIL_rotl64(unsigned long long x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+static unsigned long long SOIL_read64(const unsigned char *p) {
+  unsigned long long v;
+  memcpy(&v, p, 8);
+  return v;
+}
+
+static unsigned long long SOIL_xxh_round(unsigned long long acc,
+                                         unsigned long long input) {
+  acc += input * SOIL_XXH_PRIME2;
+  return SOIL_rotl64(acc, 31) * SOIL_XXH_PRIME1;
+}
+
+static unsigned long long SOIL_xxh_merge(unsigned long long acc,
+                                         unsigned long long v) {
+  acc ^= SOIL_xxh_round(0, v);
+  return acc * SOIL_XXH_PRIME1 + SOIL_XXH_PRIME4;
+}
+
+static unsigned long long SOIL_hash64(const unsigned char *p, size_t length,
+                                      unsigned long long seed) {
+  const unsigned char *end = p + length;
+  unsigned long long h;
+  if (length >= 32) {
+    unsigned long long v1 = seed + SOIL_XXH_PRIME1 + SOIL_XXH_PRIME2;
+    unsigned long long v2 = seed + SOIL_XXH_PRIME2;
+    unsigned long long v3 = seed;
+    unsigned long long v4 = seed - SOIL_XXH_PRIME1;
+    do {
+      v1 = SOIL_xxh_round(v1, SOIL_read64(p));
+      v2 = SOIL_xxh_round(v2, SOIL_read64(p + 8));
+      v3 = SOIL_xxh_round(v3, SOIL_read64(p + 16));
+      v4 = SOIL_xxh_round(v4, SOIL_read64(p + 24));
+      p += 32;
+    } while (p + 32 <= end);
+    h = SOIL_rotl64(v1, 1) + SOIL_rotl64(v2, 7) + SOIL_rotl64(v3, 12) +
+        SOIL_rotl64(v4, 18);
+    h = SOIL_xxh_merge(h, v1);
+    h = SOIL_xxh_merge(h, v2);
+    h = SOIL_xxh_merge(h, v3);
+    h = SOIL_xxh_merge(h, v4);
+  } else {
+    h = seed + SOIL_XXH_PRIME5;
+  }
+  h += (unsigned long long)length;
+  for (; p + 8 <= end; p += 8) {
+    h ^= SOIL_xxh_round(0, SOIL_read64(p));
+    h = SOIL_rotl64(h, 27) * SOIL_XXH_PRIME1 + SOIL_XXH_PRIME4;
+  }
+  if (p + 4 <= end) {
+    unsigned int k;
+    memcpy(&k, p, 4);
+    h ^= (unsigned long long)k * SOIL_XXH_PRIME1;
+    h = SOIL_rotl64(h, 23) * SOIL_XXH_PRIME2 + SOIL_XXH_PRIME3;
+    p += 4;
+  }
+  for (; p < end; ++p) {
+    h ^= (*p) * SOIL_XXH_PRIME5;
+    h = SOIL_rotl64(h, 11) * SOIL_XXH_PRIME1;
+  }
+  h ^= h >> 33;
+  h *= SOIL_XXH_PRIME2;
+  h ^= h >> 29;
+  h *= SOIL_XXH_PRIME3;
+  h ^= h >> 32;
+  return h;
+}
+
+/*	the top bits pick the shard, the bottom ones the bucket	*/
+static unsigned long long SOIL_image_cache_data_hash(const unsigned char *data) {
+  return ((unsigned long long)(size_t)data >> 4) * SOIL_XXH_PRIME1;
+}
+
+static int SOIL_image_cache_shard_of(unsigned long long hash) {
+  return (int)(hash >> 60) & (SOIL_IMAGE_CACHE_SHARDS - 1);
+}
+
+/*	doubles a bucket array once there is more than one entry per
+        bucket; if that fails the chains just get longer	*/
+static void SOIL_image_cache_grow(SOIL_image_cache_entry ***buckets,
+                                  int *bucket_count, int count, int by_data) {
+  SOIL_image_cache_entry **grown;
+  int i, n = (*bucket_count > 0) ? *bucket_count * 2 : 64;
+  if (count < *bucket_count) {
+    return;
+  }
+  grown = (SOIL_image_cache_entry **)calloc(n, sizeof(SOIL_image_cache_entry *));
+  if (NULL == grown) {
+    return;
+  }
+  for (i = 0; i < *bucket_count; ++i) {
+    SOIL_image_cache_entry *entry = (*buckets)[i];
+    while (NULL != entry) {
+      SOIL_image_cache_entry *next;
+      int b;
+      if (by_data) {
+        next = entry->next_by_data;
+        b = (int)(SOIL_image_cache_data_hash(entry->data) & (n - 1));
+        entry->next_by_data = grown[b];
+      } else {
+        next = entry->next_by_key;
+        b = (int)(entry->hash & (n - 1));
+        entry->next_by_key = grown[b];
+      }
+      grown[b] = entry;
+      entry = next;
+    }
+  }
+  free(*buckets);
+  *buckets = grown;
+  *bucket_count = n;
+}
+
+/*	lists the pixels of entry in their pointer shard	*/
+static int SOIL_image_cache_register(SOIL_image_cache_entry *entry) {
+  unsigned long long hash = SOIL_image_cache_data_hash(entry->data);
+  SOIL_image_cache_pointers *registry =
+      &SOIL_image_cache_registry[SOIL_image_cache_shard_of(hash)];
+  int b;
+  image_monitor_lock(registry->lock);
+  SOIL_image_cache_grow(&registry->buckets, &registry->bucket_count,
+                        registry->count, 1);
+  if (NULL == registry->buckets) {
+    image_monitor_unlock(registry->lock);
+    return 0;
+  }
+  b = (int)(hash & (registry->bucket_count - 1));
+  entry->next_by_data = registry->buckets[b];
+  registry->buckets[b] = entry;
+  ++registry->count;
+  image_monitor_unlock(registry->lock);
+  return 1;
+}
+
+static void SOIL_image_cache_unregister(SOIL_image_cache_entry *entry) {
+  unsigned long long hash = SOIL_image_cache_data_hash(entry->data);
+  SOIL_image_cache_pointers *registry =
+      &SOIL_image_cache_registry[SOIL_image_cache_shard_of(hash)];
+  SOIL_image_cache_entry **link;
+  image_monitor_lock(registry->lock);
+  link = &registry->buckets[hash & (registry->bucket_count - 1)];
+  while (*link != entry) {
+    link = &(*link)->next_by_data;
+  }
+  *link = entry->next_by_data;
+  --registry->count;
+  image_monitor_unlock(registry->lock);
+}
+
+/*	takes entry out of its key shard, so no new user can find it; the
+        pixels go once the last user lets go of them	*/
+static void SOIL_image_cache_remove(SOIL_image_cache_shard *shard,
+                                    SOIL_image_cache_entry *entry) {
+  SOIL_image_cache_entry **link =
+      &shard->buckets[entry->hash & (shard->bucket_count - 1)];
+  while (*link != entry) {
+    link = &(*link)->next_by_key;
+  }
+  *link = entry->next_by_key;
+  --shard->count;
+  /*	the last entry of the ring takes its slot	*/
+  shard->clock[entry->clock_slot] = shard->clock[shard->count];
+  shard->clock[entry->clock_slot]->clock_slot = entry->clock_slot;
+  shard->bytes -= entry->bytes;
+  entry->cached = 0;
+  if (entry->refs == 0) {
+    SOIL_image_cache_unregister(entry);
+    free(entry->data);
+    free(entry);
+  }
+}
+
+/*	evicts images nobody is using, CLOCK order, until need more bytes
+        fit in the shard's budget; 0 if they still don't	*/
+static int SOIL_image_cache_make_room(SOIL_image_cache_shard *shard,
+                                      size_t need) {
+  int visited = 0;
+  while ((shard->bytes + need > shard->budget) &&
+         (visited < 2 * shard->count)) {
+    SOIL_image_cache_entry *entry;
+    if (shard->hand >= shard->count) {
+      shard->hand = 0;
+    }
+    entry = shard->clock[shard->hand];
+    ++visited;
+    if ((entry->refs > 0) || entry->referenced) {
+      /*	a second chance	*/
+      entry->referenced = 0;
+      ++shard->hand;
+      continue;
+    }
+    SOIL_image_cache_remove(shard, entry);
+    ++shard->evictions;
+    visited = 0;
+  }
+  return shard->bytes + need <= shard->budget;
+}
+
+static SOIL_image_cache_entry *SOIL_image_cache_find(
+    SOIL_image_cache_shard *shard, unsigned long long hash, int buffer_length,
+    int force_channels) {
+  SOIL_image_cache_entry *entry;
+  if (shard->count == 0) {
+    return NULL;
+  }
+  for (entry = shard->buckets[hash & (shard->bucket_count - 1)];
+       NULL != entry; entry = entry->next_by_key) {
+    if ((entry->hash == hash) && (entry->buffer_length == buffer_length) &&
+        (entry->force_channels == force_channels)) {
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+/*	hands out a reference to a cached image	*/
+static unsigned char *SOIL_image_cache_use(SOIL_image_cache_entry *entry,
+                                           int *width, int *height,
+                                           int *channels) {
+  ++entry->refs;
+  entry->referenced = 1;
+  *width = entry->width;
+  *height = entry->height;
+  *channels = entry->channels;
+  return entry->data;
+}
+
+/*	caches data (just decoded) if it fits, and returns the pixels to
+        hand out: data itself, or the copy another thread cached first	*/
+static unsigned char *SOIL_image_cache_insert(
+    SOIL_image_cache_shard *shard, unsigned long long hash, int buffer_length,
+    int force_channels, unsigned char *data, int *width, int *height,
+    int *channels) {
+  SOIL_image_cache_entry *entry;
+  size_t bytes = (size_t)(*width) * (*height) *
+                 (force_channels ? force_channels : *channels);
+  unsigned char *result = data;
+  image_monitor_lock(shard->lock);
+  entry = SOIL_image_cache_find(shard, hash, buffer_length, force_channels);
+  if (NULL != entry) {
+    result = SOIL_image_cache_use(entry, width, height, channels);
+    image_monitor_unlock(shard->lock);
+    free(data);
+    return result;
+  }
+  if (!SOIL_image_cache_make_room(shard, bytes)) {
+    image_monitor_unlock(shard->lock);
+    return data;
+  }
+  entry = (SOIL_image_cache_entry *)calloc(1, sizeof(SOIL_image_cache_entry));
+  if (shard->count == shard->clock_capacity) {
+    int capacity = shard->clock_capacity ? shard->clock_capacity * 2 : 64;
+    SOIL_image_cache_entry **clock = (SOIL_image_cache_entry **)realloc(
+        shard->clock, capacity * sizeof(SOIL_image_cache_entry *));
+    if (NULL != clock) {
+      shard->clock = clock;
+      shard->clock_capacity = capacity;
+    }
+  }
+  SOIL_image_cache_grow(&shard->buckets, &shard->bucket_count, shard->count,
+                        0);
+  if ((NULL == entry) || (shard->count == shard->clock_capacity) ||
+      (NULL == shard->buckets)) {
+    image_monitor_unlock(shard->lock);
+    free(entry);
+    return data;
+  }
+  entry->hash = hash;
+  entry->buffer_length = buffer_length;
+  entry->force_channels = force_channels;
+  entry->width = *width;
+  entry->height = *height;
+  entry->channels = *channels;
+  entry->data = data;
+  entry->bytes = bytes;
+  entry->refs = 1;
+  entry->referenced = 1;
+  entry->cached = 1;
+  if (!SOIL_image_cache_register(entry)) {
+    image_monitor_unlock(shard->lock);
+    free(entry);
+    return data;
+  }
+  entry->next_by_key = shard->buckets[hash & (shard->bucket_count - 1)];
+  shard->buckets[hash & (shard->bucket_count - 1)] = entry;
+  entry->clock_slot = shard->count;
+  shard->clock[shard->count++] = entry;
+  shard->bytes += bytes;
+  image_monitor_unlock(shard->lock);
+  return data;
+}
+
+/*	drops a reference to cached pixels; 0 if data isn't the cache's	*/
+static int SOIL_image_cache_release(unsigned char *data) {
+  unsigned long long hash = SOIL_image_cache_data_hash(data);
+  SOIL_image_cache_pointers *registry =
+      &SOIL_image_cache_registry[SOIL_image_cache_shard_of(hash)];
+  SOIL_image_cache_shard *shard;
+  SOIL_image_cache_entry *entry = NULL;
+  image_monitor_lock(registry->lock);
+  if (registry->count > 0) {
+    entry = registry->buckets[hash & (registry->bucket_count - 1)];
+    while ((NULL != entry) && (entry->data != data)) {
+      entry = entry->next_by_data;
+    }
+  }
+  image_monitor_unlock(registry->lock);
+  if (NULL == entry) {
+    return 0;
+  }
+  /*	the caller's reference keeps entry alive until it is dropped here	*/
+  shard = &SOIL_image_cache[SOIL_image_cache_shard_of(entry->hash)];
+  image_monitor_lock(shard->lock);
+  if ((--entry->refs == 0) && !entry->cached) {
+    SOIL_image_cache_unregister(entry);
+    free(entry->data);
+    free(entry);
+  } else if (shard->bytes > shard->budget) {
+    /*	the budget shrank while it was in use	*/
+    SOIL_image_cache_make_room(shard, 0);
+  }
+  image_monitor_unlock(shard->lock);
+  return 1;
+}
+
+/*	never cached: the texture loaders change the pixels in place	*/
+static unsigned char *SOIL_decode_image_from_memory(
+    const unsigned char *const buffer, int buffer_length, int *width,
+    int *height, int *channels, int force_channels) {
   unsigned char *result = stbi_load_from_memory(
       buffer, buffer_length, width, height, channels, force_channels);
   if (result == NULL) {
@@ -1594,6 +2114,252 @@ unsigned char *SOIL_load_image_from_memory(const unsigned char *const buffer,
   return result;
 }
 
+void SOIL_set_image_cache_size(size_t max_bytes) {
+  int i;
+  if ((NULL == SOIL_image_cache) && (max_bytes > 0)) {
+    SOIL_image_cache_shard *shards = (SOIL_image_cache_shard *)calloc(
+        SOIL_IMAGE_CACHE_SHARDS, sizeof(SOIL_image_cache_shard));
+    SOIL_image_cache_pointers *registry = (SOIL_image_cache_pointers *)calloc(
+        SOIL_IMAGE_CACHE_SHARDS, sizeof(SOIL_image_cache_pointers));
+    int ok = (NULL != shards) && (NULL != registry);
+    for (i = 0; ok && (i < SOIL_IMAGE_CACHE_SHARDS); ++i) {
+      shards[i].lock = image_monitor_create();
+      registry[i].lock = image_monitor_create();
+      ok = (NULL != shards[i].lock) && (NULL != registry[i].lock);
+    }
+    if (!ok) {
+      for (i = 0; (NULL != shards) && (NULL != registry) &&
+                  (i < SOIL_IMAGE_CACHE_SHARDS);
+           ++i) {
+        image_monitor_destroy(shards[i].lock);
+        image_monitor_destroy(registry[i].lock);
+      }
+      free(shards);
+      free(registry);
+      result_string_pointer = "Can not create the image cache";
+      return;
+    }
+    SOIL_image_cache_registry = registry;
+    SOIL_image_cache = shards;
+  }
+  if (NULL == SOIL_image_cache) {
+    return;
+  }
+  for (i = 0; i < SOIL_IMAGE_CACHE_SHARDS; ++i) {
+    SOIL_image_cache_shard *shard = &SOIL_image_cache[i];
+    image_monitor_lock(shard->lock);
+    shard->budget = max_bytes / SOIL_IMAGE_CACHE_SHARDS;
+    SOIL_image_cache_make_room(shard, 0);
+    image_monitor_unlock(shard->lock);
+  }
+}
+
+void SOIL_get_image_cache_stats(SOIL_image_cache_stats *stats) {
+  int i;
+  if (NULL == stats) {
+    return;
+  }
+  memset(stats, 0, sizeof(SOIL_image_cache_stats));
+  if (NULL == SOIL_image_cache) {
+    return;
+  }
+  for (i = 0; i < SOIL_IMAGE_CACHE_SHARDS; ++i) {
+    SOIL_image_cache_shard *shard = &SOIL_image_cache[i];
+    image_monitor_lock(shard->lock);
+    stats->hits += shard->hits;
+    stats->misses += shard->misses;
+    stats->evictions += shard->evictions;
+    stats->bytes += shard->bytes;
+    stats->images += shard->count;
+    image_monitor_unlock(shard->lock);
+  }
+}
+
+unsigned char *SOIL_load_image_from_memory(const unsigned char *const buffer,
+                                           int buffer_length, int *width,
+                                           int *height, int *channels,
+                                           int force_channels) {
+  SOIL_image_cache_shard *shard = NULL;
+  unsigned long long hash = 0;
+  unsigned char *result;
+  /*	the cache keeps its pixels on the heap, so it is left out while
+          the thread has an allocator of its own	*/
+  if ((NULL != SOIL_image_cache) && (NULL == image_allocator_current()) &&
+      (NULL != buffer) && (buffer_length > 0)) {
+    SOIL_image_cache_entry *entry;
+    hash = SOIL_hash64(buffer, (size_t)buffer_length,
+                       (unsigned long long)force_channels);
+    shard = &SOIL_image_cache[SOIL_image_cache_shard_of(hash)];
+    image_monitor_lock(shard->lock);
+    if (0 == shard->budget) {
+      /*	the cache is off	*/
+      image_monitor_unlock(shard->lock);
+      shard = NULL;
+    } else {
+      entry = SOIL_image_cache_find(shard, hash, buffer_length, force_channels);
+      if (NULL != entry) {
+        ++shard->hits;
+        result = SOIL_image_cache_use(entry, width, height, channels);
+        image_monitor_unlock(shard->lock);
+        result_string_pointer = "Image loaded from the cache";
+        return result;
+      }
+      ++shard->misses;
+      image_monitor_unlock(shard->lock);
+    }
+  }
+  /*	decode with no lock held	*/
+  result = SOIL_decode_image_from_memory(buffer, buffer_length, width, height,
+                                         channels, force_channels);
+  if ((NULL != result) && (NULL != shard)) {
+    result = SOIL_image_cache_insert(shard, hash, buffer_length,
+                                     force_channels, result, width, height,
+                                     channels);
+  }
+  return result;
+}
+
+typedef struct {
+  SOIL_batch_image *images;
+  int count;
+  int force_channels;
+  size_t memory_budget;
+  SOIL_batch_callback callback;
+  void *context;
+  image_monitor *monitor;
+  /*	the decoded bytes charged to each image, and whether it is done	*/
+  size_t *sizes;
+  unsigned char *ready;
+  /*	budget is claimed, and images delivered, in submission order	*/
+  int next_ticket;
+  int next_delivery;
+  int delivering;
+  size_t in_flight;
+  int failures;
+} SOIL_batch_job;
+
+static void SOIL_batch_load_task(void *context, int index) {
+  SOIL_batch_job *job = (SOIL_batch_job *)context;
+  SOIL_batch_image *image = &job->images[index];
+  const unsigned char *buffer = image->buffer;
+  int buffer_length = image->buffer_length;
+  image_file_view view;
+  int mapped = 0;
+  int width, height, channels;
+  size_t bytes = 0;
+  image->data = NULL;
+  image->width = image->height = image->channels = 0;
+  image->result = "NULL buffer";
+  if (NULL != image->filename) {
+    buffer = NULL;
+    image->result = "Can not open the image file";
+    if (image_file_map(image->filename, &view)) {
+      mapped = 1;
+      if (view.size <= 0x7FFFFFFF) {
+        buffer = view.data;
+        buffer_length = (int)view.size;
+      }
+    }
+  }
+  /*	the header is enough to know how much memory the decode will take	*/
+  if ((NULL != buffer) &&
+      stbi_info_from_memory(buffer, buffer_length, &width, &height,
+                            &channels)) {
+    if (job->force_channels > 0) {
+      channels = job->force_channels;
+    }
+    bytes = (size_t)width * (size_t)height * (size_t)channels;
+  }
+  /*	wait for our turn, and for the budget to have room for us;
+          an oversized image still goes once nothing else is in flight	*/
+  image_monitor_lock(job->monitor);
+  while ((job->next_ticket != index) ||
+         ((job->memory_budget > 0) && (job->in_flight > 0) &&
+          (job->in_flight + bytes > job->memory_budget))) {
+    image_monitor_wait(job->monitor);
+  }
+  job->in_flight += bytes;
+  job->sizes[index] = bytes;
+  ++job->next_ticket;
+  image_monitor_broadcast(job->monitor);
+  image_monitor_unlock(job->monitor);
+  /*	decode	*/
+  if (NULL != buffer) {
+    image->data =
+        stbi_load_from_memory(buffer, buffer_length, &image->width,
+                              &image->height, &image->channels,
+                              job->force_channels);
+    image->result =
+        (NULL == image->data) ? stbi_failure_reason() : "Image loaded";
+  }
+  if (mapped) {
+    image_file_unmap(&view);
+  }
+  /*	hand over every image that is now next in line	*/
+  image_monitor_lock(job->monitor);
+  if (NULL == image->data) {
+    ++job->failures;
+  }
+  job->ready[index] = 1;
+  if (!job->delivering) {
+    job->delivering = 1;
+    while ((job->next_delivery < job->count) &&
+           job->ready[job->next_delivery]) {
+      int i = job->next_delivery++;
+      image_monitor_unlock(job->monitor);
+      if (NULL != job->callback) {
+        job->callback(job->context, i, &job->images[i]);
+      }
+      image_monitor_lock(job->monitor);
+      job->in_flight -= job->sizes[i];
+      image_monitor_broadcast(job->monitor);
+    }
+    job->delivering = 0;
+  }
+  image_monitor_unlock(job->monitor);
+}
+
+int SOIL_load_image_batch(SOIL_batch_image *images, int count,
+                          int force_channels, int thread_count,
+                          size_t memory_budget, SOIL_batch_callback callback,
+                          void *context) {
+  SOIL_batch_job job;
+  /*	error check	*/
+  if ((NULL == images) || (count < 0)) {
+    result_string_pointer = "Invalid image batch";
+    return count;
+  }
+  if (count == 0) {
+    result_string_pointer = "Image batch loaded";
+    return 0;
+  }
+  memset(&job, 0, sizeof(SOIL_batch_job));
+  job.images = images;
+  job.count = count;
+  job.force_channels = force_channels;
+  job.memory_budget = memory_budget;
+  job.callback = callback;
+  job.context = context;
+  job.monitor = image_monitor_create();
+  job.sizes = (size_t *)malloc(count * sizeof(size_t));
+  job.ready = (unsigned char *)calloc(count, 1);
+  if ((NULL == job.monitor) || (NULL == job.sizes) || (NULL == job.ready)) {
+    image_monitor_destroy(job.monitor);
+    free(job.sizes);
+    free(job.ready);
+    result_string_pointer = "malloc failed";
+    return count;
+  }
+  image_parallel_for(count, thread_count, SOIL_batch_load_task, &job);
+  image_monitor_destroy(job.monitor);
+  free(job.sizes);
+  free(job.ready);
+  result_string_pointer = (job.failures == 0)
+                              ? "Image batch loaded"
+                              : "Some images in the batch failed to load";
+  return job.failures;
+}
+
 int SOIL_save_image(const char *filename, int image_type, int width, int height,
                     int channels, const unsigned char *const data) {
   return SOIL_save_image_quality(filename, image_type, width, height, channels,
@@ -1638,11 +2404,84 @@ int SOIL_save_image_quality(const char *filename, int image_type, int width,
 }
 
 void SOIL_free_image_data(unsigned char *img_data) {
-  if (img_data) free((void *)img_data);
+  if (NULL == img_data) {
+    return;
+  }
+  /*	cached pixels are shared, so only a reference goes	*/
+  if ((NULL != SOIL_image_cache) && SOIL_image_cache_release(img_data)) {
+    return;
+  }
+  image_free((void *)img_data);
 }
 
 const char *SOIL_last_result(void) { return result_string_pointer; }
 
+/*	installs the allocator of a context for the length of a call	*/
+static const image_allocator *SOIL_context_begin(SOIL_context *context) {
+  const image_allocator *previous = image_allocator_current();
+  if ((NULL != context) && (NULL != context->allocator)) {
+    image_allocator_use(context->allocator);
+  }
+  return previous;
+}
+
+static void SOIL_context_end(SOIL_context *context,
+                             const image_allocator *previous) {
+  if (NULL != context) {
+    context->result = result_string_pointer;
+  }
+  image_allocator_use(previous);
+}
+
+unsigned char *SOIL_load_image_ctx(const char *filename, int *width,
+                                   int *height, int *channels,
+                                   int force_channels, SOIL_context *context) {
+  const image_allocator *previous = SOIL_context_begin(context);
+  unsigned char *result =
+      SOIL_load_image(filename, width, height, channels, force_channels);
+  SOIL_context_end(context, previous);
+  return result;
+}
+
+unsigned char *SOIL_load_image_from_memory_ctx(
+    const unsigned char *const buffer, int buffer_length, int *width,
+    int *height, int *channels, int force_channels, SOIL_context *context) {
+  const image_allocator *previous = SOIL_context_begin(context);
+  unsigned char *result = SOIL_load_image_from_memory(
+      buffer, buffer_length, width, height, channels, force_channels);
+  SOIL_context_end(context, previous);
+  return result;
+}
+
+unsigned int SOIL_load_OGL_texture_ctx(const char *filename,
+                                       int force_channels,
+                                       unsigned int reuse_texture_ID,
+                                       unsigned int flags,
+                                       SOIL_context *context) {
+  const image_allocator *previous = SOIL_context_begin(context);
+  unsigned int tex_id =
+      SOIL_load_OGL_texture(filename, force_channels, reuse_texture_ID, flags);
+  SOIL_context_end(context, previous);
+  return tex_id;
+}
+
+unsigned int SOIL_load_OGL_texture_from_memory_ctx(
+    const unsigned char *const buffer, int buffer_length, int force_channels,
+    unsigned int reuse_texture_ID, unsigned int flags, SOIL_context *context) {
+  const image_allocator *previous = SOIL_context_begin(context);
+  unsigned int tex_id = SOIL_load_OGL_texture_from_memory(
+      buffer, buffer_length, force_channels, reuse_texture_ID, flags);
+  SOIL_context_end(context, previous);
+  return tex_id;
+}
+
+void SOIL_free_image_data_ctx(unsigned char *img_data,
+                              SOIL_context *context) {
+  const image_allocator *previous = SOIL_context_begin(context);
+  SOIL_free_image_data(img_data);
+  image_allocator_use(previous);
+}
+
 unsigned int SOIL_direct_load_DDS_from_memory(const unsigned char *const buffer,
                                               int buffer_length,
                                               unsigned int reuse_texture_ID,
@@ -1811,7 +2650,7 @@ unsigned int SOIL_direct_load_DDS_from_memory(const unsigned char *const buffer,
     mipmaps = 0;
     DDS_full_size = DDS_main_size;
   }
-  DDS_data = (unsigned char *)malloc(DDS_full_size);
+  DDS_data = (unsigned char *)image_malloc(DDS_full_size);
   /*	got the image data RAM, create or use an existing OpenGL texture handle
    */
   tex_ID = reuse_texture_ID;
@@ -1910,41 +2749,29 @@ quick_exit:
 unsigned int SOIL_direct_load_DDS(const char *filename,
                                   unsigned int reuse_texture_ID, int flags,
                                   int loading_as_cubemap) {
-  FILE *f;
-  unsigned char *buffer;
-  size_t buffer_length, bytes_read;
+  image_file_view view;
   unsigned int tex_ID = 0;
   /*	error checks	*/
   if (NULL == filename) {
     result_string_pointer = "NULL filename";
     return 0;
   }
-  errno_t err = fopen_s(&f, filename, "rb");
-  if (!err) {
+  /*	map the file, so the texels go to OpenGL with no copy	*/
+  if (!image_file_map(filename, &view)) {
     /*	the file doesn't seem to exist (or be open-able)	*/
     result_string_pointer = "Can not find DDS file";
     return 0;
   }
-  fseek(f, 0, SEEK_END);
-  buffer_length = ftell(f);
-  fseek(f, 0, SEEK_SET);
-  buffer = (unsigned char *)malloc(buffer_length);
-  if (NULL == buffer) {
-    result_string_pointer = "malloc failed";
-    fclose(f);
+  if (view.size > 0x7FFFFFFF) {
+    result_string_pointer = "DDS file is too large";
+    image_file_unmap(&view);
     return 0;
   }
-  bytes_read = fread((void *)buffer, 1, buffer_length, f);
-  fclose(f);
-  if (bytes_read < buffer_length) {
-    /*	huh?	*/
-    buffer_length = bytes_read;
-  }
   /*	now try to do the loading	*/
   tex_ID = SOIL_direct_load_DDS_from_memory(
-      (const unsigned char *const)buffer, (int)buffer_length, reuse_texture_ID,
+      view.data, (int)view.size, reuse_texture_ID,
       flags, loading_as_cubemap);
-  SOIL_free_image_data(buffer);
+  image_file_unmap(&view);
   return tex_ID;
 }
 
@@ -2241,41 +3068,29 @@ unsigned int SOIL_direct_load_PVR_from_memory(const unsigned char *const buffer,
 unsigned int SOIL_direct_load_PVR(const char *filename,
                                   unsigned int reuse_texture_ID, int flags,
                                   int loading_as_cubemap) {
-  FILE *f;
-  unsigned char *buffer;
-  size_t buffer_length, bytes_read;
+  image_file_view view;
   unsigned int tex_ID = 0;
   /*	error checks	*/
   if (NULL == filename) {
     result_string_pointer = "NULL filename";
     return 0;
   }
-  errno_t err = fopen_s(&f, filename, "rb");
-  if (!err) {
-    //	The file doesn't seem to exist (or be open-able).
+  /*	map the file, so the texels go to OpenGL with no copy	*/
+  if (!image_file_map(filename, &view)) {
+    /*	the file doesn't seem to exist (or be open-able)	*/
     result_string_pointer = "Can not find PVR file";
     return 0;
   }
-  fseek(f, 0, SEEK_END);
-  buffer_length = ftell(f);
-  fseek(f, 0, SEEK_SET);
-  buffer = (unsigned char *)malloc(buffer_length);
-  if (NULL == buffer) {
-    result_string_pointer = "malloc failed";
-    fclose(f);
+  if (view.size > 0x7FFFFFFF) {
+    result_string_pointer = "PVR file is too large";
+    image_file_unmap(&view);
     return 0;
   }
-  bytes_read = fread((void *)buffer, 1, buffer_length, f);
-  fclose(f);
-  if (bytes_read < buffer_length) {
-    /*	huh?	*/
-    buffer_length = bytes_read;
-  }
   /*	now try to do the loading	*/
   tex_ID = SOIL_direct_load_PVR_from_memory(
-      (const unsigned char *const)buffer, (int)buffer_length, reuse_texture_ID,
+      view.data, (int)view.size, reuse_texture_ID,
       flags, loading_as_cubemap);
-  SOIL_free_image_data(buffer);
+  image_file_unmap(&view);
   return tex_ID;
 }
 
@@ -2297,7 +3112,7 @@ unsigned int SOIL_direct_load_ETC1_from_memory(
     return 0;
   }
 
-  if (0 != strcmp(header->aName, "PKM 10")) {
+  if (0 != memcmp(header->aName, "PKM 10", 6)) {
     result_string_pointer = "error: PKM 10 header not found.";
     return 0;
   }
@@ -2365,44 +3180,785 @@ unsigned int SOIL_direct_load_ETC1_from_memory(
 
 unsigned int SOIL_direct_load_ETC1(const char *filename,
                                    unsigned int reuse_texture_ID, int flags) {
-  FILE *f;
-  unsigned char *buffer;
-  size_t buffer_length, bytes_read;
+  image_file_view view;
   unsigned int tex_ID = 0;
   /*	error checks	*/
   if (NULL == filename) {
     result_string_pointer = "NULL filename";
     return 0;
   }
-  errno_t err = fopen_s(&f, filename, "rb");
-  if (!err) {
+  /*	map the file, so the texels go to OpenGL with no copy	*/
+  if (!image_file_map(filename, &view)) {
     /*	the file doesn't seem to exist (or be open-able)	*/
-    result_string_pointer = "Can not find PVR file";
+    result_string_pointer = "Can not find PKM file";
     return 0;
   }
-  fseek(f, 0, SEEK_END);
-  buffer_length = ftell(f);
-  fseek(f, 0, SEEK_SET);
-  buffer = (unsigned char *)malloc(buffer_length);
-  if (NULL == buffer) {
-    result_string_pointer = "malloc failed";
-    fclose(f);
+  if (view.size > 0x7FFFFFFF) {
+    result_string_pointer = "PKM file is too large";
+    image_file_unmap(&view);
     return 0;
   }
-  bytes_read = fread((void *)buffer, 1, buffer_length, f);
-  fclose(f);
-  if (bytes_read < buffer_length) {
-    /*	huh?	*/
-    buffer_length = bytes_read;
-  }
   /*	now try to do the loading	*/
-  tex_ID = SOIL_direct_load_ETC1_from_memory((const unsigned char *const)buffer,
-                                             (int)buffer_length,
+  tex_ID = SOIL_direct_load_ETC1_from_memory(view.data,
+                                             (int)view.size,
                                              reuse_texture_ID, flags);
-  SOIL_free_image_data(buffer);
+  image_file_unmap(&view);
   return tex_ID;
 }
 
+/*	maps filename for one of the payload parsers below	*/
+static image_file_view *SOIL_payload_map(const char *filename) {
+  image_file_view *view;
+  if (NULL == filename) {
+    result_string_pointer = "NULL filename";
+    return NULL;
+  }
+  view = (image_file_view *)malloc(sizeof(image_file_view));
+  if (NULL == view) {
+    result_string_pointer = "malloc failed";
+    return NULL;
+  }
+  if (!image_file_map(filename, view)) {
+    /*	the file doesn't seem to exist (or be open-able)	*/
+    result_string_pointer = "Can not find the texture file";
+    free(view);
+    return NULL;
+  }
+  if (view->size > 0x7FFFFFFF) {
+    result_string_pointer = "Texture file is too large";
+    image_file_unmap(view);
+    free(view);
+    return NULL;
+  }
+  return view;
+}
+
+/*	checks buffer is big enough to hold a header_size header, and
+        points payload at it	*/
+static int SOIL_payload_start(const unsigned char *buffer, size_t size,
+                              unsigned int header_size,
+                              SOIL_payload *payload) {
+  memset(payload, 0, sizeof(SOIL_payload));
+  if (size < header_size) {
+    result_string_pointer = "File was too small to contain the header";
+    return 0;
+  }
+  payload->header = buffer;
+  payload->data = buffer + header_size;
+  payload->data_length = (int)(size - header_size);
+  payload->faces = 1;
+  return 1;
+}
+
+/*	the header parsers behind the *_payload functions and the bundles;
+        they fill in everything but payload->file	*/
+static int SOIL_parse_DDS_payload(const unsigned char *buffer, size_t size,
+                                  SOIL_payload *payload) {
+  DDS_header header;
+  unsigned int flag;
+  if (!SOIL_payload_start(buffer, size, sizeof(DDS_header), payload)) {
+    return 0;
+  }
+  memcpy((void *)(&header), (const void *)payload->header, sizeof(DDS_header));
+  flag = ('D' << 0) | ('D' << 8) | ('S' << 16) | (' ' << 24);
+  if ((header.dwMagic != flag) || (header.dwSize != 124) ||
+      (header.sPixelFormat.dwSize != 32)) {
+    result_string_pointer = "Failed to read a known DDS header";
+    return 0;
+  }
+  payload->width = (int)header.dwWidth;
+  payload->height = (int)header.dwHeight;
+  if (header.sCaps.dwCaps2 & DDSCAPS2_CUBEMAP) {
+    payload->faces = 6;
+  }
+  if ((header.sCaps.dwCaps1 & DDSCAPS_MIPMAP) && (header.dwMipMapCount > 1)) {
+    payload->mipmaps = (int)header.dwMipMapCount - 1;
+  }
+  if (header.sPixelFormat.dwFlags & DDPF_FOURCC) {
+    switch (header.sPixelFormat.dwFourCC) {
+      case ('D' << 0) | ('X' << 8) | ('T' << 16) | ('1' << 24):
+        payload->format = SOIL_RGBA_S3TC_DXT1;
+        break;
+      case ('D' << 0) | ('X' << 8) | ('T' << 16) | ('3' << 24):
+        payload->format = SOIL_RGBA_S3TC_DXT3;
+        break;
+      case ('D' << 0) | ('X' << 8) | ('T' << 16) | ('5' << 24):
+        payload->format = SOIL_RGBA_S3TC_DXT5;
+        break;
+    }
+  }
+  result_string_pointer = "DDS payload mapped";
+  return 1;
+}
+
+static int SOIL_parse_PVR_payload(const unsigned char *buffer, size_t size,
+                                  SOIL_payload *payload) {
+  PVR_Texture_Header header;
+  size_t copy_size;
+  if (!SOIL_payload_start(buffer, size, PVRTEX_V1_HEADER_SIZE, payload)) {
+    return 0;
+  }
+  /*	an old header is shorter, so only copy what the file holds	*/
+  memset((void *)(&header), 0, sizeof(PVR_Texture_Header));
+  copy_size = sizeof(PVR_Texture_Header);
+  if (size < copy_size) {
+    copy_size = size;
+  }
+  memcpy((void *)(&header), (const void *)payload->header, copy_size);
+  if (!((header.dwHeaderSize == PVRTEX_V1_HEADER_SIZE) ||
+        ((header.dwHeaderSize == sizeof(PVR_Texture_Header)) &&
+         (size >= sizeof(PVR_Texture_Header)) &&
+         (header.dwPVR == PVRTEX_IDENTIFIER)))) {
+    result_string_pointer = "invalid PVR header";
+    return 0;
+  }
+  payload->data = payload->header + header.dwHeaderSize;
+  payload->data_length = (int)(size - header.dwHeaderSize);
+  payload->width = (int)header.dwWidth;
+  payload->height = (int)header.dwHeight;
+  payload->mipmaps = (int)header.dwMipMapCount;
+  if (header.dwpfFlags & PVRTEX_CUBEMAP) {
+    payload->faces = 6;
+  }
+  switch (header.dwpfFlags & PVRTEX_PIXELTYPE) {
+    case MGLPT_PVRTC2:
+    case OGL_PVRTC2:
+      payload->format = header.dwAlphaBitMask == 0
+                            ? SOIL_COMPRESSED_RGB_PVRTC_2BPPV1_IMG
+                            : SOIL_COMPRESSED_RGBA_PVRTC_2BPPV1_IMG;
+      break;
+    case MGLPT_PVRTC4:
+    case OGL_PVRTC4:
+      payload->format = header.dwAlphaBitMask == 0
+                            ? SOIL_COMPRESSED_RGB_PVRTC_4BPPV1_IMG
+                            : SOIL_COMPRESSED_RGBA_PVRTC_4BPPV1_IMG;
+      break;
+  }
+  result_string_pointer = "PVR payload mapped";
+  return 1;
+}
+
+static int SOIL_parse_ETC1_payload(const unsigned char *buffer, size_t size,
+                                   SOIL_payload *payload) {
+  const PKMHeader *header;
+  if (!SOIL_payload_start(buffer, size, PKM_HEADER_SIZE, payload)) {
+    return 0;
+  }
+  header = (const PKMHeader *)payload->header;
+  if (0 != memcmp(header->aName, "PKM 10", 6)) {
+    result_string_pointer = "error: PKM 10 header not found.";
+    return 0;
+  }
+  payload->width = (header->iWidthMSB << 8) | header->iWidthLSB;
+  payload->height = (header->iHeightMSB << 8) | header->iHeightLSB;
+  payload->format = SOIL_GL_ETC1_RGB8_OES;
+  result_string_pointer = "PKM payload mapped";
+  return 1;
+}
+
+typedef int (*SOIL_payload_parser)(const unsigned char *buffer, size_t size,
+                                   SOIL_payload *payload);
+
+static int SOIL_payload_load(const char *filename, SOIL_payload *payload,
+                             SOIL_payload_parser parse) {
+  image_file_view *view;
+  if (NULL == payload) {
+    result_string_pointer = "NULL payload";
+    return 0;
+  }
+  memset(payload, 0, sizeof(SOIL_payload));
+  view = SOIL_payload_map(filename);
+  if (NULL == view) {
+    return 0;
+  }
+  if (!parse(view->data, view->size, payload)) {
+    image_file_unmap(view);
+    free(view);
+    memset(payload, 0, sizeof(SOIL_payload));
+    return 0;
+  }
+  payload->file = view;
+  return 1;
+}
+
+int SOIL_direct_load_DDS_payload(const char *filename, SOIL_payload *payload) {
+  return SOIL_payload_load(filename, payload, SOIL_parse_DDS_payload);
+}
+
+int SOIL_direct_load_PVR_payload(const char *filename, SOIL_payload *payload) {
+  return SOIL_payload_load(filename, payload, SOIL_parse_PVR_payload);
+}
+
+int SOIL_direct_load_ETC1_payload(const char *filename, SOIL_payload *payload) {
+  return SOIL_payload_load(filename, payload, SOIL_parse_ETC1_payload);
+}
+
+void SOIL_free_payload(SOIL_payload *payload) {
+  if ((NULL == payload) || (NULL == payload->file)) {
+    return;
+  }
+  image_file_unmap((image_file_view *)payload->file);
+  free(payload->file);
+  memset(payload, 0, sizeof(SOIL_payload));
+}
+
+/*	a bundle file: a header of 5 words ("SBND", version, texture count,
+        hash slots, file size), the hash table (one word per slot, the
+        entry number + 1, or 0 for an empty slot), the entries, the
+        NUL terminated names, then the files	*/
+#define SOIL_BUNDLE_MAGIC 0x444E4253
+#define SOIL_BUNDLE_VERSION 1
+#define SOIL_BUNDLE_HEADER_SIZE (5 * 4)
+/*	name hash, name offset, name length, kind, format, width, height,
+        mipmaps, faces, header offset, header size, data length, face
+        size, then the level offsets	*/
+#define SOIL_BUNDLE_ENTRY_WORDS (13 + SOIL_BUNDLE_MAX_LEVELS)
+#define SOIL_BUNDLE_ENTRY_SIZE (SOIL_BUNDLE_ENTRY_WORDS * 4)
+
+static void SOIL_bundle_put_u32(unsigned char *dest, unsigned int v) {
+  dest[0] = (unsigned char)(v);
+  dest[1] = (unsigned char)(v >> 8);
+  dest[2] = (unsigned char)(v >> 16);
+  dest[3] = (unsigned char)(v >> 24);
+}
+
+static unsigned int SOIL_bundle_get_u32(const unsigned char *src) {
+  return (unsigned int)src[0] | ((unsigned int)src[1] << 8) |
+         ((unsigned int)src[2] << 16) | ((unsigned int)src[3] << 24);
+}
+
+/*	32 bit FNV-1a	*/
+static unsigned int SOIL_bundle_hash(const char *name, size_t length) {
+  unsigned int hash = 2166136261u;
+  size_t i;
+  for (i = 0; i < length; ++i) {
+    hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+  }
+  return hash;
+}
+
+/*	where each MIPmap level of the first face starts, and how big a
+        face is; 0 if the levels don't fit in the payload	*/
+static int SOIL_bundle_levels(int kind, const SOIL_payload *payload,
+                              unsigned int level_offsets[],
+                              unsigned int *face_size) {
+  unsigned int min_width = 1, min_height = 1, bits = 0, block_size = 0;
+  unsigned int declared_face_size = 0;
+  unsigned long long offset = 0;
+  int levels = payload->mipmaps + 1;
+  int i;
+  if ((levels < 1) || (levels > SOIL_BUNDLE_MAX_LEVELS)) {
+    result_string_pointer = "Too many MIPmap levels for a bundle";
+    return 0;
+  }
+  if (kind == SOIL_BUNDLE_DDS) {
+    DDS_header header;
+    memcpy((void *)(&header), (const void *)payload->header,
+           sizeof(DDS_header));
+    if (header.sPixelFormat.dwFlags & DDPF_FOURCC) {
+      /*	4x4 blocks of 8 or 16 bytes	*/
+      block_size = 16;
+      if ((header.sPixelFormat.dwFourCC ==
+           (('D' << 0) | ('X' << 8) | ('T' << 16) | ('1' << 24))) ||
+          (header.sPixelFormat.dwFourCC ==
+           (('A' << 0) | ('T' << 8) | ('I' << 16) | ('1' << 24))) ||
+          (header.sPixelFormat.dwFourCC ==
+           (('B' << 0) | ('C' << 8) | ('4' << 16) | ('U' << 24)))) {
+        block_size = 8;
+      }
+    } else {
+      bits = (header.sPixelFormat.dwFlags & DDPF_ALPHAPIXELS) ? 32 : 24;
+    }
+  } else if (kind == SOIL_BUNDLE_PVR) {
+    PVR_Texture_Header header;
+    size_t header_size = (size_t)(payload->data - payload->header);
+    memset((void *)(&header), 0, sizeof(PVR_Texture_Header));
+    memcpy((void *)(&header), (const void *)payload->header,
+           header_size < sizeof(header) ? header_size : sizeof(header));
+    bits = header.dwBitCount;
+    declared_face_size = header.dwTextureDataSize;
+    switch (header.dwpfFlags & PVRTEX_PIXELTYPE) {
+      case MGLPT_PVRTC2:
+      case OGL_PVRTC2:
+        min_width = PVRTC2_MIN_TEXWIDTH;
+        min_height = PVRTC2_MIN_TEXHEIGHT;
+        break;
+      case MGLPT_PVRTC4:
+      case OGL_PVRTC4:
+        min_width = PVRTC4_MIN_TEXWIDTH;
+        min_height = PVRTC4_MIN_TEXHEIGHT;
+        break;
+    }
+  } else {
+    /*	ETC1 is 4x4 blocks of 8 bytes, one level	*/
+    block_size = 8;
+  }
+  for (i = 0; i < levels; ++i) {
+    unsigned long long w = (unsigned int)payload->width >> i;
+    unsigned long long h = (unsigned int)payload->height >> i;
+    level_offsets[i] = (unsigned int)offset;
+    w = (w < min_width) ? min_width : w;
+    h = (h < min_height) ? min_height : h;
+    if (block_size) {
+      offset += ((w + 3) >> 2) * ((h + 3) >> 2) * block_size;
+    } else {
+      offset += (w * h * bits + 7) >> 3;
+    }
+    if (offset > 0x7FFFFFFF) {
+      break;
+    }
+  }
+  for (; i < SOIL_BUNDLE_MAX_LEVELS; ++i) {
+    level_offsets[i] = 0;
+  }
+  if (declared_face_size > offset) {
+    offset = declared_face_size;
+  }
+  if (offset * payload->faces > (unsigned long long)payload->data_length) {
+    result_string_pointer = "Texture file is shorter than its MIPmap levels";
+    return 0;
+  }
+  *face_size = (unsigned int)offset;
+  return 1;
+}
+
+/*	what the bundle writer needs to know about one file	*/
+typedef struct {
+  image_file_view view;
+  SOIL_payload payload;
+  int kind;
+  const char *name;
+  unsigned int name_length, name_hash;
+  unsigned int face_size;
+  unsigned int level_offsets[SOIL_BUNDLE_MAX_LEVELS];
+  unsigned long long header_offset;
+} SOIL_bundle_item;
+
+/*	reads one file for the bundle writer, working out what it is	*/
+static int SOIL_bundle_item_load(SOIL_bundle_item *item, const char *filename,
+                                 const char *name) {
+  const unsigned char *data;
+  size_t size;
+  if (!image_file_map(filename, &item->view)) {
+    result_string_pointer = "Can not find the texture file";
+    return 0;
+  }
+  data = item->view.data;
+  size = item->view.size;
+  if (size > 0x7FFFFFFF) {
+    result_string_pointer = "Texture file is too large";
+    return 0;
+  }
+  /*	DDS and PKM have a magic number, the old PVR header doesn't	*/
+  if ((size >= 4) && (0 == memcmp(data, "DDS ", 4))) {
+    item->kind = SOIL_BUNDLE_DDS;
+    if (!SOIL_parse_DDS_payload(data, size, &item->payload)) {
+      return 0;
+    }
+  } else if ((size >= 6) && (0 == memcmp(data, "PKM 10", 6))) {
+    item->kind = SOIL_BUNDLE_PKM;
+    if (!SOIL_parse_ETC1_payload(data, size, &item->payload)) {
+      return 0;
+    }
+  } else {
+    item->kind = SOIL_BUNDLE_PVR;
+    if (!SOIL_parse_PVR_payload(data, size, &item->payload)) {
+      result_string_pointer = "Not a DDS, PVR or PKM file";
+      return 0;
+    }
+  }
+  item->name = name;
+  item->name_length = (unsigned int)strlen(name);
+  item->name_hash = SOIL_bundle_hash(name, item->name_length);
+  return SOIL_bundle_levels(item->kind, &item->payload, item->level_offsets,
+                            &item->face_size);
+}
+
+static int SOIL_bundle_write(FILE *fout, const SOIL_bundle_item *items,
+                             unsigned int count, unsigned int slots,
+                             unsigned long long file_size) {
+  unsigned char header[SOIL_BUNDLE_HEADER_SIZE];
+  unsigned char entry[SOIL_BUNDLE_ENTRY_SIZE];
+  unsigned char zeros[SOIL_BUNDLE_ALIGNMENT];
+  unsigned char *table;
+  unsigned long long position, name_offset;
+  unsigned int i, k;
+  /*	the header and hash table	*/
+  SOIL_bundle_put_u32(header + 0, SOIL_BUNDLE_MAGIC);
+  SOIL_bundle_put_u32(header + 4, SOIL_BUNDLE_VERSION);
+  SOIL_bundle_put_u32(header + 8, count);
+  SOIL_bundle_put_u32(header + 12, slots);
+  SOIL_bundle_put_u32(header + 16, (unsigned int)file_size);
+  table = (unsigned char *)calloc(slots, 4);
+  if (NULL == table) {
+    result_string_pointer = "malloc failed";
+    return 0;
+  }
+  for (i = 0; i < count; ++i) {
+    /*	linear probing	*/
+    unsigned int slot = items[i].name_hash & (slots - 1);
+    while (SOIL_bundle_get_u32(table + slot * 4) != 0) {
+      slot = (slot + 1) & (slots - 1);
+    }
+    SOIL_bundle_put_u32(table + slot * 4, i + 1);
+  }
+  fwrite(header, 1, SOIL_BUNDLE_HEADER_SIZE, fout);
+  fwrite(table, 4, slots, fout);
+  free(table);
+  /*	the entries	*/
+  name_offset = SOIL_BUNDLE_HEADER_SIZE + slots * 4ULL +
+                (unsigned long long)count * SOIL_BUNDLE_ENTRY_SIZE;
+  for (i = 0; i < count; ++i) {
+    const SOIL_bundle_item *item = &items[i];
+    unsigned int words[13];
+    words[0] = item->name_hash;
+    words[1] = (unsigned int)name_offset;
+    words[2] = item->name_length;
+    words[3] = (unsigned int)item->kind;
+    words[4] = item->payload.format;
+    words[5] = (unsigned int)item->payload.width;
+    words[6] = (unsigned int)item->payload.height;
+    words[7] = (unsigned int)item->payload.mipmaps;
+    words[8] = (unsigned int)item->payload.faces;
+    words[9] = (unsigned int)item->header_offset;
+    words[10] = (unsigned int)(item->payload.data - item->payload.header);
+    words[11] = (unsigned int)item->payload.data_length;
+    words[12] = item->face_size;
+    for (k = 0; k < 13; ++k) {
+      SOIL_bundle_put_u32(entry + k * 4, words[k]);
+    }
+    for (k = 0; k < SOIL_BUNDLE_MAX_LEVELS; ++k) {
+      SOIL_bundle_put_u32(entry + (13 + k) * 4, item->level_offsets[k]);
+    }
+    fwrite(entry, 1, SOIL_BUNDLE_ENTRY_SIZE, fout);
+    name_offset += item->name_length + 1;
+  }
+  /*	the names	*/
+  for (i = 0; i < count; ++i) {
+    fwrite(items[i].name, 1, items[i].name_length + 1, fout);
+  }
+  /*	and the files, padded out to their places	*/
+  memset(zeros, 0, sizeof(zeros));
+  position = name_offset;
+  for (i = 0; i < count; ++i) {
+    const SOIL_bundle_item *item = &items[i];
+    fwrite(zeros, 1, (size_t)(item->header_offset - position), fout);
+    fwrite(item->view.data, 1, item->view.size, fout);
+    position = item->header_offset + item->view.size;
+  }
+  return ferror(fout) ? 0 : 1;
+}
+
+int SOIL_create_bundle(const char *bundle_filename,
+                       const char *const *filenames, const char *const *names,
+                       int count) {
+  SOIL_bundle_item *items;
+  unsigned long long position;
+  unsigned int slots = 1;
+  int i, k, result = 0;
+  FILE *fout;
+  errno_t err;
+  /*	error check	*/
+  if ((NULL == bundle_filename) || (count < 0) ||
+      ((count > 0) && (NULL == filenames))) {
+    result_string_pointer = "Invalid bundle parameters";
+    return 0;
+  }
+  if (NULL == names) {
+    names = filenames;
+  }
+  items = (SOIL_bundle_item *)calloc(count + 1, sizeof(SOIL_bundle_item));
+  if (NULL == items) {
+    result_string_pointer = "malloc failed";
+    return 0;
+  }
+  /*	map and check every file	*/
+  for (i = 0; i < count; ++i) {
+    if (!SOIL_bundle_item_load(&items[i], filenames[i], names[i])) {
+      goto quick_exit;
+    }
+    for (k = 0; k < i; ++k) {
+      if ((items[k].name_hash == items[i].name_hash) &&
+          (0 == strcmp(items[k].name, items[i].name))) {
+        result_string_pointer = "Two textures have the same bundle name";
+        goto quick_exit;
+      }
+    }
+  }
+  /*	at least twice as many slots as textures keeps the probes short	*/
+  while (slots < 2 * (unsigned int)count) {
+    slots <<= 1;
+  }
+  /*	lay the files out so their texels are aligned	*/
+  position = SOIL_BUNDLE_HEADER_SIZE + slots * 4ULL +
+             (unsigned long long)count * SOIL_BUNDLE_ENTRY_SIZE;
+  for (i = 0; i < count; ++i) {
+    position += items[i].name_length + 1;
+  }
+  for (i = 0; i < count; ++i) {
+    unsigned long long header_size =
+        (unsigned long long)(items[i].payload.data - items[i].payload.header);
+    unsigned long long data_offset = position + header_size;
+    data_offset = (data_offset + SOIL_BUNDLE_ALIGNMENT - 1) &
+                  ~(unsigned long long)(SOIL_BUNDLE_ALIGNMENT - 1);
+    items[i].header_offset = data_offset - header_size;
+    position = items[i].header_offset + items[i].view.size;
+  }
+  if (position > 0xFFFFFFFFULL) {
+    result_string_pointer = "A bundle can not be over 4 GB";
+    goto quick_exit;
+  }
+  err = fopen_s(&fout, bundle_filename, "wb");
+  if (err) {
+    result_string_pointer = "Can not create the bundle file";
+    goto quick_exit;
+  }
+  result = SOIL_bundle_write(fout, items, (unsigned int)count, slots, position);
+  if (fclose(fout) || !result) {
+    result = 0;
+    result_string_pointer = "Failed writing the bundle file";
+  } else {
+    result_string_pointer = "Bundle created";
+  }
+quick_exit:
+  for (i = 0; i < count; ++i) {
+    image_file_unmap(&items[i].view);
+  }
+  free(items);
+  return result;
+}
+
+int SOIL_create_bundle_from_directory(const char *bundle_filename,
+                                      const char *directory,
+                                      int thread_count) {
+  image_index index;
+  const char **filenames, **names;
+  size_t prefix;
+  int i, count = 0, result;
+  if ((NULL == bundle_filename) || (NULL == directory)) {
+    result_string_pointer = "Invalid bundle parameters";
+    return 0;
+  }
+  if (!image_index_scan(&index, directory, NULL, thread_count)) {
+    result_string_pointer = "Can not read the directory";
+    return 0;
+  }
+  filenames = (const char **)malloc((index.count + 1) * sizeof(char *));
+  names = (const char **)malloc((index.count + 1) * sizeof(char *));
+  if ((NULL == filenames) || (NULL == names)) {
+    free((void *)filenames);
+    free((void *)names);
+    image_index_free(&index);
+    result_string_pointer = "malloc failed";
+    return 0;
+  }
+  /*	the index paths are directory + '/' + the name	*/
+  prefix = strlen(directory) + 1;
+  for (i = 0; i < index.count; ++i) {
+    const image_index_entry *entry = &index.entries[i];
+    if ((entry->format == IMAGE_FORMAT_DDS) ||
+        (entry->format == IMAGE_FORMAT_PVR) ||
+        (entry->format == IMAGE_FORMAT_PKM)) {
+      filenames[count] = entry->path;
+      names[count] = (strlen(entry->path) > prefix) ? entry->path + prefix
+                                                      : entry->path;
+      ++count;
+    }
+  }
+  result = SOIL_create_bundle(bundle_filename, filenames, names, count);
+  free((void *)filenames);
+  free((void *)names);
+  image_index_free(&index);
+  return result;
+}
+
+int SOIL_open_bundle(const char *filename, SOIL_bundle *bundle) {
+  image_file_view *view;
+  const unsigned char *data;
+  unsigned char *seen;
+  unsigned long long entries_end;
+  unsigned int size, count, slots, i, used;
+  if (NULL == bundle) {
+    result_string_pointer = "NULL bundle";
+    return 0;
+  }
+  memset(bundle, 0, sizeof(SOIL_bundle));
+  if (NULL == filename) {
+    result_string_pointer = "NULL filename";
+    return 0;
+  }
+  view = (image_file_view *)malloc(sizeof(image_file_view));
+  if (NULL == view) {
+    result_string_pointer = "malloc failed";
+    return 0;
+  }
+  if (!image_file_map(filename, view)) {
+    result_string_pointer = "Can not find the bundle file";
+    free(view);
+    return 0;
+  }
+  data = view->data;
+  size = (unsigned int)view->size;
+  result_string_pointer = "Not a valid texture bundle";
+  if ((view->size > 0xFFFFFFFFULL) || (size < SOIL_BUNDLE_HEADER_SIZE) ||
+      (SOIL_bundle_get_u32(data) != SOIL_BUNDLE_MAGIC) ||
+      (SOIL_bundle_get_u32(data + 4) != SOIL_BUNDLE_VERSION) ||
+      (SOIL_bundle_get_u32(data + 16) != size)) {
+    goto quick_exit;
+  }
+  count = SOIL_bundle_get_u32(data + 8);
+  slots = SOIL_bundle_get_u32(data + 12);
+  /*	a power of 2, with at least one empty slot to end every probe	*/
+  if ((slots == 0) || (slots & (slots - 1)) || (count >= slots)) {
+    goto quick_exit;
+  }
+  entries_end = SOIL_BUNDLE_HEADER_SIZE + slots * 4ULL +
+                (unsigned long long)count * SOIL_BUNDLE_ENTRY_SIZE;
+  if (entries_end > size) {
+    goto quick_exit;
+  }
+  /*	every entry is in the table exactly once, so the rest of the
+          slots are empty	*/
+  seen = (unsigned char *)calloc(count + 1, 1);
+  if (NULL == seen) {
+    result_string_pointer = "malloc failed";
+    goto quick_exit;
+  }
+  for (i = 0, used = 0; i < slots; ++i) {
+    unsigned int index =
+        SOIL_bundle_get_u32(data + SOIL_BUNDLE_HEADER_SIZE + i * 4);
+    if (index == 0) {
+      continue;
+    }
+    if ((index > count) || seen[index]) {
+      break;
+    }
+    seen[index] = 1;
+    ++used;
+  }
+  free(seen);
+  if ((i < slots) || (used != count)) {
+    goto quick_exit;
+  }
+  /*	everything SOIL_find_in_bundle trusts is checked here	*/
+  for (i = 0; i < count; ++i) {
+    const unsigned char *entry = data + SOIL_BUNDLE_HEADER_SIZE + slots * 4 +
+                                 i * SOIL_BUNDLE_ENTRY_SIZE;
+    unsigned long long name_offset = SOIL_bundle_get_u32(entry + 4);
+    unsigned long long name_length = SOIL_bundle_get_u32(entry + 8);
+    unsigned long long faces = SOIL_bundle_get_u32(entry + 32);
+    unsigned long long header_offset = SOIL_bundle_get_u32(entry + 36);
+    unsigned long long header_size = SOIL_bundle_get_u32(entry + 40);
+    unsigned long long data_length = SOIL_bundle_get_u32(entry + 44);
+    unsigned long long face_size = SOIL_bundle_get_u32(entry + 48);
+    if ((name_offset < entries_end) || (name_offset + name_length >= size) ||
+        (data[name_offset + name_length] != 0) ||
+        (header_offset + header_size + data_length > size) ||
+        (data_length > 0x7FFFFFFF) || (faces * face_size > data_length) ||
+        (SOIL_bundle_get_u32(entry + 28) > SOIL_BUNDLE_MAX_LEVELS - 1)) {
+      goto quick_exit;
+    }
+  }
+  bundle->data = data;
+  bundle->size = size;
+  bundle->count = count;
+  bundle->slots = slots;
+  bundle->file = view;
+  result_string_pointer = "Bundle mapped";
+  return 1;
+quick_exit:
+  image_file_unmap(view);
+  free(view);
+  return 0;
+}
+
+int SOIL_find_in_bundle(const SOIL_bundle *bundle, const char *name,
+                        SOIL_bundle_texture *texture) {
+  const unsigned char *table, *entries;
+  unsigned int hash, slot, index, probes;
+  size_t length;
+  if ((NULL == bundle) || (NULL == bundle->data) || (NULL == name) ||
+      (NULL == texture)) {
+    result_string_pointer = "Invalid bundle parameters";
+    return 0;
+  }
+  length = strlen(name);
+  hash = SOIL_bundle_hash(name, length);
+  table = bundle->data + SOIL_BUNDLE_HEADER_SIZE;
+  entries = table + bundle->slots * 4;
+  for (slot = hash & (bundle->slots - 1), probes = 0;
+       (probes < bundle->slots) &&
+       ((index = SOIL_bundle_get_u32(table + slot * 4)) != 0);
+       slot = (slot + 1) & (bundle->slots - 1), ++probes) {
+    const unsigned char *entry = entries + (index - 1) * SOIL_BUNDLE_ENTRY_SIZE;
+    const char *entry_name =
+        (const char *)bundle->data + SOIL_bundle_get_u32(entry + 4);
+    unsigned int k;
+    if ((SOIL_bundle_get_u32(entry) != hash) ||
+        (SOIL_bundle_get_u32(entry + 8) != length) ||
+        (0 != memcmp(entry_name, name, length))) {
+      continue;
+    }
+    /*	found it, point straight into the mapping	*/
+    memset(texture, 0, sizeof(SOIL_bundle_texture));
+    texture->name = entry_name;
+    texture->kind = (int)SOIL_bundle_get_u32(entry + 12);
+    texture->payload.format = SOIL_bundle_get_u32(entry + 16);
+    texture->payload.width = (int)SOIL_bundle_get_u32(entry + 20);
+    texture->payload.height = (int)SOIL_bundle_get_u32(entry + 24);
+    texture->payload.mipmaps = (int)SOIL_bundle_get_u32(entry + 28);
+    texture->payload.faces = (int)SOIL_bundle_get_u32(entry + 32);
+    texture->payload.header = bundle->data + SOIL_bundle_get_u32(entry + 36);
+    texture->payload.data =
+        texture->payload.header + SOIL_bundle_get_u32(entry + 40);
+    texture->payload.data_length = (int)SOIL_bundle_get_u32(entry + 44);
+    texture->face_size = SOIL_bundle_get_u32(entry + 48);
+    for (k = 0; k < SOIL_BUNDLE_MAX_LEVELS; ++k) {
+      texture->level_offsets[k] = SOIL_bundle_get_u32(entry + (13 + k) * 4);
+    }
+    return 1;
+  }
+  result_string_pointer = "Texture is not in the bundle";
+  return 0;
+}
+
+unsigned int SOIL_load_OGL_texture_from_bundle(const SOIL_bundle *bundle,
+                                               const char *name,
+                                               unsigned int reuse_texture_ID,
+                                               int flags) {
+  SOIL_bundle_texture texture;
+  int length;
+  if (!SOIL_find_in_bundle(bundle, name, &texture)) {
+    return 0;
+  }
+  length = (int)(texture.payload.data - texture.payload.header) +
+           texture.payload.data_length;
+  switch (texture.kind) {
+    case SOIL_BUNDLE_DDS:
+      return SOIL_direct_load_DDS_from_memory(texture.payload.header, length,
+                                              reuse_texture_ID, flags,
+                                              texture.payload.faces == 6);
+    case SOIL_BUNDLE_PVR:
+      return SOIL_direct_load_PVR_from_memory(texture.payload.header, length,
+                                              reuse_texture_ID, flags,
+                                              texture.payload.faces == 6);
+    case SOIL_BUNDLE_PKM:
+      return SOIL_direct_load_ETC1_from_memory(texture.payload.header, length,
+                                               reuse_texture_ID, flags);
+  }
+  result_string_pointer = "Unknown texture kind in the bundle";
+  return 0;
+}
+
+void SOIL_close_bundle(SOIL_bundle *bundle) {
+  if ((NULL == bundle) || (NULL == bundle->file)) {
+    return;
+  }
+  image_file_unmap((image_file_view *)bundle->file);
+  free(bundle->file);
+  memset(bundle, 0, sizeof(SOIL_bundle));
+}
+
 int query_NPOT_capability(void) {
   /*	check for the capability	*/
   if (has_NPOT_capability == SOIL_CAPABILITY_UNKNOWN) {
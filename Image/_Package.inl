@@ -1,6 +1,11 @@
+#include "image_simd.inl"
+#include "image_thread.inl"
+#include "image_alloc.inl"
+#include "image_mmap.inl"
 #include "etc1_utils.inl"
 #include "image_DXT.inl"
 #include "image_helper.inl"
+#include "image_index.inl"
 //
 #include "SOIL2.inl"
 //
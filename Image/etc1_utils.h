@@ -43,6 +43,25 @@ extern "C" {
 
 void etc1_encode_block(const etc1_byte* pIn, etc1_uint32 validPixelMask, etc1_byte* pOut);
 
+// Encoder quality tiers.
+//
+// ETC1_QUALITY_FAST picks the flip orientation and each sub-block's modifier
+// table with a heuristic instead of searching, roughly an order of magnitude
+// quicker than normal.
+// ETC1_QUALITY_NORMAL searches every table in both orientations; it is what
+// etc1_encode_block and etc1_encode_image use.
+// ETC1_QUALITY_EXHAUSTIVE also tries individual (4 bit) base colors and base
+// colors one step either side of the sub-block averages.
+
+#define ETC1_QUALITY_FAST 0
+#define ETC1_QUALITY_NORMAL 1
+#define ETC1_QUALITY_EXHAUSTIVE 2
+
+// Encode a block of pixels at the given ETC1_QUALITY_*.
+
+void etc1_encode_block_quality(const etc1_byte* pIn, etc1_uint32 validPixelMask,
+        etc1_byte* pOut, int quality);
+
 // Decode a block of pixels.
 //
 // pIn is an ETC1 compressed version of the data.
@@ -53,6 +72,15 @@ void etc1_encode_block(const etc1_byte* pIn, etc1_uint32 validPixelMask, etc1_by
 
 void etc1_decode_block(const etc1_byte* pIn, etc1_byte* pOut);
 
+// Decode a block of pixels to RGBA.
+//
+// pOut is a pointer to a 64 byte array that receives the 4 x 4 square as
+// 4-byte pixels in form R, G, B, A (A is always 255). Byte (4 * (x + 4 * y) is
+// the R value of pixel (x, y). Uses SSSE3 when the CPU has it, with the same
+// results as etc1_decode_block.
+
+void etc1_decode_block_rgba(const etc1_byte* pIn, etc1_byte* pOut);
+
 // Return the size of the encoded image data (does not include size of PKM header).
 
 etc1_uint32 etc1_get_encoded_data_size(etc1_uint32 width, etc1_uint32 height);
@@ -67,6 +95,15 @@ etc1_uint32 etc1_get_encoded_data_size(etc1_uint32 width, etc1_uint32 height);
 int etc1_encode_image(const etc1_byte* pIn, etc1_uint32 width, etc1_uint32 height,
         etc1_uint32 pixelSize, etc1_uint32 stride, etc1_byte* pOut);
 
+// Encode an entire image at the given ETC1_QUALITY_*, one row of blocks per
+// task on up to threadCount threads (<= 0 means one per hardware thread).
+// The output does not depend on threadCount.
+// returns non-zero if there is an error.
+
+int etc1_encode_image_parallel(const etc1_byte* pIn, etc1_uint32 width,
+        etc1_uint32 height, etc1_uint32 pixelSize, etc1_uint32 stride,
+        etc1_byte* pOut, int quality, int threadCount);
+
 // Decode an entire image.
 // pIn - pointer to encoded data.
 // pOut - pointer to the image data. Will be written such that
@@ -79,6 +116,41 @@ int etc1_decode_image(const etc1_byte* pIn, etc1_byte* pOut,
         etc1_uint32 width, etc1_uint32 height,
         etc1_uint32 pixelSize, etc1_uint32 stride);
 
+// Decode an entire image to 8 bit pixels in a single pass.
+// pIn - pointer to encoded data.
+// pOut - pointer to the image data. Will be written such that
+//        pixel (x,y) is at pOut + components * x + stride * y.
+// components can be 3 (R, G, B) or 4 (R, G, B, A with A = 255).
+// returns non-zero if there is an error.
+
+int etc1_decode_image_rgba(const etc1_byte* pIn, etc1_byte* pOut,
+        etc1_uint32 width, etc1_uint32 height,
+        etc1_uint32 components, etc1_uint32 stride);
+
+// One file for etc1_decode_pkm_batch.
+// pData/size - the PKM file (header and data) to decode.
+// pOut - set to a malloc'ed, tightly packed image that the caller frees, or
+//        NULL if the file could not be decoded.
+// width/height - set to the size of the image.
+// result - set to 0 on success, non-zero if there is an error.
+
+typedef struct {
+    const etc1_byte* pData;
+    etc1_uint32 size;
+    etc1_byte* pOut;
+    etc1_uint32 width;
+    etc1_uint32 height;
+    int result;
+} etc1_pkm_batch_item;
+
+// Decode count independent PKM files to 3 or 4 components, one file per task
+// on up to threadCount threads (<= 0 means one per hardware thread).
+// returns the number of files that failed to decode, or -1 if the arguments
+// are invalid.
+
+int etc1_decode_pkm_batch(etc1_pkm_batch_item* items, int count,
+        etc1_uint32 components, int threadCount);
+
 // Size of a PKM header, in bytes.
 
 #define ETC_PKM_HEADER_SIZE 16
@@ -13,7 +13,10 @@
 // limitations under the License.
 
 #include "etc1_utils.h"
+#include "image_simd.h"
+#include "image_thread.h"
 
+#include <stdlib.h>
 #include <string.h>
 
 /* From
@@ -224,6 +227,156 @@ void etc1_decode_block(const etc1_byte* pIn, etc1_byte* pOut) {
   decode_subblock(pOut, r2, g2, b2, tableB, low, 1, flipped);
 }
 
+// The header of a block: the two sub-block base colors and modifier tables.
+
+typedef struct {
+  int r[2], g[2], b[2];
+  const int* table[2];
+  etc1_bool flipped;
+  etc1_uint32 low;
+} etc_block_header;
+
+static void etc_decode_header(const etc1_byte* pIn, etc_block_header* pHeader) {
+  etc1_uint32 high = (pIn[0] << 24) | (pIn[1] << 16) | (pIn[2] << 8) | pIn[3];
+  pHeader->low = (pIn[4] << 24) | (pIn[5] << 16) | (pIn[6] << 8) | pIn[7];
+  if (high & 2) {
+    // differential
+    int rBase = high >> 27;
+    int gBase = high >> 19;
+    int bBase = high >> 11;
+    pHeader->r[0] = convert5To8(rBase);
+    pHeader->r[1] = convertDiff(rBase, high >> 24);
+    pHeader->g[0] = convert5To8(gBase);
+    pHeader->g[1] = convertDiff(gBase, high >> 16);
+    pHeader->b[0] = convert5To8(bBase);
+    pHeader->b[1] = convertDiff(bBase, high >> 8);
+  } else {
+    // not differential
+    pHeader->r[0] = convert4To8(high >> 28);
+    pHeader->r[1] = convert4To8(high >> 24);
+    pHeader->g[0] = convert4To8(high >> 20);
+    pHeader->g[1] = convert4To8(high >> 16);
+    pHeader->b[0] = convert4To8(high >> 12);
+    pHeader->b[1] = convert4To8(high >> 8);
+  }
+  pHeader->table[0] = kModifierTable + (7 & (high >> 5)) * 4;
+  pHeader->table[1] = kModifierTable + (7 & (high >> 2)) * 4;
+  pHeader->flipped = (high & 1) != 0;
+}
+
+// Decodes a block into 4 rows of 4 RGBA pixels (alpha 255), one pixel at a
+// time. Bit-exact with etc1_decode_block.
+
+static void etc_decode_block_rgba_scalar(const etc1_byte* pIn,
+                                         etc1_byte* pOut) {
+  etc_block_header header;
+  int i;
+  etc_decode_header(pIn, &header);
+  for (i = 0; i < 16; i++) {
+    int x = i & 3;
+    int y = i >> 2;
+    int k = y + (x * 4);
+    int sub = (header.flipped ? y : x) >> 1;
+    int delta = header.table[sub][((header.low >> k) & 1) |
+                                  ((header.low >> (k + 15)) & 2)];
+    pOut[i * 4 + 0] = clamp(header.r[sub] + delta);
+    pOut[i * 4 + 1] = clamp(header.g[sub] + delta);
+    pOut[i * 4 + 2] = clamp(header.b[sub] + delta);
+    pOut[i * 4 + 3] = 255;
+  }
+}
+
+#ifdef IMAGE_SIMD_X86
+// Decodes a block into 4 rows of 4 RGBA pixels with all 16 pixels in
+// registers: the 2 bit pixel indices are expanded with per-lane bit masks,
+// the modifiers looked up with a byte shuffle, and the clamp is the saturation
+// of the 16 to 8 bit pack, so it is bit-exact with etc1_decode_block.
+
+IMAGE_TARGET_SSSE3
+static void etc_decode_block_rgba_SSSE3(const etc1_byte* pIn,
+                                        etc1_byte* pOut) {
+  // bit (y + 4 * x) of each plane holds pixel x + 4 * y
+  const __m128i kBits0 = _mm_setr_epi16(
+      0x0001, 0x0010, 0x0100, 0x1000, 0x0002, 0x0020, 0x0200, 0x2000);
+  const __m128i kBits1 = _mm_setr_epi16(0x0004, 0x0040, 0x0400, 0x4000,
+                                        0x0008, 0x0080, 0x0800,
+                                        (short)0x8000);
+  // which sub-block each pixel is in, as 0 or -1
+  const __m128i kSubX = _mm_setr_epi16(0, 0, -1, -1, 0, 0, -1, -1);
+  const __m128i kSubY0 = _mm_setzero_si128();
+  const __m128i kSubY1 = _mm_set1_epi16(-1);
+  const __m128i one = _mm_set1_epi16(1);
+  const __m128i two = _mm_set1_epi16(2);
+  const __m128i four = _mm_set1_epi16(4);
+  etc_block_header header;
+  __m128i lsb, msb, table, sub[2], delta[2], c[2];
+  __m128i r, g, b, a, rg, ba;
+  int h;
+  etc_decode_header(pIn, &header);
+  lsb = _mm_set1_epi16((short)(header.low & 0xffff));
+  msb = _mm_set1_epi16((short)(header.low >> 16));
+  table = _mm_setr_epi16(
+      (short)header.table[0][0], (short)header.table[0][1],
+      (short)header.table[0][2], (short)header.table[0][3],
+      (short)header.table[1][0], (short)header.table[1][1],
+      (short)header.table[1][2], (short)header.table[1][3]);
+  sub[0] = header.flipped ? kSubY0 : kSubX;
+  sub[1] = header.flipped ? kSubY1 : kSubX;
+  for (h = 0; h < 2; h++) {
+    const __m128i bits = h ? kBits1 : kBits0;
+    // index in [0, 3], plus 4 for the second sub-block's table
+    __m128i index = _mm_or_si128(
+        _mm_and_si128(_mm_cmpeq_epi16(_mm_and_si128(lsb, bits), bits), one),
+        _mm_and_si128(_mm_cmpeq_epi16(_mm_and_si128(msb, bits), bits), two));
+    index = _mm_or_si128(index, _mm_and_si128(sub[h], four));
+    // byte shuffle control for the 16 bit table entry: 2i, 2i + 1
+    index = _mm_add_epi16(_mm_mullo_epi16(index, _mm_set1_epi16(0x0202)),
+                          _mm_set1_epi16(0x0100));
+    delta[h] = _mm_shuffle_epi8(table, index);
+  }
+#define ETC_DECODE_CHANNEL(out, base)                                        \
+  for (h = 0; h < 2; h++) {                                                  \
+    c[h] = _mm_or_si128(                                                     \
+        _mm_andnot_si128(sub[h], _mm_set1_epi16((short)header.base[0])),     \
+        _mm_and_si128(sub[h], _mm_set1_epi16((short)header.base[1])));       \
+    c[h] = _mm_add_epi16(c[h], delta[h]);                                    \
+  }                                                                          \
+  out = _mm_packus_epi16(c[0], c[1]);
+  ETC_DECODE_CHANNEL(r, r)
+  ETC_DECODE_CHANNEL(g, g)
+  ETC_DECODE_CHANNEL(b, b)
+#undef ETC_DECODE_CHANNEL
+  a = _mm_set1_epi8((char)255);
+  rg = _mm_unpacklo_epi8(r, g);
+  ba = _mm_unpacklo_epi8(b, a);
+  _mm_storeu_si128((__m128i*)(pOut + 0), _mm_unpacklo_epi16(rg, ba));
+  _mm_storeu_si128((__m128i*)(pOut + 16), _mm_unpackhi_epi16(rg, ba));
+  rg = _mm_unpackhi_epi8(r, g);
+  ba = _mm_unpackhi_epi8(b, a);
+  _mm_storeu_si128((__m128i*)(pOut + 32), _mm_unpacklo_epi16(rg, ba));
+  _mm_storeu_si128((__m128i*)(pOut + 48), _mm_unpackhi_epi16(rg, ba));
+}
+#endif
+
+typedef void (*etc_decode_block_func)(const etc1_byte* pIn, etc1_byte* pOut);
+
+static etc_decode_block_func etc_decode_block_rgba_kernel(void) {
+  static etc_decode_block_func kernel = NULL;
+  if (kernel == NULL) {
+    kernel = etc_decode_block_rgba_scalar;
+#ifdef IMAGE_SIMD_X86
+    if (image_cpu_features() & IMAGE_CPU_SSSE3) {
+      kernel = etc_decode_block_rgba_SSSE3;
+    }
+#endif
+  }
+  return kernel;
+}
+
+void etc1_decode_block_rgba(const etc1_byte* pIn, etc1_byte* pOut) {
+  etc_decode_block_rgba_kernel()(pIn, pOut);
+}
+
 typedef struct {
   etc1_uint32 high;
   etc1_uint32 low;
@@ -370,7 +523,8 @@ static etc1_bool inRange4bitSigned(int color) {
 
 static void etc_encodeBaseColors(etc1_byte* pBaseColors,
                                  const etc1_byte* pColors,
-                                 etc_compressed* pCompressed) {
+                                 etc_compressed* pCompressed,
+                                 etc1_bool allowDifferential) {
   int r1, g1, b1, r2 = 0, g2 = 0, b2 = 0;  // 8 bit base colors for sub-blocks
   etc1_bool differential;
   {
@@ -389,8 +543,8 @@ static void etc_encodeBaseColors(etc1_byte* pBaseColors,
     int dg = g52 - g51;
     int db = b52 - b51;
 
-    differential =
-        inRange4bitSigned(dr) && inRange4bitSigned(dg) && inRange4bitSigned(db);
+    differential = allowDifferential && inRange4bitSigned(dr) &&
+                   inRange4bitSigned(dg) && inRange4bitSigned(db);
     if (differential) {
       r2 = convert5To8(r51 + dr);
       g2 = convert5To8(g51 + dg);
@@ -424,11 +578,58 @@ static void etc_encodeBaseColors(etc1_byte* pBaseColors,
   pBaseColors[5] = b2;
 }
 
+// The pixels of sub-block `second` for each flip orientation.
+
+static const etc1_uint32 kSubblockMask[2][2] = {{0x3333, 0xcccc},
+                                                {0x00ff, 0xff00}};
+
+// Picks the modifier table for a sub-block without trying them all: the one
+// whose mean modifier magnitude is closest to the mean luma-weighted distance
+// of the pixels from the base color.
+
+static int etc_pick_table(const etc1_byte* pIn, etc1_uint32 inMask,
+                          const etc1_byte* pBaseColors, etc1_bool flipped,
+                          etc1_bool second) {
+  int sum = 0;
+  int count = 0;
+  int bestIndex = 0;
+  int bestError = 0x7fffffff;
+  int i, t;
+  etc1_uint32 mask = inMask & kSubblockMask[flipped != 0][second != 0];
+  for (i = 0; i < 16; i++) {
+    if (!(mask & (1 << i))) {
+      continue;
+    }
+    const etc1_byte* p = pIn + i * 3;
+    int d = 3 * (p[0] - pBaseColors[0]) + 6 * (p[1] - pBaseColors[1]) +
+            (p[2] - pBaseColors[2]);
+    sum += d < 0 ? -d : d;
+    count++;
+  }
+  if (count == 0) {
+    return 0;
+  }
+  // sum / count / 10 is the mean distance; compare in the scaled domain.
+  for (t = 0; t < 8; t++) {
+    const int* table = kModifierTable + t * 4;
+    int error = 5 * count * (table[0] + table[1]) - sum;
+    if (error < 0) {
+      error = -error;
+    }
+    if (error < bestError) {
+      bestError = error;
+      bestIndex = t;
+    }
+  }
+  return bestIndex;
+}
+
 static void etc_encode_block_helper(const etc1_byte* pIn, etc1_uint32 inMask,
                                     const etc1_byte* pColors,
                                     etc_compressed* pCompressed,
-                                    etc1_bool flipped) {
-  int i;
+                                    etc1_bool flipped,
+                                    etc1_bool allowDifferential, int quality) {
+  int i, first, last;
 
   pCompressed->score = ~0;
   pCompressed->high = (flipped ? 1 : 0);
@@ -436,12 +637,17 @@ static void etc_encode_block_helper(const etc1_byte* pIn, etc1_uint32 inMask,
 
   etc1_byte pBaseColors[6];
 
-  etc_encodeBaseColors(pBaseColors, pColors, pCompressed);
+  etc_encodeBaseColors(pBaseColors, pColors, pCompressed, allowDifferential);
 
   int originalHigh = pCompressed->high;
 
-  const int* pModifierTable = kModifierTable;
-  for (i = 0; i < 8; i++, pModifierTable += 4) {
+  first = 0;
+  last = 7;
+  if (quality == ETC1_QUALITY_FAST) {
+    first = last = etc_pick_table(pIn, inMask, pBaseColors, flipped, 0);
+  }
+  const int* pModifierTable = kModifierTable + first * 4;
+  for (i = first; i <= last; i++, pModifierTable += 4) {
     etc_compressed temp;
     temp.score = 0;
     temp.high = originalHigh | (i << 5);
@@ -450,16 +656,19 @@ static void etc_encode_block_helper(const etc1_byte* pIn, etc1_uint32 inMask,
                                pModifierTable);
     take_best(pCompressed, &temp);
   }
-  pModifierTable = kModifierTable;
+  if (quality == ETC1_QUALITY_FAST) {
+    first = last = etc_pick_table(pIn, inMask, pBaseColors + 3, flipped, 1);
+  }
+  pModifierTable = kModifierTable + first * 4;
   etc_compressed firstHalf = *pCompressed;
-  for (i = 0; i < 8; i++, pModifierTable += 4) {
+  for (i = first; i <= last; i++, pModifierTable += 4) {
     etc_compressed temp;
     temp.score = firstHalf.score;
     temp.high = firstHalf.high | (i << 2);
     temp.low = firstHalf.low;
     etc_encode_subblock_helper(pIn, inMask, &temp, flipped, 1, pBaseColors + 3,
                                pModifierTable);
-    if (i == 0) {
+    if (i == first) {
       *pCompressed = temp;
     } else {
       take_best(pCompressed, &temp);
@@ -467,6 +676,37 @@ static void etc_encode_block_helper(const etc1_byte* pIn, etc1_uint32 inMask,
   }
 }
 
+// Sum of the squared luma-weighted distances of the pixels from their
+// sub-block averages; a cheap stand-in for encoding both flip orientations.
+
+static etc1_uint32 etc_flip_error(const etc1_byte* pIn, etc1_uint32 inMask,
+                                  const etc1_byte* pColors,
+                                  etc1_bool flipped) {
+  etc1_uint32 error = 0;
+  int i;
+  for (i = 0; i < 16; i++) {
+    if (!(inMask & (1 << i))) {
+      continue;
+    }
+    const etc1_byte* p = pIn + i * 3;
+    const etc1_byte* c =
+        pColors + ((kSubblockMask[flipped][1] >> i) & 1) * 3;
+    error += 3 * square(p[0] - c[0]) + 6 * square(p[1] - c[1]) +
+             square(p[2] - c[2]);
+  }
+  return error;
+}
+
+// Moves both sub-block averages along the grey axis, for the exhaustive search.
+
+static void etc_shift_colors(const etc1_byte* pColors, int shift,
+                             etc1_byte* pShifted) {
+  int i;
+  for (i = 0; i < 6; i++) {
+    pShifted[i] = clamp(pColors[i] + shift);
+  }
+}
+
 static void writeBigEndian(etc1_byte* pOut, etc1_uint32 d) {
   pOut[0] = (etc1_byte)(d >> 24);
   pOut[1] = (etc1_byte)(d >> 16);
@@ -481,6 +721,11 @@ static void writeBigEndian(etc1_byte* pOut, etc1_uint32 d) {
 
 void etc1_encode_block(const etc1_byte* pIn, etc1_uint32 inMask,
                        etc1_byte* pOut) {
+  etc1_encode_block_quality(pIn, inMask, pOut, ETC1_QUALITY_NORMAL);
+}
+
+void etc1_encode_block_quality(const etc1_byte* pIn, etc1_uint32 inMask,
+                               etc1_byte* pOut, int quality) {
   etc1_byte colors[6];
   etc1_byte flippedColors[6];
   etc_average_colors_subblock(pIn, inMask, colors, 0, 0);
@@ -489,9 +734,40 @@ void etc1_encode_block(const etc1_byte* pIn, etc1_uint32 inMask,
   etc_average_colors_subblock(pIn, inMask, flippedColors + 3, 1, 1);
 
   etc_compressed a, b;
-  etc_encode_block_helper(pIn, inMask, colors, &a, 0);
-  etc_encode_block_helper(pIn, inMask, flippedColors, &b, 1);
-  take_best(&a, &b);
+  if (quality == ETC1_QUALITY_FAST) {
+    // Only encode the orientation that splits the block more cleanly.
+    if (etc_flip_error(pIn, inMask, flippedColors, 1) <
+        etc_flip_error(pIn, inMask, colors, 0)) {
+      etc_encode_block_helper(pIn, inMask, flippedColors, &a, 1, 1, quality);
+    } else {
+      etc_encode_block_helper(pIn, inMask, colors, &a, 0, 1, quality);
+    }
+  } else {
+    etc_encode_block_helper(pIn, inMask, colors, &a, 0, 1, quality);
+    etc_encode_block_helper(pIn, inMask, flippedColors, &b, 1, 1, quality);
+    take_best(&a, &b);
+  }
+  if (quality == ETC1_QUALITY_EXHAUSTIVE) {
+    // Also try the individual (4 bit) base colors, and base colors one
+    // 5 bit step either side of the averages, in both orientations.
+    static const int kShifts[] = {0, -8, 8};
+    int flipped, shift, differential;
+    for (flipped = 0; flipped < 2; flipped++) {
+      for (shift = 0; shift < 3; shift++) {
+        for (differential = 0; differential < 2; differential++) {
+          etc1_byte shifted[6];
+          if (shift == 0 && differential) {
+            continue;  // the normal search above
+          }
+          etc_shift_colors(flipped ? flippedColors : colors, kShifts[shift],
+                           shifted);
+          etc_encode_block_helper(pIn, inMask, shifted, &b, flipped,
+                                  differential, quality);
+          take_best(&a, &b);
+        }
+      }
+    }
+  }
   writeBigEndian(pOut, a.high);
   writeBigEndian(pOut + 4, a.low);
 }
@@ -512,49 +788,91 @@ etc1_uint32 etc1_get_encoded_data_size(etc1_uint32 width, etc1_uint32 height) {
 int etc1_encode_image(const etc1_byte* pIn, etc1_uint32 width,
                       etc1_uint32 height, etc1_uint32 pixelSize,
                       etc1_uint32 stride, etc1_byte* pOut) {
-  if (pixelSize < 2 || pixelSize > 3) {
-    return -1;
-  }
+  return etc1_encode_image_parallel(pIn, width, height, pixelSize, stride, pOut,
+                                    ETC1_QUALITY_NORMAL, 1);
+}
+
+typedef struct {
+  const etc1_byte* pIn;
+  etc1_uint32 width;
+  etc1_uint32 height;
+  etc1_uint32 pixelSize;
+  etc1_uint32 stride;
+  etc1_byte* pOut;
+  int quality;
+} etc_encode_job;
+
+// Encodes the row of blocks starting at scanline 4 * blockRow.
+
+static void etc_encode_block_row(void* context, int blockRow) {
   static const unsigned short kYMask[] = {0x0, 0xf, 0xff, 0xfff, 0xffff};
   static const unsigned short kXMask[] = {0x0, 0x1111, 0x3333, 0x7777, 0xffff};
+  const etc_encode_job* job = (const etc_encode_job*)context;
   etc1_byte block[ETC1_DECODED_BLOCK_SIZE];
   etc1_byte encoded[ETC1_ENCODED_BLOCK_SIZE];
-  etc1_uint32 y, x, cy, cx;
+  etc1_uint32 x, cy, cx;
 
-  etc1_uint32 encodedWidth = (width + 3) & ~3;
-  etc1_uint32 encodedHeight = (height + 3) & ~3;
+  etc1_uint32 encodedWidth = (job->width + 3) & ~3;
+  etc1_uint32 y = blockRow * 4;
+  etc1_byte* pOut = job->pOut + (encodedWidth >> 2) * ETC1_ENCODED_BLOCK_SIZE *
+                                    blockRow;
 
-  for (y = 0; y < encodedHeight; y += 4) {
-    etc1_uint32 yEnd = height - y;
-    if (yEnd > 4) {
-      yEnd = 4;
+  etc1_uint32 yEnd = job->height - y;
+  if (yEnd > 4) {
+    yEnd = 4;
+  }
+  int ymask = kYMask[yEnd];
+  for (x = 0; x < encodedWidth; x += 4) {
+    etc1_uint32 xEnd = job->width - x;
+    if (xEnd > 4) {
+      xEnd = 4;
     }
-    int ymask = kYMask[yEnd];
-    for (x = 0; x < encodedWidth; x += 4) {
-      etc1_uint32 xEnd = width - x;
-      if (xEnd > 4) {
-        xEnd = 4;
-      }
-      int mask = ymask & kXMask[xEnd];
-      for (cy = 0; cy < yEnd; cy++) {
-        etc1_byte* q = block + (cy * 4) * 3;
-        const etc1_byte* p = pIn + pixelSize * x + stride * (y + cy);
-        if (pixelSize == 3) {
-          memcpy(q, p, xEnd * 3);
-        } else {
-          for (cx = 0; cx < xEnd; cx++) {
-            int pixel = (p[1] << 8) | p[0];
-            *q++ = convert5To8(pixel >> 11);
-            *q++ = convert6To8(pixel >> 5);
-            *q++ = convert5To8(pixel);
-            p += pixelSize;
-          }
+    int mask = ymask & kXMask[xEnd];
+    for (cy = 0; cy < yEnd; cy++) {
+      etc1_byte* q = block + (cy * 4) * 3;
+      const etc1_byte* p =
+          job->pIn + job->pixelSize * x + job->stride * (y + cy);
+      if (job->pixelSize == 3) {
+        memcpy(q, p, xEnd * 3);
+      } else {
+        for (cx = 0; cx < xEnd; cx++) {
+          int pixel = (p[1] << 8) | p[0];
+          *q++ = convert5To8(pixel >> 11);
+          *q++ = convert6To8(pixel >> 5);
+          *q++ = convert5To8(pixel);
+          p += job->pixelSize;
         }
       }
-      etc1_encode_block(block, mask, encoded);
-      memcpy(pOut, encoded, sizeof(encoded));
-      pOut += sizeof(encoded);
     }
+    etc1_encode_block_quality(block, mask, encoded, job->quality);
+    memcpy(pOut, encoded, sizeof(encoded));
+    pOut += sizeof(encoded);
+  }
+}
+
+int etc1_encode_image_parallel(const etc1_byte* pIn, etc1_uint32 width,
+                               etc1_uint32 height, etc1_uint32 pixelSize,
+                               etc1_uint32 stride, etc1_byte* pOut,
+                               int quality, int threadCount) {
+  if (pixelSize < 2 || pixelSize > 3) {
+    return -1;
+  }
+  if (quality < ETC1_QUALITY_FAST || quality > ETC1_QUALITY_EXHAUSTIVE) {
+    return -1;
+  }
+  etc_encode_job job;
+  job.pIn = pIn;
+  job.width = width;
+  job.height = height;
+  job.pixelSize = pixelSize;
+  job.stride = stride;
+  job.pOut = pOut;
+  job.quality = quality;
+  // Every row of blocks has a fixed place in pOut, so the output does not
+  // depend on the thread count.
+  if (!image_parallel_for((int)((height + 3) >> 2), threadCount,
+                          etc_encode_block_row, &job)) {
+    return -1;
   }
   return 0;
 }
@@ -612,6 +930,107 @@ int etc1_decode_image(const etc1_byte* pIn, etc1_byte* pOut, etc1_uint32 width,
   return 0;
 }
 
+// Decode an entire image straight to 8 bit RGB or RGBA.
+
+int etc1_decode_image_rgba(const etc1_byte* pIn, etc1_byte* pOut,
+                           etc1_uint32 width, etc1_uint32 height,
+                           etc1_uint32 components, etc1_uint32 stride) {
+  if (components < 3 || components > 4) {
+    return -1;
+  }
+  etc_decode_block_func decode = etc_decode_block_rgba_kernel();
+  etc1_byte block[16 * 4];
+
+  etc1_uint32 encodedWidth = (width + 3) & ~3;
+  etc1_uint32 encodedHeight = (height + 3) & ~3;
+
+  etc1_uint32 y, x, cy, cx;
+
+  for (y = 0; y < encodedHeight; y += 4) {
+    etc1_uint32 yEnd = height - y;
+    if (yEnd > 4) {
+      yEnd = 4;
+    }
+    for (x = 0; x < encodedWidth; x += 4) {
+      etc1_uint32 xEnd = width - x;
+      if (xEnd > 4) {
+        xEnd = 4;
+      }
+      decode(pIn, block);
+      pIn += ETC1_ENCODED_BLOCK_SIZE;
+      for (cy = 0; cy < yEnd; cy++) {
+        const etc1_byte* q = block + cy * 16;
+        etc1_byte* p = pOut + components * x + stride * (y + cy);
+        if (components == 4) {
+          memcpy(p, q, xEnd * 4);
+        } else {
+          for (cx = 0; cx < xEnd; cx++, q += 4) {
+            *p++ = q[0];
+            *p++ = q[1];
+            *p++ = q[2];
+          }
+        }
+      }
+    }
+  }
+  return 0;
+}
+
+typedef struct {
+  etc1_pkm_batch_item* items;
+  etc1_uint32 components;
+} etc_pkm_batch_job;
+
+static void etc_decode_pkm_task(void* context, int index) {
+  const etc_pkm_batch_job* job = (const etc_pkm_batch_job*)context;
+  etc1_pkm_batch_item* item = job->items + index;
+  item->pOut = NULL;
+  item->width = item->height = 0;
+  item->result = -1;
+  if (item->pData == NULL || item->size < ETC_PKM_HEADER_SIZE ||
+      !etc1_pkm_is_valid(item->pData)) {
+    return;
+  }
+  etc1_uint32 width = etc1_pkm_get_width(item->pData);
+  etc1_uint32 height = etc1_pkm_get_height(item->pData);
+  if (item->size - ETC_PKM_HEADER_SIZE <
+      etc1_get_encoded_data_size(width, height)) {
+    return;
+  }
+  etc1_byte* pOut = (etc1_byte*)malloc(width * height * job->components);
+  if (pOut == NULL) {
+    return;
+  }
+  etc1_decode_image_rgba(item->pData + ETC_PKM_HEADER_SIZE, pOut, width,
+                         height, job->components, width * job->components);
+  item->pOut = pOut;
+  item->width = width;
+  item->height = height;
+  item->result = 0;
+}
+
+// Decode a batch of PKM files, one file per task.
+
+int etc1_decode_pkm_batch(etc1_pkm_batch_item* items, int count,
+                          etc1_uint32 components, int threadCount) {
+  int i, failed = 0;
+  if (items == NULL || count < 0 || components < 3 || components > 4) {
+    return -1;
+  }
+  etc_pkm_batch_job job;
+  job.items = items;
+  job.components = components;
+  if (!image_parallel_for(count, threadCount, etc_decode_pkm_task, &job)) {
+    return -1;
+  }
+  for (i = 0; i < count; i++) {
+    if (items[i].result != 0) {
+      failed++;
+    }
+  }
+  return failed;
+}
+
 static const char kMagic[] = {'P', 'K', 'M', ' ', '1', '0'};
 
 static const etc1_uint32 ETC1_PKM_FORMAT_OFFSET = 6;
@@ -23,8 +23,126 @@ save_image_as_DDS
     const unsigned char *const data
 );
 
+/**
+	The output sink for the streaming DDS encoder; the same
+	signature as stbi_write_func, so either can be passed.
+**/
+typedef void DDS_write_func( void *context, void *data, int size );
+
+/**
+	Same as save_image_as_DDS, but the file goes to func, one
+	row of blocks at a time.
+	\return 0 if failed, otherwise returns 1
+**/
+int
+save_image_as_DDS_to_func
+(
+    DDS_write_func *func, void *context,
+    int width, int height, int channels,
+    const unsigned char *const data
+);
+
+/**
+	A DDS encoder that is fed scanlines as they become available.
+	Every time 4 scanlines have arrived they are compressed and
+	written out, so only one strip of 4 scanlines and one row of
+	blocks are ever held, whatever the height of the image.
+	The output is byte-identical to save_image_as_DDS.
+**/
+typedef struct
+{
+    DDS_write_func  *func;
+    void            *context;
+    int             width, height, channels;
+    int             block_row_size;
+    int             rows_done;
+    int             strip_rows;
+    unsigned char   *strip;
+    unsigned char   *blocks;
+}
+DDS_stream;
+
+/**
+	Writes the DDS header and gets ready for the first scanline.
+	\return 0 if failed, otherwise returns 1
+**/
+int
+DDS_stream_begin
+(
+    DDS_stream *stream,
+    DDS_write_func *func, void *context,
+    int width, int height, int channels
+);
+
+/**
+	Pushes the next row_count scanlines (tightly packed, top row first).
+	Rows may arrive in batches of any size.
+	\return 0 if failed, otherwise returns 1
+**/
+int
+DDS_stream_push_rows
+(
+    DDS_stream *stream,
+    const unsigned char *rows, int row_count
+);
+
+/**
+	Releases the stream.
+	\return 0 if fewer than height scanlines were pushed, otherwise 1
+**/
+int
+DDS_stream_end
+(
+    DDS_stream *stream
+);
+
+/**
+	Flags for save_image_as_DDS_ex.
+	DDS_SAVE_MIPMAPS writes the full MIPmap chain down to 1x1.
+	DDS_SAVE_CUBEMAP writes six square faces, in the order
+	+X, -X, +Y, -Y, +Z, -Z.
+**/
+enum
+{
+	DDS_SAVE_MIPMAPS = 1,
+	DDS_SAVE_CUBEMAP = 2
+};
+
+/**
+	Converts one (or six, for a cubemap) images to DXT1 or DXT5 and
+	saves them, with their MIPmaps if asked for, as a single DDS file
+	that loads with no resampling.  The MIPmaps are box filtered with
+	mipmap_image, and every level is compressed in parallel on up to
+	thread_count threads (<= 0 means one per hardware thread).
+	\return 0 if failed, otherwise returns 1
+**/
+int
+save_image_as_DDS_ex
+(
+    const char *filename,
+    int width, int height, int channels,
+    const unsigned char *const *faces,
+    int flags, int thread_count
+);
+
+/**
+	Same as save_image_as_DDS_ex, but the file goes to func.
+	\return 0 if failed, otherwise returns 1
+**/
+int
+save_image_as_DDS_ex_to_func
+(
+    DDS_write_func *func, void *context,
+    int width, int height, int channels,
+    const unsigned char *const *faces,
+    int flags, int thread_count
+);
+
 /**
 	take an image and convert it to DXT1 (no alpha)
+	The output of this and the other convert_image_to_* functions
+	comes from image_malloc (see image_alloc.h), which is malloc
+	unless the calling thread installed an allocator.
 **/
 unsigned char*
 convert_image_to_DXT1
@@ -45,6 +163,84 @@ convert_image_to_DXT5
     int *out_size
 );
 
+/**
+	take an image and convert it to DXT1 (no alpha), compressing
+	rows of 4x4 blocks on up to thread_count threads
+	(<= 0 means one per hardware thread).  The output is
+	byte-identical to convert_image_to_DXT1.
+**/
+unsigned char*
+convert_image_to_DXT1_parallel
+(
+    const unsigned char *const uncompressed,
+    int width, int height, int channels,
+    int *out_size, int thread_count
+);
+
+/**
+	take an image and convert it to DXT5 (with alpha), compressing
+	rows of 4x4 blocks on up to thread_count threads
+	(<= 0 means one per hardware thread).  The output is
+	byte-identical to convert_image_to_DXT5.
+**/
+unsigned char*
+convert_image_to_DXT5_parallel
+(
+    const unsigned char *const uncompressed,
+    int width, int height, int channels,
+    int *out_size, int thread_count
+);
+
+/**
+	Converts an RGB or RGBA image to YCoCg and compresses it, the same
+	as convert_RGB_to_YCoCg followed by convert_image_to_DXT1 (for 3
+	channels, CoYCg) or convert_image_to_DXT5 (for 4 channels, CoCgAY),
+	and with the same output.  The YCoCg pixels only ever exist a few
+	rows and columns of blocks at a time, right before they are
+	compressed, and uncompressed is left unchanged.  Rows of blocks are
+	done on up to thread_count threads (<= 0 means one per hardware
+	thread).
+**/
+unsigned char*
+convert_image_to_DXT_YCoCg
+(
+    const unsigned char *const uncompressed,
+    int width, int height, int channels,
+    int *out_size, int thread_count
+);
+
+/**
+	The block formats decode_DXT_image understands.  DXT2 and DXT4
+	decode as DXT3 and DXT5 (the color stays premultiplied).
+	BC4 (ATI1) decodes to gray and BC5 (ATI2) to red and green with
+	blue 0, both with alpha 255.
+**/
+enum
+{
+	DDS_FORMAT_DXT1 = 1,
+	DDS_FORMAT_DXT3,
+	DDS_FORMAT_DXT5,
+	DDS_FORMAT_BC4,
+	DDS_FORMAT_BC5
+};
+
+/**
+	Decodes a width x height image of 4x4 blocks in one of the
+	DDS_FORMAT_* formats to RGBA (width * 4 bytes per row), one row
+	of blocks per task on up to thread_count threads (<= 0 means one
+	per hardware thread).  compressed holds ((width + 3) / 4) *
+	((height + 3) / 4) blocks of 8 (DXT1, BC4) or 16 bytes.  The SSSE3
+	kernel is used when the CPU has it, with the same output.
+	\return 0 if failed, otherwise returns 1
+**/
+int
+decode_DXT_image
+(
+    const unsigned char *const compressed,
+    int format, int width, int height,
+    unsigned char *rgba, int thread_count
+);
+
 /**	A bunch of DirectDraw Surface structures and flags **/
 typedef struct
 {
@@ -85,6 +281,17 @@ typedef struct
 }
 DDS_header ;
 
+/**
+	Fills in the header of a single level DXT1 (odd channel count)
+	or DXT5 (even channel count) DDS file.
+**/
+void
+DDS_fill_header
+(
+    DDS_header *header,
+    int width, int height, int channels
+);
+
 /*	the following constants were copied directly off the MSDN website	*/
 
 /*	The dwFlags member of the original DDSURFACEDESC2 structure
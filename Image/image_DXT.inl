@@ -12,6 +12,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include "image_DXT.h"
+#include "image_helper.h"
+#include "image_simd.h"
+#include "image_thread.h"
+#include "image_alloc.h"
 
 /*	set this =1 if you want to use the covarince matrix method...
         which is better than my method of using standard deviations
@@ -28,6 +32,36 @@
 void compress_DDS_color_block(int channels,
                               const unsigned char *const uncompressed,
                               unsigned char compressed[8]);
+/*
+        The kernels compress_DDS_color_block picks between at run time.
+        All of them produce the same bits.
+*/
+typedef void (*DDS_color_block_func)(int channels,
+                                     const unsigned char *const uncompressed,
+                                     unsigned char compressed[8]);
+void compress_DDS_color_block_scalar(int channels,
+                                     const unsigned char *const uncompressed,
+                                     unsigned char compressed[8]);
+#ifdef IMAGE_SIMD_X86
+void compress_DDS_color_block_SSE2(int channels,
+                                   const unsigned char *const uncompressed,
+                                   unsigned char compressed[8]);
+IMAGE_TARGET_AVX2
+void compress_DDS_color_block_AVX2(int channels,
+                                   const unsigned char *const uncompressed,
+                                   unsigned char compressed[8]);
+#endif
+/*
+        Pieces of the color block fit shared by all of the kernels, so
+        they stay bit-exact with one another.
+*/
+void compute_color_line_from_sums(const float sums[9], float point[3],
+                                  float direction[3]);
+void LSE_master_colors_from_line(int *cmax, int *cmin, const float sum_x[3],
+                                 const float sum_x2[3], float dot_min,
+                                 float dot_max);
+void DDS_color_block_line(int enc_c0, int enc_c1, unsigned char compressed[8],
+                          float color_line[3], float *dot_offset);
 /*
         Takes a 4x4 block of pixels and compresses the alpha
         component it into 8 bytes for use in DXT5 DDS files.
@@ -35,212 +69,693 @@ void compress_DDS_color_block(int channels,
 */
 void compress_DDS_alpha_block(const unsigned char *const uncompressed,
                               unsigned char compressed[8]);
+/*
+        Compresses the row of 4x4 blocks whose top scanline is j,
+        writing ((width + 3) / 4) blocks of 8 (DXT1) or 16 (DXT5)
+        bytes.  Rows are independent, so they can run in parallel.
+*/
+void compress_DXT1_block_row(const unsigned char *const uncompressed,
+                             int width, int height, int channels, int j,
+                             unsigned char *compressed);
+void compress_DXT5_block_row(const unsigned char *const uncompressed,
+                             int width, int height, int channels, int j,
+                             unsigned char *compressed);
+/*
+        Decodes one 4x4 block in format (a DDS_FORMAT_*) to RGBA, with
+        stride bytes between the rows of rgba.  decode_DXT_image picks
+        a kernel at run time; they all produce the same bytes.
+*/
+typedef void (*DDS_decode_block_func)(const unsigned char *block, int format,
+                                      unsigned char *rgba, int stride);
+void decode_DDS_block_scalar(const unsigned char *block, int format,
+                             unsigned char *rgba, int stride);
+#ifdef IMAGE_SIMD_X86
+IMAGE_TARGET_SSSE3
+void decode_DDS_block_SSSE3(const unsigned char *block, int format,
+                            unsigned char *rgba, int stride);
+#endif
 
 /********* Actual Exposed Functions *********/
+static void DDS_write_to_FILE(void *context, void *data, int size) {
+  fwrite(data, 1, size, (FILE *)context);
+}
+
 int save_image_as_DDS(const char *filename, int width, int height, int channels,
                       const unsigned char *const data) {
   /*	variables	*/
   FILE *fout;
-  unsigned char *DDS_data;
-  DDS_header header;
-  int DDS_size;
+  int result;
   /*	error check	*/
   if ((NULL == filename) || (width < 1) || (height < 1) || (channels < 1) ||
       (channels > 4) || (data == NULL)) {
     return 0;
   }
-  /*	Convert the image	*/
-  if ((channels & 1) == 1) {
-    /*	no alpha, just use DXT1	*/
-    DDS_data = convert_image_to_DXT1(data, width, height, channels, &DDS_size);
-  } else {
-    /*	has alpha, so use DXT5	*/
-    DDS_data = convert_image_to_DXT5(data, width, height, channels, &DDS_size);
+  /*	write it out, a strip at a time	*/
+  errno_t err = fopen_s(&fout, filename, "wb");
+  if (err) return 0;
+  result = save_image_as_DDS_to_func(DDS_write_to_FILE, fout, width, height,
+                                     channels, data);
+  fclose(fout);
+  /*	done	*/
+  return result;
+}
+
+int save_image_as_DDS_to_func(DDS_write_func *func, void *context, int width,
+                              int height, int channels,
+                              const unsigned char *const data) {
+  DDS_stream stream;
+  if (NULL == data) {
+    return 0;
+  }
+  if (!DDS_stream_begin(&stream, func, context, width, height, channels)) {
+    return 0;
   }
-  /*	save it	*/
-  memset(&header, 0, sizeof(DDS_header));
-  header.dwMagic = ('D' << 0) | ('D' << 8) | ('S' << 16) | (' ' << 24);
-  header.dwSize = 124;
-  header.dwFlags =
+  DDS_stream_push_rows(&stream, data, height);
+  return DDS_stream_end(&stream);
+}
+
+void DDS_fill_header(DDS_header *header, int width, int height, int channels) {
+  int DDS_size = ((width + 3) >> 2) * ((height + 3) >> 2) *
+                 (((channels & 1) == 1) ? 8 : 16);
+  memset(header, 0, sizeof(DDS_header));
+  header->dwMagic = ('D' << 0) | ('D' << 8) | ('S' << 16) | (' ' << 24);
+  header->dwSize = 124;
+  header->dwFlags =
       DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_LINEARSIZE;
-  header.dwWidth = width;
-  header.dwHeight = height;
-  header.dwPitchOrLinearSize = DDS_size;
-  header.sPixelFormat.dwSize = 32;
-  header.sPixelFormat.dwFlags = DDPF_FOURCC;
+  header->dwWidth = width;
+  header->dwHeight = height;
+  header->dwPitchOrLinearSize = DDS_size;
+  header->sPixelFormat.dwSize = 32;
+  header->sPixelFormat.dwFlags = DDPF_FOURCC;
   if ((channels & 1) == 1) {
-    header.sPixelFormat.dwFourCC =
+    /*	no alpha, just use DXT1	*/
+    header->sPixelFormat.dwFourCC =
         ('D' << 0) | ('X' << 8) | ('T' << 16) | ('1' << 24);
   } else {
-    header.sPixelFormat.dwFourCC =
+    /*	has alpha, so use DXT5	*/
+    header->sPixelFormat.dwFourCC =
         ('D' << 0) | ('X' << 8) | ('T' << 16) | ('5' << 24);
   }
-  header.sCaps.dwCaps1 = DDSCAPS_TEXTURE;
-  /*	write it out	*/
+  header->sCaps.dwCaps1 = DDSCAPS_TEXTURE;
+}
+
+int DDS_stream_begin(DDS_stream *stream, DDS_write_func *func, void *context,
+                     int width, int height, int channels) {
+  DDS_header header;
+  /*	error check	*/
+  if ((NULL == stream) || (NULL == func) || (width < 1) || (height < 1) ||
+      (channels < 1) || (channels > 4)) {
+    return 0;
+  }
+  memset(stream, 0, sizeof(DDS_stream));
+  stream->func = func;
+  stream->context = context;
+  stream->width = width;
+  stream->height = height;
+  stream->channels = channels;
+  stream->block_row_size =
+      ((width + 3) >> 2) * (((channels & 1) == 1) ? 8 : 16);
+  /*	one strip of 4 scanlines in, one row of blocks out	*/
+  stream->strip = (unsigned char *)malloc(4 * width * channels);
+  stream->blocks = (unsigned char *)malloc(stream->block_row_size);
+  if ((NULL == stream->strip) || (NULL == stream->blocks)) {
+    free(stream->strip);
+    free(stream->blocks);
+    stream->strip = stream->blocks = NULL;
+    return 0;
+  }
+  DDS_fill_header(&header, width, height, channels);
+  func(context, &header, sizeof(DDS_header));
+  return 1;
+}
+
+/*	compresses the (up to) 4 scanlines at strip and sends them off	*/
+static void DDS_stream_emit_strip(DDS_stream *stream,
+                                  const unsigned char *const strip) {
+  int strip_height = stream->height - stream->rows_done;
+  if (strip_height > 4) {
+    strip_height = 4;
+  }
+  /*	the last strip pads its blocks just like the whole image would	*/
+  if ((stream->channels & 1) == 1) {
+    compress_DXT1_block_row(strip, stream->width, strip_height,
+                            stream->channels, 0, stream->blocks);
+  } else {
+    compress_DXT5_block_row(strip, stream->width, strip_height,
+                            stream->channels, 0, stream->blocks);
+  }
+  stream->func(stream->context, stream->blocks, stream->block_row_size);
+  stream->rows_done += strip_height;
+}
+
+int DDS_stream_push_rows(DDS_stream *stream, const unsigned char *rows,
+                         int row_count) {
+  int row_size;
+  if ((NULL == stream) || (NULL == stream->strip) || (NULL == rows) ||
+      (row_count < 0) ||
+      (row_count > stream->height - stream->rows_done - stream->strip_rows)) {
+    return 0;
+  }
+  row_size = stream->width * stream->channels;
+  while (row_count > 0) {
+    int need = stream->height - stream->rows_done;
+    if (need > 4) {
+      need = 4;
+    }
+    if ((0 == stream->strip_rows) && (row_count >= need)) {
+      /*	a whole strip is already in the caller's memory	*/
+      DDS_stream_emit_strip(stream, rows);
+      rows += need * row_size;
+      row_count -= need;
+    } else {
+      /*	gather the partial strip	*/
+      int take = need - stream->strip_rows;
+      if (take > row_count) {
+        take = row_count;
+      }
+      memcpy(stream->strip + stream->strip_rows * row_size, rows,
+             take * row_size);
+      stream->strip_rows += take;
+      rows += take * row_size;
+      row_count -= take;
+      if (stream->strip_rows == need) {
+        DDS_stream_emit_strip(stream, stream->strip);
+        stream->strip_rows = 0;
+      }
+    }
+  }
+  return 1;
+}
+
+int DDS_stream_end(DDS_stream *stream) {
+  int complete;
+  if (NULL == stream) {
+    return 0;
+  }
+  complete = (NULL != stream->strip) && (stream->rows_done == stream->height);
+  free(stream->strip);
+  free(stream->blocks);
+  stream->strip = stream->blocks = NULL;
+  return complete;
+}
+
+int save_image_as_DDS_ex(const char *filename, int width, int height,
+                         int channels, const unsigned char *const *faces,
+                         int flags, int thread_count) {
+  FILE *fout;
+  int result;
+  if (NULL == filename) {
+    return 0;
+  }
   errno_t err = fopen_s(&fout, filename, "wb");
-  if (!err) return 0;
-  fwrite(&header, sizeof(DDS_header), 1, fout);
-  fwrite(DDS_data, 1, DDS_size, fout);
+  if (err) return 0;
+  result = save_image_as_DDS_ex_to_func(DDS_write_to_FILE, fout, width, height,
+                                        channels, faces, flags, thread_count);
   fclose(fout);
+  return result;
+}
+
+/*	one face of one MIPmap level	*/
+typedef struct {
+  const unsigned char *pixels;
+  unsigned char *resampled;
+  int width, height;
+  int level;
+  int first_block_row;
+  unsigned char *compressed;
+} DDS_surface;
+
+typedef struct {
+  DDS_surface *surfaces;
+  int surface_count;
+  int channels;
+  int block_row_size_base;
+  int block_size;
+} DDS_surface_job;
+
+static void DDS_resample_task(void *context, int index) {
+  DDS_surface_job *job = (DDS_surface_job *)context;
+  DDS_surface *surface = &job->surfaces[index];
+  const DDS_surface *base = surface - surface->level;
+  if (0 == surface->level) {
+    return;
+  }
+  /*	box filter straight from the full size face, like createMipmaps	*/
+  surface->resampled =
+      (unsigned char *)image_malloc(surface->width * surface->height *
+                                    job->channels);
+  if (NULL != surface->resampled) {
+    mipmap_image(base->pixels, base->width, base->height, job->channels,
+                 surface->resampled, 1 << surface->level, 1 << surface->level);
+  }
+  surface->pixels = surface->resampled;
+}
+
+static void DDS_compress_task(void *context, int block_row) {
+  DDS_surface_job *job = (DDS_surface_job *)context;
+  DDS_surface *surface = job->surfaces;
+  int row;
+  /*	find the surface this row of blocks belongs to	*/
+  while ((surface + 1 < job->surfaces + job->surface_count) &&
+         (surface[1].first_block_row <= block_row)) {
+    ++surface;
+  }
+  if (NULL == surface->pixels) {
+    return;
+  }
+  row = block_row - surface->first_block_row;
+  if (8 == job->block_size) {
+    compress_DXT1_block_row(surface->pixels, surface->width, surface->height,
+                            job->channels, row * 4,
+                            surface->compressed +
+                                row * ((surface->width + 3) >> 2) * 8);
+  } else {
+    compress_DXT5_block_row(surface->pixels, surface->width, surface->height,
+                            job->channels, row * 4,
+                            surface->compressed +
+                                row * ((surface->width + 3) >> 2) * 16);
+  }
+}
+
+int save_image_as_DDS_ex_to_func(DDS_write_func *func, void *context,
+                                 int width, int height, int channels,
+                                 const unsigned char *const *faces, int flags,
+                                 int thread_count) {
+  DDS_header header;
+  DDS_surface_job job;
+  unsigned char *compressed;
+  int face_count, level_count, face, level, i;
+  int block_rows = 0, total_size = 0, result = 1;
+  /*	error check	*/
+  face_count = (flags & DDS_SAVE_CUBEMAP) ? 6 : 1;
+  if ((NULL == func) || (NULL == faces) || (width < 1) || (height < 1) ||
+      (channels < 1) || (channels > 4) ||
+      ((flags & DDS_SAVE_CUBEMAP) && (width != height))) {
+    return 0;
+  }
+  for (face = 0; face < face_count; ++face) {
+    if (NULL == faces[face]) {
+      return 0;
+    }
+  }
+  /*	all the way down to 1x1	*/
+  level_count = 1;
+  if (flags & DDS_SAVE_MIPMAPS) {
+    while ((width >> level_count) || (height >> level_count)) {
+      ++level_count;
+    }
+  }
+  /*	lay the surfaces out in file order: each face with its MIPmaps	*/
+  job.surface_count = face_count * level_count;
+  job.surfaces =
+      (DDS_surface *)image_malloc(job.surface_count * sizeof(DDS_surface));
+  if (NULL == job.surfaces) {
+    return 0;
+  }
+  memset(job.surfaces, 0, job.surface_count * sizeof(DDS_surface));
+  job.channels = channels;
+  job.block_size = ((channels & 1) == 1) ? 8 : 16;
+  for (face = 0; face < face_count; ++face) {
+    for (level = 0; level < level_count; ++level) {
+      DDS_surface *surface = &job.surfaces[face * level_count + level];
+      surface->level = level;
+      surface->width = (width >> level) ? (width >> level) : 1;
+      surface->height = (height >> level) ? (height >> level) : 1;
+      surface->pixels = level ? NULL : faces[face];
+      surface->first_block_row = block_rows;
+      block_rows += (surface->height + 3) >> 2;
+      total_size += ((surface->width + 3) >> 2) *
+                    ((surface->height + 3) >> 2) * job.block_size;
+    }
+  }
+  compressed = (unsigned char *)image_malloc(total_size);
+  if (NULL == compressed) {
+    image_free(job.surfaces);
+    return 0;
+  }
+  total_size = 0;
+  for (i = 0; i < job.surface_count; ++i) {
+    DDS_surface *surface = &job.surfaces[i];
+    surface->compressed = compressed + total_size;
+    total_size += ((surface->width + 3) >> 2) * ((surface->height + 3) >> 2) *
+                  job.block_size;
+  }
+  /*	downsample every level, then compress every row of blocks
+          of every level at once, so the threads stay busy	*/
+  image_parallel_for(job.surface_count, thread_count, DDS_resample_task, &job);
+  for (i = 0; i < job.surface_count; ++i) {
+    if (NULL == job.surfaces[i].pixels) {
+      result = 0;
+    }
+  }
+  if (result) {
+    image_parallel_for(block_rows, thread_count, DDS_compress_task, &job);
+    DDS_fill_header(&header, width, height, channels);
+    if (flags & DDS_SAVE_MIPMAPS) {
+      header.dwFlags |= DDSD_MIPMAPCOUNT;
+      header.dwMipMapCount = level_count;
+      header.sCaps.dwCaps1 |= DDSCAPS_COMPLEX | DDSCAPS_MIPMAP;
+    }
+    if (flags & DDS_SAVE_CUBEMAP) {
+      header.sCaps.dwCaps1 |= DDSCAPS_COMPLEX;
+      header.sCaps.dwCaps2 =
+          DDSCAPS2_CUBEMAP | DDSCAPS2_CUBEMAP_POSITIVEX |
+          DDSCAPS2_CUBEMAP_NEGATIVEX | DDSCAPS2_CUBEMAP_POSITIVEY |
+          DDSCAPS2_CUBEMAP_NEGATIVEY | DDSCAPS2_CUBEMAP_POSITIVEZ |
+          DDSCAPS2_CUBEMAP_NEGATIVEZ;
+    }
+    func(context, &header, sizeof(DDS_header));
+    func(context, compressed, total_size);
+  }
   /*	done	*/
-  free(DDS_data);
-  return 1;
+  for (i = 0; i < job.surface_count; ++i) {
+    image_free(job.surfaces[i].resampled);
+  }
+  image_free(job.surfaces);
+  image_free(compressed);
+  return result;
 }
 
 unsigned char *convert_image_to_DXT1(const unsigned char *const uncompressed,
                                      int width, int height, int channels,
                                      int *out_size) {
+  return convert_image_to_DXT1_parallel(uncompressed, width, height, channels,
+                                        out_size, 1);
+}
+
+unsigned char *convert_image_to_DXT5(const unsigned char *const uncompressed,
+                                     int width, int height, int channels,
+                                     int *out_size) {
+  return convert_image_to_DXT5_parallel(uncompressed, width, height, channels,
+                                        out_size, 1);
+}
+
+/*	shared state for compressing one row of blocks per task	*/
+typedef struct {
+  const unsigned char *uncompressed;
+  int width, height, channels;
+  int block_row_size;
   unsigned char *compressed;
-  int i, j, x, y;
-  unsigned char ublock[16 * 3];
-  unsigned char cblock[8];
-  int index = 0, chan_step = 1;
-  int block_count = 0;
+} DXT_block_row_job;
+
+static void DXT1_block_row_task(void *context, int block_row) {
+  DXT_block_row_job *job = (DXT_block_row_job *)context;
+  compress_DXT1_block_row(job->uncompressed, job->width, job->height,
+                          job->channels, block_row * 4,
+                          job->compressed + block_row * job->block_row_size);
+}
+
+static void DXT5_block_row_task(void *context, int block_row) {
+  DXT_block_row_job *job = (DXT_block_row_job *)context;
+  compress_DXT5_block_row(job->uncompressed, job->width, job->height,
+                          job->channels, block_row * 4,
+                          job->compressed + block_row * job->block_row_size);
+}
+
+static unsigned char *convert_image_to_DXT_parallel(
+    const unsigned char *const uncompressed, int width, int height,
+    int channels, int *out_size, int thread_count, int block_size,
+    image_task_func task) {
+  DXT_block_row_job job;
+  int block_rows;
   /*	error check	*/
   *out_size = 0;
   if ((width < 1) || (height < 1) || (NULL == uncompressed) || (channels < 1) ||
       (channels > 4)) {
     return NULL;
   }
+  /*	get the RAM for the compressed image	*/
+  block_rows = (height + 3) >> 2;
+  job.uncompressed = uncompressed;
+  job.width = width;
+  job.height = height;
+  job.channels = channels;
+  job.block_row_size = ((width + 3) >> 2) * block_size;
+  job.compressed =
+      (unsigned char *)image_malloc(block_rows * job.block_row_size);
+  if (NULL == job.compressed) {
+    return NULL;
+  }
+  /*	every row of blocks lands at a fixed offset, so the
+          output does not depend on the number of threads	*/
+  image_parallel_for(block_rows, thread_count, task, &job);
+  *out_size = block_rows * job.block_row_size;
+  return job.compressed;
+}
+
+unsigned char *convert_image_to_DXT1_parallel(
+    const unsigned char *const uncompressed, int width, int height,
+    int channels, int *out_size, int thread_count) {
+  /*	8 bytes per 4x4 pixel block	*/
+  return convert_image_to_DXT_parallel(uncompressed, width, height, channels,
+                                       out_size, thread_count, 8,
+                                       DXT1_block_row_task);
+}
+
+unsigned char *convert_image_to_DXT5_parallel(
+    const unsigned char *const uncompressed, int width, int height,
+    int channels, int *out_size, int thread_count) {
+  /*	16 bytes per 4x4 pixel block	*/
+  return convert_image_to_DXT_parallel(uncompressed, width, height, channels,
+                                       out_size, thread_count, 16,
+                                       DXT5_block_row_task);
+}
+
+/*	the widest strip converted to YCoCg at a time: 4 rows of 256 RGBA
+        pixels is 4 KB, which is compressed while it is still in L1	*/
+#define DXT_YCOCG_STRIP_WIDTH 256
+
+static void DXT_YCoCg_block_row_task(void *context, int block_row) {
+  DXT_block_row_job *job = (DXT_block_row_job *)context;
+  unsigned char strip[4 * DXT_YCOCG_STRIP_WIDTH * 4];
+  const int j = block_row * 4;
+  const int rows = (job->height - j < 4) ? job->height - j : 4;
+  const int block_size = (job->channels == 3) ? 8 : 16;
+  unsigned char *compressed = job->compressed + block_row * job->block_row_size;
+  int i, y;
+  for (i = 0; i < job->width; i += DXT_YCOCG_STRIP_WIDTH) {
+    int columns = job->width - i;
+    if (columns > DXT_YCOCG_STRIP_WIDTH) {
+      columns = DXT_YCOCG_STRIP_WIDTH;
+    }
+    for (y = 0; y < rows; ++y) {
+      convert_RGB_to_YCoCg_copy(
+          job->uncompressed + ((j + y) * job->width + i) * job->channels,
+          columns, 1, job->channels, strip + y * columns * job->channels);
+    }
+    /*	the strip is a tiny image of its own; its blocks are the same
+            as they would be in the whole image	*/
+    if (job->channels == 3) {
+      compress_DXT1_block_row(strip, columns, rows, 3, 0,
+                              compressed + (i >> 2) * block_size);
+    } else {
+      compress_DXT5_block_row(strip, columns, rows, 4, 0,
+                              compressed + (i >> 2) * block_size);
+    }
+  }
+}
+
+unsigned char *convert_image_to_DXT_YCoCg(
+    const unsigned char *const uncompressed, int width, int height,
+    int channels, int *out_size, int thread_count) {
+  /*	error check	*/
+  *out_size = 0;
+  if ((channels < 3) || (channels > 4)) {
+    return NULL;
+  }
+  return convert_image_to_DXT_parallel(uncompressed, width, height, channels,
+                                       out_size, thread_count,
+                                       (channels == 3) ? 8 : 16,
+                                       DXT_YCoCg_block_row_task);
+}
+
+/*	shared state for decoding one row of blocks per task	*/
+typedef struct {
+  const unsigned char *compressed;
+  int format, width, height;
+  int block_size, block_row_size;
+  unsigned char *rgba;
+  DDS_decode_block_func kernel;
+} DXT_decode_job;
+
+static void DXT_decode_block_row_task(void *context, int block_row) {
+  DXT_decode_job *job = (DXT_decode_job *)context;
+  const unsigned char *block =
+      job->compressed + (size_t)block_row * job->block_row_size;
+  const size_t stride = (size_t)job->width * 4;
+  const int j = block_row * 4;
+  const int rows = (job->height - j < 4) ? job->height - j : 4;
+  unsigned char *row = job->rgba + j * stride;
+  unsigned char partial[16 * 4];
+  int i, y;
+  for (i = 0; i < job->width; i += 4, block += job->block_size) {
+    int columns = job->width - i;
+    if ((rows == 4) && (columns >= 4)) {
+      job->kernel(block, job->format, row + i * 4, (int)stride);
+      continue;
+    }
+    /*	an edge block: decode it whole, keep the part inside the image	*/
+    if (columns > 4) {
+      columns = 4;
+    }
+    job->kernel(block, job->format, partial, 16);
+    for (y = 0; y < rows; ++y) {
+      memcpy(row + y * stride + i * 4, partial + y * 16, columns * 4);
+    }
+  }
+}
+
+int decode_DXT_image(const unsigned char *const compressed, int format,
+                     int width, int height, unsigned char *rgba,
+                     int thread_count) {
+  DXT_decode_job job;
+  /*	error check	*/
+  if ((NULL == compressed) || (NULL == rgba) || (width < 1) || (height < 1) ||
+      (format < DDS_FORMAT_DXT1) || (format > DDS_FORMAT_BC5)) {
+    return 0;
+  }
+  job.compressed = compressed;
+  job.format = format;
+  job.width = width;
+  job.height = height;
+  job.block_size =
+      ((format == DDS_FORMAT_DXT1) || (format == DDS_FORMAT_BC4)) ? 8 : 16;
+  job.block_row_size = ((width + 3) >> 2) * job.block_size;
+  job.rgba = rgba;
+  /*	pick the kernel here, before any of the threads need it	*/
+  job.kernel = decode_DDS_block_scalar;
+#ifdef IMAGE_SIMD_X86
+  if (image_cpu_features() & IMAGE_CPU_SSSE3) {
+    job.kernel = decode_DDS_block_SSSE3;
+  }
+#endif
+  /*	each row of blocks writes its own 4 scanlines	*/
+  image_parallel_for((height + 3) >> 2, thread_count,
+                     DXT_decode_block_row_task, &job);
+  return 1;
+}
+
+void compress_DXT1_block_row(const unsigned char *const uncompressed,
+                             int width, int height, int channels, int j,
+                             unsigned char *compressed) {
+  int i, x, y;
+  unsigned char ublock[16 * 3];
+  unsigned char cblock[8];
+  int index = 0, chan_step = 1;
   /*	for channels == 1 or 2, I do not step forward for R,G,B values	*/
   if (channels < 3) {
     chan_step = 0;
   }
-  /*	get the RAM for the compressed image
-          (8 bytes per 4x4 pixel block)	*/
-  *out_size = ((width + 3) >> 2) * ((height + 3) >> 2) * 8;
-  compressed = (unsigned char *)malloc(*out_size);
-  /*	go through each block	*/
-  for (j = 0; j < height; j += 4) {
-    for (i = 0; i < width; i += 4) {
-      /*	copy this block into a new one	*/
-      int idx = 0;
-      int mx = 4, my = 4;
-      if (j + 4 >= height) {
-        my = height - j;
-      }
-      if (i + 4 >= width) {
-        mx = width - i;
-      }
-      for (y = 0; y < my; ++y) {
-        for (x = 0; x < mx; ++x) {
-          ublock[idx++] =
-              uncompressed[(j + y) * width * channels + (i + x) * channels];
-          ublock[idx++] = uncompressed[(j + y) * width * channels +
-                                       (i + x) * channels + chan_step];
-          ublock[idx++] =
-              uncompressed[(j + y) * width * channels + (i + x) * channels +
-                           chan_step + chan_step];
-        }
-        for (x = mx; x < 4; ++x) {
-          ublock[idx++] = ublock[0];
-          ublock[idx++] = ublock[1];
-          ublock[idx++] = ublock[2];
-        }
+  for (i = 0; i < width; i += 4) {
+    /*	copy this block into a new one	*/
+    int idx = 0;
+    int mx = 4, my = 4;
+    if (j + 4 >= height) {
+      my = height - j;
+    }
+    if (i + 4 >= width) {
+      mx = width - i;
+    }
+    for (y = 0; y < my; ++y) {
+      for (x = 0; x < mx; ++x) {
+        ublock[idx++] =
+            uncompressed[(j + y) * width * channels + (i + x) * channels];
+        ublock[idx++] = uncompressed[(j + y) * width * channels +
+                                     (i + x) * channels + chan_step];
+        ublock[idx++] =
+            uncompressed[(j + y) * width * channels + (i + x) * channels +
+                         chan_step + chan_step];
       }
-      for (y = my; y < 4; ++y) {
-        for (x = 0; x < 4; ++x) {
-          ublock[idx++] = ublock[0];
-          ublock[idx++] = ublock[1];
-          ublock[idx++] = ublock[2];
-        }
+      for (x = mx; x < 4; ++x) {
+        ublock[idx++] = ublock[0];
+        ublock[idx++] = ublock[1];
+        ublock[idx++] = ublock[2];
       }
-      /*	compress the block	*/
-      ++block_count;
-      compress_DDS_color_block(3, ublock, cblock);
-      /*	copy the data from the block into the main block	*/
-      for (x = 0; x < 8; ++x) {
-        compressed[index++] = cblock[x];
+    }
+    for (y = my; y < 4; ++y) {
+      for (x = 0; x < 4; ++x) {
+        ublock[idx++] = ublock[0];
+        ublock[idx++] = ublock[1];
+        ublock[idx++] = ublock[2];
       }
     }
+    /*	compress the block	*/
+    compress_DDS_color_block(3, ublock, cblock);
+    /*	copy the data from the block into the main block	*/
+    for (x = 0; x < 8; ++x) {
+      compressed[index++] = cblock[x];
+    }
   }
-  return compressed;
 }
 
-unsigned char *convert_image_to_DXT5(const unsigned char *const uncompressed,
-                                     int width, int height, int channels,
-                                     int *out_size) {
-  unsigned char *compressed;
-  int i, j, x, y;
+void compress_DXT5_block_row(const unsigned char *const uncompressed,
+                             int width, int height, int channels, int j,
+                             unsigned char *compressed) {
+  int i, x, y;
   unsigned char ublock[16 * 4];
   unsigned char cblock[8];
   int index = 0, chan_step = 1;
-  int block_count = 0, has_alpha;
-  /*	error check	*/
-  *out_size = 0;
-  if ((width < 1) || (height < 1) || (NULL == uncompressed) || (channels < 1) ||
-      (channels > 4)) {
-    return NULL;
-  }
+  int has_alpha;
   /*	for channels == 1 or 2, I do not step forward for R,G,B vales	*/
   if (channels < 3) {
     chan_step = 0;
   }
   /*	# channels = 1 or 3 have no alpha, 2 & 4 do have alpha	*/
   has_alpha = 1 - (channels & 1);
-  /*	get the RAM for the compressed image
-          (16 bytes per 4x4 pixel block)	*/
-  *out_size = ((width + 3) >> 2) * ((height + 3) >> 2) * 16;
-  compressed = (unsigned char *)malloc(*out_size);
-  /*	go through each block	*/
-  for (j = 0; j < height; j += 4) {
-    for (i = 0; i < width; i += 4) {
-      /*	local variables, and my block counter	*/
-      int idx = 0;
-      int mx = 4, my = 4;
-      if (j + 4 >= height) {
-        my = height - j;
-      }
-      if (i + 4 >= width) {
-        mx = width - i;
-      }
-      for (y = 0; y < my; ++y) {
-        for (x = 0; x < mx; ++x) {
-          ublock[idx++] =
-              uncompressed[(j + y) * width * channels + (i + x) * channels];
-          ublock[idx++] = uncompressed[(j + y) * width * channels +
-                                       (i + x) * channels + chan_step];
-          ublock[idx++] =
-              uncompressed[(j + y) * width * channels + (i + x) * channels +
-                           chan_step + chan_step];
-          ublock[idx++] =
-              has_alpha * uncompressed[(j + y) * width * channels +
-                                       (i + x) * channels + channels - 1] +
-              (1 - has_alpha) * 255;
-        }
-        for (x = mx; x < 4; ++x) {
-          ublock[idx++] = ublock[0];
-          ublock[idx++] = ublock[1];
-          ublock[idx++] = ublock[2];
-          ublock[idx++] = ublock[3];
-        }
-      }
-      for (y = my; y < 4; ++y) {
-        for (x = 0; x < 4; ++x) {
-          ublock[idx++] = ublock[0];
-          ublock[idx++] = ublock[1];
-          ublock[idx++] = ublock[2];
-          ublock[idx++] = ublock[3];
-        }
+  for (i = 0; i < width; i += 4) {
+    /*	local variables, and my block counter	*/
+    int idx = 0;
+    int mx = 4, my = 4;
+    if (j + 4 >= height) {
+      my = height - j;
+    }
+    if (i + 4 >= width) {
+      mx = width - i;
+    }
+    for (y = 0; y < my; ++y) {
+      for (x = 0; x < mx; ++x) {
+        ublock[idx++] =
+            uncompressed[(j + y) * width * channels + (i + x) * channels];
+        ublock[idx++] = uncompressed[(j + y) * width * channels +
+                                     (i + x) * channels + chan_step];
+        ublock[idx++] =
+            uncompressed[(j + y) * width * channels + (i + x) * channels +
+                         chan_step + chan_step];
+        ublock[idx++] =
+            has_alpha * uncompressed[(j + y) * width * channels +
+                                     (i + x) * channels + channels - 1] +
+            (1 - has_alpha) * 255;
       }
-      /*	now compress the alpha block	*/
-      compress_DDS_alpha_block(ublock, cblock);
-      /*	copy the data from the compressed alpha block into the main
-       * buffer	*/
-      for (x = 0; x < 8; ++x) {
-        compressed[index++] = cblock[x];
+      for (x = mx; x < 4; ++x) {
+        ublock[idx++] = ublock[0];
+        ublock[idx++] = ublock[1];
+        ublock[idx++] = ublock[2];
+        ublock[idx++] = ublock[3];
       }
-      /*	then compress the color block	*/
-      ++block_count;
-      compress_DDS_color_block(4, ublock, cblock);
-      /*	copy the data from the compressed color block into the main
-       * buffer	*/
-      for (x = 0; x < 8; ++x) {
-        compressed[index++] = cblock[x];
+    }
+    for (y = my; y < 4; ++y) {
+      for (x = 0; x < 4; ++x) {
+        ublock[idx++] = ublock[0];
+        ublock[idx++] = ublock[1];
+        ublock[idx++] = ublock[2];
+        ublock[idx++] = ublock[3];
       }
     }
+    /*	now compress the alpha block	*/
+    compress_DDS_alpha_block(ublock, cblock);
+    /*	copy the data from the compressed alpha block into the main
+     * buffer	*/
+    for (x = 0; x < 8; ++x) {
+      compressed[index++] = cblock[x];
+    }
+    /*	then compress the color block	*/
+    compress_DDS_color_block(4, ublock, cblock);
+    /*	copy the data from the compressed color block into the main
+     * buffer	*/
+    for (x = 0; x < 8; ++x) {
+      compressed[index++] = cblock[x];
+    }
   }
-  return compressed;
 }
 
 /********* Helper Functions *********/
@@ -264,8 +779,8 @@ void rgb_888_from_565(unsigned int c, int *r, int *g, int *b) {
 void compute_color_line_STDEV(const unsigned char *const uncompressed,
                               int channels, float point[3],
                               float direction[3]) {
-  const float inv_16 = 1.0f / 16.0f;
   int i;
+  float sums[9];
   float sum_r = 0.0f, sum_g = 0.0f, sum_b = 0.0f;
   float sum_rr = 0.0f, sum_gg = 0.0f, sum_bb = 0.0f;
   float sum_rg = 0.0f, sum_rb = 0.0f, sum_gb = 0.0f;
@@ -282,6 +797,24 @@ void compute_color_line_STDEV(const unsigned char *const uncompressed,
     sum_rb += uncompressed[i + 0] * uncompressed[i + 2];
     sum_gb += uncompressed[i + 1] * uncompressed[i + 2];
   }
+  sums[0] = sum_r;
+  sums[1] = sum_g;
+  sums[2] = sum_b;
+  sums[3] = sum_rr;
+  sums[4] = sum_gg;
+  sums[5] = sum_bb;
+  sums[6] = sum_rg;
+  sums[7] = sum_rb;
+  sums[8] = sum_gb;
+  compute_color_line_from_sums(sums, point, direction);
+}
+
+void compute_color_line_from_sums(const float sums[9], float point[3],
+                                  float direction[3]) {
+  const float inv_16 = 1.0f / 16.0f;
+  float sum_r = sums[0], sum_g = sums[1], sum_b = sums[2];
+  float sum_rr = sums[3], sum_gg = sums[4], sum_bb = sums[5];
+  float sum_rg = sums[6], sum_rb = sums[7], sum_gb = sums[8];
   /*	convert the sums to averages	*/
   sum_r *= inv_16;
   sum_g *= inv_16;
@@ -367,22 +900,17 @@ void compute_color_line_STDEV(const unsigned char *const uncompressed,
 
 void LSE_master_colors_max_min(int *cmax, int *cmin, int channels,
                                const unsigned char *const uncompressed) {
-  int i, j;
-  /*	the master colors	*/
-  int c0[3], c1[3];
+  int i;
   /*	used for fitting the line	*/
   float sum_x[] = {0.0f, 0.0f, 0.0f};
   float sum_x2[] = {0.0f, 0.0f, 0.0f};
   float dot_max = 1.0f, dot_min = -1.0f;
-  float vec_len2 = 0.0f;
   float dot;
   /*	error check	*/
   if ((channels < 3) || (channels > 4)) {
     return;
   }
   compute_color_line_STDEV(uncompressed, channels, sum_x, sum_x2);
-  vec_len2 = 1.0f / (0.00001f + sum_x2[0] * sum_x2[0] + sum_x2[1] * sum_x2[1] +
-                     sum_x2[2] * sum_x2[2]);
   /*	finding the max and min vector values	*/
   dot_max = (sum_x2[0] * uncompressed[0] + sum_x2[1] * uncompressed[1] +
              sum_x2[2] * uncompressed[2]);
@@ -397,6 +925,18 @@ void LSE_master_colors_max_min(int *cmax, int *cmin, int channels,
       dot_max = dot;
     }
   }
+  LSE_master_colors_from_line(cmax, cmin, sum_x, sum_x2, dot_min, dot_max);
+}
+
+void LSE_master_colors_from_line(int *cmax, int *cmin, const float sum_x[3],
+                                 const float sum_x2[3], float dot_min,
+                                 float dot_max) {
+  int i, j;
+  /*	the master colors	*/
+  int c0[3], c1[3];
+  float vec_len2 = 1.0f / (0.00001f + sum_x2[0] * sum_x2[0] +
+                           sum_x2[1] * sum_x2[1] + sum_x2[2] * sum_x2[2]);
+  float dot;
   /*	and the offset (from the average location)	*/
   dot = sum_x2[0] * sum_x[0] + sum_x2[1] * sum_x[1] + sum_x2[2] * sum_x[2];
   dot_min -= dot;
@@ -436,17 +976,64 @@ void LSE_master_colors_max_min(int *cmax, int *cmin, int channels,
 void compress_DDS_color_block(int channels,
                               const unsigned char *const uncompressed,
                               unsigned char compressed[8]) {
+  /*	pick the widest kernel this CPU runs, once	*/
+  static DDS_color_block_func kernel = NULL;
+  if (NULL == kernel) {
+    kernel = compress_DDS_color_block_scalar;
+#ifdef IMAGE_SIMD_X86
+    if (image_cpu_features() & IMAGE_CPU_AVX2) {
+      kernel = compress_DDS_color_block_AVX2;
+    } else if (image_cpu_features() & IMAGE_CPU_SSE2) {
+      kernel = compress_DDS_color_block_SSE2;
+    }
+#endif
+  }
+  kernel(channels, uncompressed, compressed);
+}
+
+void compress_DDS_color_block_scalar(int channels,
+                                     const unsigned char *const uncompressed,
+                                     unsigned char compressed[8]) {
   /*	variables	*/
   int i;
   int next_bit;
   int enc_c0, enc_c1;
-  int c0[4], c1[4];
   float color_line[] = {0.0f, 0.0f, 0.0f, 0.0f};
-  float vec_len2 = 0.0f, dot_offset = 0.0f;
+  float dot_offset = 0.0f;
   /*	stupid order	*/
   int swizzle4[] = {0, 2, 3, 1};
   /*	get the master colors	*/
   LSE_master_colors_max_min(&enc_c0, &enc_c1, channels, uncompressed);
+  DDS_color_block_line(enc_c0, enc_c1, compressed, color_line, &dot_offset);
+  /*	store the rest of the bits	*/
+  next_bit = 8 * 4;
+  for (i = 0; i < 16; ++i) {
+    /*	find the dot product of this color, to place it on the line
+            (should be [-1,1])	*/
+    int next_value = 0;
+    float dot_product = color_line[0] * uncompressed[i * channels + 0] +
+                        color_line[1] * uncompressed[i * channels + 1] +
+                        color_line[2] * uncompressed[i * channels + 2] -
+                        dot_offset;
+    /*	map to [0,3]	*/
+    next_value = (int)(dot_product * 3.0f + 0.5f);
+    if (next_value > 3) {
+      next_value = 3;
+    } else if (next_value < 0) {
+      next_value = 0;
+    }
+    /*	OK, store this value	*/
+    compressed[next_bit >> 3] |= swizzle4[next_value] << (next_bit & 7);
+    next_bit += 2;
+  }
+  /*	done compressing to DXT1	*/
+}
+
+void DDS_color_block_line(int enc_c0, int enc_c1, unsigned char compressed[8],
+                          float color_line[3], float *dot_offset) {
+  int i;
+  int c0[4], c1[4];
+  float vec_len2 = 0.0f;
   /*	store the 565 color 0 and color 1	*/
   compressed[0] = (enc_c0 >> 0) & 255;
   compressed[1] = (enc_c0 >> 8) & 255;
@@ -474,32 +1061,259 @@ void compress_DDS_color_block(int channels,
   color_line[1] *= vec_len2;
   color_line[2] *= vec_len2;
   /*	compute the offset (constant) portion of the dot product	*/
-  dot_offset =
+  *dot_offset =
       color_line[0] * c0[0] + color_line[1] * c0[1] + color_line[2] * c0[2];
-  /*	store the rest of the bits	*/
-  next_bit = 8 * 4;
+}
+
+#ifdef IMAGE_SIMD_X86
+/*
+        The SIMD kernels below are bit-exact with the scalar ones: the
+        covariance sums are integers below 2^24 (so exact in any order),
+        and every dot product is evaluated with the same operations in
+        the same order as the scalar code, just 4 or 8 pixels at a time.
+        That only holds if the scalar code is not contracted into FMAs
+        (e.g. -ffp-contract=fast with -mfma); in that case the endpoints
+        differ by at most one rounding step in the line fit.
+*/
+
+/*	expands a 3 channel block to 4 so both can be loaded the same way	*/
+static const unsigned char *DDS_block_as_RGBX(
+    int channels, const unsigned char *const uncompressed,
+    unsigned char rgbx[16 * 4]) {
+  int i;
+  if (channels == 4) {
+    return uncompressed;
+  }
   for (i = 0; i < 16; ++i) {
-    /*	find the dot product of this color, to place it on the line
-            (should be [-1,1])	*/
-    int next_value = 0;
-    float dot_product = color_line[0] * uncompressed[i * channels + 0] +
-                        color_line[1] * uncompressed[i * channels + 1] +
-                        color_line[2] * uncompressed[i * channels + 2] -
-                        dot_offset;
-    /*	map to [0,3]	*/
-    next_value = (int)(dot_product * 3.0f + 0.5f);
-    if (next_value > 3) {
-      next_value = 3;
-    } else if (next_value < 0) {
-      next_value = 0;
-    }
-    /*	OK, store this value	*/
-    compressed[next_bit >> 3] |= swizzle4[next_value] << (next_bit & 7);
-    next_bit += 2;
+    rgbx[i * 4 + 0] = uncompressed[i * 3 + 0];
+    rgbx[i * 4 + 1] = uncompressed[i * 3 + 1];
+    rgbx[i * 4 + 2] = uncompressed[i * 3 + 2];
+    rgbx[i * 4 + 3] = 0;
   }
-  /*	done compressing to DXT1	*/
+  return rgbx;
+}
+
+/*	swizzles 16 indices in [0,3] into the DXT order and packs them
+        into bytes 4 to 7 of the block; inlined into both kernels	*/
+static inline void DDS_store_indices_SSE2(__m128i i0, __m128i i1, __m128i i2,
+                                          __m128i i3,
+                                          unsigned char compressed[8]) {
+  const __m128i one = _mm_set1_epi8(1);
+  __m128i v, hi, s;
+  unsigned int bits;
+  /*	16 bytes, one per pixel	*/
+  v = _mm_packus_epi16(_mm_packs_epi32(i0, i1), _mm_packs_epi32(i2, i3));
+  /*	{0, 1, 2, 3} -> {0, 2, 3, 1}: the low bit becomes the old high bit
+          and the high bit becomes the xor of the two	*/
+  hi = _mm_and_si128(_mm_srli_epi16(v, 1), one);
+  s = _mm_or_si128(hi,
+                   _mm_add_epi8(_mm_xor_si128(_mm_and_si128(v, one), hi),
+                                _mm_xor_si128(_mm_and_si128(v, one), hi)));
+  /*	merge neighbours: 2 bits per byte -> 4 per word -> 8 per dword	*/
+  s = _mm_or_si128(_mm_and_si128(s, _mm_set1_epi16(0x00FF)),
+                   _mm_slli_epi16(_mm_srli_epi16(s, 8), 2));
+  s = _mm_or_si128(_mm_and_si128(s, _mm_set1_epi32(0x0000FFFF)),
+                   _mm_slli_epi32(_mm_srli_epi32(s, 16), 4));
+  s = _mm_packus_epi16(_mm_packs_epi32(s, s), s);
+  bits = (unsigned int)_mm_cvtsi128_si32(s);
+  compressed[4] = (bits >> 0) & 255;
+  compressed[5] = (bits >> 8) & 255;
+  compressed[6] = (bits >> 16) & 255;
+  compressed[7] = (bits >> 24) & 255;
+}
+
+static float DDS_hsum_SSE2(__m128 v) {
+  v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+  v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+  return _mm_cvtss_f32(v);
+}
+
+static float DDS_hmin_SSE2(__m128 v) {
+  v = _mm_min_ps(v, _mm_movehl_ps(v, v));
+  v = _mm_min_ss(v, _mm_shuffle_ps(v, v, 1));
+  return _mm_cvtss_f32(v);
+}
+
+static float DDS_hmax_SSE2(__m128 v) {
+  v = _mm_max_ps(v, _mm_movehl_ps(v, v));
+  v = _mm_max_ss(v, _mm_shuffle_ps(v, v, 1));
+  return _mm_cvtss_f32(v);
+}
+
+void compress_DDS_color_block_SSE2(int channels,
+                                   const unsigned char *const uncompressed,
+                                   unsigned char compressed[8]) {
+  unsigned char rgbx[16 * 4];
+  const unsigned char *block;
+  const __m128i mask = _mm_set1_epi32(255);
+  __m128 r[4], g[4], b[4], acc[9], d0, d1, d2, lo, hi, off;
+  float sums[9], point[3], direction[3], color_line[3], dot_offset;
+  __m128i indices[4];
+  int i, k, enc_c0, enc_c1;
+  if ((channels < 3) || (channels > 4)) {
+    return;
+  }
+  /*	split the pixels into R, G and B planes, 4 pixels per register	*/
+  block = DDS_block_as_RGBX(channels, uncompressed, rgbx);
+  for (k = 0; k < 4; ++k) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(block + k * 16));
+    r[k] = _mm_cvtepi32_ps(_mm_and_si128(v, mask));
+    g[k] = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(v, 8), mask));
+    b[k] = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(v, 16), mask));
+  }
+  /*	the covariance sums	*/
+  for (i = 0; i < 9; ++i) {
+    acc[i] = _mm_setzero_ps();
+  }
+  for (k = 0; k < 4; ++k) {
+    acc[0] = _mm_add_ps(acc[0], r[k]);
+    acc[1] = _mm_add_ps(acc[1], g[k]);
+    acc[2] = _mm_add_ps(acc[2], b[k]);
+    acc[3] = _mm_add_ps(acc[3], _mm_mul_ps(r[k], r[k]));
+    acc[4] = _mm_add_ps(acc[4], _mm_mul_ps(g[k], g[k]));
+    acc[5] = _mm_add_ps(acc[5], _mm_mul_ps(b[k], b[k]));
+    acc[6] = _mm_add_ps(acc[6], _mm_mul_ps(r[k], g[k]));
+    acc[7] = _mm_add_ps(acc[7], _mm_mul_ps(r[k], b[k]));
+    acc[8] = _mm_add_ps(acc[8], _mm_mul_ps(g[k], b[k]));
+  }
+  for (i = 0; i < 9; ++i) {
+    sums[i] = DDS_hsum_SSE2(acc[i]);
+  }
+  compute_color_line_from_sums(sums, point, direction);
+  /*	project onto the principal axis for the extremes	*/
+  d0 = _mm_set1_ps(direction[0]);
+  d1 = _mm_set1_ps(direction[1]);
+  d2 = _mm_set1_ps(direction[2]);
+  for (k = 0; k < 4; ++k) {
+    __m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(d0, r[k]), _mm_mul_ps(d1, g[k])),
+                            _mm_mul_ps(d2, b[k]));
+    lo = k ? _mm_min_ps(lo, dot) : dot;
+    hi = k ? _mm_max_ps(hi, dot) : dot;
+  }
+  LSE_master_colors_from_line(&enc_c0, &enc_c1, point, direction,
+                              DDS_hmin_SSE2(lo), DDS_hmax_SSE2(hi));
+  DDS_color_block_line(enc_c0, enc_c1, compressed, color_line, &dot_offset);
+  /*	and map every pixel to the nearest of the 4 palette entries	*/
+  d0 = _mm_set1_ps(color_line[0]);
+  d1 = _mm_set1_ps(color_line[1]);
+  d2 = _mm_set1_ps(color_line[2]);
+  off = _mm_set1_ps(dot_offset);
+  for (k = 0; k < 4; ++k) {
+    __m128 dot = _mm_sub_ps(
+        _mm_add_ps(_mm_add_ps(_mm_mul_ps(d0, r[k]), _mm_mul_ps(d1, g[k])),
+                   _mm_mul_ps(d2, b[k])),
+        off);
+    dot = _mm_add_ps(_mm_mul_ps(dot, _mm_set1_ps(3.0f)), _mm_set1_ps(0.5f));
+    dot = _mm_min_ps(_mm_max_ps(dot, _mm_setzero_ps()), _mm_set1_ps(3.0f));
+    indices[k] = _mm_cvttps_epi32(dot);
+  }
+  DDS_store_indices_SSE2(indices[0], indices[1], indices[2], indices[3],
+                         compressed);
+}
+
+/*	these repeat the SSE2 reductions so that the AVX2 kernel never
+        mixes in legacy SSE encodings, which stalls on the transition	*/
+IMAGE_TARGET_AVX2 static float DDS_hsum_AVX2(__m256 v) {
+  __m128 h = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+  h = _mm_add_ps(h, _mm_movehl_ps(h, h));
+  h = _mm_add_ss(h, _mm_shuffle_ps(h, h, 1));
+  return _mm_cvtss_f32(h);
+}
+
+IMAGE_TARGET_AVX2 static float DDS_hmin_AVX2(__m256 v) {
+  __m128 h = _mm_min_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+  h = _mm_min_ps(h, _mm_movehl_ps(h, h));
+  h = _mm_min_ss(h, _mm_shuffle_ps(h, h, 1));
+  return _mm_cvtss_f32(h);
 }
 
+IMAGE_TARGET_AVX2 static float DDS_hmax_AVX2(__m256 v) {
+  __m128 h = _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+  h = _mm_max_ps(h, _mm_movehl_ps(h, h));
+  h = _mm_max_ss(h, _mm_shuffle_ps(h, h, 1));
+  return _mm_cvtss_f32(h);
+}
+
+IMAGE_TARGET_AVX2
+void compress_DDS_color_block_AVX2(int channels,
+                                   const unsigned char *const uncompressed,
+                                   unsigned char compressed[8]) {
+  unsigned char rgbx[16 * 4];
+  const unsigned char *block;
+  const __m256i mask = _mm256_set1_epi32(255);
+  __m256 r[2], g[2], b[2], acc[9], d0, d1, d2, lo, hi, off, dot[2];
+  float sums[9], point[3], direction[3], color_line[3], dot_offset;
+  float dot_min, dot_max;
+  __m256i indices[2];
+  int i, k, enc_c0, enc_c1;
+  if ((channels < 3) || (channels > 4)) {
+    return;
+  }
+  /*	split the pixels into R, G and B planes, 8 pixels per register	*/
+  block = DDS_block_as_RGBX(channels, uncompressed, rgbx);
+  for (k = 0; k < 2; ++k) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(block + k * 32));
+    r[k] = _mm256_cvtepi32_ps(_mm256_and_si256(v, mask));
+    g[k] = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(v, 8), mask));
+    b[k] = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(v, 16), mask));
+  }
+  /*	the covariance sums	*/
+  acc[0] = _mm256_add_ps(r[0], r[1]);
+  acc[1] = _mm256_add_ps(g[0], g[1]);
+  acc[2] = _mm256_add_ps(b[0], b[1]);
+  acc[3] = _mm256_add_ps(_mm256_mul_ps(r[0], r[0]), _mm256_mul_ps(r[1], r[1]));
+  acc[4] = _mm256_add_ps(_mm256_mul_ps(g[0], g[0]), _mm256_mul_ps(g[1], g[1]));
+  acc[5] = _mm256_add_ps(_mm256_mul_ps(b[0], b[0]), _mm256_mul_ps(b[1], b[1]));
+  acc[6] = _mm256_add_ps(_mm256_mul_ps(r[0], g[0]), _mm256_mul_ps(r[1], g[1]));
+  acc[7] = _mm256_add_ps(_mm256_mul_ps(r[0], b[0]), _mm256_mul_ps(r[1], b[1]));
+  acc[8] = _mm256_add_ps(_mm256_mul_ps(g[0], b[0]), _mm256_mul_ps(g[1], b[1]));
+  for (i = 0; i < 9; ++i) {
+    sums[i] = DDS_hsum_AVX2(acc[i]);
+  }
+  /*	the shared scalar helpers use legacy SSE encodings	*/
+  _mm256_zeroupper();
+  compute_color_line_from_sums(sums, point, direction);
+  /*	project onto the principal axis for the extremes	*/
+  d0 = _mm256_set1_ps(direction[0]);
+  d1 = _mm256_set1_ps(direction[1]);
+  d2 = _mm256_set1_ps(direction[2]);
+  for (k = 0; k < 2; ++k) {
+    dot[k] = _mm256_add_ps(
+        _mm256_add_ps(_mm256_mul_ps(d0, r[k]), _mm256_mul_ps(d1, g[k])),
+        _mm256_mul_ps(d2, b[k]));
+  }
+  lo = _mm256_min_ps(dot[0], dot[1]);
+  hi = _mm256_max_ps(dot[0], dot[1]);
+  dot_min = DDS_hmin_AVX2(lo);
+  dot_max = DDS_hmax_AVX2(hi);
+  _mm256_zeroupper();
+  LSE_master_colors_from_line(&enc_c0, &enc_c1, point, direction, dot_min,
+                              dot_max);
+  DDS_color_block_line(enc_c0, enc_c1, compressed, color_line, &dot_offset);
+  /*	and map every pixel to the nearest of the 4 palette entries	*/
+  d0 = _mm256_set1_ps(color_line[0]);
+  d1 = _mm256_set1_ps(color_line[1]);
+  d2 = _mm256_set1_ps(color_line[2]);
+  off = _mm256_set1_ps(dot_offset);
+  for (k = 0; k < 2; ++k) {
+    __m256 v = _mm256_sub_ps(
+        _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(d0, r[k]),
+                                    _mm256_mul_ps(d1, g[k])),
+                      _mm256_mul_ps(d2, b[k])),
+        off);
+    v = _mm256_add_ps(_mm256_mul_ps(v, _mm256_set1_ps(3.0f)),
+                      _mm256_set1_ps(0.5f));
+    v = _mm256_min_ps(_mm256_max_ps(v, _mm256_setzero_ps()),
+                      _mm256_set1_ps(3.0f));
+    indices[k] = _mm256_cvttps_epi32(v);
+  }
+  DDS_store_indices_SSE2(_mm256_castsi256_si128(indices[0]),
+                         _mm256_extracti128_si256(indices[0], 1),
+                         _mm256_castsi256_si128(indices[1]),
+                         _mm256_extracti128_si256(indices[1], 1), compressed);
+}
+#endif
+
 void compress_DDS_alpha_block(const unsigned char *const uncompressed,
                               unsigned char compressed[8]) {
   /*	variables	*/
@@ -546,3 +1360,248 @@ void compress_DDS_alpha_block(const unsigned char *const uncompressed,
   }
   /*	done compressing to DXT1	*/
 }
+
+/*	the 4 colors of a color block, as RGBA; a DXT1 block whose first
+        color is not the larger one has 3 colors and transparent black	*/
+static void DDS_color_palette(const unsigned char block[8], int dxt1,
+                              unsigned char palette[16]) {
+  int i, r, g, b;
+  int c0 = block[0] + (block[1] << 8);
+  int c1 = block[2] + (block[3] << 8);
+  rgb_888_from_565(c0, &r, &g, &b);
+  palette[0] = r;
+  palette[1] = g;
+  palette[2] = b;
+  rgb_888_from_565(c1, &r, &g, &b);
+  palette[4] = r;
+  palette[5] = g;
+  palette[6] = b;
+  if (!dxt1 || (c0 > c1)) {
+    /*	2 interpolated colors	*/
+    for (i = 0; i < 3; ++i) {
+      palette[8 + i] = (2 * palette[i] + palette[4 + i]) / 3;
+      palette[12 + i] = (palette[i] + 2 * palette[4 + i]) / 3;
+    }
+    palette[15] = 255;
+  } else {
+    /*	1 interpolated color, and transparent black	*/
+    for (i = 0; i < 3; ++i) {
+      palette[8 + i] = (palette[i] + palette[4 + i]) / 2;
+      palette[12 + i] = 0;
+    }
+    palette[15] = 0;
+  }
+  palette[3] = palette[7] = palette[11] = 255;
+}
+
+/*	the 8 values of a DXT5 alpha (or BC4) block	*/
+static void DDS_value_palette(const unsigned char block[8],
+                              unsigned char palette[8]) {
+  int a0 = block[0], a1 = block[1];
+  palette[0] = a0;
+  palette[1] = a1;
+  if (a0 > a1) {
+    /*	6 step intermediate	*/
+    palette[2] = (6 * a0 + 1 * a1) / 7;
+    palette[3] = (5 * a0 + 2 * a1) / 7;
+    palette[4] = (4 * a0 + 3 * a1) / 7;
+    palette[5] = (3 * a0 + 4 * a1) / 7;
+    palette[6] = (2 * a0 + 5 * a1) / 7;
+    palette[7] = (1 * a0 + 6 * a1) / 7;
+  } else {
+    /*	4 step intermediate, plus none and full	*/
+    palette[2] = (4 * a0 + 1 * a1) / 5;
+    palette[3] = (3 * a0 + 2 * a1) / 5;
+    palette[4] = (2 * a0 + 3 * a1) / 5;
+    palette[5] = (1 * a0 + 4 * a1) / 5;
+    palette[6] = 0;
+    palette[7] = 255;
+  }
+}
+
+/*	the 16 values of a DXT5 alpha (or BC4) block, 3 bits each	*/
+static void DDS_decode_values(const unsigned char block[8],
+                              unsigned char values[16]) {
+  unsigned char palette[8];
+  int i;
+  DDS_value_palette(block, palette);
+  for (i = 0; i < 16; i += 8) {
+    /*	8 values fill 3 bytes	*/
+    const unsigned char *b = block + 2 + (i >> 3) * 3;
+    unsigned int bits = b[0] | (b[1] << 8) | (b[2] << 16);
+    int k;
+    for (k = 0; k < 8; ++k) {
+      values[i + k] = palette[(bits >> (3 * k)) & 7];
+    }
+  }
+}
+
+void decode_DDS_block_scalar(const unsigned char *block, int format,
+                             unsigned char *rgba, int stride) {
+  unsigned char palette[16], alpha[16], green[16];
+  const unsigned char *color = block;
+  unsigned int bits;
+  int i;
+  if ((format == DDS_FORMAT_BC4) || (format == DDS_FORMAT_BC5)) {
+    /*	one or two channels of values, no colors	*/
+    DDS_decode_values(block, alpha);
+    if (format == DDS_FORMAT_BC5) {
+      DDS_decode_values(block + 8, green);
+    }
+    for (i = 0; i < 16; ++i) {
+      unsigned char *out = rgba + (i >> 2) * stride + (i & 3) * 4;
+      out[0] = alpha[i];
+      out[1] = (format == DDS_FORMAT_BC5) ? green[i] : alpha[i];
+      out[2] = (format == DDS_FORMAT_BC5) ? 0 : alpha[i];
+      out[3] = 255;
+    }
+    return;
+  }
+  if (format == DDS_FORMAT_DXT3) {
+    /*	4 bit alpha values, then the colors	*/
+    for (i = 0; i < 16; ++i) {
+      alpha[i] = ((block[i >> 1] >> ((i & 1) * 4)) & 15) * 17;
+    }
+    color = block + 8;
+  } else if (format == DDS_FORMAT_DXT5) {
+    DDS_decode_values(block, alpha);
+    color = block + 8;
+  }
+  DDS_color_palette(color, format == DDS_FORMAT_DXT1, palette);
+  bits = color[4] | (color[5] << 8) | (color[6] << 16) |
+         ((unsigned int)color[7] << 24);
+  for (i = 0; i < 16; ++i) {
+    unsigned char *out = rgba + (i >> 2) * stride + (i & 3) * 4;
+    memcpy(out, palette + ((bits >> (2 * i)) & 3) * 4, 4);
+    if (format != DDS_FORMAT_DXT1) {
+      out[3] = alpha[i];
+    }
+  }
+}
+
+#ifdef IMAGE_SIMD_X86
+/*
+        The SSSE3 decoder builds the same palettes as the scalar one,
+        then turns the packed indices into one byte per pixel and looks
+        the pixels up with pshufb.  A 2 or 3 bit index is brought to the
+        top of a 16 bit lane with a multiply (a per lane left shift) and
+        shifted back down, 8 pixels per register.
+*/
+
+/*	the 2 bit color indices of the 8 byte color block, one per byte	*/
+IMAGE_TARGET_SSSE3 static __m128i DDS_color_indices_SSSE3(
+    const unsigned char *color) {
+  /*	pixel p is at bit 2 * (p % 4) of byte 4 + p / 4	*/
+  const __m128i bits = _mm_loadl_epi64((const __m128i *)color);
+  const __m128i scale = _mm_setr_epi16(1 << 14, 1 << 12, 1 << 10, 1 << 8,
+                                       1 << 14, 1 << 12, 1 << 10, 1 << 8);
+  __m128i lo = _mm_shuffle_epi8(bits, _mm_setr_epi8(4, -128, 4, -128, 4, -128,
+                                                    4, -128, 5, -128, 5, -128,
+                                                    5, -128, 5, -128));
+  __m128i hi = _mm_shuffle_epi8(bits, _mm_setr_epi8(6, -128, 6, -128, 6, -128,
+                                                    6, -128, 7, -128, 7, -128,
+                                                    7, -128, 7, -128));
+  lo = _mm_srli_epi16(_mm_mullo_epi16(lo, scale), 14);
+  hi = _mm_srli_epi16(_mm_mullo_epi16(hi, scale), 14);
+  return _mm_packus_epi16(lo, hi);
+}
+
+/*	the 16 values of the 8 byte DXT5 alpha (or BC4) block	*/
+IMAGE_TARGET_SSSE3 static __m128i DDS_decode_values_SSSE3(
+    const unsigned char *block) {
+  /*	pixel p is at bit 3 * p of bytes 2 to 7; each lane gets the
+          2 bytes around it (byte 8 of the load is 0, and never needed)	*/
+  const __m128i bits = _mm_loadl_epi64((const __m128i *)block);
+  const __m128i scale = _mm_setr_epi16(1 << 13, 1 << 10, 1 << 7, 1 << 12,
+                                       1 << 9, 1 << 6, 1 << 11, 1 << 8);
+  unsigned char palette[8];
+  __m128i lo = _mm_shuffle_epi8(
+      bits, _mm_setr_epi8(2, 3, 2, 3, 2, 3, 3, 4, 3, 4, 3, 4, 4, 5, 4, 5));
+  __m128i hi = _mm_shuffle_epi8(
+      bits, _mm_setr_epi8(5, 6, 5, 6, 5, 6, 6, 7, 6, 7, 6, 7, 7, 8, 7, 8));
+  lo = _mm_srli_epi16(_mm_mullo_epi16(lo, scale), 13);
+  hi = _mm_srli_epi16(_mm_mullo_epi16(hi, scale), 13);
+  DDS_value_palette(block, palette);
+  return _mm_shuffle_epi8(_mm_loadl_epi64((const __m128i *)palette),
+                          _mm_packus_epi16(lo, hi));
+}
+
+/*	spreads byte 4 * row + x of v to the bytes of pixel x that
+        lanes selects (0 for a byte, -128 for none)	*/
+IMAGE_TARGET_SSSE3 static __m128i DDS_spread_row_SSSE3(__m128i v, int row,
+                                                       __m128i lanes) {
+  const __m128i pixel = _mm_setr_epi8(0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3,
+                                      3, 3);
+  return _mm_shuffle_epi8(
+      v, _mm_or_si128(_mm_add_epi8(pixel, _mm_set1_epi8((char)(4 * row))),
+                      lanes));
+}
+
+IMAGE_TARGET_SSSE3
+void decode_DDS_block_SSSE3(const unsigned char *block, int format,
+                            unsigned char *rgba, int stride) {
+  const __m128i alpha_lane = _mm_setr_epi8(-128, -128, -128, 0, -128, -128,
+                                           -128, 0, -128, -128, -128, 0, -128,
+                                           -128, -128, 0);
+  const __m128i opaque = _mm_set1_epi32((int)0xFF000000u);
+  unsigned char palette[16];
+  const unsigned char *color = block;
+  __m128i colors, index, alpha = _mm_setzero_si128();
+  int row;
+  if ((format == DDS_FORMAT_BC4) || (format == DDS_FORMAT_BC5)) {
+    const __m128i red_lane = _mm_setr_epi8(0, -128, -128, -128, 0, -128, -128,
+                                           -128, 0, -128, -128, -128, 0, -128,
+                                           -128, -128);
+    const __m128i gray_lane = _mm_setr_epi8(0, 0, 0, -128, 0, 0, 0, -128, 0,
+                                            0, 0, -128, 0, 0, 0, -128);
+    __m128i red = DDS_decode_values_SSSE3(block);
+    __m128i green = red;
+    if (format == DDS_FORMAT_BC5) {
+      green = DDS_decode_values_SSSE3(block + 8);
+    }
+    for (row = 0; row < 4; ++row) {
+      __m128i out;
+      if (format == DDS_FORMAT_BC5) {
+        out = _mm_or_si128(
+            DDS_spread_row_SSSE3(red, row, red_lane),
+            _mm_slli_epi32(DDS_spread_row_SSSE3(green, row, red_lane), 8));
+      } else {
+        out = DDS_spread_row_SSSE3(red, row, gray_lane);
+      }
+      _mm_storeu_si128((__m128i *)(rgba + row * stride),
+                       _mm_or_si128(out, opaque));
+    }
+    return;
+  }
+  if (format == DDS_FORMAT_DXT3) {
+    /*	4 bit alpha values, low nibble first, scaled by 17	*/
+    const __m128i nibble = _mm_set1_epi8(15);
+    __m128i bits = _mm_loadl_epi64((const __m128i *)block);
+    alpha = _mm_unpacklo_epi8(_mm_and_si128(bits, nibble),
+                              _mm_and_si128(_mm_srli_epi16(bits, 4), nibble));
+    alpha = _mm_or_si128(alpha, _mm_slli_epi16(alpha, 4));
+    color = block + 8;
+  } else if (format == DDS_FORMAT_DXT5) {
+    alpha = DDS_decode_values_SSSE3(block);
+    color = block + 8;
+  }
+  DDS_color_palette(color, format == DDS_FORMAT_DXT1, palette);
+  colors = _mm_loadu_si128((const __m128i *)palette);
+  if (format != DDS_FORMAT_DXT1) {
+    /*	the alpha is OR'd in below	*/
+    colors = _mm_andnot_si128(opaque, colors);
+  }
+  /*	the first byte of each palette entry, then + {0, 1, 2, 3}	*/
+  index = _mm_slli_epi16(DDS_color_indices_SSSE3(color), 2);
+  for (row = 0; row < 4; ++row) {
+    __m128i out = _mm_shuffle_epi8(
+        colors,
+        _mm_add_epi8(DDS_spread_row_SSSE3(index, row, _mm_setzero_si128()),
+                     _mm_set1_epi32(0x03020100)));
+    if (format != DDS_FORMAT_DXT1) {
+      out = _mm_or_si128(out, DDS_spread_row_SSSE3(alpha, row, alpha_lane));
+    }
+    _mm_storeu_si128((__m128i *)(rgba + row * stride), out);
+  }
+}
+#endif
@@ -0,0 +1,143 @@
+/*
+	Image memory allocation
+
+	The image codecs get their working memory from image_malloc,
+	image_realloc and image_free, which go to the allocator the
+	calling thread installed with image_allocator_use, or to the C
+	heap when it installed none.  image_arena is a bump allocator
+	meant to be installed for the decode of one image and reset
+	after it.
+
+	public domain
+*/
+
+#ifndef HEADER_IMAGE_ALLOC
+#define HEADER_IMAGE_ALLOC
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+	A memory allocator, with the semantics of malloc, realloc and
+	free.  realloc_func is never passed NULL, free_func may be.
+	Each gets context as its first argument.
+**/
+typedef struct image_allocator
+{
+	void	*(*malloc_func)( void *context, size_t size );
+	void	*(*realloc_func)( void *context, void *block, size_t size );
+	void	(*free_func)( void *context, void *block );
+	void	*context;
+}
+image_allocator;
+
+/**
+	Makes allocator the one image_malloc and friends use on the
+	calling thread (NULL for the C heap).  image_parallel_for hands
+	it on to its workers, so everything a call allocates comes from
+	it.  A block has to be freed with the allocator that allocated
+	it, so install one around a whole call, and free what the call
+	returned before installing another (or, for an arena, reset it).
+	\return the allocator that was installed before
+**/
+const image_allocator*
+	image_allocator_use
+	(
+		const image_allocator *allocator
+	);
+
+/**
+	\return the calling thread's allocator, NULL for the C heap
+**/
+const image_allocator*
+	image_allocator_current
+	(
+		void
+	);
+
+void*
+	image_malloc
+	(
+		size_t size
+	);
+
+void*
+	image_realloc
+	(
+		void *block,
+		size_t size
+	);
+
+void
+	image_free
+	(
+		void *block
+	);
+
+/**
+	A bump allocator.  Blocks are carved one after another out of
+	big chunks, and are only given back all at once, by
+	image_arena_reset; freeing or growing the latest block is done
+	in place.  A reset keeps the memory, merged into one chunk as big
+	as all of them, so an arena that keeps decoding images of about
+	the same size soon stops going to the C heap at all.
+	An arena may be used by several threads at once.
+**/
+typedef struct image_arena image_arena;
+
+/**
+	chunk_size is the size of the chunks taken from the heap
+	(0 for 1 MB); a bigger block gets a chunk of its own.
+	\return a new empty arena, or NULL if failed
+**/
+image_arena*
+	image_arena_create
+	(
+		size_t chunk_size
+	);
+
+/**
+	Frees the arena and every block it handed out.
+**/
+void
+	image_arena_destroy
+	(
+		image_arena *arena
+	);
+
+/**
+	Takes back every block the arena handed out.
+**/
+void
+	image_arena_reset
+	(
+		image_arena *arena
+	);
+
+/**
+	\return the allocator to install (or put in a SOIL_context) to
+	allocate from the arena; it lives as long as the arena
+**/
+const image_allocator*
+	image_arena_allocator
+	(
+		image_arena *arena
+	);
+
+/**
+	\return the bytes handed out since the last reset
+**/
+size_t
+	image_arena_used
+	(
+		image_arena *arena
+	);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HEADER_IMAGE_ALLOC	*/
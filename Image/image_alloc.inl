@@ -0,0 +1,267 @@
+/*
+	Image memory allocation
+
+	public domain
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "image_alloc.h"
+#include "image_thread.h"
+
+/*	chunks, and the blocks in them, are aligned for SIMD loads	*/
+#define IMAGE_ARENA_ALIGNMENT 16
+#define IMAGE_ARENA_ROUND(x) \
+  (((x) + (IMAGE_ARENA_ALIGNMENT - 1)) & ~(size_t)(IMAGE_ARENA_ALIGNMENT - 1))
+#define IMAGE_ARENA_DEFAULT_CHUNK (1 << 20)
+
+static IMAGE_THREAD_LOCAL const image_allocator *image_allocator_installed =
+    NULL;
+
+const image_allocator *image_allocator_use(const image_allocator *allocator) {
+  const image_allocator *previous = image_allocator_installed;
+  image_allocator_installed = allocator;
+  return previous;
+}
+
+const image_allocator *image_allocator_current(void) {
+  return image_allocator_installed;
+}
+
+void *image_malloc(size_t size) {
+  const image_allocator *allocator = image_allocator_installed;
+  if (NULL == allocator) {
+    return malloc(size);
+  }
+  return allocator->malloc_func(allocator->context, size);
+}
+
+void *image_realloc(void *block, size_t size) {
+  const image_allocator *allocator = image_allocator_installed;
+  if (NULL == allocator) {
+    return realloc(block, size);
+  }
+  if (NULL == block) {
+    return allocator->malloc_func(allocator->context, size);
+  }
+  return allocator->realloc_func(allocator->context, block, size);
+}
+
+void image_free(void *block) {
+  const image_allocator *allocator = image_allocator_installed;
+  if (NULL == block) {
+    return;
+  }
+  if (NULL == allocator) {
+    free(block);
+  } else {
+    allocator->free_func(allocator->context, block);
+  }
+}
+
+/*	a chunk of an arena, with its blocks right after it; every block
+        is preceded by its size, in a header of IMAGE_ARENA_ALIGNMENT
+        bytes	*/
+typedef struct image_arena_chunk {
+  struct image_arena_chunk *next;
+  size_t size, used;
+} image_arena_chunk;
+
+struct image_arena {
+  image_allocator allocator;
+  image_monitor *lock;
+  image_arena_chunk *chunks, *current;
+  size_t chunk_size;
+  size_t used;
+  /*	the latest block, which can be freed or grown in place	*/
+  unsigned char *last;
+};
+
+static unsigned char *image_arena_chunk_data(image_arena_chunk *chunk) {
+  return (unsigned char *)chunk + IMAGE_ARENA_ROUND(sizeof(image_arena_chunk));
+}
+
+static image_arena_chunk *image_arena_new_chunk(size_t size) {
+  image_arena_chunk *chunk = (image_arena_chunk *)malloc(
+      IMAGE_ARENA_ROUND(sizeof(image_arena_chunk)) + size);
+  if (NULL != chunk) {
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->used = 0;
+  }
+  return chunk;
+}
+
+static size_t image_arena_block_size(const unsigned char *block) {
+  size_t size;
+  memcpy(&size, block - IMAGE_ARENA_ALIGNMENT, sizeof(size_t));
+  return size;
+}
+
+/*	call with the lock held	*/
+static void *image_arena_carve(image_arena *arena, size_t size) {
+  size_t need = IMAGE_ARENA_ALIGNMENT + IMAGE_ARENA_ROUND(size);
+  image_arena_chunk *chunk = arena->current;
+  unsigned char *block;
+  if (need < size) {
+    return NULL;
+  }
+  /*	the chunks past the current one are empty, left over from before
+          a reset that could not merge them	*/
+  while ((NULL != chunk) && (chunk->used + need > chunk->size)) {
+    chunk = chunk->next;
+  }
+  if (NULL == chunk) {
+    chunk = image_arena_new_chunk(need > arena->chunk_size ? need
+                                                           : arena->chunk_size);
+    if (NULL == chunk) {
+      return NULL;
+    }
+    if (NULL == arena->current) {
+      arena->chunks = chunk;
+    } else {
+      chunk->next = arena->current->next;
+      arena->current->next = chunk;
+    }
+  }
+  block = image_arena_chunk_data(chunk) + chunk->used + IMAGE_ARENA_ALIGNMENT;
+  memcpy(block - IMAGE_ARENA_ALIGNMENT, &size, sizeof(size_t));
+  chunk->used += need;
+  arena->current = chunk;
+  arena->last = block;
+  arena->used += size;
+  return block;
+}
+
+static void *image_arena_malloc(void *context, size_t size) {
+  image_arena *arena = (image_arena *)context;
+  void *block;
+  image_monitor_lock(arena->lock);
+  block = image_arena_carve(arena, size);
+  image_monitor_unlock(arena->lock);
+  return block;
+}
+
+static void *image_arena_realloc(void *context, void *block, size_t size) {
+  image_arena *arena = (image_arena *)context;
+  unsigned char *grown;
+  size_t old_size;
+  image_monitor_lock(arena->lock);
+  old_size = image_arena_block_size((unsigned char *)block);
+  if (block == arena->last) {
+    /*	the latest block just moves the end of its chunk	*/
+    image_arena_chunk *chunk = arena->current;
+    size_t start = (size_t)((unsigned char *)block -
+                            image_arena_chunk_data(chunk));
+    size_t end = start + IMAGE_ARENA_ROUND(size);
+    if ((end >= start) && (end <= chunk->size)) {
+      chunk->used = end;
+      arena->used = arena->used - old_size + size;
+      memcpy((unsigned char *)block - IMAGE_ARENA_ALIGNMENT, &size,
+             sizeof(size_t));
+      image_monitor_unlock(arena->lock);
+      return block;
+    }
+  }
+  grown = (unsigned char *)image_arena_carve(arena, size);
+  if (NULL != grown) {
+    memcpy(grown, block, old_size < size ? old_size : size);
+  }
+  image_monitor_unlock(arena->lock);
+  return grown;
+}
+
+static void image_arena_free(void *context, void *block) {
+  image_arena *arena = (image_arena *)context;
+  if (NULL == block) {
+    return;
+  }
+  image_monitor_lock(arena->lock);
+  /*	only the latest block can be taken back before a reset	*/
+  if (block == arena->last) {
+    size_t size = image_arena_block_size((unsigned char *)block);
+    arena->current->used -= IMAGE_ARENA_ALIGNMENT + IMAGE_ARENA_ROUND(size);
+    arena->used -= size;
+    arena->last = NULL;
+  }
+  image_monitor_unlock(arena->lock);
+}
+
+image_arena *image_arena_create(size_t chunk_size) {
+  image_arena *arena = (image_arena *)calloc(1, sizeof(image_arena));
+  if (NULL == arena) {
+    return NULL;
+  }
+  arena->lock = image_monitor_create();
+  if (NULL == arena->lock) {
+    free(arena);
+    return NULL;
+  }
+  arena->chunk_size = chunk_size ? IMAGE_ARENA_ROUND(chunk_size)
+                                 : IMAGE_ARENA_DEFAULT_CHUNK;
+  arena->allocator.malloc_func = image_arena_malloc;
+  arena->allocator.realloc_func = image_arena_realloc;
+  arena->allocator.free_func = image_arena_free;
+  arena->allocator.context = arena;
+  return arena;
+}
+
+static void image_arena_free_chunks(image_arena_chunk *chunk) {
+  while (NULL != chunk) {
+    image_arena_chunk *next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+}
+
+void image_arena_destroy(image_arena *arena) {
+  if (NULL == arena) {
+    return;
+  }
+  image_arena_free_chunks(arena->chunks);
+  image_monitor_destroy(arena->lock);
+  free(arena);
+}
+
+void image_arena_reset(image_arena *arena) {
+  image_arena_chunk *chunk;
+  if (NULL == arena) {
+    return;
+  }
+  image_monitor_lock(arena->lock);
+  if ((NULL != arena->chunks) && (NULL != arena->chunks->next)) {
+    /*	one chunk as big as all of them, so next time fits in it	*/
+    size_t total = 0;
+    image_arena_chunk *merged;
+    for (chunk = arena->chunks; NULL != chunk; chunk = chunk->next) {
+      total += chunk->size;
+    }
+    merged = image_arena_new_chunk(total);
+    if (NULL != merged) {
+      image_arena_free_chunks(arena->chunks);
+      arena->chunks = merged;
+    }
+  }
+  for (chunk = arena->chunks; NULL != chunk; chunk = chunk->next) {
+    chunk->used = 0;
+  }
+  arena->current = arena->chunks;
+  arena->used = 0;
+  arena->last = NULL;
+  image_monitor_unlock(arena->lock);
+}
+
+const image_allocator *image_arena_allocator(image_arena *arena) {
+  return (NULL != arena) ? &arena->allocator : NULL;
+}
+
+size_t image_arena_used(image_arena *arena) {
+  size_t used;
+  if (NULL == arena) {
+    return 0;
+  }
+  image_monitor_lock(arena->lock);
+  used = arena->used;
+  image_monitor_unlock(arena->lock);
+  return used;
+}
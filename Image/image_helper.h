@@ -43,6 +43,62 @@ int
 		int block_size_x, int block_size_y
 	);
 
+/**
+	The filters for resample_image_filtered and mipmap_image_chain.
+	BOX and BILINEAR are cheap, LANCZOS3 and KAISER (a Kaiser windowed
+	sinc) are sharper and keep more detail in small MIPmaps.
+**/
+enum
+{
+	IMAGE_FILTER_BOX = 0,
+	IMAGE_FILTER_BILINEAR,
+	IMAGE_FILTER_LANCZOS3,
+	IMAGE_FILTER_KAISER
+};
+
+/**
+	This function resizes an image to any size, up or down,
+	with one of the IMAGE_FILTER_* filters (clamping at the edges).
+	\return 0 if failed, otherwise returns 1
+**/
+int
+	resample_image_filtered
+	(
+		const unsigned char* const orig,
+		int width, int height, int channels,
+		unsigned char* resampled,
+		int resampled_width, int resampled_height,
+		int filter
+	);
+
+/**
+	The number of bytes mipmap_image_chain needs for all of the
+	MIPmaps of an image, not counting the image itself.
+**/
+int
+	mipmap_chain_size
+	(
+		int width, int height, int channels
+	);
+
+/**
+	This function creates every MIPmap of an image down to 1x1 in one
+	pass, each level right after the last, in chain (which must hold
+	mipmap_chain_size bytes).  Level n is max(1, width >> n) by
+	max(1, height >> n).  Every level is filtered from the one above
+	it: with IMAGE_FILTER_BOX each row of a level is built as soon as
+	the two rows above it are done, while they are still in cache.
+	\return the number of levels written, 0 if failed (or already 1x1)
+**/
+int
+	mipmap_image_chain
+	(
+		const unsigned char* const orig,
+		int width, int height, int channels,
+		unsigned char* chain,
+		int filter
+	);
+
 /**
 	This function takes the RGB components of the image
 	and scales each channel from [0,255] to [16,235].
@@ -71,6 +127,18 @@ int
 		int width, int height, int channels
 	);
 
+/**
+	Same as convert_RGB_to_YCoCg, but the result goes to converted
+	(width * height * channels bytes, which may be orig itself).
+**/
+int
+	convert_RGB_to_YCoCg_copy
+	(
+		const unsigned char* const orig,
+		int width, int height, int channels,
+		unsigned char* converted
+	);
+
 /**
 	This function takes the YCoCg components of the image
 	and converts them into RGB.  See above.
@@ -108,6 +176,53 @@ int
 		int rescale_to_max
 	);
 
+/**
+	Same as RGBE_to_RGBdivA, but converting bands of rows on up to
+	thread_count threads (<= 0 means one per hardware thread).
+	The output is byte-identical.
+	\return 0 if failed, otherwise returns 1
+**/
+int
+	RGBE_to_RGBdivA_parallel
+	(
+		unsigned char *image,
+		int width, int height,
+		int rescale_to_max, int thread_count
+	);
+
+/**
+	Same as RGBE_to_RGBdivA2, but converting bands of rows on up to
+	thread_count threads (<= 0 means one per hardware thread).
+	The output is byte-identical.
+	\return 0 if failed, otherwise returns 1
+**/
+int
+	RGBE_to_RGBdivA2_parallel
+	(
+		unsigned char *image,
+		int width, int height,
+		int rescale_to_max, int thread_count
+	);
+
+/**
+	Decodes an HDR image from an array of unsigned chars (RGBE) straight
+	to half floats, 3 per pixel (RGB), into half_rgb, which must hold
+	width * height * 3 of them.  Each component is m * 2^(e - 136), the
+	same value stbi_loadf gives, rounded to the nearest half; values too
+	large for a half become the largest one (65504), not infinity.
+	Bands of rows are done on up to thread_count threads
+	(<= 0 means one per hardware thread).
+	\return 0 if failed, otherwise returns 1
+**/
+int
+	RGBE_to_RGB16F
+	(
+		const unsigned char *image,
+		int width, int height,
+		unsigned short *half_rgb,
+		int thread_count
+	);
+
 #ifdef __cplusplus
 }
 #endif
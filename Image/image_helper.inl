@@ -7,9 +7,148 @@
 */
 
 #include "image_helper.h"
+#include "image_simd.h"
+#include "image_thread.h"
+#include "image_alloc.h"
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
+#ifdef IMAGE_SIMD_X86
+/*
+	The bilinear upscale of up_scale_image, four output bytes at a time.
+	src_offset and frac_x hold, for every byte of an output row, where
+	its sample starts in a source row and how far along x it lies; the
+	float math is done in exactly the same order as the scalar code,
+	so the results are identical.
+*/
+static void
+	up_scale_row_SSE2
+	(
+		const unsigned char* const row0,
+		const unsigned char* const row1,
+		int channels,
+		const int* src_offset, const float* frac_x,
+		float sampley,
+		unsigned char* out, int count
+	)
+{
+	const __m128 one = _mm_set1_ps( 1.0f );
+	const __m128 half = _mm_set1_ps( 0.5f );
+	const __m128 sy = _mm_set1_ps( sampley );
+	const __m128 inv_sy = _mm_set1_ps( 1.0f - sampley );
+	int k = 0;
+	for( ; k + 4 <= count; k += 4 )
+	{
+		const int* o = src_offset + k;
+		__m128 sx = _mm_loadu_ps( frac_x + k );
+		__m128 inv_sx = _mm_sub_ps( one, sx );
+		__m128 a = _mm_cvtepi32_ps( _mm_set_epi32(
+				row0[o[3]], row0[o[2]], row0[o[1]], row0[o[0]] ) );
+		__m128 b = _mm_cvtepi32_ps( _mm_set_epi32(
+				row0[o[3]+channels], row0[o[2]+channels],
+				row0[o[1]+channels], row0[o[0]+channels] ) );
+		__m128 c = _mm_cvtepi32_ps( _mm_set_epi32(
+				row1[o[3]], row1[o[2]], row1[o[1]], row1[o[0]] ) );
+		__m128 d = _mm_cvtepi32_ps( _mm_set_epi32(
+				row1[o[3]+channels], row1[o[2]+channels],
+				row1[o[1]+channels], row1[o[0]+channels] ) );
+		__m128 value = _mm_add_ps( half,
+				_mm_mul_ps( _mm_mul_ps( a, inv_sx ), inv_sy ) );
+		__m128i v;
+		value = _mm_add_ps( value, _mm_mul_ps( _mm_mul_ps( b, sx ), inv_sy ) );
+		value = _mm_add_ps( value, _mm_mul_ps( _mm_mul_ps( c, inv_sx ), sy ) );
+		value = _mm_add_ps( value, _mm_mul_ps( _mm_mul_ps( d, sx ), sy ) );
+		v = _mm_cvttps_epi32( value );
+		v = _mm_packs_epi32( v, v );
+		v = _mm_packus_epi16( v, v );
+		{
+			int packed = _mm_cvtsi128_si32( v );
+			memcpy( out + k, &packed, 4 );
+		}
+	}
+	for( ; k < count; ++k )
+	{
+		const int o = src_offset[k];
+		float samplex = frac_x[k];
+		float value = 0.5f;
+		value += row0[o] *(1.0f-samplex)*(1.0f-sampley);
+		value += row0[o+channels] *(samplex)*(1.0f-sampley);
+		value += row1[o] *(1.0f-samplex)*(sampley);
+		value += row1[o+channels] *(samplex)*(sampley);
+		out[k] = (unsigned char)(value);
+	}
+}
+#endif
+
+/*
+	One row of a 2x2 box filtered MIPmap: every output pixel is the
+	rounded average of 2 pixels from each of row0 and row1 (pass the
+	same row twice for a 1 pixel high source).  The rounding matches
+	mipmap_image, which is also what a 2x1 or 1x1 block rounds to.
+*/
+static void
+	mipmap_box_row
+	(
+		const unsigned char* const row0,
+		const unsigned char* const row1,
+		int src_width, int channels,
+		unsigned char* out, int out_width
+	)
+{
+	int k = 0, c;
+	const int step = (src_width > 1) ? channels : 0;
+	const int count = out_width * channels;
+#ifdef IMAGE_SIMD_X86
+	if( (src_width > 1) &&
+		((channels == 1) || (channels == 2) || (channels == 4)) )
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i two = _mm_set1_epi16( 2 );
+		/*	16 source bytes from each row make 8 output bytes	*/
+		for( ; k + 8 <= count; k += 8 )
+		{
+			__m128i r0 = _mm_loadu_si128( (const __m128i*)(row0 + 2*k) );
+			__m128i r1 = _mm_loadu_si128( (const __m128i*)(row1 + 2*k) );
+			__m128i lo = _mm_add_epi16( _mm_unpacklo_epi8( r0, zero ),
+					_mm_unpacklo_epi8( r1, zero ) );
+			__m128i hi = _mm_add_epi16( _mm_unpackhi_epi8( r0, zero ),
+					_mm_unpackhi_epi8( r1, zero ) );
+			__m128i sum;
+			if( channels == 1 )
+			{
+				const __m128i ones = _mm_set1_epi16( 1 );
+				sum = _mm_packs_epi32( _mm_madd_epi16( lo, ones ),
+						_mm_madd_epi16( hi, ones ) );
+			} else if( channels == 2 )
+			{
+				/*	gather the even and the odd pixels	*/
+				lo = _mm_shuffle_epi32( lo, _MM_SHUFFLE( 3, 1, 2, 0 ) );
+				hi = _mm_shuffle_epi32( hi, _MM_SHUFFLE( 3, 1, 2, 0 ) );
+				sum = _mm_add_epi16( _mm_unpacklo_epi64( lo, hi ),
+						_mm_unpackhi_epi64( lo, hi ) );
+			} else
+			{
+				sum = _mm_add_epi16( _mm_unpacklo_epi64( lo, hi ),
+						_mm_unpackhi_epi64( lo, hi ) );
+			}
+			sum = _mm_srli_epi16( _mm_add_epi16( sum, two ), 2 );
+			_mm_storel_epi64( (__m128i*)(out + k),
+					_mm_packus_epi16( sum, sum ) );
+		}
+	}
+#endif
+	for( ; k < count; k += channels )
+	{
+		const int i = (k / channels) * 2 * step;
+		for( c = 0; c < channels; ++c )
+		{
+			out[k+c] = (unsigned char)(( row0[i+c] + row0[i+step+c] +
+					row1[i+c] + row1[i+step+c] + 2 ) >> 2);
+		}
+	}
+}
+
 /*	Upscaling the image uses simple bilinear interpolation	*/
 int
 	up_scale_image
@@ -38,6 +177,47 @@ int
 	*/
     dx = (width - 1.0f) / (resampled_width - 1.0f);
     dy = (height - 1.0f) / (resampled_height - 1.0f);
+#ifdef IMAGE_SIMD_X86
+	if( (width > 1) && (height > 1) )
+	{
+		/*	the x sampling is the same for every row, so work it out once	*/
+		const int count = resampled_width * channels;
+		int* src_offset = (int*)image_malloc( count * sizeof(int) );
+		float* frac_x = (float*)image_malloc( count * sizeof(float) );
+		if( (NULL != src_offset) && (NULL != frac_x) )
+		{
+			for( x = 0; x < resampled_width; ++x )
+			{
+				float samplex = x * dx;
+				int intx = (int)samplex;
+				if( intx > width - 2 ) { intx = width - 2; }
+				samplex -= intx;
+				for( c = 0; c < channels; ++c )
+				{
+					src_offset[x*channels+c] = intx * channels + c;
+					frac_x[x*channels+c] = samplex;
+				}
+			}
+			for( y = 0; y < resampled_height; ++y )
+			{
+				float sampley = y * dy;
+				int inty = (int)sampley;
+				if( inty > height - 2 ) { inty = height - 2; }
+				sampley -= inty;
+				up_scale_row_SSE2(
+						orig + inty * width * channels,
+						orig + (inty + 1) * width * channels,
+						channels, src_offset, frac_x, sampley,
+						resampled + y * count, count );
+			}
+			image_free( src_offset );
+			image_free( frac_x );
+			return 1;
+		}
+		image_free( src_offset );
+		image_free( frac_x );
+	}
+#endif
     for ( y = 0; y < resampled_height; ++y )
     {
     	/* find the base y index and fractional offset from that	*/
@@ -112,6 +292,82 @@ int
 	{
 		mip_height = 1;
 	}
+	/*	the common case, halving the image, has its own row filter	*/
+	if( (block_size_x == 2) && (block_size_y == 2) &&
+		(width >= 2) && (height >= 2) )
+	{
+		for( j = 0; j < mip_height; ++j )
+		{
+			mipmap_box_row( orig + (2*j)*width*channels,
+					orig + (2*j+1)*width*channels, width, channels,
+					resampled + j*mip_width*channels, mip_width );
+		}
+		return 1;
+	}
+#ifdef IMAGE_SIMD_X86
+	/*	otherwise sum each strip of rows down into 16 bits first
+		(exact as long as no more than 257 rows are summed)	*/
+	if( block_size_y <= 257 )
+	{
+		const int row_bytes = width * channels;
+		unsigned short* column_sums =
+				(unsigned short*)image_malloc( (row_bytes + 8) * sizeof(unsigned short) );
+		if( NULL != column_sums )
+		{
+			for( j = 0; j < mip_height; ++j )
+			{
+				const unsigned char* src = orig + (j*block_size_y)*row_bytes;
+				int v_block = block_size_y, v, k;
+				if( block_size_y * (j+1) > height )
+				{
+					v_block = height - j*block_size_y;
+				}
+				memset( column_sums, 0, row_bytes * sizeof(unsigned short) );
+				for( v = 0; v < v_block; ++v, src += row_bytes )
+				{
+					const __m128i zero = _mm_setzero_si128();
+					for( k = 0; k + 16 <= row_bytes; k += 16 )
+					{
+						__m128i in = _mm_loadu_si128( (const __m128i*)(src + k) );
+						__m128i* sums = (__m128i*)(column_sums + k);
+						_mm_storeu_si128( sums, _mm_add_epi16( _mm_loadu_si128( sums ),
+								_mm_unpacklo_epi8( in, zero ) ) );
+						_mm_storeu_si128( sums + 1, _mm_add_epi16( _mm_loadu_si128( sums + 1 ),
+								_mm_unpackhi_epi8( in, zero ) ) );
+					}
+					for( ; k < row_bytes; ++k )
+					{
+						column_sums[k] += src[k];
+					}
+				}
+				for( i = 0; i < mip_width; ++i )
+				{
+					int u_block = block_size_x, u;
+					int block_area;
+					if( block_size_x * (i+1) > width )
+					{
+						u_block = width - i*block_size_x;
+					}
+					block_area = u_block*v_block;
+					for( c = 0; c < channels; ++c )
+					{
+						const unsigned short* sums =
+								column_sums + (i*block_size_x)*channels + c;
+						int sum_value = block_area >> 1;
+						for( u = 0; u < u_block; ++u )
+						{
+							sum_value += sums[u*channels];
+						}
+						resampled[j*mip_width*channels + i*channels + c] =
+								sum_value / block_area;
+					}
+				}
+			}
+			image_free( column_sums );
+			return 1;
+		}
+	}
+#endif
 	for( j = 0; j < mip_height; ++j )
 	{
 		for( i = 0; i < mip_width; ++i )
@@ -151,263 +407,875 @@ int
 	return 1;
 }
 
-int
-	scale_image_RGB_to_NTSC_safe
+/*
+	The color space kernels below come in a scalar version and, on x86,
+	SSE2 / SSSE3 / AVX2 versions that do 16 or 32 pixels per iteration
+	with the same integer math (saturating where the scalar code clamps),
+	so every kernel produces the same bytes.  Each public function picks
+	the widest kernel this CPU runs, once.
+	The kernels read src and write dst, which may be the same buffer.
+*/
+typedef void (*color_kernel_func)
+	( const unsigned char* src, unsigned char* dst, int pixels );
+
+unsigned char clamp_byte( int x ) { return ( (x) < 0 ? (0) : ( (x) > 255 ? 255 : (x) ) ); }
+
+static void
+	RGB_to_YCoCg3_scalar
 	(
-		unsigned char* orig,
-		int width, int height, int channels
+		const unsigned char* src, unsigned char* dst, int pixels
 	)
 {
-	const float scale_lo = 16.0f - 0.499f;
-	const float scale_hi = 235.0f + 0.499f;
-	int i, j;
-	int nc = channels;
-	unsigned char scale_LUT[256];
-	/*	error check	*/
-	if( (width < 1) || (height < 1) ||
-		(channels < 1) || (orig == NULL) )
+	int i;
+	for( i = 0; i < pixels*3; i += 3 )
 	{
-		/*	nothing to do	*/
-		return 0;
+		int r = src[i+0];
+		int g = (src[i+1] + 1) >> 1;
+		int b = src[i+2];
+		int tmp = (2 + r + b) >> 2;
+		/*	Co	*/
+		dst[i+0] = clamp_byte( 128 + ((r - b + 1) >> 1) );
+		/*	Y	*/
+		dst[i+1] = clamp_byte( g + tmp );
+		/*	Cg	*/
+		dst[i+2] = clamp_byte( 128 + g - tmp );
 	}
-	/*	set up the scaling Look Up Table	*/
-	for( i = 0; i < 256; ++i )
+}
+
+static void
+	RGB_to_YCoCg4_scalar
+	(
+		const unsigned char* src, unsigned char* dst, int pixels
+	)
+{
+	int i;
+	for( i = 0; i < pixels*4; i += 4 )
 	{
-		scale_LUT[i] = (unsigned char)((scale_hi - scale_lo) * i / 255.0f + scale_lo);
+		int r = src[i+0];
+		int g = (src[i+1] + 1) >> 1;
+		int b = src[i+2];
+		unsigned char a = src[i+3];
+		int tmp = (2 + r + b) >> 2;
+		/*	Co	*/
+		dst[i+0] = clamp_byte( 128 + ((r - b + 1) >> 1) );
+		/*	Cg	*/
+		dst[i+1] = clamp_byte( 128 + g - tmp );
+		/*	Alpha	*/
+		dst[i+2] = a;
+		/*	Y	*/
+		dst[i+3] = clamp_byte( g + tmp );
 	}
-	/*	for channels = 2 or 4, ignore the alpha component	*/
-	nc -= 1 - (channels & 1);
-	/*	OK, go through the image and scale any non-alpha components	*/
-	for( i = 0; i < width*height*channels; i += channels )
+}
+
+static void
+	YCoCg3_to_RGB_scalar
+	(
+		const unsigned char* src, unsigned char* dst, int pixels
+	)
+{
+	int i;
+	for( i = 0; i < pixels*3; i += 3 )
 	{
-		for( j = 0; j < nc; ++j )
-		{
-			orig[i+j] = scale_LUT[orig[i+j]];
-		}
+		int co = src[i+0] - 128;
+		int y  = src[i+1];
+		int cg = src[i+2] - 128;
+		/*	R	*/
+		dst[i+0] = clamp_byte( y + co - cg );
+		/*	G	*/
+		dst[i+1] = clamp_byte( y + cg );
+		/*	B	*/
+		dst[i+2] = clamp_byte( y - co - cg );
 	}
-	return 1;
 }
 
-unsigned char clamp_byte( int x ) { return ( (x) < 0 ? (0) : ( (x) > 255 ? 255 : (x) ) ); }
-
-/*
-	This function takes the RGB components of the image
-	and converts them into YCoCg.  3 components will be
-	re-ordered to CoYCg (for optimum DXT1 compression),
-	while 4 components will be ordered CoCgAY (for DXT5
-	compression).
-*/
-int
-	convert_RGB_to_YCoCg
+static void
+	YCoCg4_to_RGB_scalar
 	(
-		unsigned char* orig,
-		int width, int height, int channels
+		const unsigned char* src, unsigned char* dst, int pixels
 	)
 {
 	int i;
-	/*	error check	*/
-	if( (width < 1) || (height < 1) ||
-		(channels < 3) || (channels > 4) ||
-		(orig == NULL) )
+	for( i = 0; i < pixels*4; i += 4 )
 	{
-		/*	nothing to do	*/
-		return -1;
+		int co = src[i+0] - 128;
+		int cg = src[i+1] - 128;
+		unsigned char a  = src[i+2];
+		int y  = src[i+3];
+		/*	R	*/
+		dst[i+0] = clamp_byte( y + co - cg );
+		/*	G	*/
+		dst[i+1] = clamp_byte( y + cg );
+		/*	B	*/
+		dst[i+2] = clamp_byte( y - co - cg );
+		/*	A	*/
+		dst[i+3] = a;
 	}
-	/*	do the conversion	*/
-	if( channels == 3 )
+}
+
+#ifdef IMAGE_SIMD_X86
+/*
+	4 channel pixels are split into one 16 bit lane per channel with
+	shifts and packs, and put back together with packus (which does
+	the clamping) and unpacks; for 8 pixels (SSE2) or 16 (AVX2) at a
+	time.  The AVX2 packs and unpacks work within 128 bit halves, but
+	they do so the same way going in and coming out, so the pixels
+	land back where they started.
+*/
+static inline void
+	split_4_channels_SSE2
+	(
+		const unsigned char* src, __m128i c[4]
+	)
+{
+	const __m128i mask = _mm_set1_epi32( 0xFF );
+	__m128i p0 = _mm_loadu_si128( (const __m128i*)(src) );
+	__m128i p1 = _mm_loadu_si128( (const __m128i*)(src + 16) );
+	c[0] = _mm_packs_epi32( _mm_and_si128( p0, mask ),
+			_mm_and_si128( p1, mask ) );
+	c[1] = _mm_packs_epi32( _mm_and_si128( _mm_srli_epi32( p0, 8 ), mask ),
+			_mm_and_si128( _mm_srli_epi32( p1, 8 ), mask ) );
+	c[2] = _mm_packs_epi32( _mm_and_si128( _mm_srli_epi32( p0, 16 ), mask ),
+			_mm_and_si128( _mm_srli_epi32( p1, 16 ), mask ) );
+	c[3] = _mm_packs_epi32( _mm_srli_epi32( p0, 24 ),
+			_mm_srli_epi32( p1, 24 ) );
+}
+
+static inline void
+	join_4_channels_SSE2
+	(
+		__m128i c0, __m128i c1, __m128i c2, __m128i c3,
+		unsigned char* dst
+	)
+{
+	__m128i lo = _mm_unpacklo_epi8( _mm_packus_epi16( c0, c0 ),
+			_mm_packus_epi16( c1, c1 ) );
+	__m128i hi = _mm_unpacklo_epi8( _mm_packus_epi16( c2, c2 ),
+			_mm_packus_epi16( c3, c3 ) );
+	_mm_storeu_si128( (__m128i*)(dst), _mm_unpacklo_epi16( lo, hi ) );
+	_mm_storeu_si128( (__m128i*)(dst + 16), _mm_unpackhi_epi16( lo, hi ) );
+}
+
+/*	Co, Cg and Y from R, G and B, in 16 bit lanes, before clamping	*/
+static inline void
+	RGB_to_YCoCg_SSE2
+	(
+		__m128i r, __m128i g, __m128i b,
+		__m128i* co, __m128i* cg, __m128i* y
+	)
+{
+	const __m128i one = _mm_set1_epi16( 1 );
+	const __m128i two = _mm_set1_epi16( 2 );
+	const __m128i half = _mm_set1_epi16( 128 );
+	__m128i tmp = _mm_srli_epi16( _mm_add_epi16( _mm_add_epi16( r, b ), two ), 2 );
+	g = _mm_srli_epi16( _mm_add_epi16( g, one ), 1 );
+	*co = _mm_add_epi16( half,
+			_mm_srai_epi16( _mm_add_epi16( _mm_sub_epi16( r, b ), one ), 1 ) );
+	*cg = _mm_sub_epi16( _mm_add_epi16( half, g ), tmp );
+	*y = _mm_add_epi16( g, tmp );
+}
+
+/*	R, G and B from Co, Cg and Y, in 16 bit lanes, before clamping	*/
+static inline void
+	YCoCg_to_RGB_SSE2
+	(
+		__m128i co, __m128i cg, __m128i y,
+		__m128i* r, __m128i* g, __m128i* b
+	)
+{
+	const __m128i half = _mm_set1_epi16( 128 );
+	co = _mm_sub_epi16( co, half );
+	cg = _mm_sub_epi16( cg, half );
+	*r = _mm_sub_epi16( _mm_add_epi16( y, co ), cg );
+	*g = _mm_add_epi16( y, cg );
+	*b = _mm_sub_epi16( _mm_sub_epi16( y, co ), cg );
+}
+
+static void
+	RGB_to_YCoCg4_SSE2
+	(
+		const unsigned char* src, unsigned char* dst, int pixels
+	)
+{
+	int i = 0, k;
+	for( ; i + 16 <= pixels; i += 16 )
 	{
-		for( i = 0; i < width*height*3; i += 3 )
+		for( k = 0; k < 16; k += 8 )
 		{
-			int r = orig[i+0];
-			int g = (orig[i+1] + 1) >> 1;
-			int b = orig[i+2];
-			int tmp = (2 + r + b) >> 2;
-			/*	Co	*/
-			orig[i+0] = clamp_byte( 128 + ((r - b + 1) >> 1) );
-			/*	Y	*/
-			orig[i+1] = clamp_byte( g + tmp );
-			/*	Cg	*/
-			orig[i+2] = clamp_byte( 128 + g - tmp );
+			__m128i c[4], co, cg, y;
+			split_4_channels_SSE2( src + (i+k)*4, c );
+			RGB_to_YCoCg_SSE2( c[0], c[1], c[2], &co, &cg, &y );
+			join_4_channels_SSE2( co, cg, c[3], y, dst + (i+k)*4 );
 		}
-	} else
+	}
+	RGB_to_YCoCg4_scalar( src + i*4, dst + i*4, pixels - i );
+}
+
+static void
+	YCoCg4_to_RGB_SSE2
+	(
+		const unsigned char* src, unsigned char* dst, int pixels
+	)
+{
+	int i = 0, k;
+	for( ; i + 16 <= pixels; i += 16 )
 	{
-		for( i = 0; i < width*height*4; i += 4 )
+		for( k = 0; k < 16; k += 8 )
 		{
-			int r = orig[i+0];
-			int g = (orig[i+1] + 1) >> 1;
-			int b = orig[i+2];
-			unsigned char a = orig[i+3];
-			int tmp = (2 + r + b) >> 2;
-			/*	Co	*/
-			orig[i+0] = clamp_byte( 128 + ((r - b + 1) >> 1) );
-			/*	Cg	*/
-			orig[i+1] = clamp_byte( 128 + g - tmp );
-			/*	Alpha	*/
-			orig[i+2] = a;
-			/*	Y	*/
-			orig[i+3] = clamp_byte( g + tmp );
+			__m128i c[4], r, g, b;
+			split_4_channels_SSE2( src + (i+k)*4, c );
+			YCoCg_to_RGB_SSE2( c[0], c[1], c[3], &r, &g, &b );
+			join_4_channels_SSE2( r, g, b, c[2], dst + (i+k)*4 );
 		}
 	}
-	/*	done	*/
-	return 0;
+	YCoCg4_to_RGB_scalar( src + i*4, dst + i*4, pixels - i );
 }
 
 /*
-	This function takes the YCoCg components of the image
-	and converts them into RGB.  See above.
+	3 channel pixels don't line up with any lane size, so those
+	are split and joined 16 at a time with SSSE3 byte shuffles.
+	split_3_shuffle[c][k] gathers channel c out of the k'th 16 bytes,
+	join_3_shuffle[k][c] scatters channel c into the k'th 16 bytes.
 */
-int
-	convert_YCoCg_to_RGB
+static const signed char split_3_shuffle[3][3][16] =
+{
+	{
+		{ 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+		{ -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1 },
+		{ -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13 }
+	},
+	{
+		{ 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+		{ -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1 },
+		{ -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14 }
+	},
+	{
+		{ 2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+		{ -1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1 },
+		{ -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15 }
+	}
+};
+
+static const signed char join_3_shuffle[3][3][16] =
+{
+	{
+		{ 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1, 5 },
+		{ -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1 },
+		{ -1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1 }
+	},
+	{
+		{ -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10, -1 },
+		{ 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10 },
+		{ -1, 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1 }
+	},
+	{
+		{ -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1 },
+		{ -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1 },
+		{ 10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15 }
+	}
+};
+
+IMAGE_TARGET_SSSE3
+static inline void
+	split_3_channels_SSSE3
 	(
-		unsigned char* orig,
-		int width, int height, int channels
+		const unsigned char* src, __m128i lo[3], __m128i hi[3]
 	)
 {
-	int i;
-	/*	error check	*/
-	if( (width < 1) || (height < 1) ||
-		(channels < 3) || (channels > 4) ||
-		(orig == NULL) )
+	const __m128i zero = _mm_setzero_si128();
+	__m128i p[3];
+	int c, k;
+	for( k = 0; k < 3; ++k )
 	{
-		/*	nothing to do	*/
-		return -1;
+		p[k] = _mm_loadu_si128( (const __m128i*)(src + k*16) );
 	}
-	/*	do the conversion	*/
-	if( channels == 3 )
-	{
-		for( i = 0; i < width*height*3; i += 3 )
-		{
-			int co = orig[i+0] - 128;
-			int y  = orig[i+1];
-			int cg = orig[i+2] - 128;
-			/*	R	*/
-			orig[i+0] = clamp_byte( y + co - cg );
-			/*	G	*/
-			orig[i+1] = clamp_byte( y + cg );
-			/*	B	*/
-			orig[i+2] = clamp_byte( y - co - cg );
-		}
-	} else
+	for( c = 0; c < 3; ++c )
 	{
-		for( i = 0; i < width*height*4; i += 4 )
+		__m128i v = _mm_setzero_si128();
+		for( k = 0; k < 3; ++k )
 		{
-			int co = orig[i+0] - 128;
-			int cg = orig[i+1] - 128;
-			unsigned char a  = orig[i+2];
-			int y  = orig[i+3];
-			/*	R	*/
-			orig[i+0] = clamp_byte( y + co - cg );
-			/*	G	*/
-			orig[i+1] = clamp_byte( y + cg );
-			/*	B	*/
-			orig[i+2] = clamp_byte( y - co - cg );
-			/*	A	*/
-			orig[i+3] = a;
+			v = _mm_or_si128( v, _mm_shuffle_epi8( p[k],
+					_mm_loadu_si128( (const __m128i*)split_3_shuffle[c][k] ) ) );
 		}
+		lo[c] = _mm_unpacklo_epi8( v, zero );
+		hi[c] = _mm_unpackhi_epi8( v, zero );
 	}
-	/*	done	*/
-	return 0;
 }
 
-float
-find_max_RGBE
-(
-	unsigned char *image,
-    int width, int height
-)
+IMAGE_TARGET_SSSE3
+static inline void
+	join_3_channels_SSSE3
+	(
+		const __m128i lo[3], const __m128i hi[3], unsigned char* dst
+	)
 {
-	float max_val = 0.0f;
-	unsigned char *img = image;
-	int i, j;
-	for( i = width * height; i > 0; --i )
+	__m128i v[3];
+	int c, k;
+	for( c = 0; c < 3; ++c )
 	{
-		/* float scale = powf( 2.0f, img[3] - 128.0f ) / 255.0f; */
-		float scale = (float)ldexp( 1.0f / 255.0f, (int)(img[3]) - 128 );
-		for( j = 0; j < 3; ++j )
+		v[c] = _mm_packus_epi16( lo[c], hi[c] );
+	}
+	for( k = 0; k < 3; ++k )
+	{
+		__m128i p = _mm_setzero_si128();
+		for( c = 0; c < 3; ++c )
 		{
-			if( img[j] * scale > max_val )
-			{
-				max_val = img[j] * scale;
-			}
+			p = _mm_or_si128( p, _mm_shuffle_epi8( v[c],
+					_mm_loadu_si128( (const __m128i*)join_3_shuffle[k][c] ) ) );
 		}
-		/* next pixel */
-		img += 4;
+		_mm_storeu_si128( (__m128i*)(dst + k*16), p );
 	}
-	return max_val;
 }
 
-int
-RGBE_to_RGBdivA
-(
-    unsigned char *image,
-    int width, int height,
-    int rescale_to_max
-)
+IMAGE_TARGET_SSSE3
+static void
+	RGB_to_YCoCg3_SSSE3
+	(
+		const unsigned char* src, unsigned char* dst, int pixels
+	)
 {
-	/* local variables */
-	int i, iv;
-	unsigned char *img = image;
-	float scale = 1.0f;
-	/* error check */
-	if( (!image) || (width < 1) || (height < 1) )
-	{
-		return 0;
-	}
-	/* convert (note: no negative numbers, but 0.0 is possible) */
-	if( rescale_to_max )
+	int i = 0;
+	for( ; i + 16 <= pixels; i += 16 )
 	{
-		scale = 255.0f / find_max_RGBE( image, width, height );
+		__m128i lo[3], hi[3], out_lo[3], out_hi[3];
+		split_3_channels_SSSE3( src + i*3, lo, hi );
+		/*	CoYCg order	*/
+		RGB_to_YCoCg_SSE2( lo[0], lo[1], lo[2],
+				&out_lo[0], &out_lo[2], &out_lo[1] );
+		RGB_to_YCoCg_SSE2( hi[0], hi[1], hi[2],
+				&out_hi[0], &out_hi[2], &out_hi[1] );
+		join_3_channels_SSSE3( out_lo, out_hi, dst + i*3 );
 	}
-	for( i = width * height; i > 0; --i )
+	RGB_to_YCoCg3_scalar( src + i*3, dst + i*3, pixels - i );
+}
+
+IMAGE_TARGET_SSSE3
+static void
+	YCoCg3_to_RGB_SSSE3
+	(
+		const unsigned char* src, unsigned char* dst, int pixels
+	)
+{
+	int i = 0;
+	for( ; i + 16 <= pixels; i += 16 )
 	{
-		/* decode this pixel, and find the max */
-		float r,g,b,e, m;
-		/* e = scale * powf( 2.0f, img[3] - 128.0f ) / 255.0f; */
-		e = scale * (float)ldexp( 1.0f / 255.0f, (int)(img[3]) - 128 );
-		r = e * img[0];
-		g = e * img[1];
-		b = e * img[2];
-		m = (r > g) ? r : g;
-		m = (b > m) ? b : m;
-		/* and encode it into RGBdivA */
-		iv = (m != 0.0f) ? (int)(255.0f / m) : 1;
-		iv = (iv < 1) ? 1 : iv;
-		img[3] = (iv > 255) ? 255 : iv;
-		iv = (int)(img[3] * r + 0.5f);
-		img[0] = (iv > 255) ? 255 : iv;
-		iv = (int)(img[3] * g + 0.5f);
-		img[1] = (iv > 255) ? 255 : iv;
-		iv = (int)(img[3] * b + 0.5f);
-		img[2] = (iv > 255) ? 255 : iv;
-		/* and on to the next pixel */
-		img += 4;
+		__m128i lo[3], hi[3], out_lo[3], out_hi[3];
+		split_3_channels_SSSE3( src + i*3, lo, hi );
+		YCoCg_to_RGB_SSE2( lo[0], lo[2], lo[1],
+				&out_lo[0], &out_lo[1], &out_lo[2] );
+		YCoCg_to_RGB_SSE2( hi[0], hi[2], hi[1],
+				&out_hi[0], &out_hi[1], &out_hi[2] );
+		join_3_channels_SSSE3( out_lo, out_hi, dst + i*3 );
 	}
-	return 1;
+	YCoCg3_to_RGB_scalar( src + i*3, dst + i*3, pixels - i );
 }
 
-int
-RGBE_to_RGBdivA2
-(
-    unsigned char *image,
-    int width, int height,
-    int rescale_to_max
-)
+IMAGE_TARGET_AVX2
+static inline void
+	split_4_channels_AVX2
+	(
+		const unsigned char* src, __m256i c[4]
+	)
 {
-	/* local variables */
-	int i, iv;
-	unsigned char *img = image;
-	float scale = 1.0f;
-	/* error check */
-	if( (!image) || (width < 1) || (height < 1) )
+	const __m256i mask = _mm256_set1_epi32( 0xFF );
+	__m256i p0 = _mm256_loadu_si256( (const __m256i*)(src) );
+	__m256i p1 = _mm256_loadu_si256( (const __m256i*)(src + 32) );
+	c[0] = _mm256_packs_epi32( _mm256_and_si256( p0, mask ),
+			_mm256_and_si256( p1, mask ) );
+	c[1] = _mm256_packs_epi32(
+			_mm256_and_si256( _mm256_srli_epi32( p0, 8 ), mask ),
+			_mm256_and_si256( _mm256_srli_epi32( p1, 8 ), mask ) );
+	c[2] = _mm256_packs_epi32(
+			_mm256_and_si256( _mm256_srli_epi32( p0, 16 ), mask ),
+			_mm256_and_si256( _mm256_srli_epi32( p1, 16 ), mask ) );
+	c[3] = _mm256_packs_epi32( _mm256_srli_epi32( p0, 24 ),
+			_mm256_srli_epi32( p1, 24 ) );
+}
+
+IMAGE_TARGET_AVX2
+static inline void
+	join_4_channels_AVX2
+	(
+		__m256i c0, __m256i c1, __m256i c2, __m256i c3,
+		unsigned char* dst
+	)
+{
+	__m256i lo = _mm256_unpacklo_epi8( _mm256_packus_epi16( c0, c0 ),
+			_mm256_packus_epi16( c1, c1 ) );
+	__m256i hi = _mm256_unpacklo_epi8( _mm256_packus_epi16( c2, c2 ),
+			_mm256_packus_epi16( c3, c3 ) );
+	_mm256_storeu_si256( (__m256i*)(dst), _mm256_unpacklo_epi16( lo, hi ) );
+	_mm256_storeu_si256( (__m256i*)(dst + 32), _mm256_unpackhi_epi16( lo, hi ) );
+}
+
+IMAGE_TARGET_AVX2
+static void
+	RGB_to_YCoCg4_AVX2
+	(
+		const unsigned char* src, unsigned char* dst, int pixels
+	)
+{
+	const __m256i one = _mm256_set1_epi16( 1 );
+	const __m256i two = _mm256_set1_epi16( 2 );
+	const __m256i half = _mm256_set1_epi16( 128 );
+	int i = 0, k;
+	for( ; i + 32 <= pixels; i += 32 )
+	{
+		for( k = 0; k < 32; k += 16 )
+		{
+			__m256i c[4], g, tmp, co, cg, y;
+			split_4_channels_AVX2( src + (i+k)*4, c );
+			tmp = _mm256_srli_epi16( _mm256_add_epi16(
+					_mm256_add_epi16( c[0], c[2] ), two ), 2 );
+			g = _mm256_srli_epi16( _mm256_add_epi16( c[1], one ), 1 );
+			co = _mm256_add_epi16( half, _mm256_srai_epi16(
+					_mm256_add_epi16( _mm256_sub_epi16( c[0], c[2] ), one ), 1 ) );
+			cg = _mm256_sub_epi16( _mm256_add_epi16( half, g ), tmp );
+			y = _mm256_add_epi16( g, tmp );
+			join_4_channels_AVX2( co, cg, c[3], y, dst + (i+k)*4 );
+		}
+	}
+	RGB_to_YCoCg4_scalar( src + i*4, dst + i*4, pixels - i );
+}
+
+IMAGE_TARGET_AVX2
+static void
+	YCoCg4_to_RGB_AVX2
+	(
+		const unsigned char* src, unsigned char* dst, int pixels
+	)
+{
+	const __m256i half = _mm256_set1_epi16( 128 );
+	int i = 0, k;
+	for( ; i + 32 <= pixels; i += 32 )
+	{
+		for( k = 0; k < 32; k += 16 )
+		{
+			__m256i c[4], co, cg, r, g, b;
+			split_4_channels_AVX2( src + (i+k)*4, c );
+			co = _mm256_sub_epi16( c[0], half );
+			cg = _mm256_sub_epi16( c[1], half );
+			r = _mm256_sub_epi16( _mm256_add_epi16( c[3], co ), cg );
+			g = _mm256_add_epi16( c[3], cg );
+			b = _mm256_sub_epi16( _mm256_sub_epi16( c[3], co ), cg );
+			join_4_channels_AVX2( r, g, b, c[2], dst + (i+k)*4 );
+		}
+	}
+	YCoCg4_to_RGB_scalar( src + i*4, dst + i*4, pixels - i );
+}
+
+/*
+	The NTSC safe scaling table is matched exactly (checked for all 256
+	inputs) by 15 + round( (2x * 56539) >> 16, 1 bit ), which is a
+	mulhi and an avg per 8 bytes.  alpha_mask keeps the alpha bytes of
+	2 and 4 channel images; count is a multiple of the vector size.
+*/
+static inline __m128i
+	NTSC_scale_SSE2
+	(
+		__m128i x
+	)
+{
+	const __m128i scale = _mm_set1_epi16( (short)56539 );
+	const __m128i offset = _mm_set1_epi16( 15 );
+	const __m128i zero = _mm_setzero_si128();
+	x = _mm_add_epi16( x, x );
+	return _mm_add_epi16( offset,
+			_mm_avg_epu16( _mm_mulhi_epu16( x, scale ), zero ) );
+}
+
+static void
+	scale_NTSC_safe_SSE2
+	(
+		unsigned char* data, int count, __m128i alpha_mask
+	)
+{
+	const __m128i zero = _mm_setzero_si128();
+	int i;
+	for( i = 0; i < count; i += 16 )
+	{
+		__m128i v = _mm_loadu_si128( (const __m128i*)(data + i) );
+		__m128i s = _mm_packus_epi16(
+				NTSC_scale_SSE2( _mm_unpacklo_epi8( v, zero ) ),
+				NTSC_scale_SSE2( _mm_unpackhi_epi8( v, zero ) ) );
+		s = _mm_or_si128( _mm_and_si128( alpha_mask, v ),
+				_mm_andnot_si128( alpha_mask, s ) );
+		_mm_storeu_si128( (__m128i*)(data + i), s );
+	}
+}
+
+IMAGE_TARGET_AVX2
+static void
+	scale_NTSC_safe_AVX2
+	(
+		unsigned char* data, int count, __m128i alpha_mask_128
+	)
+{
+	const __m256i scale = _mm256_set1_epi16( (short)56539 );
+	const __m256i offset = _mm256_set1_epi16( 15 );
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i alpha_mask = _mm256_broadcastsi128_si256( alpha_mask_128 );
+	int i;
+	for( i = 0; i < count; i += 32 )
+	{
+		__m256i v = _mm256_loadu_si256( (const __m256i*)(data + i) );
+		__m256i lo = _mm256_unpacklo_epi8( v, zero );
+		__m256i hi = _mm256_unpackhi_epi8( v, zero );
+		__m256i s;
+		lo = _mm256_add_epi16( offset, _mm256_avg_epu16(
+				_mm256_mulhi_epu16( _mm256_add_epi16( lo, lo ), scale ), zero ) );
+		hi = _mm256_add_epi16( offset, _mm256_avg_epu16(
+				_mm256_mulhi_epu16( _mm256_add_epi16( hi, hi ), scale ), zero ) );
+		s = _mm256_packus_epi16( lo, hi );
+		s = _mm256_blendv_epi8( s, v, alpha_mask );
+		_mm256_storeu_si256( (__m256i*)(data + i), s );
+	}
+}
+#endif
+
+int
+	scale_image_RGB_to_NTSC_safe
+	(
+		unsigned char* orig,
+		int width, int height, int channels
+	)
+{
+	const float scale_lo = 16.0f - 0.499f;
+	const float scale_hi = 235.0f + 0.499f;
+	int i = 0, j;
+	int nc = channels;
+	unsigned char scale_LUT[256];
+	/*	error check	*/
+	if( (width < 1) || (height < 1) ||
+		(channels < 1) || (orig == NULL) )
 	{
+		/*	nothing to do	*/
 		return 0;
 	}
-	/* convert (note: no negative numbers, but 0.0 is possible) */
-	if( rescale_to_max )
+	/*	for channels = 2 or 4, ignore the alpha component	*/
+	nc -= 1 - (channels & 1);
+#ifdef IMAGE_SIMD_X86
+	/*	whole vectors of whole pixels, so the alpha bytes stay put	*/
+	if( image_cpu_features() & IMAGE_CPU_SSE2 )
+	{
+		const int count = width*height*channels;
+		__m128i alpha_mask = _mm_setzero_si128();
+		if( channels == 2 )
+		{
+			alpha_mask = _mm_set1_epi16( (short)0xFF00 );
+		} else if( channels == 4 )
+		{
+			alpha_mask = _mm_set1_epi32( (int)0xFF000000 );
+		}
+		if( image_cpu_features() & IMAGE_CPU_AVX2 )
+		{
+			i = count - count % (32*channels);
+			scale_NTSC_safe_AVX2( orig, i, alpha_mask );
+		} else
+		{
+			i = count - count % (16*channels);
+			scale_NTSC_safe_SSE2( orig, i, alpha_mask );
+		}
+	}
+#endif
+	/*	set up the scaling Look Up Table	*/
+	for( j = 0; j < 256; ++j )
+	{
+		scale_LUT[j] = (unsigned char)((scale_hi - scale_lo) * j / 255.0f + scale_lo);
+	}
+	/*	OK, go through the image and scale any non-alpha components	*/
+	for( ; i < width*height*channels; i += channels )
+	{
+		for( j = 0; j < nc; ++j )
+		{
+			orig[i+j] = scale_LUT[orig[i+j]];
+		}
+	}
+	return 1;
+}
+
+/*	the widest RGB to YCoCg kernel for 3 or 4 channels	*/
+static color_kernel_func RGB_to_YCoCg_kernel( int channels )
+{
+	static color_kernel_func kernels[2] = { NULL, NULL };
+	if( NULL == kernels[0] )
+	{
+		color_kernel_func three = RGB_to_YCoCg3_scalar;
+		color_kernel_func four = RGB_to_YCoCg4_scalar;
+#ifdef IMAGE_SIMD_X86
+		if( image_cpu_features() & IMAGE_CPU_AVX2 )
+		{
+			four = RGB_to_YCoCg4_AVX2;
+		} else if( image_cpu_features() & IMAGE_CPU_SSE2 )
+		{
+			four = RGB_to_YCoCg4_SSE2;
+		}
+		if( image_cpu_features() & IMAGE_CPU_SSSE3 )
+		{
+			three = RGB_to_YCoCg3_SSSE3;
+		}
+#endif
+		kernels[1] = four;
+		kernels[0] = three;
+	}
+	return kernels[channels - 3];
+}
+
+/*	the widest YCoCg to RGB kernel for 3 or 4 channels	*/
+static color_kernel_func YCoCg_to_RGB_kernel( int channels )
+{
+	static color_kernel_func kernels[2] = { NULL, NULL };
+	if( NULL == kernels[0] )
+	{
+		color_kernel_func three = YCoCg3_to_RGB_scalar;
+		color_kernel_func four = YCoCg4_to_RGB_scalar;
+#ifdef IMAGE_SIMD_X86
+		if( image_cpu_features() & IMAGE_CPU_AVX2 )
+		{
+			four = YCoCg4_to_RGB_AVX2;
+		} else if( image_cpu_features() & IMAGE_CPU_SSE2 )
+		{
+			four = YCoCg4_to_RGB_SSE2;
+		}
+		if( image_cpu_features() & IMAGE_CPU_SSSE3 )
+		{
+			three = YCoCg3_to_RGB_SSSE3;
+		}
+#endif
+		kernels[1] = four;
+		kernels[0] = three;
+	}
+	return kernels[channels - 3];
+}
+
+/*
+	This function takes the RGB components of the image
+	and converts them into YCoCg.  3 components will be
+	re-ordered to CoYCg (for optimum DXT1 compression),
+	while 4 components will be ordered CoCgAY (for DXT5
+	compression).
+*/
+int
+	convert_RGB_to_YCoCg
+	(
+		unsigned char* orig,
+		int width, int height, int channels
+	)
+{
+	return convert_RGB_to_YCoCg_copy( orig, width, height, channels, orig );
+}
+
+int
+	convert_RGB_to_YCoCg_copy
+	(
+		const unsigned char* const orig,
+		int width, int height, int channels,
+		unsigned char* converted
+	)
+{
+	/*	error check	*/
+	if( (width < 1) || (height < 1) ||
+		(channels < 3) || (channels > 4) ||
+		(orig == NULL) || (converted == NULL) )
+	{
+		/*	nothing to do	*/
+		return -1;
+	}
+	/*	do the conversion	*/
+	RGB_to_YCoCg_kernel( channels )( orig, converted, width*height );
+	/*	done	*/
+	return 0;
+}
+
+/*
+	This function takes the YCoCg components of the image
+	and converts them into RGB.  See above.
+*/
+int
+	convert_YCoCg_to_RGB
+	(
+		unsigned char* orig,
+		int width, int height, int channels
+	)
+{
+	/*	error check	*/
+	if( (width < 1) || (height < 1) ||
+		(channels < 3) || (channels > 4) ||
+		(orig == NULL) )
+	{
+		/*	nothing to do	*/
+		return -1;
+	}
+	/*	do the conversion	*/
+	YCoCg_to_RGB_kernel( channels )( orig, orig, width*height );
+	/*	done	*/
+	return 0;
+}
+
+/*
+	The RGBE conversions work on spans of whole pixels, 4 at a time with
+	SSE2, and the drivers below hand out bands of rows to threads.
+	Every float operation is the same one, in the same order, as in the
+	scalar code, so the output does not depend on either.
+*/
+
+/*	the bands of rows given to each task: about 64K pixels	*/
+static int RGBE_rows_per_task( int width )
+{
+	int rows = 65536 / width;
+	return (rows < 1) ? 1 : rows;
+}
+
+#ifdef IMAGE_SIMD_X86
+/*
+	(float)ldexp( 1.0f / 255.0f, e - 128 ) for 4 exponents.  Adding to
+	the exponent bits is exact while the result is a normal float; below
+	that (e < 10) it is scaled in two steps, so the result is rounded
+	once, just as the double result of ldexp is.
+*/
+static inline __m128
+	RGBE_exponent_scale_SSE2
+	(
+		__m128i e
+	)
+{
+	const __m128 one_255 = _mm_set1_ps( 1.0f / 255.0f );
+	const __m128i n = _mm_sub_epi32( e, _mm_set1_epi32( 128 ) );
+	__m128i normal = _mm_add_epi32( _mm_castps_si128( one_255 ),
+			_mm_slli_epi32( n, 23 ) );
+	__m128 tiny = _mm_mul_ps( _mm_mul_ps( one_255, _mm_castsi128_ps(
+			_mm_slli_epi32( _mm_add_epi32( n, _mm_set1_epi32( 64 + 127 ) ), 23 ) ) ),
+			_mm_castsi128_ps( _mm_set1_epi32( (127 - 64) << 23 ) ) );
+	__m128i is_tiny = _mm_cmplt_epi32( e, _mm_set1_epi32( 10 ) );
+	return _mm_or_ps( _mm_and_ps( _mm_castsi128_ps( is_tiny ), tiny ),
+			_mm_andnot_ps( _mm_castsi128_ps( is_tiny ), _mm_castsi128_ps( normal ) ) );
+}
+
+/*	4 RGBE pixels, one float lane per pixel for each component	*/
+static inline void
+	RGBE_split_SSE2
+	(
+		const unsigned char* img,
+		__m128* r, __m128* g, __m128* b, __m128i* e
+	)
+{
+	const __m128i mask = _mm_set1_epi32( 0xFF );
+	__m128i p = _mm_loadu_si128( (const __m128i*)img );
+	*r = _mm_cvtepi32_ps( _mm_and_si128( p, mask ) );
+	*g = _mm_cvtepi32_ps( _mm_and_si128( _mm_srli_epi32( p, 8 ), mask ) );
+	*b = _mm_cvtepi32_ps( _mm_and_si128( _mm_srli_epi32( p, 16 ), mask ) );
+	*e = _mm_srli_epi32( p, 24 );
+}
+
+/*	packs 4 pixels of int lanes back into RGBA bytes; the casts in the
+	scalar code turn an out of range float into INT_MIN, which packs
+	to 0 here just as it truncates to 0 there	*/
+static inline void
+	RGBE_join_SSE2
+	(
+		__m128i r, __m128i g, __m128i b, __m128i a, unsigned char* img
+	)
+{
+	__m128i x = _mm_packus_epi16( _mm_packs_epi32( r, g ),
+			_mm_packs_epi32( b, a ) );
+	x = _mm_unpacklo_epi8( x, _mm_srli_si128( x, 8 ) );
+	x = _mm_unpacklo_epi8( x, _mm_srli_si128( x, 8 ) );
+	_mm_storeu_si128( (__m128i*)img, x );
+}
+
+/*	clamps the int lanes of a new alpha to [1,255]	*/
+static inline __m128i
+	RGBE_alpha_SSE2
+	(
+		__m128i iv
+	)
+{
+	iv = _mm_packs_epi32( iv, iv );
+	iv = _mm_min_epi16( _mm_max_epi16( iv, _mm_set1_epi16( 1 ) ),
+			_mm_set1_epi16( 255 ) );
+	return _mm_unpacklo_epi16( iv, _mm_setzero_si128() );
+}
+#endif
+
+static float
+	find_max_RGBE_span
+	(
+		const unsigned char *img, int pixels
+	)
+{
+	float max_val = 0.0f;
+	int i = 0, j;
+#ifdef IMAGE_SIMD_X86
+	{
+		__m128 vmax = _mm_setzero_ps();
+		float lanes[4];
+		for( ; i + 4 <= pixels; i += 4, img += 16 )
+		{
+			__m128 r, g, b, scale;
+			__m128i e;
+			RGBE_split_SSE2( img, &r, &g, &b, &e );
+			scale = RGBE_exponent_scale_SSE2( e );
+			vmax = _mm_max_ps( vmax, _mm_mul_ps( r, scale ) );
+			vmax = _mm_max_ps( vmax, _mm_mul_ps( g, scale ) );
+			vmax = _mm_max_ps( vmax, _mm_mul_ps( b, scale ) );
+		}
+		_mm_storeu_ps( lanes, vmax );
+		for( j = 0; j < 4; ++j )
+		{
+			max_val = (lanes[j] > max_val) ? lanes[j] : max_val;
+		}
+	}
+#endif
+	for( ; i < pixels; ++i )
+	{
+		/* float scale = powf( 2.0f, img[3] - 128.0f ) / 255.0f; */
+		float scale = (float)ldexp( 1.0f / 255.0f, (int)(img[3]) - 128 );
+		for( j = 0; j < 3; ++j )
+		{
+			if( img[j] * scale > max_val )
+			{
+				max_val = img[j] * scale;
+			}
+		}
+		/* next pixel */
+		img += 4;
+	}
+	return max_val;
+}
+
+static void
+	RGBE_to_RGBdivA_span
+	(
+		unsigned char *img, int pixels, float scale
+	)
+{
+	int i = 0, iv;
+#ifdef IMAGE_SIMD_X86
 	{
-		scale = 255.0f * 255.0f / find_max_RGBE( image, width, height );
+		const __m128 vscale = _mm_set1_ps( scale );
+		const __m128 half = _mm_set1_ps( 0.5f );
+		const __m128 top = _mm_set1_ps( 255.0f );
+		for( ; i + 4 <= pixels; i += 4, img += 16 )
+		{
+			__m128 r, g, b, e, m, a;
+			__m128i ev, av;
+			RGBE_split_SSE2( img, &r, &g, &b, &ev );
+			e = _mm_mul_ps( vscale, RGBE_exponent_scale_SSE2( ev ) );
+			r = _mm_mul_ps( e, r );
+			g = _mm_mul_ps( e, g );
+			b = _mm_mul_ps( e, b );
+			m = _mm_max_ps( b, _mm_max_ps( r, g ) );
+			/*	m == 0 divides to infinity, which also ends up as 1	*/
+			av = RGBE_alpha_SSE2( _mm_cvttps_epi32( _mm_div_ps( top, m ) ) );
+			a = _mm_cvtepi32_ps( av );
+			RGBE_join_SSE2(
+					_mm_cvttps_epi32( _mm_add_ps( _mm_mul_ps( a, r ), half ) ),
+					_mm_cvttps_epi32( _mm_add_ps( _mm_mul_ps( a, g ), half ) ),
+					_mm_cvttps_epi32( _mm_add_ps( _mm_mul_ps( a, b ), half ) ),
+					av, img );
+		}
 	}
-	for( i = width * height; i > 0; --i )
+#endif
+	for( ; i < pixels; ++i )
 	{
 		/* decode this pixel, and find the max */
 		float r,g,b,e, m;
@@ -419,17 +1287,857 @@ RGBE_to_RGBdivA2
 		m = (r > g) ? r : g;
 		m = (b > m) ? b : m;
 		/* and encode it into RGBdivA */
-		iv = (m != 0.0f) ? (int)sqrtf( 255.0f * 255.0f / m ) : 1;
+		iv = (m != 0.0f) ? (int)(255.0f / m) : 1;
 		iv = (iv < 1) ? 1 : iv;
 		img[3] = (iv > 255) ? 255 : iv;
-		iv = (int)(img[3] * img[3] * r / 255.0f + 0.5f);
+		iv = (int)(img[3] * r + 0.5f);
 		img[0] = (iv > 255) ? 255 : iv;
-		iv = (int)(img[3] * img[3] * g / 255.0f + 0.5f);
+		iv = (int)(img[3] * g + 0.5f);
 		img[1] = (iv > 255) ? 255 : iv;
-		iv = (int)(img[3] * img[3] * b / 255.0f + 0.5f);
+		iv = (int)(img[3] * b + 0.5f);
 		img[2] = (iv > 255) ? 255 : iv;
 		/* and on to the next pixel */
 		img += 4;
 	}
-	return 1;
+}
+
+static void
+	RGBE_to_RGBdivA2_span
+	(
+		unsigned char *img, int pixels, float scale
+	)
+{
+	int i = 0, iv;
+#ifdef IMAGE_SIMD_X86
+	{
+		const __m128 vscale = _mm_set1_ps( scale );
+		const __m128 half = _mm_set1_ps( 0.5f );
+		const __m128 top = _mm_set1_ps( 255.0f );
+		const __m128 top2 = _mm_set1_ps( 255.0f * 255.0f );
+		for( ; i + 4 <= pixels; i += 4, img += 16 )
+		{
+			__m128 r, g, b, e, m, a2;
+			__m128i ev, av;
+			RGBE_split_SSE2( img, &r, &g, &b, &ev );
+			e = _mm_mul_ps( vscale, RGBE_exponent_scale_SSE2( ev ) );
+			r = _mm_mul_ps( e, r );
+			g = _mm_mul_ps( e, g );
+			b = _mm_mul_ps( e, b );
+			m = _mm_max_ps( b, _mm_max_ps( r, g ) );
+			av = RGBE_alpha_SSE2( _mm_cvttps_epi32(
+					_mm_sqrt_ps( _mm_div_ps( top2, m ) ) ) );
+			/*	A*A is at most 65025, exact as a float	*/
+			a2 = _mm_cvtepi32_ps( av );
+			a2 = _mm_mul_ps( a2, a2 );
+			RGBE_join_SSE2(
+					_mm_cvttps_epi32( _mm_add_ps( _mm_div_ps(
+						_mm_mul_ps( a2, r ), top ), half ) ),
+					_mm_cvttps_epi32( _mm_add_ps( _mm_div_ps(
+						_mm_mul_ps( a2, g ), top ), half ) ),
+					_mm_cvttps_epi32( _mm_add_ps( _mm_div_ps(
+						_mm_mul_ps( a2, b ), top ), half ) ),
+					av, img );
+		}
+	}
+#endif
+	for( ; i < pixels; ++i )
+	{
+		/* decode this pixel, and find the max */
+		float r,g,b,e, m;
+		/* e = scale * powf( 2.0f, img[3] - 128.0f ) / 255.0f; */
+		e = scale * (float)ldexp( 1.0f / 255.0f, (int)(img[3]) - 128 );
+		r = e * img[0];
+		g = e * img[1];
+		b = e * img[2];
+		m = (r > g) ? r : g;
+		m = (b > m) ? b : m;
+		/* and encode it into RGBdivA */
+		iv = (m != 0.0f) ? (int)sqrtf( 255.0f * 255.0f / m ) : 1;
+		iv = (iv < 1) ? 1 : iv;
+		img[3] = (iv > 255) ? 255 : iv;
+		iv = (int)(img[3] * img[3] * r / 255.0f + 0.5f);
+		img[0] = (iv > 255) ? 255 : iv;
+		iv = (int)(img[3] * img[3] * g / 255.0f + 0.5f);
+		img[1] = (iv > 255) ? 255 : iv;
+		iv = (int)(img[3] * img[3] * b / 255.0f + 0.5f);
+		img[2] = (iv > 255) ? 255 : iv;
+		/* and on to the next pixel */
+		img += 4;
+	}
+}
+
+/*
+	Float to half, rounding to nearest even, for the non-negative
+	floats RGBE decodes to; anything too big for a half comes out as
+	the largest one, 65504, rather than infinity.  Subnormal halves are
+	rounded by the float addition of a magic number.
+*/
+static unsigned short
+	float_to_half
+	(
+		float f
+	)
+{
+	const float denorm_magic = 0.5f;	/*	2^-1: ((127 - 15) + (23 - 10) + 1) << 23	*/
+	unsigned int u;
+	if( !(f < 65504.0f) )
+	{
+		return 0x7BFF;
+	}
+	memcpy( &u, &f, 4 );
+	if( u < (113u << 23) )
+	{
+		/*	zero or a subnormal half	*/
+		f += denorm_magic;
+		memcpy( &u, &f, 4 );
+		return (unsigned short)(u - 0x3F000000u);
+	}
+	/*	rebias the exponent and round the mantissa	*/
+	u += ((unsigned int)(15 - 127) << 23) + 0xFFF + ((u >> 13) & 1);
+	return (unsigned short)(u >> 13);
+}
+
+#ifdef IMAGE_SIMD_X86
+static inline __m128i
+	float_to_half_SSE2
+	(
+		__m128 f
+	)
+{
+	const __m128 denorm_magic = _mm_set1_ps( 0.5f );
+	__m128i u, normal, tiny, is_tiny;
+	f = _mm_min_ps( f, _mm_set1_ps( 65504.0f ) );
+	u = _mm_castps_si128( f );
+	tiny = _mm_sub_epi32( _mm_castps_si128( _mm_add_ps( f, denorm_magic ) ),
+			_mm_castps_si128( denorm_magic ) );
+	normal = _mm_add_epi32( u, _mm_set1_epi32( (int)(((unsigned int)(15 - 127) << 23) + 0xFFF) ) );
+	normal = _mm_add_epi32( normal,
+			_mm_and_si128( _mm_srli_epi32( u, 13 ), _mm_set1_epi32( 1 ) ) );
+	normal = _mm_srli_epi32( normal, 13 );
+	is_tiny = _mm_cmplt_epi32( u, _mm_set1_epi32( 113 << 23 ) );
+	return _mm_or_si128( _mm_and_si128( is_tiny, tiny ),
+			_mm_andnot_si128( is_tiny, normal ) );
+}
+#endif
+
+/*	the Radiance decoding, m * 2^(e - 136), which is what stb_image's
+	float loader gives for these pixels	*/
+static void
+	RGBE_to_RGB16F_span
+	(
+		const unsigned char *img, int pixels, unsigned short *out
+	)
+{
+	int i = 0, j;
+#ifdef IMAGE_SIMD_X86
+	{
+		const __m128i zero = _mm_setzero_si128();
+		for( ; i + 4 <= pixels; i += 4, img += 16, out += 12 )
+		{
+			__m128 r, g, b, f1;
+			__m128i e, n, pow2, tiny, rg, b0;
+			RGBE_split_SSE2( img, &r, &g, &b, &e );
+			/*	2^(e-136): exponent bits while normal, 2^(e-72) * 2^-64
+				for the exact subnormal powers below that, and 0 for e == 0	*/
+			n = _mm_sub_epi32( e, _mm_set1_epi32( 136 ) );
+			pow2 = _mm_slli_epi32( _mm_add_epi32( n, _mm_set1_epi32( 127 ) ), 23 );
+			tiny = _mm_castps_si128( _mm_mul_ps( _mm_castsi128_ps( _mm_slli_epi32(
+					_mm_add_epi32( n, _mm_set1_epi32( 64 + 127 ) ), 23 ) ),
+					_mm_castsi128_ps( _mm_set1_epi32( (127 - 64) << 23 ) ) ) );
+			pow2 = _mm_or_si128( _mm_and_si128( _mm_cmplt_epi32( e, _mm_set1_epi32( 10 ) ), tiny ),
+					_mm_andnot_si128( _mm_cmplt_epi32( e, _mm_set1_epi32( 10 ) ), pow2 ) );
+			pow2 = _mm_andnot_si128( _mm_cmpeq_epi32( e, zero ), pow2 );
+			f1 = _mm_castsi128_ps( pow2 );
+			/*	every half fits in 15 bits, so packs can't saturate	*/
+			rg = _mm_packs_epi32( float_to_half_SSE2( _mm_mul_ps( r, f1 ) ),
+					float_to_half_SSE2( _mm_mul_ps( g, f1 ) ) );
+			b0 = _mm_packs_epi32( float_to_half_SSE2( _mm_mul_ps( b, f1 ) ), zero );
+			{
+				unsigned short lanes[16];
+				_mm_storeu_si128( (__m128i*)lanes, rg );
+				_mm_storeu_si128( (__m128i*)(lanes + 8), b0 );
+				for( j = 0; j < 4; ++j )
+				{
+					out[j*3+0] = lanes[j];
+					out[j*3+1] = lanes[4+j];
+					out[j*3+2] = lanes[8+j];
+				}
+			}
+		}
+	}
+#endif
+	for( ; i < pixels; ++i, img += 4, out += 3 )
+	{
+		float f1 = 0.0f;
+		if( img[3] != 0 )
+		{
+			f1 = (float)ldexp( 1.0f, (int)(img[3]) - (128 + 8) );
+		}
+		for( j = 0; j < 3; ++j )
+		{
+			out[j] = float_to_half( img[j] * f1 );
+		}
+	}
+}
+
+typedef struct
+{
+	unsigned char *image;
+	unsigned short *half_rgb;
+	int width, height, rows_per_task;
+	float scale;
+	float *maxima;
+}
+RGBE_job;
+
+static int RGBE_job_task_pixels( RGBE_job *job, int index, int *first )
+{
+	int rows = job->height - index * job->rows_per_task;
+	rows = (rows > job->rows_per_task) ? job->rows_per_task : rows;
+	*first = index * job->rows_per_task * job->width;
+	return rows * job->width;
+}
+
+static void RGBE_max_task( void *context, int index )
+{
+	RGBE_job *job = (RGBE_job *)context;
+	int first, pixels = RGBE_job_task_pixels( job, index, &first );
+	job->maxima[index] = find_max_RGBE_span( job->image + first*4, pixels );
+}
+
+static void RGBE_divA_task( void *context, int index )
+{
+	RGBE_job *job = (RGBE_job *)context;
+	int first, pixels = RGBE_job_task_pixels( job, index, &first );
+	RGBE_to_RGBdivA_span( job->image + first*4, pixels, job->scale );
+}
+
+static void RGBE_divA2_task( void *context, int index )
+{
+	RGBE_job *job = (RGBE_job *)context;
+	int first, pixels = RGBE_job_task_pixels( job, index, &first );
+	RGBE_to_RGBdivA2_span( job->image + first*4, pixels, job->scale );
+}
+
+static void RGBE_half_task( void *context, int index )
+{
+	RGBE_job *job = (RGBE_job *)context;
+	int first, pixels = RGBE_job_task_pixels( job, index, &first );
+	RGBE_to_RGB16F_span( job->image + first*4, pixels, job->half_rgb + first*3 );
+}
+
+/*	the largest decoded component, found on up to thread_count threads;
+	a negative result means it ran out of memory	*/
+static float
+	find_max_RGBE_parallel
+	(
+		unsigned char *image,
+		int width, int height,
+		int thread_count
+	)
+{
+	RGBE_job job;
+	float max_val = 0.0f;
+	int i, tasks;
+	job.image = image;
+	job.width = width;
+	job.height = height;
+	job.rows_per_task = RGBE_rows_per_task( width );
+	tasks = (height + job.rows_per_task - 1) / job.rows_per_task;
+	job.maxima = (float*)image_malloc( tasks * sizeof(float) );
+	if( NULL == job.maxima )
+	{
+		return -1.0f;
+	}
+	image_parallel_for( tasks, thread_count, RGBE_max_task, &job );
+	for( i = 0; i < tasks; ++i )
+	{
+		max_val = (job.maxima[i] > max_val) ? job.maxima[i] : max_val;
+	}
+	image_free( job.maxima );
+	return max_val;
+}
+
+float
+find_max_RGBE
+(
+	unsigned char *image,
+    int width, int height
+)
+{
+	return find_max_RGBE_span( image, width * height );
+}
+
+/*	the shared driver of the RGBdivA and RGBdivA2 conversions	*/
+static int
+	RGBE_convert_parallel
+	(
+		unsigned char *image,
+		int width, int height,
+		float max_scale, int rescale_to_max,
+		int thread_count, image_task_func task
+	)
+{
+	RGBE_job job;
+	/* error check */
+	if( (!image) || (width < 1) || (height < 1) )
+	{
+		return 0;
+	}
+	job.image = image;
+	job.width = width;
+	job.height = height;
+	job.rows_per_task = RGBE_rows_per_task( width );
+	job.scale = 1.0f;
+	/* convert (note: no negative numbers, but 0.0 is possible) */
+	if( rescale_to_max )
+	{
+		float max_val = find_max_RGBE_parallel( image, width, height, thread_count );
+		if( max_val < 0.0f )
+		{
+			return 0;
+		}
+		job.scale = max_scale / max_val;
+	}
+	return image_parallel_for(
+			(height + job.rows_per_task - 1) / job.rows_per_task,
+			thread_count, task, &job );
+}
+
+int
+RGBE_to_RGBdivA
+(
+    unsigned char *image,
+    int width, int height,
+    int rescale_to_max
+)
+{
+	return RGBE_to_RGBdivA_parallel( image, width, height, rescale_to_max, 1 );
+}
+
+int
+RGBE_to_RGBdivA_parallel
+(
+    unsigned char *image,
+    int width, int height,
+    int rescale_to_max, int thread_count
+)
+{
+	return RGBE_convert_parallel( image, width, height, 255.0f,
+			rescale_to_max, thread_count, RGBE_divA_task );
+}
+
+int
+RGBE_to_RGBdivA2
+(
+    unsigned char *image,
+    int width, int height,
+    int rescale_to_max
+)
+{
+	return RGBE_to_RGBdivA2_parallel( image, width, height, rescale_to_max, 1 );
+}
+
+int
+RGBE_to_RGBdivA2_parallel
+(
+    unsigned char *image,
+    int width, int height,
+    int rescale_to_max, int thread_count
+)
+{
+	return RGBE_convert_parallel( image, width, height, 255.0f * 255.0f,
+			rescale_to_max, thread_count, RGBE_divA2_task );
+}
+
+int
+RGBE_to_RGB16F
+(
+    const unsigned char *image,
+    int width, int height,
+    unsigned short *half_rgb,
+    int thread_count
+)
+{
+	RGBE_job job;
+	/* error check */
+	if( (!image) || (!half_rgb) || (width < 1) || (height < 1) )
+	{
+		return 0;
+	}
+	job.image = (unsigned char *)image;
+	job.half_rgb = half_rgb;
+	job.width = width;
+	job.height = height;
+	job.rows_per_task = RGBE_rows_per_task( width );
+	return image_parallel_for(
+			(height + job.rows_per_task - 1) / job.rows_per_task,
+			thread_count, RGBE_half_task, &job );
+}
+
+/*	filter weights are fixed point, with this many fractional bits	*/
+#define IMAGE_FILTER_BITS 14
+
+static float
+	image_filter_sinc
+	(
+		float x
+	)
+{
+	if( x < 1e-6f )
+	{
+		return 1.0f;
+	}
+	x *= 3.14159265358979f;
+	return sinf( x ) / x;
+}
+
+/*	the zeroth order modified Bessel function, for the Kaiser window	*/
+static float
+	image_filter_bessel_I0
+	(
+		float x
+	)
+{
+	float sum = 1.0f, term = 1.0f;
+	int k;
+	for( k = 1; k < 32; ++k )
+	{
+		float t = x / (2.0f * k);
+		term *= t * t;
+		sum += term;
+		if( term < sum * 1e-8f )
+		{
+			break;
+		}
+	}
+	return sum;
+}
+
+static float
+	image_filter_radius
+	(
+		int filter
+	)
+{
+	switch( filter )
+	{
+	case IMAGE_FILTER_BOX:		return 0.5f;
+	case IMAGE_FILTER_BILINEAR:	return 1.0f;
+	default:					return 3.0f;
+	}
+}
+
+static float
+	image_filter_evaluate
+	(
+		int filter, float x
+	)
+{
+	x = fabsf( x );
+	switch( filter )
+	{
+	case IMAGE_FILTER_BOX:
+		return (x < 0.5f) ? 1.0f : ((x == 0.5f) ? 0.5f : 0.0f);
+	case IMAGE_FILTER_BILINEAR:
+		return (x < 1.0f) ? 1.0f - x : 0.0f;
+	case IMAGE_FILTER_LANCZOS3:
+		return (x < 3.0f) ? image_filter_sinc( x ) * image_filter_sinc( x / 3.0f ) : 0.0f;
+	case IMAGE_FILTER_KAISER:
+		if( x < 3.0f )
+		{
+			const float alpha = 4.0f;
+			float r = x / 3.0f;
+			return image_filter_sinc( x ) *
+					image_filter_bessel_I0( alpha * sqrtf( 1.0f - r * r ) ) /
+					image_filter_bessel_I0( alpha );
+		}
+		return 0.0f;
+	}
+	return 0.0f;
+}
+
+/*
+	Works out, for every output pixel along one axis, the first source
+	pixel it reads (spans[2*i]), how many it reads (spans[2*i+1]) and
+	their weights (weights[i*max_taps...], padded with zeros to an even
+	count).  Taps past the edges are folded onto the edge pixels, so the
+	source pixels of an output are always contiguous.
+	Returns the weights (free them), or NULL if out of memory.
+*/
+static short*
+	image_filter_weights
+	(
+		int src_size, int dst_size, int filter,
+		int* spans, int* max_taps_out
+	)
+{
+	const float scale = (float)dst_size / (float)src_size;
+	const float filter_scale = (scale < 1.0f) ? scale : 1.0f;
+	const float support = image_filter_radius( filter ) / filter_scale;
+	int max_taps = (int)ceilf( support * 2.0f ) + 2;
+	short* weights;
+	float* fw;
+	int i, j;
+	max_taps += max_taps & 1;
+	weights = (short*)image_malloc( dst_size * max_taps * sizeof(short) );
+	fw = (float*)image_malloc( max_taps * sizeof(float) );
+	if( (NULL == weights) || (NULL == fw) )
+	{
+		image_free( weights );
+		image_free( fw );
+		return NULL;
+	}
+	memset( weights, 0, dst_size * max_taps * sizeof(short) );
+	for( i = 0; i < dst_size; ++i )
+	{
+		const float center = (i + 0.5f) / scale - 0.5f;
+		int lo = (int)ceilf( center - support );
+		int hi = (int)floorf( center + support );
+		int first, last, count, largest = 0, total_fixed = 0;
+		short* w = weights + i * max_taps;
+		float total = 0.0f;
+		if( hi - lo + 1 > max_taps )
+		{
+			hi = lo + max_taps - 1;
+		}
+		first = (lo < 0) ? 0 : lo;
+		last = (hi > src_size - 1) ? src_size - 1 : hi;
+		if( first > src_size - 1 ) { first = src_size - 1; }
+		if( last < first ) { last = first; }
+		count = last - first + 1;
+		for( j = 0; j < count; ++j )
+		{
+			fw[j] = 0.0f;
+		}
+		for( j = lo; j <= hi; ++j )
+		{
+			int clamped = (j < first) ? first : ((j > last) ? last : j);
+			fw[clamped - first] += image_filter_evaluate( filter, (j - center) * filter_scale );
+		}
+		for( j = 0; j < count; ++j )
+		{
+			total += fw[j];
+		}
+		if( total == 0.0f )
+		{
+			/*	nothing in reach, so point sample	*/
+			int nearest = (int)floorf( center + 0.5f );
+			nearest = (nearest < first) ? first : ((nearest > last) ? last : nearest);
+			fw[nearest - first] = total = 1.0f;
+		}
+		/*	round to fixed point, then give the error to the biggest tap
+			so the weights always sum to exactly 1	*/
+		for( j = 0; j < count; ++j )
+		{
+			float v = fw[j] / total * (1 << IMAGE_FILTER_BITS);
+			w[j] = (short)((v < 0.0f) ? (v - 0.5f) : (v + 0.5f));
+			total_fixed += w[j];
+			if( abs( w[j] ) > abs( w[largest] ) )
+			{
+				largest = j;
+			}
+		}
+		w[largest] += (short)((1 << IMAGE_FILTER_BITS) - total_fixed);
+		spans[2*i] = first;
+		spans[2*i+1] = count;
+	}
+	image_free( fw );
+	*max_taps_out = max_taps;
+	return weights;
+}
+
+static unsigned char
+	image_filter_round
+	(
+		int acc
+	)
+{
+	acc = (acc + (1 << (IMAGE_FILTER_BITS - 1))) >> IMAGE_FILTER_BITS;
+	return (unsigned char)((acc < 0) ? 0 : ((acc > 255) ? 255 : acc));
+}
+
+/*	filters whole rows of bytes together (the vertical pass)	*/
+static void
+	image_filter_rows
+	(
+		const unsigned char* src, int row_bytes,
+		int first, int count, const short* w,
+		unsigned char* out
+	)
+{
+	int k = 0, t;
+#ifdef IMAGE_SIMD_X86
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i round = _mm_set1_epi32( 1 << (IMAGE_FILTER_BITS - 1) );
+	for( ; k + 16 <= row_bytes; k += 16 )
+	{
+		__m128i acc0 = round, acc1 = round, acc2 = round, acc3 = round;
+		/*	two rows at a time, interleaved so madd does both taps	*/
+		for( t = 0; t < count; t += 2 )
+		{
+			const unsigned char* row0 = src + (first + t) * row_bytes;
+			const unsigned char* row1 = (t + 1 < count) ? row0 + row_bytes : row0;
+			__m128i pair = _mm_set1_epi32( (int)((unsigned short)w[t] | ((unsigned int)(unsigned short)w[t+1] << 16)) );
+			__m128i r0 = _mm_loadu_si128( (const __m128i*)(row0 + k) );
+			__m128i r1 = _mm_loadu_si128( (const __m128i*)(row1 + k) );
+			__m128i lo0 = _mm_unpacklo_epi8( r0, zero );
+			__m128i lo1 = _mm_unpacklo_epi8( r1, zero );
+			__m128i hi0 = _mm_unpackhi_epi8( r0, zero );
+			__m128i hi1 = _mm_unpackhi_epi8( r1, zero );
+			acc0 = _mm_add_epi32( acc0, _mm_madd_epi16( _mm_unpacklo_epi16( lo0, lo1 ), pair ) );
+			acc1 = _mm_add_epi32( acc1, _mm_madd_epi16( _mm_unpackhi_epi16( lo0, lo1 ), pair ) );
+			acc2 = _mm_add_epi32( acc2, _mm_madd_epi16( _mm_unpacklo_epi16( hi0, hi1 ), pair ) );
+			acc3 = _mm_add_epi32( acc3, _mm_madd_epi16( _mm_unpackhi_epi16( hi0, hi1 ), pair ) );
+		}
+		acc0 = _mm_packs_epi32( _mm_srai_epi32( acc0, IMAGE_FILTER_BITS ),
+				_mm_srai_epi32( acc1, IMAGE_FILTER_BITS ) );
+		acc2 = _mm_packs_epi32( _mm_srai_epi32( acc2, IMAGE_FILTER_BITS ),
+				_mm_srai_epi32( acc3, IMAGE_FILTER_BITS ) );
+		_mm_storeu_si128( (__m128i*)(out + k), _mm_packus_epi16( acc0, acc2 ) );
+	}
+#endif
+	for( ; k < row_bytes; ++k )
+	{
+		int acc = 0;
+		for( t = 0; t < count; ++t )
+		{
+			acc += w[t] * src[(first + t) * row_bytes + k];
+		}
+		out[k] = image_filter_round( acc );
+	}
+}
+
+/*	filters along a row (the horizontal pass); src must have 8 bytes
+	of slack after it, which are read (but weighted by 0) for RGBA	*/
+static void
+	image_filter_columns
+	(
+		const unsigned char* src, int channels,
+		const int* spans, const short* weights, int max_taps,
+		unsigned char* out, int out_width
+	)
+{
+	int i, c, t;
+	for( i = 0; i < out_width; ++i, out += channels )
+	{
+		const int first = spans[2*i];
+		const int count = spans[2*i+1];
+		const short* w = weights + i * max_taps;
+		const unsigned char* p = src + first * channels;
+#ifdef IMAGE_SIMD_X86
+		if( channels == 4 )
+		{
+			const __m128i zero = _mm_setzero_si128();
+			__m128i acc = _mm_set1_epi32( 1 << (IMAGE_FILTER_BITS - 1) );
+			int packed;
+			for( t = 0; t < count; t += 2 )
+			{
+				/*	two neighbouring pixels, as RRGGBBAA pairs	*/
+				__m128i px = _mm_unpacklo_epi8(
+						_mm_loadl_epi64( (const __m128i*)(p + t * 4) ), zero );
+				px = _mm_unpacklo_epi16( px, _mm_srli_si128( px, 8 ) );
+				acc = _mm_add_epi32( acc, _mm_madd_epi16( px,
+						_mm_set1_epi32( (int)((unsigned short)w[t] | ((unsigned int)(unsigned short)w[t+1] << 16)) ) ) );
+			}
+			acc = _mm_packs_epi32( _mm_srai_epi32( acc, IMAGE_FILTER_BITS ), zero );
+			packed = _mm_cvtsi128_si32( _mm_packus_epi16( acc, zero ) );
+			memcpy( out, &packed, 4 );
+			continue;
+		}
+#endif
+		for( c = 0; c < channels; ++c )
+		{
+			int acc = 0;
+			for( t = 0; t < count; ++t )
+			{
+				acc += w[t] * p[t * channels + c];
+			}
+			out[c] = image_filter_round( acc );
+		}
+	}
+}
+
+int
+	resample_image_filtered
+	(
+		const unsigned char* const orig,
+		int width, int height, int channels,
+		unsigned char* resampled,
+		int resampled_width, int resampled_height,
+		int filter
+	)
+{
+	int *x_spans, *y_spans;
+	short *x_weights, *y_weights;
+	int x_taps, y_taps;
+	unsigned char* column;
+	int j, result = 0;
+	/*	error check	*/
+	if( (width < 1) || (height < 1) ||
+		(resampled_width < 1) || (resampled_height < 1) ||
+		(channels < 1) || (filter < IMAGE_FILTER_BOX) ||
+		(filter > IMAGE_FILTER_KAISER) ||
+		(NULL == orig) || (NULL == resampled) )
+	{
+		return 0;
+	}
+	x_spans = (int*)image_malloc( 2 * resampled_width * sizeof(int) );
+	y_spans = (int*)image_malloc( 2 * resampled_height * sizeof(int) );
+	/*	the vertical pass goes first, so the SIMD friendly
+		whole-row filter sees the most data	*/
+	column = (unsigned char*)image_malloc( width * channels * resampled_height + 8 );
+	x_weights = (NULL != x_spans) ? image_filter_weights( width,
+			resampled_width, filter, x_spans, &x_taps ) : NULL;
+	y_weights = (NULL != y_spans) ? image_filter_weights( height,
+			resampled_height, filter, y_spans, &y_taps ) : NULL;
+	if( (NULL != column) && (NULL != x_weights) && (NULL != y_weights) )
+	{
+		const int row_bytes = width * channels;
+		memset( column + row_bytes * resampled_height, 0, 8 );
+		for( j = 0; j < resampled_height; ++j )
+		{
+			image_filter_rows( orig, row_bytes,
+					y_spans[2*j], y_spans[2*j+1], y_weights + j * y_taps,
+					column + j * row_bytes );
+			image_filter_columns( column + j * row_bytes, channels,
+					x_spans, x_weights, x_taps,
+					resampled + j * resampled_width * channels, resampled_width );
+		}
+		result = 1;
+	}
+	image_free( x_spans );
+	image_free( y_spans );
+	image_free( x_weights );
+	image_free( y_weights );
+	image_free( column );
+	return result;
+}
+
+int
+	mipmap_chain_size
+	(
+		int width, int height, int channels
+	)
+{
+	int size = 0;
+	if( (width < 1) || (height < 1) || (channels < 1) )
+	{
+		return 0;
+	}
+	while( (width > 1) || (height > 1) )
+	{
+		width = (width > 1) ? width / 2 : 1;
+		height = (height > 1) ? height / 2 : 1;
+		size += width * height * channels;
+	}
+	return size;
+}
+
+/*	every level of a chain, with level 0 being the original image	*/
+typedef struct
+{
+	const unsigned char* pixels[32];
+	int width[32];
+	int height[32];
+	int count;
+	int channels;
+}
+mipmap_chain_levels;
+
+/*
+	Row "row" of level "level" has just been written: if it was the
+	second of a pair, filter the pair into the next level straight
+	away, and carry on down the chain the same way.
+*/
+static void
+	mipmap_chain_row_done
+	(
+		mipmap_chain_levels* chain,
+		int level, int row
+	)
+{
+	const int next = level + 1;
+	const int channels = chain->channels;
+	const int row_bytes = chain->width[level] * channels;
+	const unsigned char *row0, *row1;
+	int out_row;
+	if( next >= chain->count )
+	{
+		return;
+	}
+	if( chain->height[level] == 1 )
+	{
+		out_row = 0;
+		row0 = row1 = chain->pixels[level];
+	} else
+	{
+		out_row = row >> 1;
+		if( ((row & 1) == 0) || (out_row >= chain->height[next]) )
+		{
+			return;
+		}
+		row1 = chain->pixels[level] + row * row_bytes;
+		row0 = row1 - row_bytes;
+	}
+	mipmap_box_row( row0, row1, chain->width[level], channels,
+			(unsigned char*)chain->pixels[next] +
+				out_row * chain->width[next] * channels,
+			chain->width[next] );
+	mipmap_chain_row_done( chain, next, out_row );
+}
+
+int
+	mipmap_image_chain
+	(
+		const unsigned char* const orig,
+		int width, int height, int channels,
+		unsigned char* chain,
+		int filter
+	)
+{
+	mipmap_chain_levels levels;
+	int level, row;
+	/*	error check	*/
+	if( (width < 1) || (height < 1) || (channels < 1) ||
+		(filter < IMAGE_FILTER_BOX) || (filter > IMAGE_FILTER_KAISER) ||
+		(NULL == orig) || (NULL == chain) )
+	{
+		return 0;
+	}
+	levels.pixels[0] = orig;
+	levels.width[0] = width;
+	levels.height[0] = height;
+	levels.channels = channels;
+	levels.count = 1;
+	while( (width > 1) || (height > 1) )
+	{
+		width = (width > 1) ? width / 2 : 1;
+		height = (height > 1) ? height / 2 : 1;
+		levels.pixels[levels.count] = chain;
+		levels.width[levels.count] = width;
+		levels.height[levels.count] = height;
+		++levels.count;
+		chain += width * height * channels;
+	}
+	if( filter == IMAGE_FILTER_BOX )
+	{
+		for( row = 0; row < levels.height[0]; ++row )
+		{
+			mipmap_chain_row_done( &levels, 0, row );
+		}
+	} else
+	{
+		for( level = 1; level < levels.count; ++level )
+		{
+			if( !resample_image_filtered( levels.pixels[level-1],
+					levels.width[level-1], levels.height[level-1], channels,
+					(unsigned char*)levels.pixels[level],
+					levels.width[level], levels.height[level], filter ) )
+			{
+				return 0;
+			}
+		}
+	}
+	return levels.count - 1;
 }
@@ -0,0 +1,133 @@
+/*
+	Image metadata index
+
+	Probes every file under a directory tree for its dimensions,
+	channel count and format (reading headers only, in parallel),
+	and keeps the results in a small binary cache file, so a later
+	scan only has to look at the files that have changed since.
+
+	public domain
+*/
+
+#ifndef HEADER_IMAGE_INDEX
+#define HEADER_IMAGE_INDEX
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+	The file formats the index can tell apart.
+**/
+enum
+{
+	IMAGE_FORMAT_UNKNOWN = 0,
+	IMAGE_FORMAT_PNG,
+	IMAGE_FORMAT_JPEG,
+	IMAGE_FORMAT_BMP,
+	IMAGE_FORMAT_TGA,
+	IMAGE_FORMAT_PSD,
+	IMAGE_FORMAT_GIF,
+	IMAGE_FORMAT_HDR,
+	IMAGE_FORMAT_PIC,
+	IMAGE_FORMAT_PNM,
+	IMAGE_FORMAT_DDS,
+	IMAGE_FORMAT_PVR,
+	IMAGE_FORMAT_PKM
+};
+
+/**
+	What the index knows about one file.  Files that are not images
+	it can read are kept too (with format IMAGE_FORMAT_UNKNOWN and no
+	dimensions), so they aren't probed again either.
+	mtime is the last write time in the platform's native units
+	(nanoseconds on POSIX, 100 ns ticks on Windows).
+**/
+typedef struct
+{
+	char		*path;
+	long long	mtime;
+	long long	size;
+	int			width, height, components;
+	int			is_compressed;
+	int			format;
+}
+image_index_entry;
+
+/**
+	A set of entries, sorted by path.
+**/
+typedef struct
+{
+	image_index_entry	*entries;
+	int					count;
+	int					capacity;
+}
+image_index;
+
+/**
+	Fills index (which is overwritten) with every file under directory,
+	probing them on up to thread_count threads (<= 0 means one per
+	hardware thread).
+	If cache_filename is not NULL, files whose path, size and mtime
+	match an entry in that cache are not opened at all, and the cache
+	is rewritten if anything changed.
+	Paths are directory, then '/' and the path inside it.  A directory
+	reached twice (through a symlink, say) is only walked once.
+	\return 0 if failed, otherwise returns 1
+**/
+int
+	image_index_scan
+	(
+		image_index *index,
+		const char *directory,
+		const char *cache_filename,
+		int thread_count
+	);
+
+/**
+	Returns the entry for path, or NULL if it isn't in the index.
+**/
+const image_index_entry*
+	image_index_find
+	(
+		const image_index *index,
+		const char *path
+	);
+
+/**
+	Reads an index saved by image_index_save (index is overwritten).
+	\return 0 if failed, otherwise returns 1
+**/
+int
+	image_index_load
+	(
+		image_index *index,
+		const char *cache_filename
+	);
+
+/**
+	Writes the index to a binary cache file.
+	\return 0 if failed, otherwise returns 1
+**/
+int
+	image_index_save
+	(
+		const image_index *index,
+		const char *cache_filename
+	);
+
+/**
+	Frees the entries of an index and leaves it empty.
+**/
+void
+	image_index_free
+	(
+		image_index *index
+	);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HEADER_IMAGE_INDEX	*/
@@ -0,0 +1,564 @@
+/*
+	Image metadata index
+
+	public domain
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "image_index.h"
+#include "image_mmap.h"
+#include "image_thread.h"
+#include "stb_image.h"
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+/*	the nanoseconds of a stat's mtime, where the platform has them	*/
+#if defined(__APPLE__) && defined(st_mtime)
+#define IMAGE_INDEX_MTIME_NSEC(info) ((info).st_mtimespec.tv_nsec)
+#elif !defined(_WIN32) && defined(st_mtime)
+#define IMAGE_INDEX_MTIME_NSEC(info) ((info).st_mtim.tv_nsec)
+#else
+#define IMAGE_INDEX_MTIME_NSEC(info) 0
+#endif
+
+/*	the cache file: "IIDX", a version and a count, then every entry as
+	a 16 bit path length, the path, and the fixed size fields	*/
+#define IMAGE_INDEX_MAGIC 0x58444949
+#define IMAGE_INDEX_VERSION 2
+#define IMAGE_INDEX_HEADER_SIZE 12
+#define IMAGE_INDEX_ENTRY_SIZE (2 + 8 + 8 + 4 * 3 + 1 + 1)
+#define IMAGE_INDEX_MAX_PATH 65535
+
+static void image_index_put_u32(unsigned char *dest, unsigned int v) {
+  dest[0] = (unsigned char)(v);
+  dest[1] = (unsigned char)(v >> 8);
+  dest[2] = (unsigned char)(v >> 16);
+  dest[3] = (unsigned char)(v >> 24);
+}
+
+static void image_index_put_u64(unsigned char *dest, long long v) {
+  image_index_put_u32(dest, (unsigned int)((unsigned long long)v));
+  image_index_put_u32(dest + 4, (unsigned int)((unsigned long long)v >> 32));
+}
+
+static unsigned int image_index_get_u32(const unsigned char *src) {
+  return (unsigned int)src[0] | ((unsigned int)src[1] << 8) |
+         ((unsigned int)src[2] << 16) | ((unsigned int)src[3] << 24);
+}
+
+static long long image_index_get_u64(const unsigned char *src) {
+  return (long long)((unsigned long long)image_index_get_u32(src) |
+                     ((unsigned long long)image_index_get_u32(src + 4) << 32));
+}
+
+/*	appends an entry that owns a copy of path; 0 if out of memory	*/
+static int image_index_push(image_index *index, const char *path,
+                            size_t path_length, long long mtime,
+                            long long size) {
+  image_index_entry *entry;
+  if (index->count == index->capacity) {
+    int capacity = (index->capacity > 0) ? index->capacity * 2 : 256;
+    image_index_entry *grown = (image_index_entry *)realloc(
+        index->entries, capacity * sizeof(image_index_entry));
+    if (NULL == grown) {
+      return 0;
+    }
+    index->entries = grown;
+    index->capacity = capacity;
+  }
+  entry = &index->entries[index->count];
+  memset(entry, 0, sizeof(image_index_entry));
+  entry->path = (char *)malloc(path_length + 1);
+  if (NULL == entry->path) {
+    return 0;
+  }
+  memcpy(entry->path, path, path_length);
+  entry->path[path_length] = 0;
+  entry->mtime = mtime;
+  entry->size = size;
+  ++index->count;
+  return 1;
+}
+
+static int image_index_compare(const void *a, const void *b) {
+  return strcmp(((const image_index_entry *)a)->path,
+                ((const image_index_entry *)b)->path);
+}
+
+#ifndef _WIN32
+typedef struct {
+  unsigned long long dev, ino;
+} image_index_file_id;
+#endif
+
+/*	what the walk of one tree keeps: the directories walked so far, so
+	that a symlink back to one of them (or two links to the same one)
+	is only walked once, and the cache file, which is left out	*/
+typedef struct {
+#ifndef _WIN32
+  image_index_file_id *dirs;
+  int count, capacity;
+  image_index_file_id cache;
+  int has_cache;
+#else
+  char cache[MAX_PATH];
+  const char *cache_name;
+#endif
+} image_index_walker;
+
+#ifndef _WIN32
+/*	1 if info is a directory not walked yet, now marked as walked	*/
+static int image_index_visit(image_index_walker *walker,
+                             const struct stat *info) {
+  int i;
+  for (i = 0; i < walker->count; ++i) {
+    if ((walker->dirs[i].dev == (unsigned long long)info->st_dev) &&
+        (walker->dirs[i].ino == (unsigned long long)info->st_ino)) {
+      return 0;
+    }
+  }
+  if (walker->count == walker->capacity) {
+    int capacity = (walker->capacity > 0) ? walker->capacity * 2 : 16;
+    image_index_file_id *grown = (image_index_file_id *)realloc(
+        walker->dirs, capacity * sizeof(image_index_file_id));
+    if (NULL == grown) {
+      return 0;
+    }
+    walker->dirs = grown;
+    walker->capacity = capacity;
+  }
+  walker->dirs[walker->count].dev = (unsigned long long)info->st_dev;
+  walker->dirs[walker->count].ino = (unsigned long long)info->st_ino;
+  ++walker->count;
+  return 1;
+}
+#endif
+
+/*	1 if the file at path is the cache file	*/
+#ifndef _WIN32
+static int image_index_is_cache(const image_index_walker *walker,
+                                const struct stat *info) {
+  return walker->has_cache &&
+         (walker->cache.dev == (unsigned long long)info->st_dev) &&
+         (walker->cache.ino == (unsigned long long)info->st_ino);
+}
+#else
+static int image_index_is_cache(const image_index_walker *walker,
+                                const char *path, const char *name) {
+  char full[MAX_PATH];
+  DWORD length;
+  /*	only a file of the same name needs its full path worked out	*/
+  if ((NULL == walker->cache_name) ||
+      (0 != _stricmp(name, walker->cache_name))) {
+    return 0;
+  }
+  length = GetFullPathNameA(path, MAX_PATH, full, NULL);
+  return (length > 0) && (length < MAX_PATH) &&
+         (0 == _stricmp(full, walker->cache));
+}
+#endif
+
+/*	walks directory, adding every regular file below it	*/
+static int image_index_walk(image_index *index, const char *directory,
+                            image_index_walker *walker) {
+  size_t directory_length = strlen(directory);
+  char *path;
+  int result = 1;
+#ifdef _WIN32
+  WIN32_FIND_DATAA found;
+  HANDLE search;
+  path = (char *)malloc(directory_length + MAX_PATH + 3);
+  if (NULL == path) {
+    return 0;
+  }
+  memcpy(path, directory, directory_length);
+  memcpy(path + directory_length, "/*", 3);
+  search = FindFirstFileA(path, &found);
+  if (INVALID_HANDLE_VALUE == search) {
+    free(path);
+    return 0;
+  }
+  do {
+    size_t name_length = strlen(found.cFileName);
+    if ((0 == strcmp(found.cFileName, ".")) ||
+        (0 == strcmp(found.cFileName, ".."))) {
+      continue;
+    }
+    path[directory_length] = '/';
+    memcpy(path + directory_length + 1, found.cFileName, name_length + 1);
+    if (found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+      /*	a junction or directory symlink may lead back up the tree	*/
+      if (found.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) {
+        continue;
+      }
+      /*	an unreadable subdirectory just gets skipped	*/
+      image_index_walk(index, path, walker);
+    } else {
+      long long mtime = ((long long)found.ftLastWriteTime.dwHighDateTime << 32) |
+                        found.ftLastWriteTime.dwLowDateTime;
+      long long size =
+          ((long long)found.nFileSizeHigh << 32) | found.nFileSizeLow;
+      if (image_index_is_cache(walker, path, found.cFileName)) {
+        continue;
+      }
+      if (!image_index_push(index, path, directory_length + 1 + name_length,
+                            mtime, size)) {
+        result = 0;
+        break;
+      }
+    }
+  } while (FindNextFileA(search, &found));
+  FindClose(search);
+#else
+  struct dirent *found;
+  DIR *dir = opendir(directory);
+  if (NULL == dir) {
+    return 0;
+  }
+  path = NULL;
+  while (NULL != (found = readdir(dir))) {
+    struct stat info;
+    size_t name_length = strlen(found->d_name);
+    char *grown;
+    if ((0 == strcmp(found->d_name, ".")) ||
+        (0 == strcmp(found->d_name, ".."))) {
+      continue;
+    }
+    grown = (char *)realloc(path, directory_length + name_length + 2);
+    if (NULL == grown) {
+      result = 0;
+      break;
+    }
+    path = grown;
+    memcpy(path, directory, directory_length);
+    path[directory_length] = '/';
+    memcpy(path + directory_length + 1, found->d_name, name_length + 1);
+    if (0 != stat(path, &info)) {
+      continue;
+    }
+    if (S_ISDIR(info.st_mode)) {
+      /*	an unreadable subdirectory just gets skipped	*/
+      if (image_index_visit(walker, &info)) {
+        image_index_walk(index, path, walker);
+      }
+    } else if (S_ISREG(info.st_mode) && !image_index_is_cache(walker, &info)) {
+      if (!image_index_push(index, path, directory_length + 1 + name_length,
+                            (long long)info.st_mtime * 1000000000 +
+                                IMAGE_INDEX_MTIME_NSEC(info),
+                            (long long)info.st_size)) {
+        result = 0;
+        break;
+      }
+    }
+  }
+  closedir(dir);
+#endif
+  free(path);
+  return result;
+}
+
+/*	walks directory with nothing visited yet but directory itself, and
+	leaves out cache_filename (which may be NULL) if it is in there	*/
+static int image_index_walk_tree(image_index *index, const char *directory,
+                                 const char *cache_filename) {
+  image_index_walker walker;
+  int result;
+  memset(&walker, 0, sizeof(image_index_walker));
+#ifndef _WIN32
+  {
+    struct stat info;
+    if (0 == stat(directory, &info)) {
+      image_index_visit(&walker, &info);
+    }
+    if ((NULL != cache_filename) && (0 == stat(cache_filename, &info))) {
+      walker.cache.dev = (unsigned long long)info.st_dev;
+      walker.cache.ino = (unsigned long long)info.st_ino;
+      walker.has_cache = 1;
+    }
+  }
+#else
+  if (NULL != cache_filename) {
+    char *name;
+    DWORD length = GetFullPathNameA(cache_filename, MAX_PATH, walker.cache,
+                                    &name);
+    if ((length > 0) && (length < MAX_PATH) && (NULL != name)) {
+      walker.cache_name = name;
+    }
+  }
+#endif
+  result = image_index_walk(index, directory, &walker);
+#ifndef _WIN32
+  free(walker.dirs);
+#endif
+  return result;
+}
+
+/*	stb_image can't say which decoder accepted a file, so go by the magic	*/
+static int image_index_sniff_format(const unsigned char *data, size_t size) {
+  if ((size >= 4) && (data[0] == 0x89) && (data[1] == 'P') &&
+      (data[2] == 'N') && (data[3] == 'G')) {
+    return IMAGE_FORMAT_PNG;
+  }
+  if ((size >= 2) && (data[0] == 0xFF) && (data[1] == 0xD8)) {
+    return IMAGE_FORMAT_JPEG;
+  }
+  if ((size >= 2) && (data[0] == 'B') && (data[1] == 'M')) {
+    return IMAGE_FORMAT_BMP;
+  }
+  if ((size >= 4) && (0 == memcmp(data, "8BPS", 4))) {
+    return IMAGE_FORMAT_PSD;
+  }
+  if ((size >= 4) && (0 == memcmp(data, "GIF8", 4))) {
+    return IMAGE_FORMAT_GIF;
+  }
+  if ((size >= 2) && (data[0] == '#') && (data[1] == '?')) {
+    return IMAGE_FORMAT_HDR;
+  }
+  if ((size >= 4) && (data[0] == 0x53) && (data[1] == 0x80) &&
+      (data[2] == 0xF6) && (data[3] == 0x34)) {
+    return IMAGE_FORMAT_PIC;
+  }
+  if ((size >= 2) && (data[0] == 'P') && ((data[1] == '5') || (data[1] == '6'))) {
+    return IMAGE_FORMAT_PNM;
+  }
+  /*	the only headerless format stb_image reads	*/
+  return IMAGE_FORMAT_TGA;
+}
+
+typedef struct {
+  image_index *index;
+  const int *todo;
+} image_index_probe_job;
+
+static void image_index_probe_task(void *context, int index) {
+  image_index_probe_job *job = (image_index_probe_job *)context;
+  image_index_entry *entry = &job->index->entries[job->todo[index]];
+  image_file_view view;
+  int length, compressed = 0;
+  /*	only the header pages of the mapping ever get touched	*/
+  if (!image_file_map(entry->path, &view)) {
+    return;
+  }
+  length = (view.size > 0x7FFFFFFF) ? 0x7FFFFFFF : (int)view.size;
+  if (stbi__dds_info_from_memory(view.data, length, &entry->width,
+                                 &entry->height, &entry->components,
+                                 &compressed)) {
+    entry->format = IMAGE_FORMAT_DDS;
+  } else if (stbi__pvr_info_from_memory(view.data, length, &entry->width,
+                                        &entry->height, &entry->components,
+                                        &compressed)) {
+    entry->format = IMAGE_FORMAT_PVR;
+  } else if (stbi__pkm_info_from_memory(view.data, length, &entry->width,
+                                        &entry->height, &entry->components)) {
+    entry->format = IMAGE_FORMAT_PKM;
+    compressed = 1;
+  } else if (stbi_info_from_memory(view.data, length, &entry->width,
+                                   &entry->height, &entry->components)) {
+    entry->format = image_index_sniff_format(view.data, view.size);
+  } else {
+    entry->width = entry->height = entry->components = 0;
+  }
+  entry->is_compressed = compressed ? 1 : 0;
+  image_file_unmap(&view);
+}
+
+int image_index_scan(image_index *index, const char *directory,
+                     const char *cache_filename, int thread_count) {
+  image_index cached;
+  image_index_probe_job job;
+  int *todo;
+  int i, todo_count = 0;
+  /*	error check	*/
+  if ((NULL == index) || (NULL == directory)) {
+    return 0;
+  }
+  memset(index, 0, sizeof(image_index));
+  memset(&cached, 0, sizeof(image_index));
+  if (!image_index_walk_tree(index, directory, cache_filename)) {
+    image_index_free(index);
+    return 0;
+  }
+  qsort(index->entries, index->count, sizeof(image_index_entry),
+        image_index_compare);
+  todo = (int *)malloc((index->count + 1) * sizeof(int));
+  if (NULL == todo) {
+    image_index_free(index);
+    return 0;
+  }
+  /*	anything unchanged since the cache was written is taken as is	*/
+  if (NULL != cache_filename) {
+    image_index_load(&cached, cache_filename);
+  }
+  for (i = 0; i < index->count; ++i) {
+    image_index_entry *entry = &index->entries[i];
+    const image_index_entry *hit = image_index_find(&cached, entry->path);
+    if ((NULL != hit) && (hit->mtime == entry->mtime) &&
+        (hit->size == entry->size)) {
+      entry->width = hit->width;
+      entry->height = hit->height;
+      entry->components = hit->components;
+      entry->is_compressed = hit->is_compressed;
+      entry->format = hit->format;
+    } else {
+      todo[todo_count++] = i;
+    }
+  }
+  job.index = index;
+  job.todo = todo;
+  image_parallel_for(todo_count, thread_count, image_index_probe_task, &job);
+  if ((NULL != cache_filename) &&
+      ((todo_count > 0) || (cached.count != index->count))) {
+    image_index_save(index, cache_filename);
+  }
+  image_index_free(&cached);
+  free(todo);
+  return 1;
+}
+
+const image_index_entry *image_index_find(const image_index *index,
+                                          const char *path) {
+  image_index_entry key;
+  if ((NULL == index) || (NULL == path) || (index->count == 0)) {
+    return NULL;
+  }
+  key.path = (char *)path;
+  return (const image_index_entry *)bsearch(&key, index->entries, index->count,
+                                            sizeof(image_index_entry),
+                                            image_index_compare);
+}
+
+int image_index_load(image_index *index, const char *cache_filename) {
+  image_file_view view;
+  const unsigned char *cursor, *end;
+  unsigned int count, i;
+  /*	error check	*/
+  if ((NULL == index) || (NULL == cache_filename)) {
+    return 0;
+  }
+  memset(index, 0, sizeof(image_index));
+  if (!image_file_map(cache_filename, &view)) {
+    return 0;
+  }
+  cursor = view.data;
+  end = view.data + view.size;
+  if ((view.size < IMAGE_INDEX_HEADER_SIZE) ||
+      (image_index_get_u32(cursor) != IMAGE_INDEX_MAGIC) ||
+      (image_index_get_u32(cursor + 4) != IMAGE_INDEX_VERSION)) {
+    image_file_unmap(&view);
+    return 0;
+  }
+  count = image_index_get_u32(cursor + 8);
+  cursor += IMAGE_INDEX_HEADER_SIZE;
+  for (i = 0; i < count; ++i) {
+    image_index_entry *entry;
+    size_t path_length;
+    if ((size_t)(end - cursor) < IMAGE_INDEX_ENTRY_SIZE) {
+      break;
+    }
+    path_length = cursor[0] | (cursor[1] << 8);
+    if ((size_t)(end - cursor) < IMAGE_INDEX_ENTRY_SIZE + path_length) {
+      break;
+    }
+    if (!image_index_push(index, (const char *)cursor + 2, path_length,
+                          image_index_get_u64(cursor + 2 + path_length),
+                          image_index_get_u64(cursor + 10 + path_length))) {
+      break;
+    }
+    cursor += 18 + path_length;
+    entry = &index->entries[index->count - 1];
+    entry->width = (int)image_index_get_u32(cursor);
+    entry->height = (int)image_index_get_u32(cursor + 4);
+    entry->components = (int)image_index_get_u32(cursor + 8);
+    entry->format = cursor[12];
+    entry->is_compressed = cursor[13];
+    cursor += 14;
+  }
+  image_file_unmap(&view);
+  if (i < count) {
+    /*	truncated or corrupt, so trust none of it	*/
+    image_index_free(index);
+    return 0;
+  }
+  /*	saved sorted, but don't rely on it	*/
+  qsort(index->entries, index->count, sizeof(image_index_entry),
+        image_index_compare);
+  return 1;
+}
+
+int image_index_save(const image_index *index, const char *cache_filename) {
+  FILE *fout;
+  unsigned char *buffer, *cursor;
+  size_t buffer_size = IMAGE_INDEX_HEADER_SIZE;
+  int i, count = 0, result;
+  /*	error check	*/
+  if ((NULL == index) || (NULL == cache_filename)) {
+    return 0;
+  }
+  for (i = 0; i < index->count; ++i) {
+    size_t path_length = strlen(index->entries[i].path);
+    if (path_length <= IMAGE_INDEX_MAX_PATH) {
+      buffer_size += IMAGE_INDEX_ENTRY_SIZE + path_length;
+    }
+  }
+  buffer = (unsigned char *)malloc(buffer_size);
+  if (NULL == buffer) {
+    return 0;
+  }
+  cursor = buffer + IMAGE_INDEX_HEADER_SIZE;
+  for (i = 0; i < index->count; ++i) {
+    const image_index_entry *entry = &index->entries[i];
+    size_t path_length = strlen(entry->path);
+    if (path_length > IMAGE_INDEX_MAX_PATH) {
+      continue;
+    }
+    cursor[0] = (unsigned char)(path_length);
+    cursor[1] = (unsigned char)(path_length >> 8);
+    memcpy(cursor + 2, entry->path, path_length);
+    cursor += 2 + path_length;
+    image_index_put_u64(cursor, entry->mtime);
+    image_index_put_u64(cursor + 8, entry->size);
+    image_index_put_u32(cursor + 16, (unsigned int)entry->width);
+    image_index_put_u32(cursor + 20, (unsigned int)entry->height);
+    image_index_put_u32(cursor + 24, (unsigned int)entry->components);
+    cursor[28] = (unsigned char)entry->format;
+    cursor[29] = (unsigned char)entry->is_compressed;
+    cursor += 30;
+    ++count;
+  }
+  image_index_put_u32(buffer, IMAGE_INDEX_MAGIC);
+  image_index_put_u32(buffer + 4, IMAGE_INDEX_VERSION);
+  image_index_put_u32(buffer + 8, (unsigned int)count);
+  errno_t err = fopen_s(&fout, cache_filename, "wb");
+  if (err) {
+    free(buffer);
+    return 0;
+  }
+  result = (fwrite(buffer, 1, buffer_size, fout) == buffer_size);
+  fclose(fout);
+  free(buffer);
+  return result;
+}
+
+void image_index_free(image_index *index) {
+  int i;
+  if (NULL == index) {
+    return;
+  }
+  for (i = 0; i < index->count; ++i) {
+    free(index->entries[i].path);
+  }
+  free(index->entries);
+  index->entries = NULL;
+  index->count = 0;
+  index->capacity = 0;
+}
@@ -0,0 +1,62 @@
+/*
+	Image file mapping
+
+	Maps an image file read-only into memory so the decoders can read
+	it in place with their *_from_memory entry points, instead of
+	copying every byte through a stdio buffer first.
+
+	Define IMAGE_NO_MMAP to always read the file into the heap.
+
+	public domain
+*/
+
+#ifndef HEADER_IMAGE_MMAP
+#define HEADER_IMAGE_MMAP
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+	The bytes of a file opened with image_file_map.
+	is_mapped is 1 for a read-only mapping of the file, or 0 when the
+	file could not be mapped (a pipe, a character device, an empty
+	file) and was read into a heap block instead.
+**/
+typedef struct
+{
+	const unsigned char	*data;
+	size_t				size;
+	int					is_mapped;
+}
+image_file_view;
+
+/**
+	Maps (or, failing that, reads) the whole of filename.
+	The view must be released with image_file_unmap.
+	\return 0 if failed, otherwise returns 1
+**/
+int
+	image_file_map
+	(
+		const char *filename,
+		image_file_view *view
+	);
+
+/**
+	Releases a view filled in by image_file_map; safe to call on
+	a zeroed view.
+**/
+void
+	image_file_unmap
+	(
+		image_file_view *view
+	);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HEADER_IMAGE_MMAP	*/
@@ -0,0 +1,193 @@
+/*
+	Image file mapping
+
+	public domain
+*/
+
+#include <stdlib.h>
+#include "image_mmap.h"
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*	the first heap block used when the file size isn't known up front	*/
+#define IMAGE_FILE_READ_CHUNK 65536
+
+#ifdef _WIN32
+typedef HANDLE image_file_handle;
+#else
+typedef int image_file_handle;
+#endif
+
+static long image_file_read_some(image_file_handle file, unsigned char *dest,
+                                 size_t size) {
+#ifdef _WIN32
+  DWORD bytes_read = 0;
+  if (size > 0x40000000) {
+    size = 0x40000000;
+  }
+  if (!ReadFile(file, dest, (DWORD)size, &bytes_read, NULL)) {
+    return -1;
+  }
+  return (long)bytes_read;
+#else
+  ssize_t bytes_read;
+  if (size > 0x40000000) {
+    size = 0x40000000;
+  }
+  do {
+    bytes_read = read(file, dest, size);
+  } while ((bytes_read < 0) && (errno == EINTR));
+  return (long)bytes_read;
+#endif
+}
+
+/*	the fallback: read everything that is left into a growing heap block	*/
+static int image_file_read_all(image_file_handle file, size_t size_hint,
+                               image_file_view *view) {
+  /*	one spare byte, so hitting the end doesn't need a realloc	*/
+  size_t capacity = (size_hint > 0) ? size_hint + 1 : IMAGE_FILE_READ_CHUNK;
+  size_t size = 0;
+  unsigned char *data = (unsigned char *)malloc(capacity);
+  if (NULL == data) {
+    return 0;
+  }
+  for (;;) {
+    long bytes_read;
+    if (size == capacity) {
+      unsigned char *grown = (unsigned char *)realloc(data, capacity * 2);
+      if (NULL == grown) {
+        free(data);
+        return 0;
+      }
+      data = grown;
+      capacity *= 2;
+    }
+    bytes_read = image_file_read_some(file, data + size, capacity - size);
+    if (bytes_read < 0) {
+      free(data);
+      return 0;
+    }
+    if (bytes_read == 0) {
+      break;
+    }
+    size += (size_t)bytes_read;
+  }
+  view->data = data;
+  view->size = size;
+  view->is_mapped = 0;
+  return 1;
+}
+
+int image_file_map(const char *filename, image_file_view *view) {
+  int result = 0;
+  /*	error check	*/
+  if ((NULL == filename) || (NULL == view)) {
+    return 0;
+  }
+  view->data = NULL;
+  view->size = 0;
+  view->is_mapped = 0;
+#ifdef _WIN32
+  {
+    LARGE_INTEGER file_size;
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (INVALID_HANDLE_VALUE == file) {
+      return 0;
+    }
+#ifndef IMAGE_NO_MMAP
+    if ((GetFileType(file) == FILE_TYPE_DISK) &&
+        GetFileSizeEx(file, &file_size) && (file_size.QuadPart > 0) &&
+        ((unsigned long long)file_size.QuadPart <= (size_t)-1)) {
+      HANDLE mapping =
+          CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+      if (NULL != mapping) {
+        /*	the view keeps the file alive once the handles are closed	*/
+        view->data = (const unsigned char *)MapViewOfFile(
+            mapping, FILE_MAP_READ, 0, 0, (SIZE_T)file_size.QuadPart);
+        CloseHandle(mapping);
+        if (NULL != view->data) {
+          view->size = (size_t)file_size.QuadPart;
+          view->is_mapped = 1;
+          result = 1;
+        }
+      }
+    }
+#endif
+    if (!result) {
+      if (!GetFileSizeEx(file, &file_size) || (file_size.QuadPart < 0) ||
+          ((unsigned long long)file_size.QuadPart > 0x7FFFFFFF)) {
+        file_size.QuadPart = 0;
+      }
+      result = image_file_read_all(file, (size_t)file_size.QuadPart, view);
+    }
+    CloseHandle(file);
+  }
+#else
+  {
+    struct stat info;
+    int file = open(filename, O_RDONLY);
+    if (file < 0) {
+      return 0;
+    }
+    if (0 != fstat(file, &info)) {
+      close(file);
+      return 0;
+    }
+#ifndef IMAGE_NO_MMAP
+    if (S_ISREG(info.st_mode) && (info.st_size > 0) &&
+        ((unsigned long long)info.st_size <= (size_t)-1)) {
+      void *data =
+          mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+      if (MAP_FAILED != data) {
+        view->data = (const unsigned char *)data;
+        view->size = (size_t)info.st_size;
+        view->is_mapped = 1;
+        result = 1;
+      }
+    }
+#endif
+    if (!result) {
+      /*	st_size means nothing for pipes and devices	*/
+      size_t size_hint = 0;
+      if (S_ISREG(info.st_mode) && (info.st_size > 0) &&
+          (info.st_size <= 0x7FFFFFFF)) {
+        size_hint = (size_t)info.st_size;
+      }
+      result = image_file_read_all(file, size_hint, view);
+    }
+    /*	the mapping stays valid once the descriptor is closed	*/
+    close(file);
+  }
+#endif
+  return result;
+}
+
+void image_file_unmap(image_file_view *view) {
+  if ((NULL == view) || (NULL == view->data)) {
+    return;
+  }
+  if (view->is_mapped) {
+#ifdef _WIN32
+    UnmapViewOfFile((LPCVOID)view->data);
+#else
+    munmap((void *)view->data, view->size);
+#endif
+  } else {
+    free((void *)view->data);
+  }
+  view->data = NULL;
+  view->size = 0;
+  view->is_mapped = 0;
+}
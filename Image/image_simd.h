@@ -0,0 +1,68 @@
+/*
+	Image SIMD support
+
+	Compile time detection of the x86 SIMD intrinsics and run time
+	detection of which instruction sets the CPU actually supports,
+	so the codecs can pick a kernel once and fall back to scalar code.
+
+	Define IMAGE_NO_SIMD to force the scalar code paths.
+
+	public domain
+*/
+
+#ifndef HEADER_IMAGE_SIMD
+#define HEADER_IMAGE_SIMD
+
+#if !defined(IMAGE_NO_SIMD) &&                                  \
+	(defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || \
+	 (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define IMAGE_SIMD_X86 1
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+/*	lets a single function use instructions above the compile target;
+	MSVC needs no annotation to emit them	*/
+#if defined(IMAGE_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+#define IMAGE_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define IMAGE_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define IMAGE_TARGET_AVX2 __attribute__((target("avx2")))
+#define IMAGE_TARGET_PCLMUL __attribute__((target("pclmul,sse4.1")))
+#else
+#define IMAGE_TARGET_SSSE3
+#define IMAGE_TARGET_SSE41
+#define IMAGE_TARGET_AVX2
+#define IMAGE_TARGET_PCLMUL
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+	The instruction sets reported by image_cpu_features().
+**/
+enum
+{
+	IMAGE_CPU_SSE2 = 1,
+	IMAGE_CPU_SSSE3 = 2,
+	IMAGE_CPU_SSE41 = 4,
+	IMAGE_CPU_AVX2 = 8,
+	IMAGE_CPU_PCLMUL = 16
+};
+
+/**
+	Returns a mask of the IMAGE_CPU_* instruction sets that this CPU
+	and OS support, or 0 when built without IMAGE_SIMD_X86.
+**/
+int
+	image_cpu_features
+	(
+		void
+	);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HEADER_IMAGE_SIMD	*/
@@ -0,0 +1,52 @@
+/*
+	Image SIMD support
+
+	public domain
+*/
+
+#include "image_simd.h"
+
+#if defined(IMAGE_SIMD_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+static int image_cpu_features_detect(void) {
+  int features = 0;
+#if defined(IMAGE_SIMD_X86) && defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] >= 1) {
+    __cpuid(info, 1);
+    if (info[3] & (1 << 26)) features |= IMAGE_CPU_SSE2;
+    if (info[2] & (1 << 9)) features |= IMAGE_CPU_SSSE3;
+    if (info[2] & (1 << 19)) features |= IMAGE_CPU_SSE41;
+    if (info[2] & (1 << 1)) features |= IMAGE_CPU_PCLMUL;
+    /*	AVX2 also needs the OS to save the YMM registers	*/
+    if ((info[2] & (1 << 27)) && (info[2] & (1 << 28)) &&
+        ((_xgetbv(0) & 6) == 6)) {
+      __cpuidex(info, 7, 0);
+      if (info[1] & (1 << 5)) features |= IMAGE_CPU_AVX2;
+    }
+  }
+#elif defined(IMAGE_SIMD_X86)
+  /*	these also check that the OS saves the wider registers	*/
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse2")) features |= IMAGE_CPU_SSE2;
+  if (__builtin_cpu_supports("ssse3")) features |= IMAGE_CPU_SSSE3;
+  if (__builtin_cpu_supports("sse4.1")) features |= IMAGE_CPU_SSE41;
+  if (__builtin_cpu_supports("avx2")) features |= IMAGE_CPU_AVX2;
+#if defined(__clang__) || (__GNUC__ >= 11)
+  if (__builtin_cpu_supports("pclmul")) features |= IMAGE_CPU_PCLMUL;
+#endif
+#endif
+  return features;
+}
+
+int image_cpu_features(void) {
+  /*	-1 until detected; racing threads all store the same value	*/
+  static volatile int features = -1;
+  if (features < 0) {
+    features = image_cpu_features_detect();
+  }
+  return features;
+}
@@ -0,0 +1,128 @@
+/*
+	Image worker threads
+
+	A tiny fork/join helper shared by the image codecs so that
+	independent rows of blocks can be processed concurrently.
+
+	public domain
+*/
+
+#ifndef HEADER_IMAGE_THREAD
+#define HEADER_IMAGE_THREAD
+
+/**
+	The storage class of per-thread state, such as the result of the
+	last call.  Empty, for a plain global, with compilers that have no
+	thread-local storage; define it first to override the guess.
+**/
+#ifndef IMAGE_THREAD_LOCAL
+	#if defined(__cplusplus) && __cplusplus >= 201103L
+		#define IMAGE_THREAD_LOCAL thread_local
+	#elif defined(_MSC_VER)
+		#define IMAGE_THREAD_LOCAL __declspec(thread)
+	#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+		#define IMAGE_THREAD_LOCAL _Thread_local
+	#elif defined(__GNUC__)
+		#define IMAGE_THREAD_LOCAL __thread
+	#else
+		#define IMAGE_THREAD_LOCAL
+	#endif
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+	A unit of work; called once for every index in [0, count).
+	Calls may happen on any thread and in any order, so a task
+	must only write to memory owned by its own index.
+**/
+typedef void (*image_task_func)( void *context, int index );
+
+/**
+	Returns the number of hardware threads available to the process
+	(always at least 1).
+**/
+int
+	image_thread_count_default
+	(
+		void
+	);
+
+/**
+	Runs task(context, i) for every i in [0, count) on up to thread_count
+	threads (the calling thread is one of them).  Indices are handed out
+	dynamically, so uneven tasks balance themselves.  The workers use
+	the caller's image_allocator (see image_alloc.h).
+	thread_count <= 0 uses image_thread_count_default(), 1 runs serially.
+	\return 0 if failed, otherwise returns 1
+**/
+int
+	image_parallel_for
+	(
+		int count, int thread_count,
+		image_task_func task, void *context
+	);
+
+/**
+	A mutex paired with a condition variable, for the few codecs that
+	need their workers to wait on each other.
+**/
+typedef struct image_monitor image_monitor;
+
+/**
+	\return a new unlocked monitor, or NULL if failed
+**/
+image_monitor*
+	image_monitor_create
+	(
+		void
+	);
+
+/**
+	Frees a monitor; nobody may be holding or waiting on it.
+**/
+void
+	image_monitor_destroy
+	(
+		image_monitor *monitor
+	);
+
+void
+	image_monitor_lock
+	(
+		image_monitor *monitor
+	);
+
+void
+	image_monitor_unlock
+	(
+		image_monitor *monitor
+	);
+
+/**
+	Atomically unlocks the (locked) monitor and sleeps until another
+	thread calls image_monitor_broadcast, then locks it again.
+	Wakeups may be spurious, so always wait in a loop.
+**/
+void
+	image_monitor_wait
+	(
+		image_monitor *monitor
+	);
+
+/**
+	Wakes every thread waiting on the monitor.
+**/
+void
+	image_monitor_broadcast
+	(
+		image_monitor *monitor
+	);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HEADER_IMAGE_THREAD	*/
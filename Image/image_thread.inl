@@ -0,0 +1,205 @@
+/*
+	Image worker threads
+
+	public domain
+*/
+
+#include <stdlib.h>
+#include "image_thread.h"
+#include "image_alloc.h"
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+/*	the maximum number of threads a single call will ever spin up	*/
+#define IMAGE_THREAD_MAX 64
+
+typedef struct {
+  image_task_func task;
+  void *context;
+  int count;
+  volatile long next;
+  /*	the caller's, so the workers allocate from it too	*/
+  const image_allocator *allocator;
+} image_thread_job;
+
+static int image_thread_next_index(image_thread_job *job) {
+#ifdef _WIN32
+  return (int)InterlockedExchangeAdd(&job->next, 1);
+#else
+  return (int)__sync_fetch_and_add(&job->next, 1);
+#endif
+}
+
+static void image_thread_drain(image_thread_job *job) {
+  int i;
+  /*	keep grabbing indices until they run out	*/
+  for (i = image_thread_next_index(job); i < job->count;
+       i = image_thread_next_index(job)) {
+    job->task(job->context, i);
+  }
+}
+
+#ifdef _WIN32
+static DWORD WINAPI image_thread_entry(LPVOID job) {
+  image_allocator_use(((image_thread_job *)job)->allocator);
+  image_thread_drain((image_thread_job *)job);
+  return 0;
+}
+#else
+static void *image_thread_entry(void *job) {
+  image_allocator_use(((image_thread_job *)job)->allocator);
+  image_thread_drain((image_thread_job *)job);
+  return NULL;
+}
+#endif
+
+int image_thread_count_default(void) {
+  int count;
+#ifdef _WIN32
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  count = (int)info.dwNumberOfProcessors;
+#else
+  count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+  return (count < 1) ? 1 : count;
+}
+
+int image_parallel_for(int count, int thread_count, image_task_func task,
+                       void *context) {
+  image_thread_job job;
+  int i, spawned = 0;
+#ifdef _WIN32
+  HANDLE threads[IMAGE_THREAD_MAX];
+#else
+  pthread_t threads[IMAGE_THREAD_MAX];
+#endif
+  /*	error check	*/
+  if ((NULL == task) || (count < 0)) {
+    return 0;
+  }
+  if (thread_count <= 0) {
+    thread_count = image_thread_count_default();
+  }
+  if (thread_count > count) {
+    thread_count = count;
+  }
+  if (thread_count > IMAGE_THREAD_MAX) {
+    thread_count = IMAGE_THREAD_MAX;
+  }
+  job.task = task;
+  job.context = context;
+  job.count = count;
+  job.next = 0;
+  job.allocator = image_allocator_current();
+  /*	the calling thread is worker 0	*/
+  for (i = 1; i < thread_count; ++i) {
+#ifdef _WIN32
+    threads[spawned] = CreateThread(NULL, 0, image_thread_entry, &job, 0, NULL);
+    if (NULL == threads[spawned]) {
+      break;
+    }
+#else
+    if (0 != pthread_create(&threads[spawned], NULL, image_thread_entry, &job)) {
+      break;
+    }
+#endif
+    ++spawned;
+  }
+  /*	if a thread failed to start, the rest just pick up its share	*/
+  image_thread_drain(&job);
+  for (i = 0; i < spawned; ++i) {
+#ifdef _WIN32
+    WaitForSingleObject(threads[i], INFINITE);
+    CloseHandle(threads[i]);
+#else
+    pthread_join(threads[i], NULL);
+#endif
+  }
+  return 1;
+}
+
+struct image_monitor {
+#ifdef _WIN32
+  CRITICAL_SECTION lock;
+  CONDITION_VARIABLE cond;
+#else
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+#endif
+};
+
+image_monitor *image_monitor_create(void) {
+  image_monitor *monitor = (image_monitor *)malloc(sizeof(image_monitor));
+  if (NULL == monitor) {
+    return NULL;
+  }
+#ifdef _WIN32
+  InitializeCriticalSection(&monitor->lock);
+  InitializeConditionVariable(&monitor->cond);
+#else
+  if (0 != pthread_mutex_init(&monitor->lock, NULL)) {
+    free(monitor);
+    return NULL;
+  }
+  if (0 != pthread_cond_init(&monitor->cond, NULL)) {
+    pthread_mutex_destroy(&monitor->lock);
+    free(monitor);
+    return NULL;
+  }
+#endif
+  return monitor;
+}
+
+void image_monitor_destroy(image_monitor *monitor) {
+  if (NULL == monitor) {
+    return;
+  }
+#ifdef _WIN32
+  DeleteCriticalSection(&monitor->lock);
+#else
+  pthread_cond_destroy(&monitor->cond);
+  pthread_mutex_destroy(&monitor->lock);
+#endif
+  free(monitor);
+}
+
+void image_monitor_lock(image_monitor *monitor) {
+#ifdef _WIN32
+  EnterCriticalSection(&monitor->lock);
+#else
+  pthread_mutex_lock(&monitor->lock);
+#endif
+}
+
+void image_monitor_unlock(image_monitor *monitor) {
+#ifdef _WIN32
+  LeaveCriticalSection(&monitor->lock);
+#else
+  pthread_mutex_unlock(&monitor->lock);
+#endif
+}
+
+void image_monitor_wait(image_monitor *monitor) {
+#ifdef _WIN32
+  SleepConditionVariableCS(&monitor->cond, &monitor->lock, INFINITE);
+#else
+  pthread_cond_wait(&monitor->cond, &monitor->lock);
+#endif
+}
+
+void image_monitor_broadcast(image_monitor *monitor) {
+#ifdef _WIN32
+  WakeAllConditionVariable(&monitor->cond);
+#else
+  pthread_cond_broadcast(&monitor->cond);
+#endif
+}
@@ -6,6 +6,10 @@
  * 	Supports 1, 3 or 4 component input. (luminance, RGB or RGBX)
  *
  * Latest revisions:
+ *	1.61 (2026-10-17) 4:2:2 / 4:2:0 chroma subsampling, restart intervals
+ *		encoded in parallel.
+ *	1.60 (2026-10-17) SSE2 DCT/quantize, buffered 64-bit bit writer,
+ *		added jo_write_jpg_to_func and jo_write_jpg_to_mem.
  *	1.53 (2016-07-08) Added support to compile as plain C code.
  *	1.52 (2012-22-11) Added support for specifying Luminance, RGB, or RGBA
  *via comp(onents) argument (1, 3 and 4 respectively). 1.51 (2012-19-11) Fixed
@@ -20,6 +24,17 @@
  *unused jo_write_jpg("foo.jpg", foo, 128, 128, 4, 90); // comp can be 1, 3,
  *or 4. Lum, RGB, or RGBX respectively.
  *
+ * 	Chroma is stored at full resolution unless jo_write_jpg_subsampling
+ * 	is set to JO_JPEG_422 or JO_JPEG_420. Setting jo_write_jpg_restart_rows
+ * 	puts a restart marker after every that many rows of MCUs; the intervals
+ * 	are then encoded in parallel on jo_write_jpg_thread_count threads (0,
+ * 	the default, for one per hardware thread). The file does not depend
+ * 	on the thread count.
+ *
+ * 	Define JO_JPEG_NO_SIMD to drop the SSE2 kernels and the image_simd.h
+ * 	dependency, and JO_JPEG_NO_THREADS to encode on the calling thread
+ * 	without image_thread.h.
+ *
  * */
 
 #ifndef JO_INCLUDE_JPEG_H
@@ -29,10 +44,30 @@
 // or create jo_jpeg.h, #define JO_JPEG_HEADER_FILE_ONLY, and
 // then include jo_jpeg.c from it.
 
+typedef void jo_write_func(void *context, void *data, int size);
+
+// Values for jo_write_jpg_subsampling
+enum { JO_JPEG_444, JO_JPEG_422, JO_JPEG_420 };
+
+extern int jo_write_jpg_subsampling;   // default JO_JPEG_444
+extern int jo_write_jpg_restart_rows;  // MCU rows per restart interval, 0 off
+extern int jo_write_jpg_thread_count;  // 0 for one per hardware thread
+
 // Returns false on failure
 extern int jo_write_jpg(const char *filename, const void *data, int width,
                         int height, int comp, int quality);
 
+// Same as jo_write_jpg, but the file is handed to 'func' in pieces as it is
+// encoded
+extern int jo_write_jpg_to_func(jo_write_func *func, void *context,
+                                const void *data, int width, int height,
+                                int comp, int quality);
+
+// Returns the file in a malloc()ed buffer, or NULL on failure
+extern unsigned char *jo_write_jpg_to_mem(const void *data, int width,
+                                          int height, int comp, int quality,
+                                          int *out_len);
+
 #endif  // JO_INCLUDE_JPEG_H
 
 #ifndef JO_JPEG_HEADER_FILE_ONLY
@@ -44,6 +79,28 @@ extern int jo_write_jpg(const char *filename, const void *data, int width,
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#ifndef JO_JPEG_NO_SIMD
+#include "image_simd.h"
+#endif
+
+#ifndef JO_JPEG_NO_THREADS
+#include "image_thread.h"
+#define jo_parallel_for image_parallel_for
+#else
+static int jo_parallel_for(int count, int thread_count,
+                           void (*task)(void *, int), void *context) {
+  int i;
+  (void)thread_count;
+  for (i = 0; i < count; ++i) task(context, i);
+  return 1;
+}
+#endif
+
+int jo_write_jpg_subsampling = JO_JPEG_444;
+int jo_write_jpg_restart_rows = 0;
+int jo_write_jpg_thread_count = 0;
 
 static const unsigned char s_jo_ZigZag[] = {
     0,  1,  5,  6,  14, 15, 27, 28, 2,  4,  7,  13, 16, 26, 29, 42,
@@ -51,21 +108,99 @@ static const unsigned char s_jo_ZigZag[] = {
     10, 19, 23, 32, 39, 45, 52, 54, 20, 22, 33, 38, 46, 51, 55, 60,
     21, 34, 37, 47, 50, 56, 59, 61, 35, 36, 48, 49, 57, 58, 62, 63};
 
-static void jo_writeBits(FILE *f, int *bitBuf, int *bitCnt,
-                         const unsigned short *bs) {
-  *bitCnt += bs[1];
-  *bitBuf |= bs[0] << (24 - *bitCnt);
-  while (*bitCnt >= 8) {
-    unsigned char c = (*bitBuf >> 16) & 255;
-    putc(c, f);
+// Output is gathered in 'buf' and reaches the callback in large pieces. Bits
+// collect at the bottom of a 64-bit accumulator and leave it a byte at a
+// time once 32 or more are pending.
+typedef struct {
+  jo_write_func *func;
+  void *context;
+  unsigned long long bitBuf;
+  int bitCnt, len;
+  unsigned char buf[4096];
+} jo_writer;
+
+static void jo_initWriter(jo_writer *w, jo_write_func *func, void *context) {
+  w->func = func;
+  w->context = context;
+  w->bitBuf = 0;
+  w->bitCnt = 0;
+  w->len = 0;
+}
+
+static void jo_flushBuf(jo_writer *w) {
+  if (w->len) w->func(w->context, w->buf, w->len);
+  w->len = 0;
+}
+
+static void jo_writeBytes(jo_writer *w, const void *data, int size) {
+  if (w->len + size > (int)sizeof(w->buf)) {
+    jo_flushBuf(w);
+    if (size > (int)sizeof(w->buf)) {
+      w->func(w->context, (void *)data, size);
+      return;
+    }
+  }
+  memcpy(w->buf + w->len, data, size);
+  w->len += size;
+}
+
+static void jo_putc(jo_writer *w, int c) {
+  unsigned char b = (unsigned char)c;
+  jo_writeBytes(w, &b, 1);
+}
+
+typedef struct {
+  unsigned char *data;
+  int len, cap, failed;
+} jo_memBuf;
+
+static void jo_memWrite(void *context, void *data, int size) {
+  jo_memBuf *m = (jo_memBuf *)context;
+  if (m->failed) return;
+  if (m->len + size > m->cap) {
+    int cap = m->cap * 2 > m->len + size ? m->cap * 2 : m->len + size;
+    unsigned char *p = (unsigned char *)realloc(m->data, cap);
+    if (!p) {
+      m->failed = 1;
+      return;
+    }
+    m->data = p;
+    m->cap = cap;
+  }
+  memcpy(m->data + m->len, data, size);
+  m->len += size;
+}
+
+// moves the whole bytes out of the accumulator, stuffing a 0 after each 0xFF
+static void jo_emitBits(jo_writer *w) {
+  if (w->len > (int)sizeof(w->buf) - 16) jo_flushBuf(w);
+  while (w->bitCnt >= 32) {
+    unsigned int v = (unsigned int)(w->bitBuf >> (w->bitCnt - 32));
+    if ((~v - 0x01010101u) & v & 0x80808080u) break;  // has an 0xFF byte
+    w->buf[w->len + 0] = (unsigned char)(v >> 24);
+    w->buf[w->len + 1] = (unsigned char)(v >> 16);
+    w->buf[w->len + 2] = (unsigned char)(v >> 8);
+    w->buf[w->len + 3] = (unsigned char)v;
+    w->len += 4;
+    w->bitCnt -= 32;
+  }
+  while (w->bitCnt >= 8) {
+    unsigned char c = (unsigned char)(w->bitBuf >> (w->bitCnt -= 8));
+    w->buf[w->len++] = c;
     if (c == 255) {
-      putc(0, f);
+      w->buf[w->len++] = 0;
     }
-    *bitBuf <<= 8;
-    *bitCnt -= 8;
   }
 }
 
+// at most 27 bits at a time: a Huffman code with its extra bits
+static void jo_writeBits(jo_writer *w, unsigned int bits, int count) {
+  w->bitBuf = (w->bitBuf << count) | bits;
+  w->bitCnt += count;
+  if (w->bitCnt >= 32) jo_emitBits(w);
+}
+
+#ifndef IMAGE_SIMD_X86
 static void jo_DCT(float *d0, float *d1, float *d2, float *d3, float *d4,
                    float *d5, float *d6, float *d7) {
   float tmp0 = *d0 + *d7;
@@ -109,24 +244,96 @@ static void jo_DCT(float *d0, float *d1, float *d2, float *d3, float *d4,
   *d1 = z11 + z4;
   *d7 = z11 - z4;
 }
+#endif
 
-static void jo_calcBits(int val, unsigned short bits[2]) {
-  int tmp1 = val < 0 ? -val : val;
-  val = val < 0 ? val - 1 : val;
-  bits[1] = 1;
-  while (tmp1 >>= 1) {
-    ++bits[1];
-  }
-  bits[0] = val & ((1 << bits[1]) - 1);
+#ifdef IMAGE_SIMD_X86
+// jo_DCT on four columns at once; d[0], d[2] .. d[14] are the eight inputs
+static void jo_DCT_sse2(__m128 *d) {
+  const __m128 c4 = _mm_set1_ps(0.707106781f);
+  __m128 tmp0 = _mm_add_ps(d[0], d[14]);
+  __m128 tmp7 = _mm_sub_ps(d[0], d[14]);
+  __m128 tmp1 = _mm_add_ps(d[2], d[12]);
+  __m128 tmp6 = _mm_sub_ps(d[2], d[12]);
+  __m128 tmp2 = _mm_add_ps(d[4], d[10]);
+  __m128 tmp5 = _mm_sub_ps(d[4], d[10]);
+  __m128 tmp3 = _mm_add_ps(d[6], d[8]);
+  __m128 tmp4 = _mm_sub_ps(d[6], d[8]);
+
+  // Even part
+  __m128 tmp10 = _mm_add_ps(tmp0, tmp3);
+  __m128 tmp13 = _mm_sub_ps(tmp0, tmp3);
+  __m128 tmp11 = _mm_add_ps(tmp1, tmp2);
+  __m128 tmp12 = _mm_sub_ps(tmp1, tmp2);
+  __m128 z1, z2, z3, z4, z5, z11, z13;
+
+  d[0] = _mm_add_ps(tmp10, tmp11);
+  d[8] = _mm_sub_ps(tmp10, tmp11);
+
+  z1 = _mm_mul_ps(_mm_add_ps(tmp12, tmp13), c4);
+  d[4] = _mm_add_ps(tmp13, z1);
+  d[12] = _mm_sub_ps(tmp13, z1);
+
+  // Odd part
+  tmp10 = _mm_add_ps(tmp4, tmp5);
+  tmp11 = _mm_add_ps(tmp5, tmp6);
+  tmp12 = _mm_add_ps(tmp6, tmp7);
+
+  z5 = _mm_mul_ps(_mm_sub_ps(tmp10, tmp12), _mm_set1_ps(0.382683433f));
+  z2 = _mm_add_ps(_mm_mul_ps(tmp10, _mm_set1_ps(0.541196100f)), z5);
+  z4 = _mm_add_ps(_mm_mul_ps(tmp12, _mm_set1_ps(1.306562965f)), z5);
+  z3 = _mm_mul_ps(tmp11, c4);
+
+  z11 = _mm_add_ps(tmp7, z3);
+  z13 = _mm_sub_ps(tmp7, z3);
+
+  d[10] = _mm_add_ps(z13, z2);
+  d[6] = _mm_sub_ps(z13, z2);
+  d[2] = _mm_add_ps(z11, z4);
+  d[14] = _mm_sub_ps(z11, z4);
 }
 
-static int jo_processDU(FILE *f, int *bitBuf, int *bitCnt, float *CDU,
-                        float *fdtbl, int DC, const unsigned short HTDC[256][2],
-                        const unsigned short HTAC[256][2]) {
-  const unsigned short EOB[2] = {HTAC[0x00][0], HTAC[0x00][1]};
-  const unsigned short M16zeroes[2] = {HTAC[0xF0][0], HTAC[0xF0][1]};
-  int dataOff, i, nrmarker;
+// v[2 * row + half] holds columns 4 * half .. 4 * half + 3 of a row
+static void jo_transpose8x8(__m128 *v) {
+  __m128 t;
+  int i;
+  _MM_TRANSPOSE4_PS(v[0], v[2], v[4], v[6]);
+  _MM_TRANSPOSE4_PS(v[1], v[3], v[5], v[7]);
+  _MM_TRANSPOSE4_PS(v[8], v[10], v[12], v[14]);
+  _MM_TRANSPOSE4_PS(v[9], v[11], v[13], v[15]);
+  for (i = 0; i < 4; ++i) {
+    t = v[2 * i + 1];
+    v[2 * i + 1] = v[8 + 2 * i];
+    v[8 + 2 * i] = t;
+  }
+}
+#endif
 
+// forward DCT of a data unit, then quantize/descale/zigzag into DU; the SSE2
+// path does the same float operations in the same order as the scalar one
+static void jo_fDCT_quantize(float *CDU, const float *fdtbl, int *DU) {
+  int i;
+#ifdef IMAGE_SIMD_X86
+  __m128 v[16];
+  int q[64];
+  const __m128 sign = _mm_set1_ps(-0.0f), half = _mm_set1_ps(0.5f);
+  for (i = 0; i < 16; ++i) v[i] = _mm_loadu_ps(CDU + 4 * i);
+  // rows, as columns of the transpose
+  jo_transpose8x8(v);
+  jo_DCT_sse2(v);
+  jo_DCT_sse2(v + 1);
+  jo_transpose8x8(v);
+  // columns
+  jo_DCT_sse2(v);
+  jo_DCT_sse2(v + 1);
+  for (i = 0; i < 16; ++i) {
+    // round half away from zero, like the scalar floorf/ceilf
+    __m128 x = _mm_mul_ps(v[i], _mm_loadu_ps(fdtbl + 4 * i));
+    x = _mm_add_ps(x, _mm_or_ps(half, _mm_and_ps(x, sign)));
+    _mm_storeu_si128((__m128i *)(q + 4 * i), _mm_cvttps_epi32(x));
+  }
+  for (i = 0; i < 64; ++i) DU[s_jo_ZigZag[i]] = q[i];
+#else
+  int dataOff;
   // DCT rows
   for (dataOff = 0; dataOff < 64; dataOff += 8) {
     jo_DCT(&CDU[dataOff], &CDU[dataOff + 1], &CDU[dataOff + 2],
@@ -139,56 +346,220 @@ static int jo_processDU(FILE *f, int *bitBuf, int *bitCnt, float *CDU,
            &CDU[dataOff + 24], &CDU[dataOff + 32], &CDU[dataOff + 40],
            &CDU[dataOff + 48], &CDU[dataOff + 56]);
   }
-  // Quantize/descale/zigzag the coefficients
-  int DU[64];
   for (i = 0; i < 64; ++i) {
     float v = CDU[i] * fdtbl[i];
     DU[s_jo_ZigZag[i]] = (int)(v < 0 ? ceilf(v - 0.5f) : floorf(v + 0.5f));
   }
+#endif
+}
+
+// Huffman code for the run of zeroes and size category of 'val', followed
+// by its extra bits
+static void jo_writeCoef(jo_writer *w, int val,
+                         const unsigned short HT[256][2], int run) {
+  unsigned int mag = val < 0 ? -val : val;
+  int n = 0;
+#if defined(__GNUC__) || defined(__clang__)
+  n = 32 - __builtin_clz(mag);
+#else
+  while (mag >> n) ++n;
+#endif
+  if (val < 0) val -= 1;
+  jo_writeBits(w, ((unsigned int)HT[run + n][0] << n) | (val & ((1u << n) - 1)),
+               HT[run + n][1] + n);
+}
+
+static int jo_processDU(jo_writer *w, float *CDU, const float *fdtbl, int DC,
+                        const unsigned short HTDC[256][2],
+                        const unsigned short HTAC[256][2]) {
+  int DU[64];
+  int i, nrmarker;
+
+  jo_fDCT_quantize(CDU, fdtbl, DU);
 
   // Encode DC
   int diff = DU[0] - DC;
   if (diff == 0) {
-    jo_writeBits(f, bitBuf, bitCnt, HTDC[0]);
+    jo_writeBits(w, HTDC[0][0], HTDC[0][1]);
   } else {
-    unsigned short bits[2];
-    jo_calcBits(diff, bits);
-    jo_writeBits(f, bitBuf, bitCnt, HTDC[bits[1]]);
-    jo_writeBits(f, bitBuf, bitCnt, bits);
+    jo_writeCoef(w, diff, HTDC, 0);
   }
   // Encode ACs
   int end0pos = 63;
   for (; (end0pos > 0) && (DU[end0pos] == 0); --end0pos) {
   }
   // end0pos = first element in reverse order !=0
-  if (end0pos == 0) {
-    jo_writeBits(f, bitBuf, bitCnt, EOB);
-    return DU[0];
-  }
   for (i = 1; i <= end0pos; ++i) {
     int startpos = i;
-    for (; DU[i] == 0 && i <= end0pos; ++i) {
+    for (; DU[i] == 0; ++i) {
     }
     int nrzeroes = i - startpos;
     if (nrzeroes >= 16) {
       int lng = nrzeroes >> 4;
       for (nrmarker = 1; nrmarker <= lng; ++nrmarker)
-        jo_writeBits(f, bitBuf, bitCnt, M16zeroes);
+        jo_writeBits(w, HTAC[0xF0][0], HTAC[0xF0][1]);
       nrzeroes &= 15;
     }
-    unsigned short bits[2];
-    jo_calcBits(DU[i], bits);
-    jo_writeBits(f, bitBuf, bitCnt, HTAC[(nrzeroes << 4) + bits[1]]);
-    jo_writeBits(f, bitBuf, bitCnt, bits);
+    jo_writeCoef(w, DU[i], HTAC, nrzeroes << 4);
   }
   if (end0pos != 63) {
-    jo_writeBits(f, bitBuf, bitCnt, EOB);
+    jo_writeBits(w, HTAC[0x00][0], HTAC[0x00][1]);
   }
   return DU[0];
 }
 
-int jo_write_jpg(const char *filename, const void *data, int width, int height,
-                 int comp, int quality) {
+// Everything the MCU encoder needs to know about the image
+typedef struct {
+  const unsigned char *data;
+  int width, height, comp;
+  int hsamp, vsamp;  // luma blocks per MCU across and down
+  int mcuRows, restartRows;
+  const float *fdtbl_Y, *fdtbl_UV;
+  const unsigned short (*YDC_HT)[2], (*YAC_HT)[2];
+  const unsigned short (*UVDC_HT)[2], (*UVAC_HT)[2];
+  jo_memBuf *segments;  // one per restart interval
+} jo_encoder;
+
+static void jo_RGBtoYUV(const float *r, const float *g, const float *b, int n,
+                        float *Y, float *U, float *V) {
+  int i = 0;
+#ifdef IMAGE_SIMD_X86
+  for (; i + 4 <= n; i += 4) {
+    __m128 R = _mm_loadu_ps(r + i), G = _mm_loadu_ps(g + i),
+           B = _mm_loadu_ps(b + i);
+    _mm_storeu_ps(
+        Y + i,
+        _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(0.29900f), R),
+                                         _mm_mul_ps(_mm_set1_ps(0.58700f), G)),
+                              _mm_mul_ps(_mm_set1_ps(0.11400f), B)),
+                   _mm_set1_ps(128.0f)));
+    _mm_storeu_ps(
+        U + i,
+        _mm_add_ps(_mm_sub_ps(_mm_mul_ps(_mm_set1_ps(-0.16874f), R),
+                              _mm_mul_ps(_mm_set1_ps(0.33126f), G)),
+                   _mm_mul_ps(_mm_set1_ps(0.50000f), B)));
+    _mm_storeu_ps(
+        V + i,
+        _mm_sub_ps(_mm_sub_ps(_mm_mul_ps(_mm_set1_ps(0.50000f), R),
+                              _mm_mul_ps(_mm_set1_ps(0.41869f), G)),
+                   _mm_mul_ps(_mm_set1_ps(0.08131f), B)));
+  }
+#endif
+  for (; i < n; ++i) {
+    Y[i] = +0.29900f * r[i] + 0.58700f * g[i] + 0.11400f * b[i] - 128;
+    U[i] = -0.16874f * r[i] - 0.33126f * g[i] + 0.50000f * b[i];
+    V[i] = +0.50000f * r[i] - 0.41869f * g[i] - 0.08131f * b[i];
+  }
+}
+
+// box filters a 16 wide, 8 * vsamp tall chroma plane down to one block
+static void jo_downsample(const float *src, int vsamp, float *dst) {
+  int i, j;
+  for (j = 0; j < 8; ++j) {
+    const float *s0 = src + j * vsamp * 16, *s1 = s0 + (vsamp - 1) * 16;
+#ifdef IMAGE_SIMD_X86
+    const __m128 scale = _mm_set1_ps(vsamp == 2 ? 0.25f : 0.5f);
+    for (i = 0; i < 8; i += 4) {
+      // sums of horizontal pairs, then of the two rows
+      __m128 a = _mm_loadu_ps(s0 + 2 * i), b = _mm_loadu_ps(s0 + 2 * i + 4);
+      __m128 v = _mm_add_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)),
+                            _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+      if (vsamp == 2) {
+        a = _mm_loadu_ps(s1 + 2 * i);
+        b = _mm_loadu_ps(s1 + 2 * i + 4);
+        v = _mm_add_ps(v, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+        v = _mm_add_ps(v, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+      }
+      _mm_storeu_ps(dst + j * 8 + i, _mm_mul_ps(v, scale));
+    }
+#else
+    for (i = 0; i < 8; ++i) {
+      float v = s0[2 * i] + s0[2 * i + 1];
+      if (vsamp == 2) {
+        v += s1[2 * i];
+        v += s1[2 * i + 1];
+      }
+      dst[j * 8 + i] = v * (vsamp == 2 ? 0.25f : 0.5f);
+    }
+#endif
+  }
+}
+
+// color converts the MCU at (x, y) into its luma blocks, in raster order,
+// and one U and one V block; pixels past the edges repeat the last row and
+// column
+static void jo_loadMCU(const jo_encoder *e, int x, int y, float YDU[4][64],
+                       float *UDU, float *VDU) {
+  const int mw = 8 * e->hsamp, mh = 8 * e->vsamp, comp = e->comp;
+  const int ofsG = comp > 1 ? 1 : 0, ofsB = comp > 1 ? 2 : 0;
+  const int full = e->hsamp == 1;  // 4:4:4 converts straight into U/VDU
+  float U[16 * 16], V[16 * 16];
+  float r[16], g[16], b[16], Y[16];
+  int colOfs[16];
+  int i, j;
+
+  for (i = 0; i < mw; ++i) {
+    colOfs[i] = (x + i < e->width ? x + i : e->width - 1) * comp;
+  }
+  for (j = 0; j < mh; ++j) {
+    int row = y + j < e->height ? y + j : e->height - 1;
+    const unsigned char *p = e->data + (size_t)row * e->width * comp;
+    float *blk = YDU[(j >> 3) * e->hsamp];
+    for (i = 0; i < mw; ++i) {
+      const unsigned char *q = p + colOfs[i];
+      r[i] = q[0];
+      g[i] = q[ofsG];
+      b[i] = q[ofsB];
+    }
+    jo_RGBtoYUV(r, g, b, mw, Y, full ? UDU + j * 8 : U + j * mw,
+                full ? VDU + j * 8 : V + j * mw);
+    memcpy(blk + (j & 7) * 8, Y, 8 * sizeof(float));
+    if (mw == 16) {
+      blk = YDU[(j >> 3) * 2 + 1];
+      memcpy(blk + (j & 7) * 8, Y + 8, 8 * sizeof(float));
+    }
+  }
+  if (!full) {
+    jo_downsample(U, e->vsamp, UDU);
+    jo_downsample(V, e->vsamp, VDU);
+  }
+}
+
+// encodes MCU rows [mcuRow, mcuRowEnd) as one entropy-coded segment, padded
+// with 1 bits to a byte boundary
+static void jo_encodeMCURows(jo_writer *w, const jo_encoder *e, int mcuRow,
+                             int mcuRowEnd) {
+  const int mw = 8 * e->hsamp, mh = 8 * e->vsamp;
+  int DCY = 0, DCU = 0, DCV = 0;
+  int x, y, k;
+  for (y = mcuRow * mh; y < mcuRowEnd * mh; y += mh) {
+    for (x = 0; x < e->width; x += mw) {
+      float YDU[4][64], UDU[64], VDU[64];
+      jo_loadMCU(e, x, y, YDU, UDU, VDU);
+      for (k = 0; k < e->hsamp * e->vsamp; ++k) {
+        DCY = jo_processDU(w, YDU[k], e->fdtbl_Y, DCY, e->YDC_HT, e->YAC_HT);
+      }
+      DCU = jo_processDU(w, UDU, e->fdtbl_UV, DCU, e->UVDC_HT, e->UVAC_HT);
+      DCV = jo_processDU(w, VDU, e->fdtbl_UV, DCV, e->UVDC_HT, e->UVAC_HT);
+    }
+  }
+  jo_writeBits(w, 0x7F, 7);
+  jo_emitBits(w);
+  w->bitCnt = 0;
+}
+
+static void jo_encodeSegment(void *context, int index) {
+  const jo_encoder *e = (const jo_encoder *)context;
+  int end = (index + 1) * e->restartRows;
+  jo_writer w;
+  jo_initWriter(&w, jo_memWrite, &e->segments[index]);
+  jo_encodeMCURows(&w, e, index * e->restartRows,
+                   end < e->mcuRows ? end : e->mcuRows);
+  jo_flushBuf(&w);
+}
+
+int jo_write_jpg_to_func(jo_write_func *func, void *context, const void *data,
+                         int width, int height, int comp, int quality) {
   // Constants that don't pollute global namespace
   static const unsigned char std_dc_luminance_nrcodes[] = {
       0, 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
@@ -360,16 +731,46 @@ int jo_write_jpg(const char *filename, const void *data, int width, int height,
       1.306562965f * 2.828427125f, 1.175875602f * 2.828427125f,
       1.0f * 2.828427125f,         0.785694958f * 2.828427125f,
       0.541196100f * 2.828427125f, 0.275899379f * 2.828427125f};
-  int i, row, col, x, y, k, pos;
+  int i, row, col, k;
 
-  if (!data || !filename || !width || !height || comp > 4 || comp < 1 ||
+  if (!data || !func || !width || !height || comp > 4 || comp < 1 ||
       comp == 2) {
     return 0;
   }
 
-  FILE *f;
-  errno_t err = fopen_s(&f, filename, "rb");
-  if (!err) return 0;
+  jo_encoder e;
+  e.data = (const unsigned char *)data;
+  e.width = width;
+  e.height = height;
+  e.comp = comp;
+  e.hsamp = jo_write_jpg_subsampling == JO_JPEG_444 ? 1 : 2;
+  e.vsamp = jo_write_jpg_subsampling == JO_JPEG_420 ? 2 : 1;
+  e.mcuRows = (height + 8 * e.vsamp - 1) / (8 * e.vsamp);
+  e.YDC_HT = YDC_HT;
+  e.YAC_HT = YAC_HT;
+  e.UVDC_HT = UVDC_HT;
+  e.UVAC_HT = UVAC_HT;
+  e.segments = NULL;
+
+  // the restart interval is counted in MCUs and has to fit in 16 bits
+  int mcusPerRow = (width + 8 * e.hsamp - 1) / (8 * e.hsamp);
+  int segments = 1;
+  e.restartRows = jo_write_jpg_restart_rows;
+  if (e.restartRows > 65535 / mcusPerRow) {
+    e.restartRows = 65535 / mcusPerRow;
+  }
+  if (e.restartRows > 0 && e.restartRows < e.mcuRows) {
+    segments = (e.mcuRows + e.restartRows - 1) / e.restartRows;
+    e.segments = (jo_memBuf *)calloc(segments, sizeof(jo_memBuf));
+    if (!e.segments) {
+      return 0;
+    }
+  } else {
+    e.restartRows = 0;
+  }
+
+  jo_writer w;
+  jo_initWriter(&w, func, context);
 
   quality = quality ? quality : 90;
   quality = quality < 1 ? 1 : quality > 100 ? 100 : quality;
@@ -390,15 +791,17 @@ int jo_write_jpg(const char *filename, const void *data, int width, int height,
       fdtbl_UV[k] = 1 / (UVTable[s_jo_ZigZag[k]] * aasf[row] * aasf[col]);
     }
   }
+  e.fdtbl_Y = fdtbl_Y;
+  e.fdtbl_UV = fdtbl_UV;
 
   // Write Headers
   static const unsigned char head0[] = {
       0xFF, 0xD8, 0xFF, 0xE0, 0, 0x10, 'J', 'F',  'I',  'F', 0,    1, 1,
       0,    0,    1,    0,    1, 0,    0,   0xFF, 0xDB, 0,   0x84, 0};
-  fwrite(head0, sizeof(head0), 1, f);
-  fwrite(YTable, sizeof(YTable), 1, f);
-  putc(1, f);
-  fwrite(UVTable, sizeof(UVTable), 1, f);
+  jo_writeBytes(&w, head0, sizeof(head0));
+  jo_writeBytes(&w, YTable, sizeof(YTable));
+  jo_putc(&w, 1);
+  jo_writeBytes(&w, UVTable, sizeof(UVTable));
   const unsigned char head1[] = {0xFF,
                                  0xC0,
                                  0,
@@ -410,7 +813,7 @@ int jo_write_jpg(const char *filename, const void *data, int width, int height,
                                  (unsigned char)(width & 0xFF),
                                  3,
                                  1,
-                                 0x11,
+                                 (unsigned char)(e.hsamp << 4 | e.vsamp),
                                  0,
                                  2,
                                  0x11,
@@ -423,71 +826,100 @@ int jo_write_jpg(const char *filename, const void *data, int width, int height,
                                  0x01,
                                  0xA2,
                                  0};
-  fwrite(head1, sizeof(head1), 1, f);
-  fwrite(std_dc_luminance_nrcodes + 1, sizeof(std_dc_luminance_nrcodes) - 1, 1,
-         f);
-  fwrite(std_dc_luminance_values, sizeof(std_dc_luminance_values), 1, f);
-  putc(0x10, f);  // HTYACinfo
-  fwrite(std_ac_luminance_nrcodes + 1, sizeof(std_ac_luminance_nrcodes) - 1, 1,
-         f);
-  fwrite(std_ac_luminance_values, sizeof(std_ac_luminance_values), 1, f);
-  putc(1, f);  // HTUDCinfo
-  fwrite(std_dc_chrominance_nrcodes + 1, sizeof(std_dc_chrominance_nrcodes) - 1,
-         1, f);
-  fwrite(std_dc_chrominance_values, sizeof(std_dc_chrominance_values), 1, f);
-  putc(0x11, f);  // HTUACinfo
-  fwrite(std_ac_chrominance_nrcodes + 1, sizeof(std_ac_chrominance_nrcodes) - 1,
-         1, f);
-  fwrite(std_ac_chrominance_values, sizeof(std_ac_chrominance_values), 1, f);
+  jo_writeBytes(&w, head1, sizeof(head1));
+  jo_writeBytes(&w, std_dc_luminance_nrcodes + 1,
+                sizeof(std_dc_luminance_nrcodes) - 1);
+  jo_writeBytes(&w, std_dc_luminance_values, sizeof(std_dc_luminance_values));
+  jo_putc(&w, 0x10);  // HTYACinfo
+  jo_writeBytes(&w, std_ac_luminance_nrcodes + 1,
+                sizeof(std_ac_luminance_nrcodes) - 1);
+  jo_writeBytes(&w, std_ac_luminance_values, sizeof(std_ac_luminance_values));
+  jo_putc(&w, 1);  // HTUDCinfo
+  jo_writeBytes(&w, std_dc_chrominance_nrcodes + 1,
+                sizeof(std_dc_chrominance_nrcodes) - 1);
+  jo_writeBytes(&w, std_dc_chrominance_values,
+                sizeof(std_dc_chrominance_values));
+  jo_putc(&w, 0x11);  // HTUACinfo
+  jo_writeBytes(&w, std_ac_chrominance_nrcodes + 1,
+                sizeof(std_ac_chrominance_nrcodes) - 1);
+  jo_writeBytes(&w, std_ac_chrominance_values,
+                sizeof(std_ac_chrominance_values));
+  if (e.restartRows) {
+    int interval = e.restartRows * mcusPerRow;
+    const unsigned char dri[] = {0xFF, 0xDD, 0, 4,
+                                 (unsigned char)(interval >> 8),
+                                 (unsigned char)(interval & 0xFF)};
+    jo_writeBytes(&w, dri, sizeof(dri));
+  }
   static const unsigned char head2[] = {0xFF, 0xDA, 0, 0xC,  3, 1,    0,
                                         2,    0x11, 3, 0x11, 0, 0x3F, 0};
-  fwrite(head2, sizeof(head2), 1, f);
+  jo_writeBytes(&w, head2, sizeof(head2));
 
-  // Encode 8x8 macroblocks
-  const unsigned char *imageData = (const unsigned char *)data;
-  int DCY = 0, DCU = 0, DCV = 0;
-  int bitBuf = 0, bitCnt = 0;
-  int ofsG = comp > 1 ? 1 : 0, ofsB = comp > 1 ? 2 : 0;
-  for (y = 0; y < height; y += 8) {
-    for (x = 0; x < width; x += 8) {
-      float YDU[64], UDU[64], VDU[64];
-      for (row = y, pos = 0; row < y + 8; ++row) {
-        for (col = x; col < x + 8; ++col, ++pos) {
-          int p = row * width * comp + col * comp;
-          if (row >= height) {
-            p -= width * comp * (row + 1 - height);
-          }
-          if (col >= width) {
-            p -= comp * (col + 1 - width);
-          }
-
-          float r = imageData[p + 0], g = imageData[p + ofsG],
-                b = imageData[p + ofsB];
-          YDU[pos] = +0.29900f * r + 0.58700f * g + 0.11400f * b - 128;
-          UDU[pos] = -0.16874f * r - 0.33126f * g + 0.50000f * b;
-          VDU[pos] = +0.50000f * r - 0.41869f * g - 0.08131f * b;
-        }
+  // Encode 8x8 macroblocks; restart intervals are encoded in parallel and
+  // joined with RSTn markers
+  if (!e.restartRows) {
+    jo_encodeMCURows(&w, &e, 0, e.mcuRows);
+  } else {
+    int ok = 1;
+    jo_parallel_for(segments, jo_write_jpg_thread_count, jo_encodeSegment, &e);
+    for (i = 0; i < segments; ++i) {
+      ok = ok && !e.segments[i].failed;
+      if (ok && i) {
+        jo_putc(&w, 0xFF);
+        jo_putc(&w, 0xD0 + ((i - 1) & 7));
       }
-
-      DCY =
-          jo_processDU(f, &bitBuf, &bitCnt, YDU, fdtbl_Y, DCY, YDC_HT, YAC_HT);
-      DCU = jo_processDU(f, &bitBuf, &bitCnt, UDU, fdtbl_UV, DCU, UVDC_HT,
-                         UVAC_HT);
-      DCV = jo_processDU(f, &bitBuf, &bitCnt, VDU, fdtbl_UV, DCV, UVDC_HT,
-                         UVAC_HT);
+      if (ok) {
+        jo_writeBytes(&w, e.segments[i].data, e.segments[i].len);
+      }
+      free(e.segments[i].data);
+    }
+    free(e.segments);
+    if (!ok) {
+      return 0;
     }
   }
 
-  // Do the bit alignment of the EOI marker
-  static const unsigned short fillBits[] = {0x7F, 7};
-  jo_writeBits(f, &bitBuf, &bitCnt, fillBits);
-
   // EOI
-  putc(0xFF, f);
-  putc(0xD9, f);
+  jo_putc(&w, 0xFF);
+  jo_putc(&w, 0xD9);
 
-  fclose(f);
+  jo_flushBuf(&w);
   return 1;
 }
 
+static void jo_fileWrite(void *context, void *data, int size) {
+  fwrite(data, 1, size, (FILE *)context);
+}
+
+int jo_write_jpg(const char *filename, const void *data, int width, int height,
+                 int comp, int quality) {
+  if (!filename) {
+    return 0;
+  }
+  FILE *f;
+  errno_t err = fopen_s(&f, filename, "wb");
+  if (err || !f) return 0;
+  int r = jo_write_jpg_to_func(jo_fileWrite, f, data, width, height, comp,
+                               quality);
+  fclose(f);
+  return r;
+}
+
+unsigned char *jo_write_jpg_to_mem(const void *data, int width, int height,
+                                   int comp, int quality, int *out_len) {
+  jo_memBuf m;
+  m.data = NULL;
+  m.len = 0;
+  m.cap = 0;
+  m.failed = 0;
+  if (!jo_write_jpg_to_func(jo_memWrite, &m, data, width, height, comp,
+                            quality) ||
+      m.failed) {
+    free(m.data);
+    return NULL;
+  }
+  if (out_len) *out_len = m.len;
+  return m.data;
+}
+
 #endif
@@ -154,7 +154,9 @@ RECENT REVISION HISTORY:
 // can be queried for an extremely brief, end-user unfriendly explanation
 // of why the load failed. Define STBI_NO_FAILURE_STRINGS to avoid
 // compiling these strings at all, and STBI_FAILURE_USERMSG to get slightly
-// more user-friendly ones.
+// more user-friendly ones. The failure reason is kept per thread (see
+// STBI_THREAD_LOCAL), so threads loading images at the same time each see
+// their own, including for the work a load hands to its decode threads.
 //
 // Paletted PNG, BMP, GIF, and PIC images are automatically depalettized.
 //
@@ -205,7 +207,10 @@ RECENT REVISION HISTORY:
 // code.)
 //
 // On x86, SSE2 will automatically be used when available based on a run-time
-// test; if not, the generic C versions are used as a fall-back. On ARM targets,
+// test; if not, the generic C versions are used as a fall-back. CPUs with AVX2
+// get wider versions of the JPEG IDCT, chroma upsampling and color conversion
+// kernels, also picked at run time (define STBI_NO_AVX2 to leave them out).
+// All of these produce bit-identical output. On ARM targets,
 // the typical path is to have separate builds for NEON and non-NEON devices
 // (at least this is true for iOS and Android). Therefore, the NEON support is
 // toggled by a build flag: define STBI_NEON to get NEON loops.
@@ -216,6 +221,30 @@ RECENT REVISION HISTORY:
 //
 // ===========================================================================
 //
+// Multithreading
+//
+// Large JPEGs, PNGs and DDS files can be decoded on several threads:
+//
+//     stbi_set_decode_thread_count(0); // one per hardware thread
+//
+// For JPEG, the dequantize/IDCT pass of progressive images and the
+// upsampling/color conversion of all images run in bands of rows across the
+// threads. For non-interlaced PNG, scanlines are defiltered on a second
+// thread while they are still being inflated. DXT/BC4/BC5 DDS images are
+// decoded a row of blocks per task. The default is 1, decoding on
+// the calling thread only, and images under a quarter megapixel always are.
+// The output does not depend on the thread count. The threads come from
+// image_parallel_for() in image_thread.h; define STBI_NO_THREADS to drop
+// that dependency.
+//
+// Loads on different threads don't share any state but the settings made
+// with the stbi_set_* functions, which are best made once up front. The
+// failure reason is thread-local where the compiler supports it; define
+// STBI_THREAD_LOCAL yourself (to nothing, for a plain global) if it guesses
+// wrong, or define STBI_NO_THREAD_LOCALS to never use thread-local storage.
+//
+// ===========================================================================
+//
 // HDR image support   (disable by defining STBI_NO_HDR)
 //
 // stb_image now supports loading HDR images in general, and currently
@@ -300,6 +329,10 @@ RECENT REVISION HISTORY:
 //   - If you use STBI_NO_PNG (or _ONLY_ without PNG), and you still
 //     want the zlib decoder to be available, #define STBI_SUPPORT_ZLIB
 //
+//   - stbi_load, stbi_load_16 and stbi_loadf map the file read-only and
+//     decode it in place (see image_mmap.h); #define STBI_NO_MMAP to read
+//     it through stdio instead.
+//
 
 
 #ifndef STBI_NO_STDIO
@@ -389,6 +422,14 @@ STBIDEF stbi_us *stbi_load_from_file_16(FILE *f, int *x, int *y, int *channels_i
 #ifndef STBI_NO_HDR
    STBIDEF void   stbi_hdr_to_ldr_gamma(float gamma);
    STBIDEF void   stbi_hdr_to_ldr_scale(float scale);
+
+   // Radiance .hdr files only: the raw pixels, 4 bytes each (RGB mantissas,
+   // then the shared exponent e), without converting them; a component is
+   // m * 2^(e - 136), or 0 when e is 0.
+   STBIDEF stbi_uc *stbi_load_rgbe_from_memory(stbi_uc const *buffer, int len, int *x, int *y);
+   #ifndef STBI_NO_STDIO
+   STBIDEF stbi_uc *stbi_load_rgbe            (char const *filename, int *x, int *y);
+   #endif
 #endif // STBI_NO_HDR
 
 #ifndef STBI_NO_LINEAR
@@ -405,11 +446,11 @@ STBIDEF int      stbi_is_hdr_from_file(FILE *f);
 #endif // STBI_NO_STDIO
 
 
-// get a VERY brief reason for failure
-// NOT THREADSAFE
+// get a VERY brief reason for the last failure on the calling thread
 STBIDEF const char *stbi_failure_reason  (void);
 
-// free the loaded image -- this is just free()
+// free the loaded image -- this is just free(), or STBI_FREE, which is the
+// calling thread's image_allocator by default (see image_alloc.h)
 STBIDEF void     stbi_image_free      (void *retval_from_stbi_load);
 
 // get image dimensions & components without fully decoding
@@ -436,6 +477,10 @@ STBIDEF void stbi_convert_iphone_png_to_rgb(int flag_true_if_should_convert);
 // flip the image vertically, so the first pixel in the output array is the bottom left
 STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip);
 
+// decode large JPEG and PNG images on up to this many threads (default 1,
+// 0 for one per hardware thread)
+STBIDEF void stbi_set_decode_thread_count(int thread_count);
+
 // ZLIB client - used by PNG, available for other purposes
 
 STBIDEF char *stbi_zlib_decode_malloc_guesssize(const char *buffer, int len, int initial_size, int *outlen);
@@ -523,6 +568,10 @@ STBIDEF int   stbi_zlib_decode_noheader_buffer(char *obuffer, int olen, const ch
 
 #ifndef STBI_NO_STDIO
 #include <stdio.h>
+#ifndef STBI_NO_MMAP
+#include "image_mmap.h"
+#include "image_alloc.h"
+#endif
 #endif
 
 #ifndef STBI_ASSERT
@@ -582,16 +631,47 @@ typedef unsigned char validate_uint32[sizeof(stbi__uint32)==4 ? 1 : -1];
 #error "Must define all or none of STBI_MALLOC, STBI_FREE, and STBI_REALLOC (or STBI_REALLOC_SIZED)."
 #endif
 
+// by default, the calling thread's image_allocator (the C heap unless one
+// was installed with image_allocator_use)
 #ifndef STBI_MALLOC
-#define STBI_MALLOC(sz)           malloc(sz)
-#define STBI_REALLOC(p,newsz)     realloc(p,newsz)
-#define STBI_FREE(p)              free(p)
+#define STBI_MALLOC(sz)           image_malloc(sz)
+#define STBI_REALLOC(p,newsz)     image_realloc(p,newsz)
+#define STBI_FREE(p)              image_free(p)
 #endif
 
 #ifndef STBI_REALLOC_SIZED
 #define STBI_REALLOC_SIZED(p,oldsz,newsz) STBI_REALLOC(p,newsz)
 #endif
 
+#if !defined(STBI_NO_THREAD_LOCALS) && !defined(STBI_THREAD_LOCAL)
+   #if defined(__cplusplus) && __cplusplus >= 201103L
+      #define STBI_THREAD_LOCAL       thread_local
+   #elif defined(_MSC_VER)
+      #define STBI_THREAD_LOCAL       __declspec(thread)
+   #elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+      #define STBI_THREAD_LOCAL       _Thread_local
+   #elif defined(__GNUC__)
+      #define STBI_THREAD_LOCAL       __thread
+   #endif
+#endif
+
+#ifndef STBI_THREAD_LOCAL
+#define STBI_THREAD_LOCAL
+#endif
+
+#ifndef STBI_NO_THREADS
+#include "image_thread.h"
+#define stbi__parallel_for image_parallel_for
+#else
+static int stbi__parallel_for(int count, int thread_count, void (*task)(void *, int), void *context)
+{
+   int i;
+   STBI_NOTUSED(thread_count);
+   for (i=0; i < count; ++i) task(context, i);
+   return 1;
+}
+#endif
+
 // x86/x64 detection
 #if defined(__x86_64__) || defined(_M_X64)
 #define STBI__X64_TARGET
@@ -619,6 +699,13 @@ typedef unsigned char validate_uint32[sizeof(stbi__uint32)==4 ? 1 : -1];
 #define STBI_SSE2
 #include <emmintrin.h>
 
+// the AVX2 kernels are compiled whenever image_simd.h can target AVX2 and
+// are picked at run time by stbi__setup_jpeg
+#include "image_simd.h"
+#if defined(IMAGE_SIMD_X86) && !defined(STBI_NO_AVX2)
+#define STBI_AVX2
+#endif
+
 #ifdef _MSC_VER
 
 #if _MSC_VER >= 1400  // not VC6
@@ -850,8 +937,8 @@ static void    *stbi__pkm_load(stbi__context *s, int *x, int *y, int *comp, int
 static int      stbi__pkm_info(stbi__context *s, int *x, int *y, int *comp);
 #endif
 
-// this is not threadsafe
-static const char *stbi__g_failure_reason;
+// one per thread, unless STBI_THREAD_LOCAL is empty
+static STBI_THREAD_LOCAL const char *stbi__g_failure_reason;
 
 STBIDEF const char *stbi_failure_reason(void)
 {
@@ -975,6 +1062,33 @@ STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip)
     stbi__vertically_flip_on_load = flag_true_if_should_flip;
 }
 
+static int stbi__decode_thread_count = 1;
+
+STBIDEF void stbi_set_decode_thread_count(int thread_count)
+{
+   stbi__decode_thread_count = thread_count;
+}
+
+#if !defined(STBI_NO_JPEG) || !defined(STBI_NO_PNG) || !defined(STBI_NO_DDS)
+// images smaller than this are decoded on the calling thread
+#define STBI__PARALLEL_MIN_PIXELS  (1 << 18)
+
+// the number of threads to decode an x*y image with
+static int stbi__decode_threads(stbi__uint32 x, stbi__uint32 y)
+{
+#ifdef STBI_NO_THREADS
+   STBI_NOTUSED(x);
+   STBI_NOTUSED(y);
+   return 1;
+#else
+   int threads = stbi__decode_thread_count;
+   if ((double) x * y < STBI__PARALLEL_MIN_PIXELS) return 1;
+   if (threads <= 0) threads = image_thread_count_default();
+   return threads;
+#endif
+}
+#endif
+
 static void *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri, int bpc)
 {
    memset(ri, 0, sizeof(*ri)); // make sure it's initialized if we add new fields
@@ -1174,10 +1288,33 @@ static FILE *stbi__fopen(char const *filename, char const *mode)
 }
 
 
+#ifndef STBI_NO_MMAP
+// maps the whole file; 0 if it can't be opened or is too big for an int length,
+// in which case the caller falls back to stdio
+static int stbi__map_file(char const *filename, image_file_view *view)
+{
+   if (!image_file_map(filename, view)) return 0;
+   if (view->size > INT_MAX) {
+      image_file_unmap(view);
+      return 0;
+   }
+   return 1;
+}
+#endif
+
 STBIDEF stbi_uc *stbi_load(char const *filename, int *x, int *y, int *comp, int req_comp)
 {
-   FILE *f = stbi__fopen(filename, "rb");
+   FILE *f;
    unsigned char *result;
+#ifndef STBI_NO_MMAP
+   image_file_view view;
+   if (stbi__map_file(filename, &view)) {
+      result = stbi_load_from_memory(view.data, (int) view.size, x,y,comp,req_comp);
+      image_file_unmap(&view);
+      return result;
+   }
+#endif
+   f = stbi__fopen(filename, "rb");
    if (!f) return stbi__errpuc("can't fopen", "Unable to open file");
    result = stbi_load_from_file(f,x,y,comp,req_comp);
    fclose(f);
@@ -1212,8 +1349,19 @@ STBIDEF stbi__uint16 *stbi_load_from_file_16(FILE *f, int *x, int *y, int *comp,
 
 STBIDEF stbi_us *stbi_load_16(char const *filename, int *x, int *y, int *comp, int req_comp)
 {
-   FILE *f = stbi__fopen(filename, "rb");
+   FILE *f;
    stbi__uint16 *result;
+#ifndef STBI_NO_MMAP
+   image_file_view view;
+   if (stbi__map_file(filename, &view)) {
+      stbi__context s;
+      stbi__start_mem(&s, view.data, (int) view.size);
+      result = stbi__load_and_postprocess_16bit(&s,x,y,comp,req_comp);
+      image_file_unmap(&view);
+      return result;
+   }
+#endif
+   f = stbi__fopen(filename, "rb");
    if (!f) return (stbi_us *) stbi__errpuc("can't fopen", "Unable to open file");
    result = stbi_load_from_file_16(f,x,y,comp,req_comp);
    fclose(f);
@@ -1274,7 +1422,16 @@ STBIDEF float *stbi_loadf_from_callbacks(stbi_io_callbacks const *clbk, void *us
 STBIDEF float *stbi_loadf(char const *filename, int *x, int *y, int *comp, int req_comp)
 {
    float *result;
-   FILE *f = stbi__fopen(filename, "rb");
+   FILE *f;
+#ifndef STBI_NO_MMAP
+   image_file_view view;
+   if (stbi__map_file(filename, &view)) {
+      result = stbi_loadf_from_memory(view.data, (int) view.size, x,y,comp,req_comp);
+      image_file_unmap(&view);
+      return result;
+   }
+#endif
+   f = stbi__fopen(filename, "rb");
    if (!f) return stbi__errpf("can't fopen", "Unable to open file");
    result = stbi_loadf_from_file(f,x,y,comp,req_comp);
    fclose(f);
@@ -2422,6 +2579,171 @@ static void stbi__idct_simd(stbi_uc *out, int out_stride, short data[64])
 #undef dct_pass
 }
 
+#ifdef STBI_AVX2
+// avx2 version of the sse2 IDCT above: the 32-bit intermediates of all eight
+// columns fit in one register, which halves the wide arithmetic. the math is
+// unchanged, so it is still bit-identical to the generic C version.
+IMAGE_TARGET_AVX2
+static void stbi__idct_avx2(stbi_uc *out, int out_stride, short data[64])
+{
+   __m128i row0, row1, row2, row3, row4, row5, row6, row7;
+   __m128i tmp;
+
+   // dot product constant: even elems=x, odd elems=y
+   #define dct_const(x,y)  _mm256_setr_epi16((x),(y),(x),(y),(x),(y),(x),(y), \
+                                             (x),(y),(x),(y),(x),(y),(x),(y))
+
+   // out(0) = c0[even]*x + c0[odd]*y   (c0, x, y 16-bit, out 32-bit)
+   // out(1) = c1[even]*x + c1[odd]*y
+   #define dct_rot(out0,out1, x,y,c0,c1) \
+      __m256i c0##xy = _mm256_inserti128_si256(_mm256_castsi128_si256( \
+                          _mm_unpacklo_epi16((x),(y))), _mm_unpackhi_epi16((x),(y)), 1); \
+      __m256i out0 = _mm256_madd_epi16(c0##xy, c0); \
+      __m256i out1 = _mm256_madd_epi16(c0##xy, c1)
+
+   // out = in << 12  (in 16-bit, out 32-bit)
+   #define dct_widen(out, in) \
+      __m256i out = _mm256_slli_epi32(_mm256_cvtepi16_epi32(in), 12)
+
+   // butterfly a/b, add bias, then shift by "s" and pack
+   #define dct_bfly32o(out0, out1, a,b,bias,s) \
+      { \
+         __m256i abiased = _mm256_add_epi32(a, bias); \
+         __m256i sum = _mm256_srai_epi32(_mm256_add_epi32(abiased, b), s); \
+         __m256i dif = _mm256_srai_epi32(_mm256_sub_epi32(abiased, b), s); \
+         out0 = _mm_packs_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1)); \
+         out1 = _mm_packs_epi32(_mm256_castsi256_si128(dif), _mm256_extracti128_si256(dif, 1)); \
+      }
+
+   // 8-bit interleave step (for transposes)
+   #define dct_interleave8(a, b) \
+      tmp = a; \
+      a = _mm_unpacklo_epi8(a, b); \
+      b = _mm_unpackhi_epi8(tmp, b)
+
+   // 16-bit interleave step (for transposes)
+   #define dct_interleave16(a, b) \
+      tmp = a; \
+      a = _mm_unpacklo_epi16(a, b); \
+      b = _mm_unpackhi_epi16(tmp, b)
+
+   #define dct_pass(bias,shift) \
+      { \
+         /* even part */ \
+         dct_rot(t2e,t3e, row2,row6, rot0_0,rot0_1); \
+         __m128i sum04 = _mm_add_epi16(row0, row4); \
+         __m128i dif04 = _mm_sub_epi16(row0, row4); \
+         dct_widen(t0e, sum04); \
+         dct_widen(t1e, dif04); \
+         __m256i x0 = _mm256_add_epi32(t0e, t3e); \
+         __m256i x3 = _mm256_sub_epi32(t0e, t3e); \
+         __m256i x1 = _mm256_add_epi32(t1e, t2e); \
+         __m256i x2 = _mm256_sub_epi32(t1e, t2e); \
+         /* odd part */ \
+         dct_rot(y0o,y2o, row7,row3, rot2_0,rot2_1); \
+         dct_rot(y1o,y3o, row5,row1, rot3_0,rot3_1); \
+         __m128i sum17 = _mm_add_epi16(row1, row7); \
+         __m128i sum35 = _mm_add_epi16(row3, row5); \
+         dct_rot(y4o,y5o, sum17,sum35, rot1_0,rot1_1); \
+         __m256i x4 = _mm256_add_epi32(y0o, y4o); \
+         __m256i x5 = _mm256_add_epi32(y1o, y5o); \
+         __m256i x6 = _mm256_add_epi32(y2o, y5o); \
+         __m256i x7 = _mm256_add_epi32(y3o, y4o); \
+         dct_bfly32o(row0,row7, x0,x7,bias,shift); \
+         dct_bfly32o(row1,row6, x1,x6,bias,shift); \
+         dct_bfly32o(row2,row5, x2,x5,bias,shift); \
+         dct_bfly32o(row3,row4, x3,x4,bias,shift); \
+      }
+
+   __m256i rot0_0 = dct_const(stbi__f2f(0.5411961f), stbi__f2f(0.5411961f) + stbi__f2f(-1.847759065f));
+   __m256i rot0_1 = dct_const(stbi__f2f(0.5411961f) + stbi__f2f( 0.765366865f), stbi__f2f(0.5411961f));
+   __m256i rot1_0 = dct_const(stbi__f2f(1.175875602f) + stbi__f2f(-0.899976223f), stbi__f2f(1.175875602f));
+   __m256i rot1_1 = dct_const(stbi__f2f(1.175875602f), stbi__f2f(1.175875602f) + stbi__f2f(-2.562915447f));
+   __m256i rot2_0 = dct_const(stbi__f2f(-1.961570560f) + stbi__f2f( 0.298631336f), stbi__f2f(-1.961570560f));
+   __m256i rot2_1 = dct_const(stbi__f2f(-1.961570560f), stbi__f2f(-1.961570560f) + stbi__f2f( 3.072711026f));
+   __m256i rot3_0 = dct_const(stbi__f2f(-0.390180644f) + stbi__f2f( 2.053119869f), stbi__f2f(-0.390180644f));
+   __m256i rot3_1 = dct_const(stbi__f2f(-0.390180644f), stbi__f2f(-0.390180644f) + stbi__f2f( 1.501321110f));
+
+   // rounding biases in column/row passes, see stbi__idct_block for explanation.
+   __m256i bias_0 = _mm256_set1_epi32(512);
+   __m256i bias_1 = _mm256_set1_epi32(65536 + (128<<17));
+
+   // load
+   row0 = _mm_load_si128((const __m128i *) (data + 0*8));
+   row1 = _mm_load_si128((const __m128i *) (data + 1*8));
+   row2 = _mm_load_si128((const __m128i *) (data + 2*8));
+   row3 = _mm_load_si128((const __m128i *) (data + 3*8));
+   row4 = _mm_load_si128((const __m128i *) (data + 4*8));
+   row5 = _mm_load_si128((const __m128i *) (data + 5*8));
+   row6 = _mm_load_si128((const __m128i *) (data + 6*8));
+   row7 = _mm_load_si128((const __m128i *) (data + 7*8));
+
+   // column pass
+   dct_pass(bias_0, 10);
+
+   {
+      // 16bit 8x8 transpose pass 1
+      dct_interleave16(row0, row4);
+      dct_interleave16(row1, row5);
+      dct_interleave16(row2, row6);
+      dct_interleave16(row3, row7);
+
+      // transpose pass 2
+      dct_interleave16(row0, row2);
+      dct_interleave16(row1, row3);
+      dct_interleave16(row4, row6);
+      dct_interleave16(row5, row7);
+
+      // transpose pass 3
+      dct_interleave16(row0, row1);
+      dct_interleave16(row2, row3);
+      dct_interleave16(row4, row5);
+      dct_interleave16(row6, row7);
+   }
+
+   // row pass
+   dct_pass(bias_1, 17);
+
+   {
+      // pack
+      __m128i p0 = _mm_packus_epi16(row0, row1); // a0a1a2a3...a7b0b1b2b3...b7
+      __m128i p1 = _mm_packus_epi16(row2, row3);
+      __m128i p2 = _mm_packus_epi16(row4, row5);
+      __m128i p3 = _mm_packus_epi16(row6, row7);
+
+      // 8bit 8x8 transpose pass 1
+      dct_interleave8(p0, p2); // a0e0a1e1...
+      dct_interleave8(p1, p3); // c0g0c1g1...
+
+      // transpose pass 2
+      dct_interleave8(p0, p1); // a0c0e0g0...
+      dct_interleave8(p2, p3); // b0d0f0h0...
+
+      // transpose pass 3
+      dct_interleave8(p0, p2); // a0b0c0d0...
+      dct_interleave8(p1, p3); // a4b4c4d4...
+
+      // store
+      _mm_storel_epi64((__m128i *) out, p0); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p0, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p2); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p2, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p1); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p1, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p3); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p3, 0x4e));
+   }
+
+#undef dct_const
+#undef dct_rot
+#undef dct_widen
+#undef dct_bfly32o
+#undef dct_interleave8
+#undef dct_interleave16
+#undef dct_pass
+}
+#endif // STBI_AVX2
+
 #endif // STBI_SSE2
 
 #ifdef STBI_NEON
@@ -2797,22 +3119,30 @@ static void stbi__jpeg_dequantize(short *data, stbi__uint16 *dequant)
       data[i] *= dequant[i];
 }
 
+// dequantize and idct one row of blocks; index counts the block rows of all
+// the components, one component after the other
+static void stbi__jpeg_finish_task(void *context, int index)
+{
+   stbi__jpeg *z = (stbi__jpeg *) context;
+   int i,j=index,n=0,w;
+   while (j >= (z->img_comp[n].y+7) >> 3)
+      j -= (z->img_comp[n++].y+7) >> 3;
+   w = (z->img_comp[n].x+7) >> 3;
+   for (i=0; i < w; ++i) {
+      short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
+      stbi__jpeg_dequantize(data, z->dequant[z->img_comp[n].tq]);
+      z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
+   }
+}
+
 static void stbi__jpeg_finish(stbi__jpeg *z)
 {
    if (z->progressive) {
-      // dequantize and idct the data
-      int i,j,n;
-      for (n=0; n < z->s->img_n; ++n) {
-         int w = (z->img_comp[n].x+7) >> 3;
-         int h = (z->img_comp[n].y+7) >> 3;
-         for (j=0; j < h; ++j) {
-            for (i=0; i < w; ++i) {
-               short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
-               stbi__jpeg_dequantize(data, z->dequant[z->img_comp[n].tq]);
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
-            }
-         }
-      }
+      // dequantize and idct the data; the rows of blocks are independent
+      int n,rows=0;
+      for (n=0; n < z->s->img_n; ++n)
+         rows += (z->img_comp[n].y+7) >> 3;
+      stbi__parallel_for(rows, stbi__decode_threads(z->s->img_x, z->s->img_y), stbi__jpeg_finish_task, z);
    }
 }
 
@@ -3508,6 +3838,126 @@ static void stbi__YCbCr_to_RGB_simd(stbi_uc *out, stbi_uc const *y, stbi_uc cons
 }
 #endif
 
+#ifdef STBI_AVX2
+// the sse2 hv_2 resampler sixteen pixels at a time
+IMAGE_TARGET_AVX2
+static stbi_uc *stbi__resample_row_hv_2_avx2(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
+{
+   int i=0,t0,t1;
+
+   if (w == 1) {
+      out[0] = out[1] = stbi__div4(3*in_near[0] + in_far[0] + 2);
+      return out;
+   }
+
+   t1 = 3*in_near[0] + in_far[0];
+   for (; i < ((w-1) & ~15); i += 16) {
+      // vertical pass, 3*x + y = 4*x + (y - x)
+      __m256i farw  = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_far + i)));
+      __m256i nearw = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_near + i)));
+      __m256i curr  = _mm256_add_epi16(_mm256_slli_epi16(nearw, 2), _mm256_sub_epi16(farw, nearw));
+
+      // current row shifted by one pixel either way, across the 128-bit lanes,
+      // with the neighbours outside this group of 16 put in
+      __m256i prv0 = _mm256_alignr_epi8(curr, _mm256_permute2x128_si256(curr, curr, 0x08), 14);
+      __m256i nxt0 = _mm256_alignr_epi8(_mm256_permute2x128_si256(curr, curr, 0x81), curr, 2);
+      __m256i prev = _mm256_insert_epi16(prv0, t1, 0);
+      __m256i next = _mm256_insert_epi16(nxt0, 3*in_near[i+16] + in_far[i+16], 15);
+
+      // even pixels = 3*cur + prev, odd pixels = 3*cur + next
+      __m256i curb = _mm256_add_epi16(_mm256_slli_epi16(curr, 2), _mm256_set1_epi16(8));
+      __m256i even = _mm256_add_epi16(_mm256_sub_epi16(prev, curr), curb);
+      __m256i odd  = _mm256_add_epi16(_mm256_sub_epi16(next, curr), curb);
+
+      // interleave even and odd pixels within each lane, which is already the
+      // output order once packed, then undo scaling
+      __m256i de0  = _mm256_srli_epi16(_mm256_unpacklo_epi16(even, odd), 4);
+      __m256i de1  = _mm256_srli_epi16(_mm256_unpackhi_epi16(even, odd), 4);
+      _mm256_storeu_si256((__m256i *) (out + i*2), _mm256_packus_epi16(de0, de1));
+
+      // "previous" value for next iter
+      t1 = 3*in_near[i+15] + in_far[i+15];
+   }
+
+   t0 = t1;
+   t1 = 3*in_near[i] + in_far[i];
+   out[i*2] = stbi__div16(3*t1 + t0 + 8);
+
+   for (++i; i < w; ++i) {
+      t0 = t1;
+      t1 = 3*in_near[i]+in_far[i];
+      out[i*2-1] = stbi__div16(3*t0 + t1 + 8);
+      out[i*2  ] = stbi__div16(3*t1 + t0 + 8);
+   }
+   out[w*2-1] = stbi__div4(t1+2);
+
+   STBI_NOTUSED(hs);
+
+   return out;
+}
+
+// the sse2 color conversion sixteen pixels at a time; what is left over goes
+// through the sse2 version
+IMAGE_TARGET_AVX2
+static void stbi__YCbCr_to_RGB_avx2(stbi_uc *out, stbi_uc const *y, stbi_uc const *pcb, stbi_uc const *pcr, int count, int step)
+{
+   int i = 0;
+
+   if (step == 4) {
+      __m128i signflip  = _mm_set1_epi8(-0x80);
+      __m256i cr_const0 = _mm256_set1_epi16(   (short) ( 1.40200f*4096.0f+0.5f));
+      __m256i cr_const1 = _mm256_set1_epi16( - (short) ( 0.71414f*4096.0f+0.5f));
+      __m256i cb_const0 = _mm256_set1_epi16( - (short) ( 0.34414f*4096.0f+0.5f));
+      __m256i cb_const1 = _mm256_set1_epi16(   (short) ( 1.77200f*4096.0f+0.5f));
+      __m256i y_bias = _mm256_set1_epi16(128);
+      __m256i xw = _mm256_set1_epi16(255); // alpha channel
+
+      for (; i+15 < count; i += 16) {
+         // load and widen to short, the same values the sse2 unpacks make:
+         // y*256 + 128, and cr, cb biased by -128 then shifted left by 8
+         __m128i y_bytes = _mm_loadu_si128((__m128i *) (y+i));
+         __m128i cr_biased = _mm_xor_si128(_mm_loadu_si128((__m128i *) (pcr+i)), signflip);
+         __m128i cb_biased = _mm_xor_si128(_mm_loadu_si128((__m128i *) (pcb+i)), signflip);
+         __m256i yw  = _mm256_or_si256(_mm256_slli_epi16(_mm256_cvtepu8_epi16(y_bytes), 8), y_bias);
+         __m256i crw = _mm256_slli_epi16(_mm256_cvtepi8_epi16(cr_biased), 8);
+         __m256i cbw = _mm256_slli_epi16(_mm256_cvtepi8_epi16(cb_biased), 8);
+
+         // color transform
+         __m256i yws = _mm256_srli_epi16(yw, 4);
+         __m256i cr0 = _mm256_mulhi_epi16(cr_const0, crw);
+         __m256i cb0 = _mm256_mulhi_epi16(cb_const0, cbw);
+         __m256i cb1 = _mm256_mulhi_epi16(cbw, cb_const1);
+         __m256i cr1 = _mm256_mulhi_epi16(crw, cr_const1);
+         __m256i rws = _mm256_add_epi16(cr0, yws);
+         __m256i gwt = _mm256_add_epi16(cb0, yws);
+         __m256i bws = _mm256_add_epi16(yws, cb1);
+         __m256i gws = _mm256_add_epi16(gwt, cr1);
+
+         // descale
+         __m256i rw = _mm256_srai_epi16(rws, 4);
+         __m256i bw = _mm256_srai_epi16(bws, 4);
+         __m256i gw = _mm256_srai_epi16(gws, 4);
+
+         // back to byte and interleave channels; each 128-bit lane ends up
+         // with pixels 0-3 and 8-11 (o0) or 4-7 and 12-15 (o1)
+         __m256i brb = _mm256_packus_epi16(rw, bw);
+         __m256i gxb = _mm256_packus_epi16(gw, xw);
+         __m256i t0 = _mm256_unpacklo_epi8(brb, gxb);
+         __m256i t1 = _mm256_unpackhi_epi8(brb, gxb);
+         __m256i o0 = _mm256_unpacklo_epi16(t0, t1);
+         __m256i o1 = _mm256_unpackhi_epi16(t0, t1);
+
+         // store
+         _mm256_storeu_si256((__m256i *) (out + 0), _mm256_permute2x128_si256(o0, o1, 0x20));
+         _mm256_storeu_si256((__m256i *) (out + 32), _mm256_permute2x128_si256(o0, o1, 0x31));
+         out += 64;
+      }
+   }
+
+   stbi__YCbCr_to_RGB_simd(out, y+i, pcb+i, pcr+i, count-i, step);
+}
+#endif
+
 // set up the kernels
 static void stbi__setup_jpeg(stbi__jpeg *j)
 {
@@ -3523,6 +3973,14 @@ static void stbi__setup_jpeg(stbi__jpeg *j)
    }
 #endif
 
+#ifdef STBI_AVX2
+   if (image_cpu_features() & IMAGE_CPU_AVX2) {
+      j->idct_block_kernel = stbi__idct_avx2;
+      j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_avx2;
+      j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_avx2;
+   }
+#endif
+
 #ifdef STBI_NEON
    j->idct_block_kernel = stbi__idct_simd;
    j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_simd;
@@ -3553,6 +4011,159 @@ static stbi_uc stbi__blinn_8x8(stbi_uc x, stbi_uc y)
    return (stbi_uc) ((t + (t >>8)) >> 8);
 }
 
+// resample and color-convert rows [j0,j1) into output, which starts at row j0,
+// with the resamplers set up in res_init and a line buffer of img_x+3 bytes
+// per component in linebuf[]
+static void stbi__jpeg_output_rows(stbi__jpeg *z, stbi__resample const *res_init, stbi_uc **linebuf, stbi_uc *output, int n, int decode_n, int is_rgb, unsigned int j0, unsigned int j1)
+{
+   int k;
+   unsigned int i,j;
+   stbi_uc *coutput[4];
+   stbi__resample res_comp[4];
+
+   // put the resamplers where they would be after the first j0 rows
+   for (k=0; k < decode_n; ++k) {
+      stbi__resample *r = &res_comp[k];
+      int steps = (res_init[k].vs >> 1) + (int) j0;
+      int last = z->img_comp[k].y - 1;
+      *r = res_init[k];
+      r->ystep = steps % r->vs;
+      r->ypos  = steps / r->vs;
+      r->line1 = z->img_comp[k].data + z->img_comp[k].w2 * (r->ypos < last ? r->ypos : last);
+      r->line0 = z->img_comp[k].data + z->img_comp[k].w2 * (r->ypos <= last ? (r->ypos ? r->ypos-1 : 0) : last);
+   }
+
+   for (j=j0; j < j1; ++j) {
+      stbi_uc *out = output + n * z->s->img_x * (j - j0);
+      for (k=0; k < decode_n; ++k) {
+         stbi__resample *r = &res_comp[k];
+         int y_bot = r->ystep >= (r->vs >> 1);
+         coutput[k] = r->resample(linebuf[k],
+                                  y_bot ? r->line1 : r->line0,
+                                  y_bot ? r->line0 : r->line1,
+                                  r->w_lores, r->hs);
+         if (++r->ystep >= r->vs) {
+            r->ystep = 0;
+            r->line0 = r->line1;
+            if (++r->ypos < z->img_comp[k].y)
+               r->line1 += z->img_comp[k].w2;
+         }
+      }
+      if (n >= 3) {
+         stbi_uc *y = coutput[0];
+         if (z->s->img_n == 3) {
+            if (is_rgb) {
+               for (i=0; i < z->s->img_x; ++i) {
+                  out[0] = y[i];
+                  out[1] = coutput[1][i];
+                  out[2] = coutput[2][i];
+                  out[3] = 255;
+                  out += n;
+               }
+            } else {
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+            }
+         } else if (z->s->img_n == 4) {
+            if (z->app14_color_transform == 0) { // CMYK
+               for (i=0; i < z->s->img_x; ++i) {
+                  stbi_uc k = coutput[3][i];
+                  out[0] = stbi__blinn_8x8(coutput[0][i], k);
+                  out[1] = stbi__blinn_8x8(coutput[1][i], k);
+                  out[2] = stbi__blinn_8x8(coutput[2][i], k);
+                  out[3] = 255;
+                  out += n;
+               }
+            } else if (z->app14_color_transform == 2) { // YCCK
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+               for (i=0; i < z->s->img_x; ++i) {
+                  stbi_uc k = coutput[3][i];
+                  out[0] = stbi__blinn_8x8(255 - out[0], k);
+                  out[1] = stbi__blinn_8x8(255 - out[1], k);
+                  out[2] = stbi__blinn_8x8(255 - out[2], k);
+                  out += n;
+               }
+            } else { // YCbCr + alpha?  Ignore the fourth channel for now
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+            }
+         } else
+            for (i=0; i < z->s->img_x; ++i) {
+               out[0] = out[1] = out[2] = y[i];
+               out[3] = 255; // not used if n==3
+               out += n;
+            }
+      } else {
+         if (is_rgb) {
+            if (n == 1)
+               for (i=0; i < z->s->img_x; ++i)
+                  *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+            else {
+               for (i=0; i < z->s->img_x; ++i, out += 2) {
+                  out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+                  out[1] = 255;
+               }
+            }
+         } else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
+            for (i=0; i < z->s->img_x; ++i) {
+               stbi_uc k = coutput[3][i];
+               stbi_uc r = stbi__blinn_8x8(coutput[0][i], k);
+               stbi_uc g = stbi__blinn_8x8(coutput[1][i], k);
+               stbi_uc b = stbi__blinn_8x8(coutput[2][i], k);
+               out[0] = stbi__compute_y(r, g, b);
+               out[1] = 255;
+               out += n;
+            }
+         } else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
+            for (i=0; i < z->s->img_x; ++i) {
+               out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
+               out[1] = 255;
+               out += n;
+            }
+         } else {
+            stbi_uc *y = coutput[0];
+            if (n == 1)
+               for (i=0; i < z->s->img_x; ++i) out[i] = y[i];
+            else
+               for (i=0; i < z->s->img_x; ++i) *out++ = y[i], *out++ = 255;
+         }
+      }
+   }
+}
+
+typedef struct
+{
+   stbi__jpeg *z;
+   stbi__resample *res_comp;
+   stbi_uc *output, *scratch;
+   int n, decode_n, is_rgb;
+   unsigned int band_rows;
+   size_t scratch_size;
+} stbi__jpeg_output_job;
+
+static void stbi__jpeg_output_task(void *context, int index)
+{
+   stbi__jpeg_output_job *job = (stbi__jpeg_output_job *) context;
+   stbi__jpeg *z = job->z;
+   stbi_uc *scratch = job->scratch + job->scratch_size * index;
+   stbi_uc *linebuf[4];
+   unsigned int row_bytes = job->n * z->s->img_x;
+   unsigned int j0 = job->band_rows * index;
+   unsigned int j1 = j0 + job->band_rows;
+   stbi_uc *out = job->output + (size_t) row_bytes * j0;
+   int k;
+   for (k=0; k < job->decode_n; ++k)
+      linebuf[k] = scratch + row_bytes + 1 + k * (z->s->img_x + 3);
+   if (j1 < z->s->img_y) {
+      // the converters may write a byte past the end of a row, which is fine
+      // while the next row gets written after it; the next band's first row
+      // may be done already though, so the last row goes through scratch
+      stbi__jpeg_output_rows(z, job->res_comp, linebuf, out, job->n, job->decode_n, job->is_rgb, j0, j1-1);
+      stbi__jpeg_output_rows(z, job->res_comp, linebuf, scratch, job->n, job->decode_n, job->is_rgb, j1-1, j1);
+      memcpy(out + (size_t) row_bytes * (j1-1-j0), scratch, row_bytes);
+   } else {
+      stbi__jpeg_output_rows(z, job->res_comp, linebuf, out, job->n, job->decode_n, job->is_rgb, j0, z->s->img_y);
+   }
+}
+
 static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp, int req_comp)
 {
    int n, decode_n, is_rgb;
@@ -3576,10 +4187,10 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
 
    // resample and color-convert
    {
-      int k;
-      unsigned int i,j;
+      int k, threads, bands;
       stbi_uc *output;
-      stbi_uc *coutput[4];
+      stbi_uc *linebuf[4];
+      stbi__jpeg_output_job job;
 
       stbi__resample res_comp[4];
 
@@ -3609,100 +4220,30 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
       output = (stbi_uc *) stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
       if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
 
-      // now go ahead and resample
-      for (j=0; j < z->s->img_y; ++j) {
-         stbi_uc *out = output + n * z->s->img_x * j;
-         for (k=0; k < decode_n; ++k) {
-            stbi__resample *r = &res_comp[k];
-            int y_bot = r->ystep >= (r->vs >> 1);
-            coutput[k] = r->resample(z->img_comp[k].linebuf,
-                                     y_bot ? r->line1 : r->line0,
-                                     y_bot ? r->line0 : r->line1,
-                                     r->w_lores, r->hs);
-            if (++r->ystep >= r->vs) {
-               r->ystep = 0;
-               r->line0 = r->line1;
-               if (++r->ypos < z->img_comp[k].y)
-                  r->line1 += z->img_comp[k].w2;
-            }
-         }
-         if (n >= 3) {
-            stbi_uc *y = coutput[0];
-            if (z->s->img_n == 3) {
-               if (is_rgb) {
-                  for (i=0; i < z->s->img_x; ++i) {
-                     out[0] = y[i];
-                     out[1] = coutput[1][i];
-                     out[2] = coutput[2][i];
-                     out[3] = 255;
-                     out += n;
-                  }
-               } else {
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-               }
-            } else if (z->s->img_n == 4) {
-               if (z->app14_color_transform == 0) { // CMYK
-                  for (i=0; i < z->s->img_x; ++i) {
-                     stbi_uc k = coutput[3][i];
-                     out[0] = stbi__blinn_8x8(coutput[0][i], k);
-                     out[1] = stbi__blinn_8x8(coutput[1][i], k);
-                     out[2] = stbi__blinn_8x8(coutput[2][i], k);
-                     out[3] = 255;
-                     out += n;
-                  }
-               } else if (z->app14_color_transform == 2) { // YCCK
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-                  for (i=0; i < z->s->img_x; ++i) {
-                     stbi_uc k = coutput[3][i];
-                     out[0] = stbi__blinn_8x8(255 - out[0], k);
-                     out[1] = stbi__blinn_8x8(255 - out[1], k);
-                     out[2] = stbi__blinn_8x8(255 - out[2], k);
-                     out += n;
-                  }
-               } else { // YCbCr + alpha?  Ignore the fourth channel for now
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-               }
-            } else
-               for (i=0; i < z->s->img_x; ++i) {
-                  out[0] = out[1] = out[2] = y[i];
-                  out[3] = 255; // not used if n==3
-                  out += n;
-               }
-         } else {
-            if (is_rgb) {
-               if (n == 1)
-                  for (i=0; i < z->s->img_x; ++i)
-                     *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-               else {
-                  for (i=0; i < z->s->img_x; ++i, out += 2) {
-                     out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-                     out[1] = 255;
-                  }
-               }
-            } else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
-               for (i=0; i < z->s->img_x; ++i) {
-                  stbi_uc k = coutput[3][i];
-                  stbi_uc r = stbi__blinn_8x8(coutput[0][i], k);
-                  stbi_uc g = stbi__blinn_8x8(coutput[1][i], k);
-                  stbi_uc b = stbi__blinn_8x8(coutput[2][i], k);
-                  out[0] = stbi__compute_y(r, g, b);
-                  out[1] = 255;
-                  out += n;
-               }
-            } else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
-               for (i=0; i < z->s->img_x; ++i) {
-                  out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
-                  out[1] = 255;
-                  out += n;
-               }
-            } else {
-               stbi_uc *y = coutput[0];
-               if (n == 1)
-                  for (i=0; i < z->s->img_x; ++i) out[i] = y[i];
-               else
-                  for (i=0; i < z->s->img_x; ++i) *out++ = y[i], *out++ = 255;
-            }
-         }
+      // now go ahead and resample, in bands of rows if there are threads to
+      // spare; each band needs a scratch row and line buffers of its own
+      threads = stbi__decode_threads(z->s->img_x, z->s->img_y);
+      bands = threads > 1 ? threads * 2 : 1;
+      if (bands > (int) (z->s->img_y + 7) / 8) bands = (z->s->img_y + 7) / 8;
+      job.scratch = NULL;
+      job.scratch_size = (size_t) n * z->s->img_x + 1 + (size_t) decode_n * (z->s->img_x + 3);
+      if (bands > 1)
+         job.scratch = (stbi_uc *) stbi__malloc(job.scratch_size * bands);
+      if (job.scratch) {
+         job.z = z;
+         job.res_comp = res_comp;
+         job.output = output;
+         job.n = n;
+         job.decode_n = decode_n;
+         job.is_rgb = is_rgb;
+         job.band_rows = (z->s->img_y + bands - 1) / bands;
+         bands = (int) ((z->s->img_y + job.band_rows - 1) / job.band_rows);
+         stbi__parallel_for(bands, threads, stbi__jpeg_output_task, &job);
+         STBI_FREE(job.scratch);
+      } else {
+         for (k=0; k < decode_n; ++k)
+            linebuf[k] = z->img_comp[k].linebuf;
+         stbi__jpeg_output_rows(z, res_comp, linebuf, output, n, decode_n, is_rgb, 0, z->s->img_y);
       }
       stbi__cleanup_jpeg(z);
       *out_x = z->s->img_x;
@@ -3865,6 +4406,12 @@ typedef struct
    char *zout_end;
    int   z_expandable;
 
+   // if progress is set, zout_end only marks where to report how much output
+   // is done next, and the fixed output buffer really ends at zout_limit
+   void (*progress)(void *context, int zout_len);
+   void *progress_context;
+   char *zout_limit;
+
    stbi__zhuffman z_length, z_distance;
 } stbi__zbuf;
 
@@ -3925,11 +4472,21 @@ stbi_inline static int stbi__zhuffman_decode(stbi__zbuf *a, stbi__zhuffman *z)
    return stbi__zhuffman_decode_slowpath(a, z);
 }
 
+#define STBI__ZPROGRESS_STEP  (1 << 16)
+
 static int stbi__zexpand(stbi__zbuf *z, char *zout, int n)  // need to make room for n bytes
 {
    char *q;
    int cur, limit, old_limit;
    z->zout = zout;
+   if (z->progress && z->zout_end < z->zout_limit) {
+      // only hit a progress mark; report and move it on
+      z->progress(z->progress_context, (int) (zout - z->zout_start));
+      do
+         z->zout_end = z->zout_limit - z->zout_end > STBI__ZPROGRESS_STEP ? z->zout_end + STBI__ZPROGRESS_STEP : z->zout_limit;
+      while (zout + n > z->zout_end && z->zout_end < z->zout_limit);
+      if (zout + n <= z->zout_end) return 1;
+   }
    if (!z->z_expandable) return stbi__err("output buffer limit","Corrupt PNG");
    cur   = (int) (z->zout     - z->zout_start);
    limit = old_limit = (int) (z->zout_end - z->zout_start);
@@ -4154,6 +4711,7 @@ static int stbi__do_zlib(stbi__zbuf *a, char *obuf, int olen, int exp, int parse
    a->zout       = obuf;
    a->zout_end   = obuf + olen;
    a->z_expandable = exp;
+   a->progress   = NULL;
 
    return stbi__parse_zlib(a, parse_header);
 }
@@ -4273,6 +4831,7 @@ typedef struct
    stbi__context *s;
    stbi_uc *idata, *expanded, *out;
    int depth;
+   struct stbi__png_pipe *pipe;
 } stbi__png;
 
 
@@ -4309,6 +4868,71 @@ static int stbi__paeth(int a, int b, int c)
 
 static stbi_uc stbi__depth_scale_table[9] = { 0, 0xff, 0x55, 0, 0x11, 0,0,0, 0x01 };
 
+#ifndef STBI_NO_THREADS
+// a non-interlaced image can be defiltered a scanline at a time while the
+// rest of it is still being inflated on another thread
+typedef struct stbi__png_pipe
+{
+   stbi__png *png;
+   stbi__zbuf zbuf;
+   int parse_header;
+   int out_n, color;
+   stbi__uint32 raw_len;
+
+   image_monitor *monitor;
+   stbi__uint32 inflated; // bytes of png->expanded ready so far
+   int status;            // 1 while inflating, then 2 if done, 0 if failed
+   int ok;                // result of the defiltering
+
+   // the failure reasons are per thread, and either task may run on a
+   // worker; each one's is brought back to the caller here
+   const char *inflate_failure, *defilter_failure;
+} stbi__png_pipe;
+
+static void stbi__png_pipe_progress(void *context, int zout_len)
+{
+   stbi__png_pipe *pipe = (stbi__png_pipe *) context;
+   image_monitor_lock(pipe->monitor);
+   pipe->inflated = (stbi__uint32) zout_len;
+   image_monitor_broadcast(pipe->monitor);
+   image_monitor_unlock(pipe->monitor);
+}
+
+// wait for the first len bytes of png->expanded; returns how many are ready,
+// or 0 if the stream ended or failed before that
+static stbi__uint32 stbi__png_pipe_wait(stbi__png_pipe *pipe, stbi__uint32 len)
+{
+   stbi__uint32 ready;
+   int status;
+   image_monitor_lock(pipe->monitor);
+   while (pipe->inflated < len && pipe->status == 1)
+      image_monitor_wait(pipe->monitor);
+   ready = pipe->inflated;
+   status = pipe->status;
+   image_monitor_unlock(pipe->monitor);
+   if (ready >= len) return ready;
+   if (status == 2) stbi__err("not enough pixels","Corrupt PNG");
+   return 0;
+}
+
+// wait for the inflate thread to finish; returns 0 if it failed or came up
+// short. the defilter calls this before reporting an error of its own, so a
+// corrupt stream is reported as it would be without the pipe
+static int stbi__png_pipe_join(stbi__png_pipe *pipe)
+{
+   stbi__uint32 inflated;
+   int status;
+   image_monitor_lock(pipe->monitor);
+   while (pipe->status == 1)
+      image_monitor_wait(pipe->monitor);
+   status = pipe->status;
+   inflated = pipe->inflated;
+   image_monitor_unlock(pipe->monitor);
+   if (status == 2 && inflated != pipe->raw_len) return stbi__err("not enough pixels","Corrupt PNG");
+   return status != 0;
+}
+#endif
+
 // create the png data from post-deflated data
 static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 raw_len, int out_n, stbi__uint32 x, stbi__uint32 y, int depth, int color)
 {
@@ -4322,10 +4946,18 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
    int output_bytes = out_n*bytes;
    int filter_bytes = img_n*bytes;
    int width = x;
+   #ifndef STBI_NO_THREADS
+   stbi__uint32 ready = 0;
+   #endif
 
    STBI_ASSERT(out_n == s->img_n || out_n == s->img_n+1);
    a->out = (stbi_uc *) stbi__malloc_mad3(x, y, output_bytes, 0); // extra bytes to write off the end into
-   if (!a->out) return stbi__err("outofmem", "Out of memory");
+   if (!a->out) {
+      #ifndef STBI_NO_THREADS
+      if (a->pipe && !stbi__png_pipe_join(a->pipe)) return 0;
+      #endif
+      return stbi__err("outofmem", "Out of memory");
+   }
 
    img_width_bytes = (((img_n * x * depth) + 7) >> 3);
    img_len = (img_width_bytes + 1) * y;
@@ -4338,10 +4970,23 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
    for (j=0; j < y; ++j) {
       stbi_uc *cur = a->out + stride*j;
       stbi_uc *prior;
-      int filter = *raw++;
+      int filter;
+
+      #ifndef STBI_NO_THREADS
+      // wait for the inflate thread to get past this scanline
+      if (a->pipe && (stbi__uint32) (raw - a->expanded) + img_width_bytes + 1 > ready) {
+         ready = stbi__png_pipe_wait(a->pipe, (stbi__uint32) (raw - a->expanded) + img_width_bytes + 1);
+         if (!ready) return 0;
+      }
+      #endif
 
-      if (filter > 4)
+      filter = *raw++;
+      if (filter > 4) {
+         #ifndef STBI_NO_THREADS
+         if (a->pipe && !stbi__png_pipe_join(a->pipe)) return 0;
+         #endif
          return stbi__err("invalid filter","Corrupt PNG");
+      }
 
       if (depth < 8) {
          STBI_ASSERT(img_width_bytes <= x);
@@ -4565,6 +5210,75 @@ static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint3
    return 1;
 }
 
+#ifndef STBI_NO_THREADS
+static void stbi__png_pipe_task(void *context, int index)
+{
+   stbi__png_pipe *pipe = (stbi__png_pipe *) context;
+   stbi__png *z = pipe->png;
+   if (index == 0) {
+      int ok = stbi__parse_zlib(&pipe->zbuf, pipe->parse_header);
+      if (!ok) pipe->inflate_failure = stbi__g_failure_reason;
+      image_monitor_lock(pipe->monitor);
+      pipe->inflated = (stbi__uint32) (pipe->zbuf.zout - pipe->zbuf.zout_start);
+      pipe->status = ok ? 2 : 0;
+      image_monitor_broadcast(pipe->monitor);
+      image_monitor_unlock(pipe->monitor);
+   } else {
+      pipe->ok = stbi__create_png_image_raw(z, z->expanded, pipe->raw_len, pipe->out_n, z->s->img_x, z->s->img_y, z->depth, pipe->color);
+      if (!pipe->ok) pipe->defilter_failure = stbi__g_failure_reason;
+   }
+}
+
+// inflate z->idata and defilter it at the same time; returns -1 if the image
+// is interlaced or too small to bother, otherwise as stbi__create_png_image
+static int stbi__png_pipe_decode(stbi__png *z, stbi__uint32 idata_len, int parse_header, int out_n, int color, int interlaced)
+{
+   stbi__context *s = z->s;
+   stbi__png_pipe pipe;
+   int img_width_bytes = (((s->img_n * s->img_x * z->depth) + 7) >> 3);
+
+   if (interlaced || stbi__decode_threads(s->img_x, s->img_y) < 2) return -1;
+   if (!stbi__mad2sizes_valid(img_width_bytes + 1, s->img_y, 0)) return -1;
+   pipe.monitor = image_monitor_create();
+   if (!pipe.monitor) return -1;
+
+   // the output buffer holds exactly the image, so it never moves
+   pipe.raw_len = (img_width_bytes + 1) * s->img_y;
+   z->expanded = (stbi_uc *) stbi__malloc(pipe.raw_len);
+   if (!z->expanded) {
+      image_monitor_destroy(pipe.monitor);
+      return stbi__err("outofmem", "Out of memory");
+   }
+   pipe.zbuf.zbuffer = z->idata;
+   pipe.zbuf.zbuffer_end = z->idata + idata_len;
+   pipe.zbuf.zout_start = pipe.zbuf.zout = pipe.zbuf.zout_end = (char *) z->expanded;
+   pipe.zbuf.zout_limit = (char *) z->expanded + pipe.raw_len;
+   pipe.zbuf.z_expandable = 0;
+   pipe.zbuf.progress = stbi__png_pipe_progress;
+   pipe.zbuf.progress_context = &pipe;
+
+   pipe.png = z;
+   pipe.parse_header = parse_header;
+   pipe.out_n = out_n;
+   pipe.color = color;
+   pipe.inflated = 0;
+   pipe.status = 1;
+   pipe.ok = 0;
+   pipe.inflate_failure = pipe.defilter_failure = NULL;
+
+   // inflate is index 0, so it runs first if only one thread can be had
+   z->pipe = &pipe;
+   stbi__parallel_for(2, 2, stbi__png_pipe_task, &pipe);
+   z->pipe = NULL;
+   image_monitor_destroy(pipe.monitor);
+   if (pipe.status == 0)
+      stbi__g_failure_reason = pipe.inflate_failure;
+   else if (!pipe.ok)
+      stbi__g_failure_reason = pipe.defilter_failure;
+   return pipe.ok && pipe.status == 2;
+}
+#endif
+
 static int stbi__compute_transparency(stbi__png *z, stbi_uc tc[3], int out_n)
 {
    stbi__context *s = z->s;
@@ -4721,6 +5435,7 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
    z->expanded = NULL;
    z->idata = NULL;
    z->out = NULL;
+   z->pipe = NULL;
 
    if (!stbi__check_png_header(s)) return 0;
 
@@ -4824,17 +5539,26 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
             if (first) return stbi__err("first not IHDR", "Corrupt PNG");
             if (scan != STBI__SCAN_load) return 1;
             if (z->idata == NULL) return stbi__err("no IDAT","Corrupt PNG");
-            // initial guess for decoded data size to avoid unnecessary reallocs
-            bpl = (s->img_x * z->depth + 7) / 8; // bytes per line, per component
-            raw_len = bpl * s->img_y * s->img_n /* pixels */ + s->img_y /* filter mode per row */;
-            z->expanded = (stbi_uc *) stbi_zlib_decode_malloc_guesssize_headerflag((char *) z->idata, ioff, raw_len, (int *) &raw_len, !is_iphone);
-            if (z->expanded == NULL) return 0; // zlib should set error
-            STBI_FREE(z->idata); z->idata = NULL;
             if ((req_comp == s->img_n+1 && req_comp != 3 && !pal_img_n) || has_trans)
                s->img_out_n = s->img_n+1;
             else
                s->img_out_n = s->img_n;
-            if (!stbi__create_png_image(z, z->expanded, raw_len, s->img_out_n, z->depth, color, interlace)) return 0;
+            #ifndef STBI_NO_THREADS
+            k = stbi__png_pipe_decode(z, ioff, !is_iphone, s->img_out_n, color, interlace);
+            if (k == 0) return 0;
+            if (k > 0) {
+               STBI_FREE(z->idata); z->idata = NULL;
+            } else
+            #endif
+            {
+               // initial guess for decoded data size to avoid unnecessary reallocs
+               bpl = (s->img_x * z->depth + 7) / 8; // bytes per line, per component
+               raw_len = bpl * s->img_y * s->img_n /* pixels */ + s->img_y /* filter mode per row */;
+               z->expanded = (stbi_uc *) stbi_zlib_decode_malloc_guesssize_headerflag((char *) z->idata, ioff, raw_len, (int *) &raw_len, !is_iphone);
+               if (z->expanded == NULL) return 0; // zlib should set error
+               STBI_FREE(z->idata); z->idata = NULL;
+               if (!stbi__create_png_image(z, z->expanded, raw_len, s->img_out_n, z->depth, color, interlace)) return 0;
+            }
             if (has_trans) {
                if (z->depth == 16) {
                   if (!stbi__compute_transparency16(z, tc16, s->img_out_n)) return 0;
@@ -6502,19 +7226,27 @@ static void stbi__hdr_convert(float *output, stbi_uc *input, int req_comp)
    }
 }
 
-static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri)
+// stores one pixel, either converted to floats or as the raw RGBE bytes
+static void stbi__hdr_store(void *data, int index, stbi_uc *rgbe, int req_comp, int raw)
+{
+   if (raw)
+      memcpy((stbi_uc *) data + index * 4, rgbe, 4);
+   else
+      stbi__hdr_convert((float *) data + index * req_comp, rgbe, req_comp);
+}
+
+static void *stbi__hdr_load_data(stbi__context *s, int *x, int *y, int *comp, int req_comp, int raw)
 {
    char buffer[STBI__HDR_BUFLEN];
    char *token;
    int valid = 0;
    int width, height;
    stbi_uc *scanline;
-   float *hdr_data;
+   void *hdr_data;
    int len;
    unsigned char count, value;
    int i, j, k, c1,c2, z;
    const char *headerToken;
-   STBI_NOTUSED(ri);
 
    // Check identifier
    headerToken = stbi__hdr_gettoken(s,buffer);
@@ -6546,12 +7278,13 @@ static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int re
 
    if (comp) *comp = 3;
    if (req_comp == 0) req_comp = 3;
+   if (raw) req_comp = 4;
 
-   if (!stbi__mad4sizes_valid(width, height, req_comp, sizeof(float), 0))
+   if (!stbi__mad4sizes_valid(width, height, req_comp, raw ? 1 : sizeof(float), 0))
       return stbi__errpf("too large", "HDR image is too large");
 
    // Read data
-   hdr_data = (float *) stbi__malloc_mad4(width, height, req_comp, sizeof(float), 0);
+   hdr_data = stbi__malloc_mad4(width, height, req_comp, raw ? 1 : sizeof(float), 0);
    if (!hdr_data)
       return stbi__errpf("outofmem", "Out of memory");
 
@@ -6564,7 +7297,7 @@ static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int re
             stbi_uc rgbe[4];
            main_decode_loop:
             stbi__getn(s, rgbe, 4);
-            stbi__hdr_convert(hdr_data + j * width * req_comp + i * req_comp, rgbe, req_comp);
+            stbi__hdr_store(hdr_data, j * width + i, rgbe, req_comp, raw);
          }
       }
    } else {
@@ -6583,7 +7316,7 @@ static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int re
             rgbe[1] = (stbi_uc) c2;
             rgbe[2] = (stbi_uc) len;
             rgbe[3] = (stbi_uc) stbi__get8(s);
-            stbi__hdr_convert(hdr_data, rgbe, req_comp);
+            stbi__hdr_store(hdr_data, 0, rgbe, req_comp, raw);
             i = 1;
             j = 0;
             STBI_FREE(scanline);
@@ -6620,8 +7353,11 @@ static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int re
                }
             }
          }
-         for (i=0; i < width; ++i)
-            stbi__hdr_convert(hdr_data+(j*width + i)*req_comp, scanline + i*4, req_comp);
+         if (raw)
+            memcpy((stbi_uc *) hdr_data + j*width*4, scanline, width*4);
+         else
+            for (i=0; i < width; ++i)
+               stbi__hdr_convert((float *) hdr_data+(j*width + i)*req_comp, scanline + i*4, req_comp);
       }
       if (scanline)
          STBI_FREE(scanline);
@@ -6630,6 +7366,62 @@ static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int re
    return hdr_data;
 }
 
+static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri)
+{
+   STBI_NOTUSED(ri);
+   return (float *) stbi__hdr_load_data(s, x, y, comp, req_comp, 0);
+}
+
+static stbi_uc *stbi__hdr_load_rgbe(stbi__context *s, int *x, int *y)
+{
+   stbi_uc *result;
+   if (!stbi__hdr_test(s))
+      return stbi__errpuc("not HDR", "Image is not a Radiance HDR file");
+   result = (stbi_uc *) stbi__hdr_load_data(s, x, y, NULL, 4, 1);
+   if (result && stbi__vertically_flip_on_load) {
+      int w = *x, h = *y;
+      int row,col;
+      for (row = 0; row < (h>>1); row++) {
+         for (col = 0; col < w*4; col++) {
+            stbi_uc temp = result[(row * w * 4) + col];
+            result[(row * w * 4) + col] = result[((h - row - 1) * w * 4) + col];
+            result[((h - row - 1) * w * 4) + col] = temp;
+         }
+      }
+   }
+   return result;
+}
+
+STBIDEF stbi_uc *stbi_load_rgbe_from_memory(stbi_uc const *buffer, int len, int *x, int *y)
+{
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   return stbi__hdr_load_rgbe(&s,x,y);
+}
+
+#ifndef STBI_NO_STDIO
+STBIDEF stbi_uc *stbi_load_rgbe(char const *filename, int *x, int *y)
+{
+   stbi_uc *result;
+   stbi__context s;
+   FILE *f;
+#ifndef STBI_NO_MMAP
+   image_file_view view;
+   if (stbi__map_file(filename, &view)) {
+      result = stbi_load_rgbe_from_memory(view.data, (int) view.size, x, y);
+      image_file_unmap(&view);
+      return result;
+   }
+#endif
+   f = stbi__fopen(filename, "rb");
+   if (!f) return stbi__errpuc("can't fopen", "Unable to open file");
+   stbi__start_file(&s,f);
+   result = stbi__hdr_load_rgbe(&s,x,y);
+   fclose(f);
+   return result;
+}
+#endif
+
 static int stbi__hdr_info(stbi__context *s, int *x, int *y, int *comp)
 {
    char buffer[STBI__HDR_BUFLEN];
@@ -15,17 +15,28 @@ ABOUT:
    This header file is a library for writing images to C stdio. It could be
    adapted to write to memory or a general streaming interface; let me know.
 
-   The PNG output is not optimal; it is 20-50% larger than the file
-   written by a decent optimizing implementation. This library is designed
-   for source code compactness and simplicity, not optimal image file size
-   or run-time performance.
+   PNG output is compressed with a built-in zlib-compatible deflate encoder
+   offering the usual compression levels 0 (store) to 9 (smallest).
 
 BUILDING:
 
    You can #define STBIW_ASSERT(x) before the #include to avoid using assert.h.
    You can #define STBIW_MALLOC(), STBIW_REALLOC(), and STBIW_FREE() to replace
-   malloc,realloc,free.
+   malloc,realloc,free. By default they are image_malloc, image_realloc and
+   image_free from image_alloc.h, which use the calling thread's allocator.
    You can define STBIW_MEMMOVE() to replace memmove()
+   You can #define STBIW_ZLIB_COMPRESS to use a custom zlib-style compress
+   function for PNG compression (instead of the built-in one; the row-streaming
+   PNG writer always uses the built-in one); it must have the following
+   signature:
+   unsigned char * my_compress(unsigned char *data, int data_len, int *out_len,
+                               int quality);
+   The returned data will be freed with STBIW_FREE() (image_free() by
+   default), so it must be heap allocated with STBIW_MALLOC().
+   You can #define STBIW_NO_THREADS to keep PNG encoding on the calling
+   thread; otherwise it uses image_parallel_for() from image_thread.h.
+   You can #define STBIW_NO_SIMD to drop the PCLMULQDQ CRC-32 path and the
+   image_simd.h dependency.
 
 USAGE:
 
@@ -85,6 +96,35 @@ comp, const float *data);
    TGA supports RLE or non-RLE compressed data. To use non-RLE-compressed
    data, set the global variable 'stbi_write_tga_with_rle' to 0.
 
+   PNG compression level can be set with the global variable
+   'stbi_write_png_compression_level' (0 to 9, default 6). Levels 1-3 favour
+   speed, higher levels search harder for a smaller file.
+
+   PNG encoding can pick row filters and deflate in parallel: set the
+   global variable 'stbi_write_png_thread_count' to the number of threads
+   (0 for one per hardware thread; the default, 1, keeps all work on the
+   calling thread). Images under a quarter megapixel are always encoded
+   on the calling thread. The file written does not depend on the thread
+   count.
+
+   Images too large to hold in memory can be written a band of rows at a
+   time with the row-streaming writers:
+
+     stbi_write_stream *stbi_write_png_begin(stbi_write_func *func,
+                              void *context, int w, int h, int comp);
+     (likewise stbi_write_bmp_begin, stbi_write_tga_begin and
+      stbi_write_hdr_begin)
+     int stbi_write_push_rows(stbi_write_stream *stream, const void *rows,
+                              int row_count, int stride_in_bytes);
+     int stbi_write_end(stbi_write_stream *stream);
+
+   Rows are pushed top to bottom, in any number of calls, in the same
+   layout as the full-image writers take them (float for HDR);
+   stride_in_bytes 0 means the rows are packed. Output reaches 'func' as
+   soon as it is encoded. begin returns NULL on failure; stbi_write_end
+   frees the stream and returns 0 if anything failed or fewer than 'h'
+   rows were pushed. Streamed BMP and TGA files are stored top-down.
+
 CREDITS:
 
    PNG/BMP/TGA
@@ -129,6 +169,8 @@ extern "C" {
 #else
 #define STBIWDEF extern
 extern int stbi_write_tga_with_rle;
+extern int stbi_write_png_compression_level;
+extern int stbi_write_png_thread_count;
 #endif
 
 #ifndef STBI_WRITE_NO_STDIO
@@ -154,6 +196,34 @@ STBIWDEF int stbi_write_tga_to_func(stbi_write_func *func, void *context, int w,
 STBIWDEF int stbi_write_hdr_to_func(stbi_write_func *func, void *context, int w,
                                     int h, int comp, const float *data);
 
+typedef struct stbi_write_stream stbi_write_stream;
+
+STBIWDEF stbi_write_stream *stbi_write_png_begin(stbi_write_func *func,
+                                                 void *context, int w, int h,
+                                                 int comp);
+STBIWDEF stbi_write_stream *stbi_write_bmp_begin(stbi_write_func *func,
+                                                 void *context, int w, int h,
+                                                 int comp);
+STBIWDEF stbi_write_stream *stbi_write_tga_begin(stbi_write_func *func,
+                                                 void *context, int w, int h,
+                                                 int comp);
+STBIWDEF stbi_write_stream *stbi_write_hdr_begin(stbi_write_func *func,
+                                                 void *context, int w, int h,
+                                                 int comp);
+STBIWDEF int stbi_write_push_rows(stbi_write_stream *stream, const void *rows,
+                                  int row_count, int stride_in_bytes);
+STBIWDEF int stbi_write_end(stbi_write_stream *stream);
+
+// zlib-compatible CRC-32: start from 0 and feed the data in any number of
+// pieces; stbi_crc32_combine() joins the CRCs of two adjacent pieces
+STBIWDEF unsigned int stbi_crc32(unsigned int crc, const unsigned char *buffer,
+                                 int len);
+STBIWDEF unsigned int stbi_crc32_combine(unsigned int crc1, unsigned int crc2,
+                                         int len2);
+
+STBIWDEF unsigned char *stbi_zlib_compress(unsigned char *data, int data_len,
+                                           int *out_len, int quality);
+
 #ifdef __cplusplus
 }
 #endif
@@ -191,10 +261,12 @@ STBIWDEF int stbi_write_hdr_to_func(stbi_write_func *func, void *context, int w,
     "Must define all or none of STBIW_MALLOC, STBIW_FREE, and STBIW_REALLOC (or STBIW_REALLOC_SIZED)."
 #endif
 
+// by default, the calling thread's image_allocator (see image_alloc.h)
 #ifndef STBIW_MALLOC
-#define STBIW_MALLOC(sz) malloc(sz)
-#define STBIW_REALLOC(p, newsz) realloc(p, newsz)
-#define STBIW_FREE(p) free(p)
+#include "image_alloc.h"
+#define STBIW_MALLOC(sz) image_malloc(sz)
+#define STBIW_REALLOC(p, newsz) image_realloc(p, newsz)
+#define STBIW_FREE(p) image_free(p)
 #endif
 
 #ifndef STBIW_REALLOC_SIZED
@@ -210,6 +282,23 @@ STBIWDEF int stbi_write_hdr_to_func(stbi_write_func *func, void *context, int w,
 #define STBIW_ASSERT(x) assert(x)
 #endif
 
+#ifndef STBIW_NO_SIMD
+#include "image_simd.h"
+#endif
+
+#ifndef STBIW_NO_THREADS
+#include "image_thread.h"
+#define stbiw__parallel_for image_parallel_for
+#else
+static int stbiw__parallel_for(int count, int thread_count,
+                               void (*task)(void *, int), void *context) {
+  int i;
+  (void)thread_count;
+  for (i = 0; i < count; ++i) task(context, i);
+  return 1;
+}
+#endif
+
 #define STBIW_UCHAR(x) (unsigned char)((x)&0xff)
 
 typedef struct {
@@ -234,7 +323,7 @@ static int stbi__start_write_file(stbi__write_context *s,
                                   const char *filename) {
   FILE *f;
   errno_t err = fopen_s(&f, filename, "wb");
-  if (!err) return 0;
+  if (err) return 0;
   stbi__start_write_callbacks(s, stbi__stdio_write, (void *)f);
   return f != NULL;
 }
@@ -250,10 +339,23 @@ typedef int stb_image_write_test[sizeof(stbiw_uint32) == 4 ? 1 : -1];
 
 #ifdef STB_IMAGE_WRITE_STATIC
 static int stbi_write_tga_with_rle = 1;
+static int stbi_write_png_compression_level = 6;
+static int stbi_write_png_thread_count = 1;
 #else
 int stbi_write_tga_with_rle = 1;
+int stbi_write_png_compression_level = 6;
+int stbi_write_png_thread_count = 1;
 #endif
 
+// images smaller than this are encoded on the calling thread
+#define stbiw__PARALLEL_MIN_PIXELS (1 << 18)
+
+// the number of threads to encode an x*y PNG with
+static int stbiw__png_threads(int x, int y) {
+  if ((double)x * y < stbiw__PARALLEL_MIN_PIXELS) return 1;
+  return stbi_write_png_thread_count;
+}
+
 static void stbiw__writefv(stbi__write_context *s, const char *fmt, va_list v) {
   while (*fmt) {
     switch (*fmt++) {
@@ -405,6 +507,54 @@ STBIWDEF int stbi_write_bmp(char const *filename, int x, int y, int comp,
 }
 #endif  //! STBI_WRITE_NO_STDIO
 
+static void stbiw__write_tga_rle_row(stbi__write_context *s, unsigned char *row,
+                                     int x, int comp, int has_alpha) {
+  int i, k, len;
+
+  for (i = 0; i < x; i += len) {
+    unsigned char *begin = row + i * comp;
+    int diff = 1;
+    len = 1;
+
+    if (i < x - 1) {
+      ++len;
+      diff = memcmp(begin, row + (i + 1) * comp, comp);
+      if (diff) {
+        const unsigned char *prev = begin;
+        for (k = i + 2; k < x && len < 128; ++k) {
+          if (memcmp(prev, row + k * comp, comp)) {
+            prev += comp;
+            ++len;
+          } else {
+            --len;
+            break;
+          }
+        }
+      } else {
+        for (k = i + 2; k < x && len < 128; ++k) {
+          if (!memcmp(begin, row + k * comp, comp)) {
+            ++len;
+          } else {
+            break;
+          }
+        }
+      }
+    }
+
+    if (diff) {
+      unsigned char header = STBIW_UCHAR(len - 1);
+      s->func(s->context, &header, 1);
+      for (k = 0; k < len; ++k) {
+        stbiw__write_pixel(s, -1, comp, has_alpha, 0, begin + k * comp);
+      }
+    } else {
+      unsigned char header = STBIW_UCHAR(len - 129);
+      s->func(s->context, &header, 1);
+      stbiw__write_pixel(s, -1, comp, has_alpha, 0, begin);
+    }
+  }
+}
+
 static int stbi_write_tga_core(stbi__write_context *s, int x, int y, int comp,
                                void *data) {
   int has_alpha = (comp == 2 || comp == 4);
@@ -421,58 +571,14 @@ static int stbi_write_tga_core(stbi__write_context *s, int x, int y, int comp,
                           "111 221 2222 11", 0, 0, format, 0, 0, 0, 0, 0, x, y,
                           (colorbytes + has_alpha) * 8, has_alpha * 8);
   } else {
-    int i, j, k;
+    int j;
 
     stbiw__writef(s, "111 221 2222 11", 0, 0, format + 8, 0, 0, 0, 0, 0, x, y,
                   (colorbytes + has_alpha) * 8, has_alpha * 8);
 
-    for (j = y - 1; j >= 0; --j) {
-      unsigned char *row = (unsigned char *)data + j * x * comp;
-      int len;
-
-      for (i = 0; i < x; i += len) {
-        unsigned char *begin = row + i * comp;
-        int diff = 1;
-        len = 1;
-
-        if (i < x - 1) {
-          ++len;
-          diff = memcmp(begin, row + (i + 1) * comp, comp);
-          if (diff) {
-            const unsigned char *prev = begin;
-            for (k = i + 2; k < x && len < 128; ++k) {
-              if (memcmp(prev, row + k * comp, comp)) {
-                prev += comp;
-                ++len;
-              } else {
-                --len;
-                break;
-              }
-            }
-          } else {
-            for (k = i + 2; k < x && len < 128; ++k) {
-              if (!memcmp(begin, row + k * comp, comp)) {
-                ++len;
-              } else {
-                break;
-              }
-            }
-          }
-        }
-
-        if (diff) {
-          unsigned char header = STBIW_UCHAR(len - 1);
-          s->func(s->context, &header, 1);
-          for (k = 0; k < len; ++k) {
-            stbiw__write_pixel(s, -1, comp, has_alpha, 0, begin + k * comp);
-          }
-        } else {
-          unsigned char header = STBIW_UCHAR(len - 129);
-          s->func(s->context, &header, 1);
-          stbiw__write_pixel(s, -1, comp, has_alpha, 0, begin);
-        }
-      }
-    }
+    for (j = y - 1; j >= 0; --j)
+      stbiw__write_tga_rle_row(s, (unsigned char *)data + j * x * comp, x, comp,
+                               has_alpha);
   }
   return 1;
 }
@@ -626,6 +732,19 @@ void stbiw__write_hdr_scanline(stbi__write_context *s, int width, int ncomp,
   }
 }
 
+static void stbiw__write_hdr_header(stbi__write_context *s, int x, int y) {
+  int len;
+  enum { cBufferSize = 128 };
+  char buffer[cBufferSize];
+  char header[] =
+      "#?RADIANCE\n# Written by stb_image_write.h\nFORMAT=32-bit_rle_rgbe\n";
+  s->func(s->context, header, sizeof(header) - 1);
+
+  len = sprintf_s(buffer, cBufferSize,
+                  "EXPOSURE=          1.0000000000000\n\n-Y %d +X %d\n", y, x);
+  s->func(s->context, buffer, len);
+}
+
 static int stbi_write_hdr_core(stbi__write_context *s, int x, int y, int comp,
                                float *data) {
   if (y <= 0 || x <= 0 || data == NULL)
@@ -634,18 +753,8 @@ static int stbi_write_hdr_core(stbi__write_context *s, int x, int y, int comp,
     // Each component is stored separately. Allocate scratch space for full
     // output scanline.
     unsigned char *scratch = (unsigned char *)STBIW_MALLOC(x * 4);
-    int i, len;
-    enum { cBufferSize = 128 };
-    char buffer[cBufferSize];
-    char header[] =
-        "#?RADIANCE\n# Written by stb_image_write.h\nFORMAT=32-bit_rle_rgbe\n";
-    s->func(s->context, header, sizeof(header) - 1);
-
-    len =
-        sprintf_s(buffer, cBufferSize,
-                  "EXPOSURE=          1.0000000000000\n\n-Y %d +X %d\n", y, x);
-    s->func(s->context, buffer, len);
-
+    int i;
+    stbiw__write_hdr_header(s, x, y);
     for (i = 0; i < y; i++)
       stbiw__write_hdr_scanline(s, x, comp, scratch, data + comp * i * x);
     STBIW_FREE(scratch);
@@ -675,51 +784,613 @@ int stbi_write_hdr(char const *filename, int x, int y, int comp,
 
 //////////////////////////////////////////////////////////////////////////////
 //
-// PNG writer
+// CRC-32
 //
+// Slice-by-8 table lookup, or PCLMULQDQ folding (Intel, "Fast CRC Computation
+// for Generic Polynomials Using PCLMULQDQ Instruction") on CPUs that have it.
+
+// stbiw__crc_table[0] is the usual byte table; table k advances a byte
+// through k further zero bytes
+static const unsigned int stbiw__crc_table[8][256] = {
+    {
+        0x00000000, 0x77073096, 0xEE0E612C, 0x990951BA, 0x076DC419, 0x706AF48F,
+        0xE963A535, 0x9E6495A3, 0x0EDB8832, 0x79DCB8A4, 0xE0D5E91E, 0x97D2D988,
+        0x09B64C2B, 0x7EB17CBD, 0xE7B82D07, 0x90BF1D91, 0x1DB71064, 0x6AB020F2,
+        0xF3B97148, 0x84BE41DE, 0x1ADAD47D, 0x6DDDE4EB, 0xF4D4B551, 0x83D385C7,
+        0x136C9856, 0x646BA8C0, 0xFD62F97A, 0x8A65C9EC, 0x14015C4F, 0x63066CD9,
+        0xFA0F3D63, 0x8D080DF5, 0x3B6E20C8, 0x4C69105E, 0xD56041E4, 0xA2677172,
+        0x3C03E4D1, 0x4B04D447, 0xD20D85FD, 0xA50AB56B, 0x35B5A8FA, 0x42B2986C,
+        0xDBBBC9D6, 0xACBCF940, 0x32D86CE3, 0x45DF5C75, 0xDCD60DCF, 0xABD13D59,
+        0x26D930AC, 0x51DE003A, 0xC8D75180, 0xBFD06116, 0x21B4F4B5, 0x56B3C423,
+        0xCFBA9599, 0xB8BDA50F, 0x2802B89E, 0x5F058808, 0xC60CD9B2, 0xB10BE924,
+        0x2F6F7C87, 0x58684C11, 0xC1611DAB, 0xB6662D3D, 0x76DC4190, 0x01DB7106,
+        0x98D220BC, 0xEFD5102A, 0x71B18589, 0x06B6B51F, 0x9FBFE4A5, 0xE8B8D433,
+        0x7807C9A2, 0x0F00F934, 0x9609A88E, 0xE10E9818, 0x7F6A0DBB, 0x086D3D2D,
+        0x91646C97, 0xE6635C01, 0x6B6B51F4, 0x1C6C6162, 0x856530D8, 0xF262004E,
+        0x6C0695ED, 0x1B01A57B, 0x8208F4C1, 0xF50FC457, 0x65B0D9C6, 0x12B7E950,
+        0x8BBEB8EA, 0xFCB9887C, 0x62DD1DDF, 0x15DA2D49, 0x8CD37CF3, 0xFBD44C65,
+        0x4DB26158, 0x3AB551CE, 0xA3BC0074, 0xD4BB30E2, 0x4ADFA541, 0x3DD895D7,
+        0xA4D1C46D, 0xD3D6F4FB, 0x4369E96A, 0x346ED9FC, 0xAD678846, 0xDA60B8D0,
+        0x44042D73, 0x33031DE5, 0xAA0A4C5F, 0xDD0D7CC9, 0x5005713C, 0x270241AA,
+        0xBE0B1010, 0xC90C2086, 0x5768B525, 0x206F85B3, 0xB966D409, 0xCE61E49F,
+        0x5EDEF90E, 0x29D9C998, 0xB0D09822, 0xC7D7A8B4, 0x59B33D17, 0x2EB40D81,
+        0xB7BD5C3B, 0xC0BA6CAD, 0xEDB88320, 0x9ABFB3B6, 0x03B6E20C, 0x74B1D29A,
+        0xEAD54739, 0x9DD277AF, 0x04DB2615, 0x73DC1683, 0xE3630B12, 0x94643B84,
+        0x0D6D6A3E, 0x7A6A5AA8, 0xE40ECF0B, 0x9309FF9D, 0x0A00AE27, 0x7D079EB1,
+        0xF00F9344, 0x8708A3D2, 0x1E01F268, 0x6906C2FE, 0xF762575D, 0x806567CB,
+        0x196C3671, 0x6E6B06E7, 0xFED41B76, 0x89D32BE0, 0x10DA7A5A, 0x67DD4ACC,
+        0xF9B9DF6F, 0x8EBEEFF9, 0x17B7BE43, 0x60B08ED5, 0xD6D6A3E8, 0xA1D1937E,
+        0x38D8C2C4, 0x4FDFF252, 0xD1BB67F1, 0xA6BC5767, 0x3FB506DD, 0x48B2364B,
+        0xD80D2BDA, 0xAF0A1B4C, 0x36034AF6, 0x41047A60, 0xDF60EFC3, 0xA867DF55,
+        0x316E8EEF, 0x4669BE79, 0xCB61B38C, 0xBC66831A, 0x256FD2A0, 0x5268E236,
+        0xCC0C7795, 0xBB0B4703, 0x220216B9, 0x5505262F, 0xC5BA3BBE, 0xB2BD0B28,
+        0x2BB45A92, 0x5CB36A04, 0xC2D7FFA7, 0xB5D0CF31, 0x2CD99E8B, 0x5BDEAE1D,
+        0x9B64C2B0, 0xEC63F226, 0x756AA39C, 0x026D930A, 0x9C0906A9, 0xEB0E363F,
+        0x72076785, 0x05005713, 0x95BF4A82, 0xE2B87A14, 0x7BB12BAE, 0x0CB61B38,
+        0x92D28E9B, 0xE5D5BE0D, 0x7CDCEFB7, 0x0BDBDF21, 0x86D3D2D4, 0xF1D4E242,
+        0x68DDB3F8, 0x1FDA836E, 0x81BE16CD, 0xF6B9265B, 0x6FB077E1, 0x18B74777,
+        0x88085AE6, 0xFF0F6A70, 0x66063BCA, 0x11010B5C, 0x8F659EFF, 0xF862AE69,
+        0x616BFFD3, 0x166CCF45, 0xA00AE278, 0xD70DD2EE, 0x4E048354, 0x3903B3C2,
+        0xA7672661, 0xD06016F7, 0x4969474D, 0x3E6E77DB, 0xAED16A4A, 0xD9D65ADC,
+        0x40DF0B66, 0x37D83BF0, 0xA9BCAE53, 0xDEBB9EC5, 0x47B2CF7F, 0x30B5FFE9,
+        0xBDBDF21C, 0xCABAC28A, 0x53B39330, 0x24B4A3A6, 0xBAD03605, 0xCDD70693,
+        0x54DE5729, 0x23D967BF, 0xB3667A2E, 0xC4614AB8, 0x5D681B02, 0x2A6F2B94,
+        0xB40BBE37, 0xC30C8EA1, 0x5A05DF1B, 0x2D02EF8D
+    },
+    {
+        0x00000000, 0x191B3141, 0x32366282, 0x2B2D53C3, 0x646CC504, 0x7D77F445,
+        0x565AA786, 0x4F4196C7, 0xC8D98A08, 0xD1C2BB49, 0xFAEFE88A, 0xE3F4D9CB,
+        0xACB54F0C, 0xB5AE7E4D, 0x9E832D8E, 0x87981CCF, 0x4AC21251, 0x53D92310,
+        0x78F470D3, 0x61EF4192, 0x2EAED755, 0x37B5E614, 0x1C98B5D7, 0x05838496,
+        0x821B9859, 0x9B00A918, 0xB02DFADB, 0xA936CB9A, 0xE6775D5D, 0xFF6C6C1C,
+        0xD4413FDF, 0xCD5A0E9E, 0x958424A2, 0x8C9F15E3, 0xA7B24620, 0xBEA97761,
+        0xF1E8E1A6, 0xE8F3D0E7, 0xC3DE8324, 0xDAC5B265, 0x5D5DAEAA, 0x44469FEB,
+        0x6F6BCC28, 0x7670FD69, 0x39316BAE, 0x202A5AEF, 0x0B07092C, 0x121C386D,
+        0xDF4636F3, 0xC65D07B2, 0xED705471, 0xF46B6530, 0xBB2AF3F7, 0xA231C2B6,
+        0x891C9175, 0x9007A034, 0x179FBCFB, 0x0E848DBA, 0x25A9DE79, 0x3CB2EF38,
+        0x73F379FF, 0x6AE848BE, 0x41C51B7D, 0x58DE2A3C, 0xF0794F05, 0xE9627E44,
+        0xC24F2D87, 0xDB541CC6, 0x94158A01, 0x8D0EBB40, 0xA623E883, 0xBF38D9C2,
+        0x38A0C50D, 0x21BBF44C, 0x0A96A78F, 0x138D96CE, 0x5CCC0009, 0x45D73148,
+        0x6EFA628B, 0x77E153CA, 0xBABB5D54, 0xA3A06C15, 0x888D3FD6, 0x91960E97,
+        0xDED79850, 0xC7CCA911, 0xECE1FAD2, 0xF5FACB93, 0x7262D75C, 0x6B79E61D,
+        0x4054B5DE, 0x594F849F, 0x160E1258, 0x0F152319, 0x243870DA, 0x3D23419B,
+        0x65FD6BA7, 0x7CE65AE6, 0x57CB0925, 0x4ED03864, 0x0191AEA3, 0x188A9FE2,
+        0x33A7CC21, 0x2ABCFD60, 0xAD24E1AF, 0xB43FD0EE, 0x9F12832D, 0x8609B26C,
+        0xC94824AB, 0xD05315EA, 0xFB7E4629, 0xE2657768, 0x2F3F79F6, 0x362448B7,
+        0x1D091B74, 0x04122A35, 0x4B53BCF2, 0x52488DB3, 0x7965DE70, 0x607EEF31,
+        0xE7E6F3FE, 0xFEFDC2BF, 0xD5D0917C, 0xCCCBA03D, 0x838A36FA, 0x9A9107BB,
+        0xB1BC5478, 0xA8A76539, 0x3B83984B, 0x2298A90A, 0x09B5FAC9, 0x10AECB88,
+        0x5FEF5D4F, 0x46F46C0E, 0x6DD93FCD, 0x74C20E8C, 0xF35A1243, 0xEA412302,
+        0xC16C70C1, 0xD8774180, 0x9736D747, 0x8E2DE606, 0xA500B5C5, 0xBC1B8484,
+        0x71418A1A, 0x685ABB5B, 0x4377E898, 0x5A6CD9D9, 0x152D4F1E, 0x0C367E5F,
+        0x271B2D9C, 0x3E001CDD, 0xB9980012, 0xA0833153, 0x8BAE6290, 0x92B553D1,
+        0xDDF4C516, 0xC4EFF457, 0xEFC2A794, 0xF6D996D5, 0xAE07BCE9, 0xB71C8DA8,
+        0x9C31DE6B, 0x852AEF2A, 0xCA6B79ED, 0xD37048AC, 0xF85D1B6F, 0xE1462A2E,
+        0x66DE36E1, 0x7FC507A0, 0x54E85463, 0x4DF36522, 0x02B2F3E5, 0x1BA9C2A4,
+        0x30849167, 0x299FA026, 0xE4C5AEB8, 0xFDDE9FF9, 0xD6F3CC3A, 0xCFE8FD7B,
+        0x80A96BBC, 0x99B25AFD, 0xB29F093E, 0xAB84387F, 0x2C1C24B0, 0x350715F1,
+        0x1E2A4632, 0x07317773, 0x4870E1B4, 0x516BD0F5, 0x7A468336, 0x635DB277,
+        0xCBFAD74E, 0xD2E1E60F, 0xF9CCB5CC, 0xE0D7848D, 0xAF96124A, 0xB68D230B,
+        0x9DA070C8, 0x84BB4189, 0x03235D46, 0x1A386C07, 0x31153FC4, 0x280E0E85,
+        0x674F9842, 0x7E54A903, 0x5579FAC0, 0x4C62CB81, 0x8138C51F, 0x9823F45E,
+        0xB30EA79D, 0xAA1596DC, 0xE554001B, 0xFC4F315A, 0xD7626299, 0xCE7953D8,
+        0x49E14F17, 0x50FA7E56, 0x7BD72D95, 0x62CC1CD4, 0x2D8D8A13, 0x3496BB52,
+        0x1FBBE891, 0x06A0D9D0, 0x5E7EF3EC, 0x4765C2AD, 0x6C48916E, 0x7553A02F,
+        0x3A1236E8, 0x230907A9, 0x0824546A, 0x113F652B, 0x96A779E4, 0x8FBC48A5,
+        0xA4911B66, 0xBD8A2A27, 0xF2CBBCE0, 0xEBD08DA1, 0xC0FDDE62, 0xD9E6EF23,
+        0x14BCE1BD, 0x0DA7D0FC, 0x268A833F, 0x3F91B27E, 0x70D024B9, 0x69CB15F8,
+        0x42E6463B, 0x5BFD777A, 0xDC656BB5, 0xC57E5AF4, 0xEE530937, 0xF7483876,
+        0xB809AEB1, 0xA1129FF0, 0x8A3FCC33, 0x9324FD72
+    },
+    {
+        0x00000000, 0x01C26A37, 0x0384D46E, 0x0246BE59, 0x0709A8DC, 0x06CBC2EB,
+        0x048D7CB2, 0x054F1685, 0x0E1351B8, 0x0FD13B8F, 0x0D9785D6, 0x0C55EFE1,
+        0x091AF964, 0x08D89353, 0x0A9E2D0A, 0x0B5C473D, 0x1C26A370, 0x1DE4C947,
+        0x1FA2771E, 0x1E601D29, 0x1B2F0BAC, 0x1AED619B, 0x18ABDFC2, 0x1969B5F5,
+        0x1235F2C8, 0x13F798FF, 0x11B126A6, 0x10734C91, 0x153C5A14, 0x14FE3023,
+        0x16B88E7A, 0x177AE44D, 0x384D46E0, 0x398F2CD7, 0x3BC9928E, 0x3A0BF8B9,
+        0x3F44EE3C, 0x3E86840B, 0x3CC03A52, 0x3D025065, 0x365E1758, 0x379C7D6F,
+        0x35DAC336, 0x3418A901, 0x3157BF84, 0x3095D5B3, 0x32D36BEA, 0x331101DD,
+        0x246BE590, 0x25A98FA7, 0x27EF31FE, 0x262D5BC9, 0x23624D4C, 0x22A0277B,
+        0x20E69922, 0x2124F315, 0x2A78B428, 0x2BBADE1F, 0x29FC6046, 0x283E0A71,
+        0x2D711CF4, 0x2CB376C3, 0x2EF5C89A, 0x2F37A2AD, 0x709A8DC0, 0x7158E7F7,
+        0x731E59AE, 0x72DC3399, 0x7793251C, 0x76514F2B, 0x7417F172, 0x75D59B45,
+        0x7E89DC78, 0x7F4BB64F, 0x7D0D0816, 0x7CCF6221, 0x798074A4, 0x78421E93,
+        0x7A04A0CA, 0x7BC6CAFD, 0x6CBC2EB0, 0x6D7E4487, 0x6F38FADE, 0x6EFA90E9,
+        0x6BB5866C, 0x6A77EC5B, 0x68315202, 0x69F33835, 0x62AF7F08, 0x636D153F,
+        0x612BAB66, 0x60E9C151, 0x65A6D7D4, 0x6464BDE3, 0x662203BA, 0x67E0698D,
+        0x48D7CB20, 0x4915A117, 0x4B531F4E, 0x4A917579, 0x4FDE63FC, 0x4E1C09CB,
+        0x4C5AB792, 0x4D98DDA5, 0x46C49A98, 0x4706F0AF, 0x45404EF6, 0x448224C1,
+        0x41CD3244, 0x400F5873, 0x4249E62A, 0x438B8C1D, 0x54F16850, 0x55330267,
+        0x5775BC3E, 0x56B7D609, 0x53F8C08C, 0x523AAABB, 0x507C14E2, 0x51BE7ED5,
+        0x5AE239E8, 0x5B2053DF, 0x5966ED86, 0x58A487B1, 0x5DEB9134, 0x5C29FB03,
+        0x5E6F455A, 0x5FAD2F6D, 0xE1351B80, 0xE0F771B7, 0xE2B1CFEE, 0xE373A5D9,
+        0xE63CB35C, 0xE7FED96B, 0xE5B86732, 0xE47A0D05, 0xEF264A38, 0xEEE4200F,
+        0xECA29E56, 0xED60F461, 0xE82FE2E4, 0xE9ED88D3, 0xEBAB368A, 0xEA695CBD,
+        0xFD13B8F0, 0xFCD1D2C7, 0xFE976C9E, 0xFF5506A9, 0xFA1A102C, 0xFBD87A1B,
+        0xF99EC442, 0xF85CAE75, 0xF300E948, 0xF2C2837F, 0xF0843D26, 0xF1465711,
+        0xF4094194, 0xF5CB2BA3, 0xF78D95FA, 0xF64FFFCD, 0xD9785D60, 0xD8BA3757,
+        0xDAFC890E, 0xDB3EE339, 0xDE71F5BC, 0xDFB39F8B, 0xDDF521D2, 0xDC374BE5,
+        0xD76B0CD8, 0xD6A966EF, 0xD4EFD8B6, 0xD52DB281, 0xD062A404, 0xD1A0CE33,
+        0xD3E6706A, 0xD2241A5D, 0xC55EFE10, 0xC49C9427, 0xC6DA2A7E, 0xC7184049,
+        0xC25756CC, 0xC3953CFB, 0xC1D382A2, 0xC011E895, 0xCB4DAFA8, 0xCA8FC59F,
+        0xC8C97BC6, 0xC90B11F1, 0xCC440774, 0xCD866D43, 0xCFC0D31A, 0xCE02B92D,
+        0x91AF9640, 0x906DFC77, 0x922B422E, 0x93E92819, 0x96A63E9C, 0x976454AB,
+        0x9522EAF2, 0x94E080C5, 0x9FBCC7F8, 0x9E7EADCF, 0x9C381396, 0x9DFA79A1,
+        0x98B56F24, 0x99770513, 0x9B31BB4A, 0x9AF3D17D, 0x8D893530, 0x8C4B5F07,
+        0x8E0DE15E, 0x8FCF8B69, 0x8A809DEC, 0x8B42F7DB, 0x89044982, 0x88C623B5,
+        0x839A6488, 0x82580EBF, 0x801EB0E6, 0x81DCDAD1, 0x8493CC54, 0x8551A663,
+        0x8717183A, 0x86D5720D, 0xA9E2D0A0, 0xA820BA97, 0xAA6604CE, 0xABA46EF9,
+        0xAEEB787C, 0xAF29124B, 0xAD6FAC12, 0xACADC625, 0xA7F18118, 0xA633EB2F,
+        0xA4755576, 0xA5B73F41, 0xA0F829C4, 0xA13A43F3, 0xA37CFDAA, 0xA2BE979D,
+        0xB5C473D0, 0xB40619E7, 0xB640A7BE, 0xB782CD89, 0xB2CDDB0C, 0xB30FB13B,
+        0xB1490F62, 0xB08B6555, 0xBBD72268, 0xBA15485F, 0xB853F606, 0xB9919C31,
+        0xBCDE8AB4, 0xBD1CE083, 0xBF5A5EDA, 0xBE9834ED
+    },
+    {
+        0x00000000, 0xB8BC6765, 0xAA09C88B, 0x12B5AFEE, 0x8F629757, 0x37DEF032,
+        0x256B5FDC, 0x9DD738B9, 0xC5B428EF, 0x7D084F8A, 0x6FBDE064, 0xD7018701,
+        0x4AD6BFB8, 0xF26AD8DD, 0xE0DF7733, 0x58631056, 0x5019579F, 0xE8A530FA,
+        0xFA109F14, 0x42ACF871, 0xDF7BC0C8, 0x67C7A7AD, 0x75720843, 0xCDCE6F26,
+        0x95AD7F70, 0x2D111815, 0x3FA4B7FB, 0x8718D09E, 0x1ACFE827, 0xA2738F42,
+        0xB0C620AC, 0x087A47C9, 0xA032AF3E, 0x188EC85B, 0x0A3B67B5, 0xB28700D0,
+        0x2F503869, 0x97EC5F0C, 0x8559F0E2, 0x3DE59787, 0x658687D1, 0xDD3AE0B4,
+        0xCF8F4F5A, 0x7733283F, 0xEAE41086, 0x525877E3, 0x40EDD80D, 0xF851BF68,
+        0xF02BF8A1, 0x48979FC4, 0x5A22302A, 0xE29E574F, 0x7F496FF6, 0xC7F50893,
+        0xD540A77D, 0x6DFCC018, 0x359FD04E, 0x8D23B72B, 0x9F9618C5, 0x272A7FA0,
+        0xBAFD4719, 0x0241207C, 0x10F48F92, 0xA848E8F7, 0x9B14583D, 0x23A83F58,
+        0x311D90B6, 0x89A1F7D3, 0x1476CF6A, 0xACCAA80F, 0xBE7F07E1, 0x06C36084,
+        0x5EA070D2, 0xE61C17B7, 0xF4A9B859, 0x4C15DF3C, 0xD1C2E785, 0x697E80E0,
+        0x7BCB2F0E, 0xC377486B, 0xCB0D0FA2, 0x73B168C7, 0x6104C729, 0xD9B8A04C,
+        0x446F98F5, 0xFCD3FF90, 0xEE66507E, 0x56DA371B, 0x0EB9274D, 0xB6054028,
+        0xA4B0EFC6, 0x1C0C88A3, 0x81DBB01A, 0x3967D77F, 0x2BD27891, 0x936E1FF4,
+        0x3B26F703, 0x839A9066, 0x912F3F88, 0x299358ED, 0xB4446054, 0x0CF80731,
+        0x1E4DA8DF, 0xA6F1CFBA, 0xFE92DFEC, 0x462EB889, 0x549B1767, 0xEC277002,
+        0x71F048BB, 0xC94C2FDE, 0xDBF98030, 0x6345E755, 0x6B3FA09C, 0xD383C7F9,
+        0xC1366817, 0x798A0F72, 0xE45D37CB, 0x5CE150AE, 0x4E54FF40, 0xF6E89825,
+        0xAE8B8873, 0x1637EF16, 0x048240F8, 0xBC3E279D, 0x21E91F24, 0x99557841,
+        0x8BE0D7AF, 0x335CB0CA, 0xED59B63B, 0x55E5D15E, 0x47507EB0, 0xFFEC19D5,
+        0x623B216C, 0xDA874609, 0xC832E9E7, 0x708E8E82, 0x28ED9ED4, 0x9051F9B1,
+        0x82E4565F, 0x3A58313A, 0xA78F0983, 0x1F336EE6, 0x0D86C108, 0xB53AA66D,
+        0xBD40E1A4, 0x05FC86C1, 0x1749292F, 0xAFF54E4A, 0x322276F3, 0x8A9E1196,
+        0x982BBE78, 0x2097D91D, 0x78F4C94B, 0xC048AE2E, 0xD2FD01C0, 0x6A4166A5,
+        0xF7965E1C, 0x4F2A3979, 0x5D9F9697, 0xE523F1F2, 0x4D6B1905, 0xF5D77E60,
+        0xE762D18E, 0x5FDEB6EB, 0xC2098E52, 0x7AB5E937, 0x680046D9, 0xD0BC21BC,
+        0x88DF31EA, 0x3063568F, 0x22D6F961, 0x9A6A9E04, 0x07BDA6BD, 0xBF01C1D8,
+        0xADB46E36, 0x15080953, 0x1D724E9A, 0xA5CE29FF, 0xB77B8611, 0x0FC7E174,
+        0x9210D9CD, 0x2AACBEA8, 0x38191146, 0x80A57623, 0xD8C66675, 0x607A0110,
+        0x72CFAEFE, 0xCA73C99B, 0x57A4F122, 0xEF189647, 0xFDAD39A9, 0x45115ECC,
+        0x764DEE06, 0xCEF18963, 0xDC44268D, 0x64F841E8, 0xF92F7951, 0x41931E34,
+        0x5326B1DA, 0xEB9AD6BF, 0xB3F9C6E9, 0x0B45A18C, 0x19F00E62, 0xA14C6907,
+        0x3C9B51BE, 0x842736DB, 0x96929935, 0x2E2EFE50, 0x2654B999, 0x9EE8DEFC,
+        0x8C5D7112, 0x34E11677, 0xA9362ECE, 0x118A49AB, 0x033FE645, 0xBB838120,
+        0xE3E09176, 0x5B5CF613, 0x49E959FD, 0xF1553E98, 0x6C820621, 0xD43E6144,
+        0xC68BCEAA, 0x7E37A9CF, 0xD67F4138, 0x6EC3265D, 0x7C7689B3, 0xC4CAEED6,
+        0x591DD66F, 0xE1A1B10A, 0xF3141EE4, 0x4BA87981, 0x13CB69D7, 0xAB770EB2,
+        0xB9C2A15C, 0x017EC639, 0x9CA9FE80, 0x241599E5, 0x36A0360B, 0x8E1C516E,
+        0x866616A7, 0x3EDA71C2, 0x2C6FDE2C, 0x94D3B949, 0x090481F0, 0xB1B8E695,
+        0xA30D497B, 0x1BB12E1E, 0x43D23E48, 0xFB6E592D, 0xE9DBF6C3, 0x516791A6,
+        0xCCB0A91F, 0x740CCE7A, 0x66B96194, 0xDE0506F1
+    },
+    {
+        0x00000000, 0x3D6029B0, 0x7AC05360, 0x47A07AD0, 0xF580A6C0, 0xC8E08F70,
+        0x8F40F5A0, 0xB220DC10, 0x30704BC1, 0x0D106271, 0x4AB018A1, 0x77D03111,
+        0xC5F0ED01, 0xF890C4B1, 0xBF30BE61, 0x825097D1, 0x60E09782, 0x5D80BE32,
+        0x1A20C4E2, 0x2740ED52, 0x95603142, 0xA80018F2, 0xEFA06222, 0xD2C04B92,
+        0x5090DC43, 0x6DF0F5F3, 0x2A508F23, 0x1730A693, 0xA5107A83, 0x98705333,
+        0xDFD029E3, 0xE2B00053, 0xC1C12F04, 0xFCA106B4, 0xBB017C64, 0x866155D4,
+        0x344189C4, 0x0921A074, 0x4E81DAA4, 0x73E1F314, 0xF1B164C5, 0xCCD14D75,
+        0x8B7137A5, 0xB6111E15, 0x0431C205, 0x3951EBB5, 0x7EF19165, 0x4391B8D5,
+        0xA121B886, 0x9C419136, 0xDBE1EBE6, 0xE681C256, 0x54A11E46, 0x69C137F6,
+        0x2E614D26, 0x13016496, 0x9151F347, 0xAC31DAF7, 0xEB91A027, 0xD6F18997,
+        0x64D15587, 0x59B17C37, 0x1E1106E7, 0x23712F57, 0x58F35849, 0x659371F9,
+        0x22330B29, 0x1F532299, 0xAD73FE89, 0x9013D739, 0xD7B3ADE9, 0xEAD38459,
+        0x68831388, 0x55E33A38, 0x124340E8, 0x2F236958, 0x9D03B548, 0xA0639CF8,
+        0xE7C3E628, 0xDAA3CF98, 0x3813CFCB, 0x0573E67B, 0x42D39CAB, 0x7FB3B51B,
+        0xCD93690B, 0xF0F340BB, 0xB7533A6B, 0x8A3313DB, 0x0863840A, 0x3503ADBA,
+        0x72A3D76A, 0x4FC3FEDA, 0xFDE322CA, 0xC0830B7A, 0x872371AA, 0xBA43581A,
+        0x9932774D, 0xA4525EFD, 0xE3F2242D, 0xDE920D9D, 0x6CB2D18D, 0x51D2F83D,
+        0x167282ED, 0x2B12AB5D, 0xA9423C8C, 0x9422153C, 0xD3826FEC, 0xEEE2465C,
+        0x5CC29A4C, 0x61A2B3FC, 0x2602C92C, 0x1B62E09C, 0xF9D2E0CF, 0xC4B2C97F,
+        0x8312B3AF, 0xBE729A1F, 0x0C52460F, 0x31326FBF, 0x7692156F, 0x4BF23CDF,
+        0xC9A2AB0E, 0xF4C282BE, 0xB362F86E, 0x8E02D1DE, 0x3C220DCE, 0x0142247E,
+        0x46E25EAE, 0x7B82771E, 0xB1E6B092, 0x8C869922, 0xCB26E3F2, 0xF646CA42,
+        0x44661652, 0x79063FE2, 0x3EA64532, 0x03C66C82, 0x8196FB53, 0xBCF6D2E3,
+        0xFB56A833, 0xC6368183, 0x74165D93, 0x49767423, 0x0ED60EF3, 0x33B62743,
+        0xD1062710, 0xEC660EA0, 0xABC67470, 0x96A65DC0, 0x248681D0, 0x19E6A860,
+        0x5E46D2B0, 0x6326FB00, 0xE1766CD1, 0xDC164561, 0x9BB63FB1, 0xA6D61601,
+        0x14F6CA11, 0x2996E3A1, 0x6E369971, 0x5356B0C1, 0x70279F96, 0x4D47B626,
+        0x0AE7CCF6, 0x3787E546, 0x85A73956, 0xB8C710E6, 0xFF676A36, 0xC2074386,
+        0x4057D457, 0x7D37FDE7, 0x3A978737, 0x07F7AE87, 0xB5D77297, 0x88B75B27,
+        0xCF1721F7, 0xF2770847, 0x10C70814, 0x2DA721A4, 0x6A075B74, 0x576772C4,
+        0xE547AED4, 0xD8278764, 0x9F87FDB4, 0xA2E7D404, 0x20B743D5, 0x1DD76A65,
+        0x5A7710B5, 0x67173905, 0xD537E515, 0xE857CCA5, 0xAFF7B675, 0x92979FC5,
+        0xE915E8DB, 0xD475C16B, 0x93D5BBBB, 0xAEB5920B, 0x1C954E1B, 0x21F567AB,
+        0x66551D7B, 0x5B3534CB, 0xD965A31A, 0xE4058AAA, 0xA3A5F07A, 0x9EC5D9CA,
+        0x2CE505DA, 0x11852C6A, 0x562556BA, 0x6B457F0A, 0x89F57F59, 0xB49556E9,
+        0xF3352C39, 0xCE550589, 0x7C75D999, 0x4115F029, 0x06B58AF9, 0x3BD5A349,
+        0xB9853498, 0x84E51D28, 0xC34567F8, 0xFE254E48, 0x4C059258, 0x7165BBE8,
+        0x36C5C138, 0x0BA5E888, 0x28D4C7DF, 0x15B4EE6F, 0x521494BF, 0x6F74BD0F,
+        0xDD54611F, 0xE03448AF, 0xA794327F, 0x9AF41BCF, 0x18A48C1E, 0x25C4A5AE,
+        0x6264DF7E, 0x5F04F6CE, 0xED242ADE, 0xD044036E, 0x97E479BE, 0xAA84500E,
+        0x4834505D, 0x755479ED, 0x32F4033D, 0x0F942A8D, 0xBDB4F69D, 0x80D4DF2D,
+        0xC774A5FD, 0xFA148C4D, 0x78441B9C, 0x4524322C, 0x028448FC, 0x3FE4614C,
+        0x8DC4BD5C, 0xB0A494EC, 0xF704EE3C, 0xCA64C78C
+    },
+    {
+        0x00000000, 0xCB5CD3A5, 0x4DC8A10B, 0x869472AE, 0x9B914216, 0x50CD91B3,
+        0xD659E31D, 0x1D0530B8, 0xEC53826D, 0x270F51C8, 0xA19B2366, 0x6AC7F0C3,
+        0x77C2C07B, 0xBC9E13DE, 0x3A0A6170, 0xF156B2D5, 0x03D6029B, 0xC88AD13E,
+        0x4E1EA390, 0x85427035, 0x9847408D, 0x531B9328, 0xD58FE186, 0x1ED33223,
+        0xEF8580F6, 0x24D95353, 0xA24D21FD, 0x6911F258, 0x7414C2E0, 0xBF481145,
+        0x39DC63EB, 0xF280B04E, 0x07AC0536, 0xCCF0D693, 0x4A64A43D, 0x81387798,
+        0x9C3D4720, 0x57619485, 0xD1F5E62B, 0x1AA9358E, 0xEBFF875B, 0x20A354FE,
+        0xA6372650, 0x6D6BF5F5, 0x706EC54D, 0xBB3216E8, 0x3DA66446, 0xF6FAB7E3,
+        0x047A07AD, 0xCF26D408, 0x49B2A6A6, 0x82EE7503, 0x9FEB45BB, 0x54B7961E,
+        0xD223E4B0, 0x197F3715, 0xE82985C0, 0x23755665, 0xA5E124CB, 0x6EBDF76E,
+        0x73B8C7D6, 0xB8E41473, 0x3E7066DD, 0xF52CB578, 0x0F580A6C, 0xC404D9C9,
+        0x4290AB67, 0x89CC78C2, 0x94C9487A, 0x5F959BDF, 0xD901E971, 0x125D3AD4,
+        0xE30B8801, 0x28575BA4, 0xAEC3290A, 0x659FFAAF, 0x789ACA17, 0xB3C619B2,
+        0x35526B1C, 0xFE0EB8B9, 0x0C8E08F7, 0xC7D2DB52, 0x4146A9FC, 0x8A1A7A59,
+        0x971F4AE1, 0x5C439944, 0xDAD7EBEA, 0x118B384F, 0xE0DD8A9A, 0x2B81593F,
+        0xAD152B91, 0x6649F834, 0x7B4CC88C, 0xB0101B29, 0x36846987, 0xFDD8BA22,
+        0x08F40F5A, 0xC3A8DCFF, 0x453CAE51, 0x8E607DF4, 0x93654D4C, 0x58399EE9,
+        0xDEADEC47, 0x15F13FE2, 0xE4A78D37, 0x2FFB5E92, 0xA96F2C3C, 0x6233FF99,
+        0x7F36CF21, 0xB46A1C84, 0x32FE6E2A, 0xF9A2BD8F, 0x0B220DC1, 0xC07EDE64,
+        0x46EAACCA, 0x8DB67F6F, 0x90B34FD7, 0x5BEF9C72, 0xDD7BEEDC, 0x16273D79,
+        0xE7718FAC, 0x2C2D5C09, 0xAAB92EA7, 0x61E5FD02, 0x7CE0CDBA, 0xB7BC1E1F,
+        0x31286CB1, 0xFA74BF14, 0x1EB014D8, 0xD5ECC77D, 0x5378B5D3, 0x98246676,
+        0x852156CE, 0x4E7D856B, 0xC8E9F7C5, 0x03B52460, 0xF2E396B5, 0x39BF4510,
+        0xBF2B37BE, 0x7477E41B, 0x6972D4A3, 0xA22E0706, 0x24BA75A8, 0xEFE6A60D,
+        0x1D661643, 0xD63AC5E6, 0x50AEB748, 0x9BF264ED, 0x86F75455, 0x4DAB87F0,
+        0xCB3FF55E, 0x006326FB, 0xF135942E, 0x3A69478B, 0xBCFD3525, 0x77A1E680,
+        0x6AA4D638, 0xA1F8059D, 0x276C7733, 0xEC30A496, 0x191C11EE, 0xD240C24B,
+        0x54D4B0E5, 0x9F886340, 0x828D53F8, 0x49D1805D, 0xCF45F2F3, 0x04192156,
+        0xF54F9383, 0x3E134026, 0xB8873288, 0x73DBE12D, 0x6EDED195, 0xA5820230,
+        0x2316709E, 0xE84AA33B, 0x1ACA1375, 0xD196C0D0, 0x5702B27E, 0x9C5E61DB,
+        0x815B5163, 0x4A0782C6, 0xCC93F068, 0x07CF23CD, 0xF6999118, 0x3DC542BD,
+        0xBB513013, 0x700DE3B6, 0x6D08D30E, 0xA65400AB, 0x20C07205, 0xEB9CA1A0,
+        0x11E81EB4, 0xDAB4CD11, 0x5C20BFBF, 0x977C6C1A, 0x8A795CA2, 0x41258F07,
+        0xC7B1FDA9, 0x0CED2E0C, 0xFDBB9CD9, 0x36E74F7C, 0xB0733DD2, 0x7B2FEE77,
+        0x662ADECF, 0xAD760D6A, 0x2BE27FC4, 0xE0BEAC61, 0x123E1C2F, 0xD962CF8A,
+        0x5FF6BD24, 0x94AA6E81, 0x89AF5E39, 0x42F38D9C, 0xC467FF32, 0x0F3B2C97,
+        0xFE6D9E42, 0x35314DE7, 0xB3A53F49, 0x78F9ECEC, 0x65FCDC54, 0xAEA00FF1,
+        0x28347D5F, 0xE368AEFA, 0x16441B82, 0xDD18C827, 0x5B8CBA89, 0x90D0692C,
+        0x8DD55994, 0x46898A31, 0xC01DF89F, 0x0B412B3A, 0xFA1799EF, 0x314B4A4A,
+        0xB7DF38E4, 0x7C83EB41, 0x6186DBF9, 0xAADA085C, 0x2C4E7AF2, 0xE712A957,
+        0x15921919, 0xDECECABC, 0x585AB812, 0x93066BB7, 0x8E035B0F, 0x455F88AA,
+        0xC3CBFA04, 0x089729A1, 0xF9C19B74, 0x329D48D1, 0xB4093A7F, 0x7F55E9DA,
+        0x6250D962, 0xA90C0AC7, 0x2F987869, 0xE4C4ABCC
+    },
+    {
+        0x00000000, 0xA6770BB4, 0x979F1129, 0x31E81A9D, 0xF44F2413, 0x52382FA7,
+        0x63D0353A, 0xC5A73E8E, 0x33EF4E67, 0x959845D3, 0xA4705F4E, 0x020754FA,
+        0xC7A06A74, 0x61D761C0, 0x503F7B5D, 0xF64870E9, 0x67DE9CCE, 0xC1A9977A,
+        0xF0418DE7, 0x56368653, 0x9391B8DD, 0x35E6B369, 0x040EA9F4, 0xA279A240,
+        0x5431D2A9, 0xF246D91D, 0xC3AEC380, 0x65D9C834, 0xA07EF6BA, 0x0609FD0E,
+        0x37E1E793, 0x9196EC27, 0xCFBD399C, 0x69CA3228, 0x582228B5, 0xFE552301,
+        0x3BF21D8F, 0x9D85163B, 0xAC6D0CA6, 0x0A1A0712, 0xFC5277FB, 0x5A257C4F,
+        0x6BCD66D2, 0xCDBA6D66, 0x081D53E8, 0xAE6A585C, 0x9F8242C1, 0x39F54975,
+        0xA863A552, 0x0E14AEE6, 0x3FFCB47B, 0x998BBFCF, 0x5C2C8141, 0xFA5B8AF5,
+        0xCBB39068, 0x6DC49BDC, 0x9B8CEB35, 0x3DFBE081, 0x0C13FA1C, 0xAA64F1A8,
+        0x6FC3CF26, 0xC9B4C492, 0xF85CDE0F, 0x5E2BD5BB, 0x440B7579, 0xE27C7ECD,
+        0xD3946450, 0x75E36FE4, 0xB044516A, 0x16335ADE, 0x27DB4043, 0x81AC4BF7,
+        0x77E43B1E, 0xD19330AA, 0xE07B2A37, 0x460C2183, 0x83AB1F0D, 0x25DC14B9,
+        0x14340E24, 0xB2430590, 0x23D5E9B7, 0x85A2E203, 0xB44AF89E, 0x123DF32A,
+        0xD79ACDA4, 0x71EDC610, 0x4005DC8D, 0xE672D739, 0x103AA7D0, 0xB64DAC64,
+        0x87A5B6F9, 0x21D2BD4D, 0xE47583C3, 0x42028877, 0x73EA92EA, 0xD59D995E,
+        0x8BB64CE5, 0x2DC14751, 0x1C295DCC, 0xBA5E5678, 0x7FF968F6, 0xD98E6342,
+        0xE86679DF, 0x4E11726B, 0xB8590282, 0x1E2E0936, 0x2FC613AB, 0x89B1181F,
+        0x4C162691, 0xEA612D25, 0xDB8937B8, 0x7DFE3C0C, 0xEC68D02B, 0x4A1FDB9F,
+        0x7BF7C102, 0xDD80CAB6, 0x1827F438, 0xBE50FF8C, 0x8FB8E511, 0x29CFEEA5,
+        0xDF879E4C, 0x79F095F8, 0x48188F65, 0xEE6F84D1, 0x2BC8BA5F, 0x8DBFB1EB,
+        0xBC57AB76, 0x1A20A0C2, 0x8816EAF2, 0x2E61E146, 0x1F89FBDB, 0xB9FEF06F,
+        0x7C59CEE1, 0xDA2EC555, 0xEBC6DFC8, 0x4DB1D47C, 0xBBF9A495, 0x1D8EAF21,
+        0x2C66B5BC, 0x8A11BE08, 0x4FB68086, 0xE9C18B32, 0xD82991AF, 0x7E5E9A1B,
+        0xEFC8763C, 0x49BF7D88, 0x78576715, 0xDE206CA1, 0x1B87522F, 0xBDF0599B,
+        0x8C184306, 0x2A6F48B2, 0xDC27385B, 0x7A5033EF, 0x4BB82972, 0xEDCF22C6,
+        0x28681C48, 0x8E1F17FC, 0xBFF70D61, 0x198006D5, 0x47ABD36E, 0xE1DCD8DA,
+        0xD034C247, 0x7643C9F3, 0xB3E4F77D, 0x1593FCC9, 0x247BE654, 0x820CEDE0,
+        0x74449D09, 0xD23396BD, 0xE3DB8C20, 0x45AC8794, 0x800BB91A, 0x267CB2AE,
+        0x1794A833, 0xB1E3A387, 0x20754FA0, 0x86024414, 0xB7EA5E89, 0x119D553D,
+        0xD43A6BB3, 0x724D6007, 0x43A57A9A, 0xE5D2712E, 0x139A01C7, 0xB5ED0A73,
+        0x840510EE, 0x22721B5A, 0xE7D525D4, 0x41A22E60, 0x704A34FD, 0xD63D3F49,
+        0xCC1D9F8B, 0x6A6A943F, 0x5B828EA2, 0xFDF58516, 0x3852BB98, 0x9E25B02C,
+        0xAFCDAAB1, 0x09BAA105, 0xFFF2D1EC, 0x5985DA58, 0x686DC0C5, 0xCE1ACB71,
+        0x0BBDF5FF, 0xADCAFE4B, 0x9C22E4D6, 0x3A55EF62, 0xABC30345, 0x0DB408F1,
+        0x3C5C126C, 0x9A2B19D8, 0x5F8C2756, 0xF9FB2CE2, 0xC813367F, 0x6E643DCB,
+        0x982C4D22, 0x3E5B4696, 0x0FB35C0B, 0xA9C457BF, 0x6C636931, 0xCA146285,
+        0xFBFC7818, 0x5D8B73AC, 0x03A0A617, 0xA5D7ADA3, 0x943FB73E, 0x3248BC8A,
+        0xF7EF8204, 0x519889B0, 0x6070932D, 0xC6079899, 0x304FE870, 0x9638E3C4,
+        0xA7D0F959, 0x01A7F2ED, 0xC400CC63, 0x6277C7D7, 0x539FDD4A, 0xF5E8D6FE,
+        0x647E3AD9, 0xC209316D, 0xF3E12BF0, 0x55962044, 0x90311ECA, 0x3646157E,
+        0x07AE0FE3, 0xA1D90457, 0x579174BE, 0xF1E67F0A, 0xC00E6597, 0x66796E23,
+        0xA3DE50AD, 0x05A95B19, 0x34414184, 0x92364A30
+    },
+    {
+        0x00000000, 0xCCAA009E, 0x4225077D, 0x8E8F07E3, 0x844A0EFA, 0x48E00E64,
+        0xC66F0987, 0x0AC50919, 0xD3E51BB5, 0x1F4F1B2B, 0x91C01CC8, 0x5D6A1C56,
+        0x57AF154F, 0x9B0515D1, 0x158A1232, 0xD92012AC, 0x7CBB312B, 0xB01131B5,
+        0x3E9E3656, 0xF23436C8, 0xF8F13FD1, 0x345B3F4F, 0xBAD438AC, 0x767E3832,
+        0xAF5E2A9E, 0x63F42A00, 0xED7B2DE3, 0x21D12D7D, 0x2B142464, 0xE7BE24FA,
+        0x69312319, 0xA59B2387, 0xF9766256, 0x35DC62C8, 0xBB53652B, 0x77F965B5,
+        0x7D3C6CAC, 0xB1966C32, 0x3F196BD1, 0xF3B36B4F, 0x2A9379E3, 0xE639797D,
+        0x68B67E9E, 0xA41C7E00, 0xAED97719, 0x62737787, 0xECFC7064, 0x205670FA,
+        0x85CD537D, 0x496753E3, 0xC7E85400, 0x0B42549E, 0x01875D87, 0xCD2D5D19,
+        0x43A25AFA, 0x8F085A64, 0x562848C8, 0x9A824856, 0x140D4FB5, 0xD8A74F2B,
+        0xD2624632, 0x1EC846AC, 0x9047414F, 0x5CED41D1, 0x299DC2ED, 0xE537C273,
+        0x6BB8C590, 0xA712C50E, 0xADD7CC17, 0x617DCC89, 0xEFF2CB6A, 0x2358CBF4,
+        0xFA78D958, 0x36D2D9C6, 0xB85DDE25, 0x74F7DEBB, 0x7E32D7A2, 0xB298D73C,
+        0x3C17D0DF, 0xF0BDD041, 0x5526F3C6, 0x998CF358, 0x1703F4BB, 0xDBA9F425,
+        0xD16CFD3C, 0x1DC6FDA2, 0x9349FA41, 0x5FE3FADF, 0x86C3E873, 0x4A69E8ED,
+        0xC4E6EF0E, 0x084CEF90, 0x0289E689, 0xCE23E617, 0x40ACE1F4, 0x8C06E16A,
+        0xD0EBA0BB, 0x1C41A025, 0x92CEA7C6, 0x5E64A758, 0x54A1AE41, 0x980BAEDF,
+        0x1684A93C, 0xDA2EA9A2, 0x030EBB0E, 0xCFA4BB90, 0x412BBC73, 0x8D81BCED,
+        0x8744B5F4, 0x4BEEB56A, 0xC561B289, 0x09CBB217, 0xAC509190, 0x60FA910E,
+        0xEE7596ED, 0x22DF9673, 0x281A9F6A, 0xE4B09FF4, 0x6A3F9817, 0xA6959889,
+        0x7FB58A25, 0xB31F8ABB, 0x3D908D58, 0xF13A8DC6, 0xFBFF84DF, 0x37558441,
+        0xB9DA83A2, 0x7570833C, 0x533B85DA, 0x9F918544, 0x111E82A7, 0xDDB48239,
+        0xD7718B20, 0x1BDB8BBE, 0x95548C5D, 0x59FE8CC3, 0x80DE9E6F, 0x4C749EF1,
+        0xC2FB9912, 0x0E51998C, 0x04949095, 0xC83E900B, 0x46B197E8, 0x8A1B9776,
+        0x2F80B4F1, 0xE32AB46F, 0x6DA5B38C, 0xA10FB312, 0xABCABA0B, 0x6760BA95,
+        0xE9EFBD76, 0x2545BDE8, 0xFC65AF44, 0x30CFAFDA, 0xBE40A839, 0x72EAA8A7,
+        0x782FA1BE, 0xB485A120, 0x3A0AA6C3, 0xF6A0A65D, 0xAA4DE78C, 0x66E7E712,
+        0xE868E0F1, 0x24C2E06F, 0x2E07E976, 0xE2ADE9E8, 0x6C22EE0B, 0xA088EE95,
+        0x79A8FC39, 0xB502FCA7, 0x3B8DFB44, 0xF727FBDA, 0xFDE2F2C3, 0x3148F25D,
+        0xBFC7F5BE, 0x736DF520, 0xD6F6D6A7, 0x1A5CD639, 0x94D3D1DA, 0x5879D144,
+        0x52BCD85D, 0x9E16D8C3, 0x1099DF20, 0xDC33DFBE, 0x0513CD12, 0xC9B9CD8C,
+        0x4736CA6F, 0x8B9CCAF1, 0x8159C3E8, 0x4DF3C376, 0xC37CC495, 0x0FD6C40B,
+        0x7AA64737, 0xB60C47A9, 0x3883404A, 0xF42940D4, 0xFEEC49CD, 0x32464953,
+        0xBCC94EB0, 0x70634E2E, 0xA9435C82, 0x65E95C1C, 0xEB665BFF, 0x27CC5B61,
+        0x2D095278, 0xE1A352E6, 0x6F2C5505, 0xA386559B, 0x061D761C, 0xCAB77682,
+        0x44387161, 0x889271FF, 0x825778E6, 0x4EFD7878, 0xC0727F9B, 0x0CD87F05,
+        0xD5F86DA9, 0x19526D37, 0x97DD6AD4, 0x5B776A4A, 0x51B26353, 0x9D1863CD,
+        0x1397642E, 0xDF3D64B0, 0x83D02561, 0x4F7A25FF, 0xC1F5221C, 0x0D5F2282,
+        0x079A2B9B, 0xCB302B05, 0x45BF2CE6, 0x89152C78, 0x50353ED4, 0x9C9F3E4A,
+        0x121039A9, 0xDEBA3937, 0xD47F302E, 0x18D530B0, 0x965A3753, 0x5AF037CD,
+        0xFF6B144A, 0x33C114D4, 0xBD4E1337, 0x71E413A9, 0x7B211AB0, 0xB78B1A2E,
+        0x39041DCD, 0xF5AE1D53, 0x2C8E0FFF, 0xE0240F61, 0x6EAB0882, 0xA201081C,
+        0xA8C40105, 0x646E019B, 0xEAE10678, 0x264B06E6
+    }
+};
+
+// 'crc' is the inverted running state
+static stbiw_uint32 stbiw__crc32_slice8(stbiw_uint32 crc,
+                                        const unsigned char *p, int len) {
+  while (len >= 8) {
+    stbiw_uint32 a = crc ^ (p[0] | (p[1] << 8) | (p[2] << 16) |
+                            ((stbiw_uint32)p[3] << 24));
+    stbiw_uint32 b =
+        p[4] | (p[5] << 8) | (p[6] << 16) | ((stbiw_uint32)p[7] << 24);
+    crc = stbiw__crc_table[7][a & 255] ^ stbiw__crc_table[6][(a >> 8) & 255] ^
+          stbiw__crc_table[5][(a >> 16) & 255] ^ stbiw__crc_table[4][a >> 24] ^
+          stbiw__crc_table[3][b & 255] ^ stbiw__crc_table[2][(b >> 8) & 255] ^
+          stbiw__crc_table[1][(b >> 16) & 255] ^ stbiw__crc_table[0][b >> 24];
+    p += 8;
+    len -= 8;
+  }
+  while (len--) crc = (crc >> 8) ^ stbiw__crc_table[0][(crc ^ *p++) & 255];
+  return crc;
+}
+
+#ifdef IMAGE_SIMD_X86
+// folds four 128-bit lanes across 64-byte blocks, then reduces with Barrett;
+// len must be a multiple of 16 and at least 64
+IMAGE_TARGET_PCLMUL static stbiw_uint32 stbiw__crc32_fold(
+    stbiw_uint32 crc, const unsigned char *p, int len) {
+  const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596LL, 0x0154442bd4LL);
+  const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009eLL, 0x01751997d0LL);
+  const __m128i k5k0 = _mm_set_epi64x(0, 0x0163cd6124LL);
+  const __m128i poly = _mm_set_epi64x(0x01f7011641LL, 0x01db710641LL);
+  const __m128i mask32 = _mm_setr_epi32(-1, 0, -1, 0);
+  __m128i x1, x2, x3, x4, x5, x6, x7, x8;
+
+  x1 = _mm_loadu_si128((const __m128i *)(p + 0x00));
+  x2 = _mm_loadu_si128((const __m128i *)(p + 0x10));
+  x3 = _mm_loadu_si128((const __m128i *)(p + 0x20));
+  x4 = _mm_loadu_si128((const __m128i *)(p + 0x30));
+  x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+  p += 64;
+  len -= 64;
+  while (len >= 64) {
+    x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+    x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+    x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+    x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+    x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+    x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+    x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+                       _mm_loadu_si128((const __m128i *)(p + 0x00)));
+    x2 = _mm_xor_si128(_mm_xor_si128(x2, x6),
+                       _mm_loadu_si128((const __m128i *)(p + 0x10)));
+    x3 = _mm_xor_si128(_mm_xor_si128(x3, x7),
+                       _mm_loadu_si128((const __m128i *)(p + 0x20)));
+    x4 = _mm_xor_si128(_mm_xor_si128(x4, x8),
+                       _mm_loadu_si128((const __m128i *)(p + 0x30)));
+    p += 64;
+    len -= 64;
+  }
+
+  // fold the four lanes into one
+  x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+  x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+  x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+  while (len >= 16) {
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((const __m128i *)p)),
+                       x5);
+    p += 16;
+    len -= 16;
+  }
 
-// stretchy buffer; stbiw__sbpush() == vector<>::push_back() -- stbiw__sbcount()
-// == vector<>::size()
-#define stbiw__sbraw(a) ((int *)(a)-2)
-#define stbiw__sbm(a) stbiw__sbraw(a)[0]
-#define stbiw__sbn(a) stbiw__sbraw(a)[1]
+  // 128 -> 64 bits
+  x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+  x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_and_si128(x1, mask32);
+  x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  // Barrett reduction to 32 bits
+  x2 = _mm_and_si128(x1, mask32);
+  x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+  x2 = _mm_and_si128(x2, mask32);
+  x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+  return (stbiw_uint32)_mm_extract_epi32(x1, 1);
+}
+
+static stbiw_uint32 stbiw__crc32_pclmul(stbiw_uint32 crc,
+                                        const unsigned char *p, int len) {
+  if (len >= 64) {
+    int n = len & ~15;
+    crc = stbiw__crc32_fold(crc, p, n);
+    p += n;
+    len -= n;
+  }
+  return stbiw__crc32_slice8(crc, p, len);
+}
+#endif
 
-#define stbiw__sbneedgrow(a, n) ((a) == 0 || stbiw__sbn(a) + n >= stbiw__sbm(a))
-#define stbiw__sbmaybegrow(a, n) \
-  (stbiw__sbneedgrow(a, (n)) ? stbiw__sbgrow(a, n) : 0)
-#define stbiw__sbgrow(a, n) stbiw__sbgrowf((void **)&(a), (n), sizeof(*(a)))
+typedef stbiw_uint32 (*stbiw__crc32_func)(stbiw_uint32 crc,
+                                          const unsigned char *p, int len);
+
+static stbiw__crc32_func stbiw__crc32_kernel(void) {
+  static stbiw__crc32_func kernel = NULL;
+  if (!kernel) {
+    kernel = stbiw__crc32_slice8;
+#ifdef IMAGE_SIMD_X86
+    if ((image_cpu_features() & (IMAGE_CPU_PCLMUL | IMAGE_CPU_SSE41)) ==
+        (IMAGE_CPU_PCLMUL | IMAGE_CPU_SSE41))
+      kernel = stbiw__crc32_pclmul;
+#endif
+  }
+  return kernel;
+}
 
-#define stbiw__sbpush(a, v) \
-  (stbiw__sbmaybegrow(a, 1), (a)[stbiw__sbn(a)++] = (v))
-#define stbiw__sbcount(a) ((a) ? stbiw__sbn(a) : 0)
-#define stbiw__sbfree(a) ((a) ? STBIW_FREE(stbiw__sbraw(a)), 0 : 0)
+STBIWDEF unsigned int stbi_crc32(unsigned int crc,
+                                 const unsigned char *buffer, int len) {
+  if (len <= 0) return crc;
+  return ~stbiw__crc32_kernel()(~crc, buffer, len);
+}
 
-static void *stbiw__sbgrowf(void **arr, int increment, int itemsize) {
-  int m = *arr ? 2 * stbiw__sbm(*arr) + increment : increment + 1;
-  void *p = STBIW_REALLOC_SIZED(
-      *arr ? stbiw__sbraw(*arr) : 0,
-      *arr ? (stbiw__sbm(*arr) * itemsize + sizeof(int) * 2) : 0,
-      itemsize * m + sizeof(int) * 2);
-  STBIW_ASSERT(p);
-  if (p) {
-    if (!*arr) ((int *)p)[1] = 0;
-    *arr = (void *)((int *)p + 2);
-    stbiw__sbm(*arr) = m;
+// a * b modulo the CRC polynomial, both bit-reflected
+static stbiw_uint32 stbiw__crc_multmodp(stbiw_uint32 a, stbiw_uint32 b) {
+  stbiw_uint32 m = 1u << 31, p = 0;
+  for (;;) {
+    if (a & m) {
+      p ^= b;
+      if ((a & (m - 1)) == 0) break;
+    }
+    m >>= 1;
+    b = b & 1 ? (b >> 1) ^ 0xEDB88320 : b >> 1;
   }
-  return *arr;
+  return p;
 }
 
-static unsigned char *stbiw__zlib_flushf(unsigned char *data,
-                                         unsigned int *bitbuffer,
-                                         int *bitcount) {
-  while (*bitcount >= 8) {
-    stbiw__sbpush(data, STBIW_UCHAR(*bitbuffer));
-    *bitbuffer >>= 8;
-    *bitcount -= 8;
+STBIWDEF unsigned int stbi_crc32_combine(unsigned int crc1, unsigned int crc2,
+                                         int len2) {
+  // crc1 * x^(8 * len2), by square-and-multiply over the bits of len2
+  stbiw_uint32 xp = 1u << 31, sq = 1u << 30;  // x^0, x^1
+  int k;
+  for (k = 0; k < 3; ++k) sq = stbiw__crc_multmodp(sq, sq);
+  while (len2 > 0) {
+    if (len2 & 1) xp = stbiw__crc_multmodp(sq, xp);
+    len2 >>= 1;
+    if (len2) sq = stbiw__crc_multmodp(sq, sq);
   }
-  return data;
+  return stbiw__crc_multmodp(xp, crc1) ^ crc2;
 }
 
+//////////////////////////////////////////////////////////////////////////////
+//
+// Deflate
+//
+// A zlib-style LZ77 + Huffman encoder. Levels 1-3 match greedily, levels 4-9
+// use lazy evaluation with longer hash chains, level 0 only stores. Each block
+// is emitted as whichever of dynamic Huffman, fixed Huffman or stored is the
+// smallest, and the output is written into a single buffer sized for the
+// worst case up front.
+//
+// You can #define STBIW_ZLIB_COMPRESS to route PNG output through your own
+// zlib compressor instead; it is called with the same arguments as
+// stbi_zlib_compress() below and must return a buffer freeable with
+// STBIW_FREE(). The row-streaming PNG writer still uses this encoder, as it
+// never holds the whole image.
+
+#define stbiw__ZWINDOW 32768
+#define stbiw__ZWMASK (stbiw__ZWINDOW - 1)
+#define stbiw__ZHASH_BITS 15
+#define stbiw__ZHASH_SIZE (1 << stbiw__ZHASH_BITS)
+#define stbiw__ZMAX_SYMS 16384
+#define stbiw__ZMIN_MATCH 3
+#define stbiw__ZMAX_MATCH 258
+// a length-3 match further back than this costs more than three literals
+#define stbiw__ZTOO_FAR 4096
+
+static const unsigned short stbiw__zlengthc[] = {
+    3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23,  27,
+    31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258, 259};
+static const unsigned char stbiw__zlengtheb[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                                 1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                                 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const unsigned short stbiw__zdistc[] = {
+    1,    2,    3,    4,    5,    7,     9,     13,    17,   25,   33,
+    49,   65,   97,   129,  193,  257,   385,   513,   769,  1025, 1537,
+    2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577, 32769};
+static const unsigned char stbiw__zdisteb[] = {0, 0, 0,  0,  1,  1,  2,  2,
+                                               3, 3, 4,  4,  5,  5,  6,  6,
+                                               7, 7, 8,  8,  9,  9,  10, 10,
+                                               11, 11, 12, 12, 13, 13};
+// order in which code length code lengths are transmitted
+static const unsigned char stbiw__zclorder[19] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+// per-level matcher tuning, same meaning as zlib's configuration_table
+typedef struct {
+  unsigned short good_length;  // reduce lazy search above this match length
+  unsigned short max_lazy;     // greedy levels: max length to insert in hash
+  unsigned short nice_length;  // stop searching above this match length
+  unsigned short max_chain;    // hash chain positions to visit
+} stbiw__zconfig;
+
+static const stbiw__zconfig stbiw__zconfigs[10] = {
+    {0, 0, 0, 0},        {4, 4, 8, 4},         {4, 5, 16, 8},
+    {4, 6, 32, 32},      {4, 4, 16, 16},       {8, 16, 32, 32},
+    {8, 16, 128, 128},   {8, 32, 128, 256},    {32, 128, 258, 1024},
+    {32, 258, 258, 4096}};
+
+typedef struct {
+  unsigned char *out;
+  int out_len, out_cap;
+  unsigned int bitbuf;
+  int bitcount;
+
+  int level;
+  int *head, *prev;  // hash chains, -1 terminated
+  unsigned short *sym_len, *sym_dist;  // literal/length, 0 or distance
+  int sym_count;
+  int block_start, in_pos;  // input span covered by the pending symbols
+  unsigned int lfreq[286], dfreq[30];
+
+  unsigned char lcode[stbiw__ZMAX_MATCH + 1];  // match length -> code
+  unsigned char dcode[512];                    // see stbiw__zdist_code
+} stbiw__zstate;
+
+typedef struct {
+  unsigned int key;
+  unsigned short sym;
+} stbiw__zsymfreq;
+
 static int stbiw__zlib_bitrev(int code, int codebits) {
   int res = 0;
   while (codebits--) {
@@ -729,212 +1400,711 @@ static int stbiw__zlib_bitrev(int code, int codebits) {
   return res;
 }
 
-static unsigned int stbiw__zlib_countm(unsigned char *a, unsigned char *b,
-                                       int limit) {
-  int i;
-  for (i = 0; i < limit && i < 258; ++i)
-    if (a[i] != b[i]) break;
+static int stbiw__zlib_countm(const unsigned char *a, const unsigned char *b,
+                              int limit) {
+  int i = 0;
+  while (i + 4 <= limit) {
+    stbiw_uint32 x, y;
+    memcpy(&x, a + i, 4);
+    memcpy(&y, b + i, 4);
+    if (x != y) break;
+    i += 4;
+  }
+  while (i < limit && a[i] == b[i]) ++i;
   return i;
 }
 
-static unsigned int stbiw__zhash(unsigned char *data) {
-  stbiw_uint32 hash = data[0] + (data[1] << 8) + (data[2] << 16);
-  hash ^= hash << 3;
-  hash += hash >> 5;
-  hash ^= hash << 4;
-  hash += hash >> 17;
-  hash ^= hash << 25;
-  hash += hash >> 6;
-  return hash;
-}
-
-#define stbiw__zlib_flush() (out = stbiw__zlib_flushf(out, &bitbuf, &bitcount))
-#define stbiw__zlib_add(code, codebits) \
-  (bitbuf |= (code) << bitcount, bitcount += (codebits), stbiw__zlib_flush())
-#define stbiw__zlib_huffa(b, c) stbiw__zlib_add(stbiw__zlib_bitrev(b, c), c)
-// default huffman tables
-#define stbiw__zlib_huff1(n) stbiw__zlib_huffa(0x30 + (n), 8)
-#define stbiw__zlib_huff2(n) stbiw__zlib_huffa(0x190 + (n)-144, 9)
-#define stbiw__zlib_huff3(n) stbiw__zlib_huffa(0 + (n)-256, 7)
-#define stbiw__zlib_huff4(n) stbiw__zlib_huffa(0xc0 + (n)-280, 8)
-#define stbiw__zlib_huff(n)                                    \
-  ((n) <= 143 ? stbiw__zlib_huff1(n)                           \
-              : (n) <= 255 ? stbiw__zlib_huff2(n)              \
-                           : (n) <= 279 ? stbiw__zlib_huff3(n) \
-                                        : stbiw__zlib_huff4(n))
-#define stbiw__zlib_huffb(n) \
-  ((n) <= 143 ? stbiw__zlib_huff1(n) : stbiw__zlib_huff2(n))
-
-#define stbiw__ZHASH 16384
-
-unsigned char *stbi_zlib_compress(unsigned char *data, int data_len,
-                                  int *out_len, int quality) {
-  static unsigned short lengthc[] = {
-      3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23,  27,
-      31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258, 259};
-  static unsigned char lengtheb[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
-                                     1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
-                                     4, 4, 4, 4, 5, 5, 5, 5, 0};
-  static unsigned short distc[] = {
-      1,    2,    3,    4,    5,    7,     9,     13,    17,   25,   33,
-      49,   65,   97,   129,  193,  257,   385,   513,   769,  1025, 1537,
-      2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577, 32768};
-  static unsigned char disteb[] = {0, 0, 0,  0,  1,  1,  2,  2,  3,  3,
-                                   4, 4, 5,  5,  6,  6,  7,  7,  8,  8,
-                                   9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
-  unsigned int bitbuf = 0;
-  int i, j, bitcount = 0;
-  unsigned char *out = NULL;
-  unsigned char ***hash_table =
-      (unsigned char ***)STBIW_MALLOC(stbiw__ZHASH * sizeof(char **));
-  if (quality < 5) quality = 5;
-
-  stbiw__sbpush(out, 0x78);  // DEFLATE 32K window
-  stbiw__sbpush(out, 0x5e);  // FLEVEL = 1
-  stbiw__zlib_add(1, 1);     // BFINAL = 1
-  stbiw__zlib_add(1, 2);     // BTYPE = 1 -- fixed huffman
-
-  for (i = 0; i < stbiw__ZHASH; ++i) hash_table[i] = NULL;
-
-  i = 0;
-  while (i < data_len - 3) {
-    // hash next 3 bytes of data to be compressed
-    int h = stbiw__zhash(data + i) & (stbiw__ZHASH - 1), best = 3;
-    unsigned char *bestloc = 0;
-    unsigned char **hlist = hash_table[h];
-    int n = stbiw__sbcount(hlist);
-    for (j = 0; j < n; ++j) {
-      if (hlist[j] - data > i - 32768) {  // if entry lies within window
-        int d = stbiw__zlib_countm(hlist[j], data + i, data_len - i);
-        if (d >= best) best = d, bestloc = hlist[j];
-      }
+static unsigned int stbiw__zhash(const unsigned char *data) {
+  stbiw_uint32 v = data[0] | (data[1] << 8) | (data[2] << 16);
+  return (v * 2654435761u) >> (32 - stbiw__ZHASH_BITS);
+}
+
+// distances up to 256 are looked up directly, longer ones by (dist-1)>>7
+static int stbiw__zdist_code(const stbiw__zstate *z, int dist) {
+  return dist <= 256 ? z->dcode[dist - 1] : z->dcode[256 + ((dist - 1) >> 7)];
+}
+
+static int stbiw__zreserve(stbiw__zstate *z, int bytes) {
+  if (z->out_len + bytes > z->out_cap) {
+    int cap = z->out_cap * 2 > z->out_len + bytes ? z->out_cap * 2
+                                                   : z->out_len + bytes;
+    unsigned char *p =
+        (unsigned char *)STBIW_REALLOC_SIZED(z->out, z->out_cap, cap);
+    if (!p) return 0;
+    z->out = p;
+    z->out_cap = cap;
+  }
+  return 1;
+}
+
+static void stbiw__zput(stbiw__zstate *z, unsigned int bits, int count) {
+  z->bitbuf |= bits << z->bitcount;
+  z->bitcount += count;
+  while (z->bitcount >= 8) {
+    z->out[z->out_len++] = STBIW_UCHAR(z->bitbuf);
+    z->bitbuf >>= 8;
+    z->bitcount -= 8;
+  }
+}
+
+static void stbiw__zalign(stbiw__zstate *z) {
+  if (z->bitcount) stbiw__zput(z, 0, 8 - z->bitcount);
+}
+
+// Moffat & Katajainen in-place minimum redundancy code construction; 'a'
+// must be sorted by ascending frequency, on return 'key' holds code lengths
+static void stbiw__zhuff_min_redundancy(stbiw__zsymfreq *a, int n) {
+  int root, leaf, next, avbl, used, dpth;
+  a[0].key += a[1].key;
+  root = 0;
+  leaf = 2;
+  for (next = 1; next < n - 1; ++next) {
+    if (leaf >= n || a[root].key < a[leaf].key) {
+      a[next].key = a[root].key;
+      a[root++].key = next;
+    } else
+      a[next].key = a[leaf++].key;
+    if (leaf >= n || (root < next && a[root].key < a[leaf].key)) {
+      a[next].key += a[root].key;
+      a[root++].key = next;
+    } else
+      a[next].key += a[leaf++].key;
+  }
+  a[n - 2].key = 0;
+  for (next = n - 3; next >= 0; --next) a[next].key = a[a[next].key].key + 1;
+  avbl = 1;
+  used = dpth = 0;
+  root = n - 2;
+  next = n - 1;
+  while (avbl > 0) {
+    while (root >= 0 && (int)a[root].key == dpth) {
+      ++used;
+      --root;
     }
-    // when hash table entry is too long, delete half the entries
-    if (hash_table[h] && stbiw__sbn(hash_table[h]) == 2 * quality) {
-      STBIW_MEMMOVE(hash_table[h], hash_table[h] + quality,
-                    sizeof(hash_table[h][0]) * quality);
-      stbiw__sbn(hash_table[h]) = quality;
+    while (avbl > used) {
+      a[next--].key = dpth;
+      --avbl;
     }
-    stbiw__sbpush(hash_table[h], data + i);
-
-    if (bestloc) {
-      // "lazy matching" - check match at *next* byte, and if it's better, do
-      // cur byte as literal
-      h = stbiw__zhash(data + i + 1) & (stbiw__ZHASH - 1);
-      hlist = hash_table[h];
-      n = stbiw__sbcount(hlist);
-      for (j = 0; j < n; ++j) {
-        if (hlist[j] - data > i - 32767) {
-          int e = stbiw__zlib_countm(hlist[j], data + i + 1, data_len - i - 1);
-          if (e > best) {  // if next match is better, bail on current match
-            bestloc = NULL;
-            break;
-          }
-        }
+    avbl = 2 * used;
+    ++dpth;
+    used = 0;
+  }
+}
+
+// stable two-pass radix sort by frequency; block frequencies never exceed
+// stbiw__ZMAX_SYMS + 1 so 16 bits of key are enough
+static stbiw__zsymfreq *stbiw__zsort_syms(stbiw__zsymfreq *a,
+                                          stbiw__zsymfreq *tmp, int n) {
+  unsigned int hist[2][256];
+  int i, pass;
+  memset(hist, 0, sizeof(hist));
+  for (i = 0; i < n; ++i) {
+    ++hist[0][a[i].key & 255];
+    ++hist[1][(a[i].key >> 8) & 255];
+  }
+  for (pass = 0; pass < 2; ++pass) {
+    unsigned int offs[256], total = 0;
+    stbiw__zsymfreq *t;
+    for (i = 0; i < 256; ++i) {
+      offs[i] = total;
+      total += hist[pass][i];
+    }
+    for (i = 0; i < n; ++i) tmp[offs[(a[i].key >> (pass * 8)) & 255]++] = a[i];
+    t = a;
+    a = tmp;
+    tmp = t;
+  }
+  return a;
+}
+
+// builds code lengths of at most max_bits for n symbols; like zlib, at least
+// two codes are always produced so that decoders see a complete code
+static void stbiw__zhuff_lengths(const unsigned int *freq, int n, int max_bits,
+                                 unsigned char *lengths) {
+  stbiw__zsymfreq syms[286], tmp[286], *a;
+  int num_codes[33];
+  int i, j, count = 0;
+  unsigned int total = 0;
+
+  memset(lengths, 0, n);
+  for (i = 0; i < n; ++i) {
+    if (freq[i]) {
+      syms[count].key = freq[i];
+      syms[count++].sym = (unsigned short)i;
+    }
+  }
+  a = stbiw__zsort_syms(syms, tmp, count);
+  if (count < 2) {
+    int s = count ? a[0].sym : 0;
+    lengths[s] = 1;
+    lengths[s ? 0 : 1] = 1;
+    return;
+  }
+
+  stbiw__zhuff_min_redundancy(a, count);
+
+  // limit the code length by moving leaves up the tree until Kraft holds
+  memset(num_codes, 0, sizeof(num_codes));
+  for (i = 0; i < count; ++i) ++num_codes[a[i].key < 32 ? a[i].key : 32];
+  for (i = max_bits + 1; i <= 32; ++i) num_codes[max_bits] += num_codes[i];
+  for (i = max_bits; i > 0; --i)
+    total += ((unsigned int)num_codes[i]) << (max_bits - i);
+  while (total != (1u << max_bits)) {
+    --num_codes[max_bits];
+    for (i = max_bits - 1; i > 0; --i) {
+      if (num_codes[i]) {
+        --num_codes[i];
+        num_codes[i + 1] += 2;
+        break;
       }
     }
+    --total;
+  }
+
+  // least frequent symbols get the longest codes
+  for (j = 0, i = max_bits; i > 0; --i) {
+    int k;
+    for (k = num_codes[i]; k > 0; --k) lengths[a[j++].sym] = (unsigned char)i;
+  }
+}
+
+// canonical codes, bit-reversed for LSB-first output
+static void stbiw__zhuff_codes(const unsigned char *lengths, int n,
+                               unsigned short *codes) {
+  int bl_count[16], next_code[16];
+  int i, code = 0;
+  memset(bl_count, 0, sizeof(bl_count));
+  for (i = 0; i < n; ++i) ++bl_count[lengths[i]];
+  bl_count[0] = 0;
+  for (i = 1; i < 16; ++i) {
+    code = (code + bl_count[i - 1]) << 1;
+    next_code[i] = code;
+  }
+  for (i = 0; i < n; ++i)
+    if (lengths[i])
+      codes[i] = (unsigned short)stbiw__zlib_bitrev(next_code[lengths[i]]++,
+                                                    lengths[i]);
+}
+
+static void stbiw__zfixed_lengths(unsigned char *llen, unsigned char *dlen) {
+  int i;
+  for (i = 0; i < 288; ++i)
+    llen[i] = i <= 143 ? 8 : i <= 255 ? 9 : i <= 279 ? 7 : 8;
+  for (i = 0; i < 30; ++i) dlen[i] = 5;
+}
+
+static void stbiw__zwrite_stored(stbiw__zstate *z, const unsigned char *data,
+                                 int start, int end, int final) {
+  int pos = start;
+  do {
+    int len = end - pos > 65535 ? 65535 : end - pos;
+    stbiw__zput(z, final && pos + len == end, 1);
+    stbiw__zput(z, 0, 2);
+    stbiw__zalign(z);
+    z->out[z->out_len++] = STBIW_UCHAR(len);
+    z->out[z->out_len++] = STBIW_UCHAR(len >> 8);
+    z->out[z->out_len++] = STBIW_UCHAR(~len);
+    z->out[z->out_len++] = STBIW_UCHAR(~len >> 8);
+    memcpy(z->out + z->out_len, data + pos, len);
+    z->out_len += len;
+    pos += len;
+  } while (pos < end);
+}
+
+static void stbiw__zwrite_symbols(stbiw__zstate *z, const unsigned char *llen,
+                                  const unsigned short *lcodes,
+                                  const unsigned char *dlen,
+                                  const unsigned short *dcodes) {
+  int i;
+  for (i = 0; i < z->sym_count; ++i) {
+    int len = z->sym_len[i], dist = z->sym_dist[i];
+    if (!dist) {
+      stbiw__zput(z, lcodes[len], llen[len]);
+    } else {
+      int c = z->lcode[len];
+      stbiw__zput(z, lcodes[257 + c], llen[257 + c]);
+      if (stbiw__zlengtheb[c])
+        stbiw__zput(z, len - stbiw__zlengthc[c], stbiw__zlengtheb[c]);
+      c = stbiw__zdist_code(z, dist);
+      stbiw__zput(z, dcodes[c], dlen[c]);
+      if (stbiw__zdisteb[c])
+        stbiw__zput(z, dist - stbiw__zdistc[c], stbiw__zdisteb[c]);
+    }
+  }
+  stbiw__zput(z, lcodes[256], llen[256]);
+}
 
-    if (bestloc) {
-      int d = (int)(data + i - bestloc);  // distance back
-      STBIW_ASSERT(d <= 32767 && best <= 258);
-      for (j = 0; best > lengthc[j + 1] - 1; ++j)
-        ;
-      stbiw__zlib_huff(j + 257);
-      if (lengtheb[j]) stbiw__zlib_add(best - lengthc[j], lengtheb[j]);
-      for (j = 0; d > distc[j + 1] - 1; ++j)
-        ;
-      stbiw__zlib_add(stbiw__zlib_bitrev(j, 5), 5);
-      if (disteb[j]) stbiw__zlib_add(d - distc[j], disteb[j]);
-      i += best;
+// emits the pending symbols as one block, picking the cheapest encoding
+static int stbiw__zflush_block(stbiw__zstate *z, const unsigned char *data,
+                               int final) {
+  unsigned char llen[288], dlen[30], fllen[288], fdlen[30], cllen[19];
+  unsigned short lcodes[288], dcodes[30], clcodes[19];
+  unsigned char lens[286 + 30], rle_sym[286 + 30], rle_extra[286 + 30];
+  unsigned int clfreq[19];
+  int i, hlit, hdist, hclen, nrle = 0, stored_len, nstored;
+  unsigned int extra = 0, dyn_bits, fixed_bits, stored_bits;
+
+  z->lfreq[256] = 1;
+  stbiw__zhuff_lengths(z->lfreq, 286, 15, llen);
+  stbiw__zhuff_lengths(z->dfreq, 30, 15, dlen);
+  for (hlit = 286; hlit > 257 && !llen[hlit - 1]; --hlit)
+    ;
+  for (hdist = 30; hdist > 1 && !dlen[hdist - 1]; --hdist)
+    ;
+
+  // run-length encode the code lengths with symbols 16, 17 and 18
+  memcpy(lens, llen, hlit);
+  memcpy(lens + hlit, dlen, hdist);
+  memset(clfreq, 0, sizeof(clfreq));
+  for (i = 0; i < hlit + hdist;) {
+    int v = lens[i], run = 1;
+    while (i + run < hlit + hdist && lens[i + run] == v) ++run;
+    if (v == 0 && run >= 3) {
+      int r = run > 138 ? 138 : run;
+      rle_sym[nrle] = r <= 10 ? 17 : 18;
+      rle_extra[nrle++] = (unsigned char)(r <= 10 ? r - 3 : r - 11);
+      i += r;
+    } else if (v != 0 && run >= 4) {
+      int r = run - 1 > 6 ? 6 : run - 1;
+      rle_sym[nrle] = (unsigned char)v;
+      rle_extra[nrle++] = 0;
+      rle_sym[nrle] = 16;
+      rle_extra[nrle++] = (unsigned char)(r - 3);
+      i += r + 1;
     } else {
-      stbiw__zlib_huffb(data[i]);
+      rle_sym[nrle] = (unsigned char)v;
+      rle_extra[nrle++] = 0;
       ++i;
     }
   }
-  // write out final bytes
-  for (; i < data_len; ++i) stbiw__zlib_huffb(data[i]);
-  stbiw__zlib_huff(256);  // end of block
-  // pad with 0 bits to byte boundary
-  while (bitcount) stbiw__zlib_add(0, 1);
-
-  for (i = 0; i < stbiw__ZHASH; ++i) (void)stbiw__sbfree(hash_table[i]);
-  STBIW_FREE(hash_table);
-
-  {
-    // compute adler32 on input
-    unsigned int s1 = 1, s2 = 0;
-    int blocklen = (int)(data_len % 5552);
-    j = 0;
-    while (j < data_len) {
-      for (i = 0; i < blocklen; ++i) s1 += data[j + i], s2 += s1;
-      s1 %= 65521, s2 %= 65521;
-      j += blocklen;
-      blocklen = 5552;
+  for (i = 0; i < nrle; ++i) ++clfreq[rle_sym[i]];
+  stbiw__zhuff_lengths(clfreq, 19, 7, cllen);
+  for (hclen = 19; hclen > 4 && !cllen[stbiw__zclorder[hclen - 1]]; --hclen)
+    ;
+
+  // block sizes in bits for each encoding
+  stbiw__zfixed_lengths(fllen, fdlen);
+  for (i = 0; i < 29; ++i) extra += z->lfreq[257 + i] * stbiw__zlengtheb[i];
+  for (i = 0; i < 30; ++i) extra += z->dfreq[i] * stbiw__zdisteb[i];
+  dyn_bits = 3 + 14 + hclen * 3 + extra;
+  fixed_bits = 3 + extra;
+  for (i = 0; i < 19; ++i) dyn_bits += clfreq[i] * cllen[i];
+  dyn_bits += clfreq[16] * 2 + clfreq[17] * 3 + clfreq[18] * 7;
+  for (i = 0; i < 286; ++i) {
+    dyn_bits += z->lfreq[i] * llen[i];
+    fixed_bits += z->lfreq[i] * fllen[i];
+  }
+  for (i = 0; i < 30; ++i) {
+    dyn_bits += z->dfreq[i] * dlen[i];
+    fixed_bits += z->dfreq[i] * fdlen[i];
+  }
+  stored_len = z->in_pos - z->block_start;
+  nstored = stored_len ? (stored_len + 65534) / 65535 : 1;
+  stored_bits = nstored * (3 + 7 + 32) + stored_len * 8;
+
+  if (!stbiw__zreserve(z, (int)(stored_bits >> 3) + 16)) return 0;
+  if (stored_bits <= dyn_bits && stored_bits <= fixed_bits) {
+    stbiw__zwrite_stored(z, data, z->block_start, z->in_pos, final);
+  } else if (fixed_bits <= dyn_bits) {
+    stbiw__zput(z, final, 1);
+    stbiw__zput(z, 1, 2);
+    stbiw__zhuff_codes(fllen, 288, lcodes);
+    stbiw__zhuff_codes(fdlen, 30, dcodes);
+    stbiw__zwrite_symbols(z, fllen, lcodes, fdlen, dcodes);
+  } else {
+    stbiw__zput(z, final, 1);
+    stbiw__zput(z, 2, 2);
+    stbiw__zput(z, hlit - 257, 5);
+    stbiw__zput(z, hdist - 1, 5);
+    stbiw__zput(z, hclen - 4, 4);
+    for (i = 0; i < hclen; ++i) stbiw__zput(z, cllen[stbiw__zclorder[i]], 3);
+    stbiw__zhuff_codes(cllen, 19, clcodes);
+    for (i = 0; i < nrle; ++i) {
+      int s = rle_sym[i];
+      stbiw__zput(z, clcodes[s], cllen[s]);
+      if (s >= 16) stbiw__zput(z, rle_extra[i], s == 16 ? 2 : s == 17 ? 3 : 7);
     }
-    stbiw__sbpush(out, STBIW_UCHAR(s2 >> 8));
-    stbiw__sbpush(out, STBIW_UCHAR(s2));
-    stbiw__sbpush(out, STBIW_UCHAR(s1 >> 8));
-    stbiw__sbpush(out, STBIW_UCHAR(s1));
-  }
-  *out_len = stbiw__sbn(out);
-  // make returned pointer freeable
-  STBIW_MEMMOVE(stbiw__sbraw(out), out, *out_len);
-  return (unsigned char *)stbiw__sbraw(out);
-}
-
-static unsigned int stbiw__crc32(unsigned char *buffer, int len) {
-  static unsigned int crc_table[256] = {
-      0x00000000, 0x77073096, 0xEE0E612C, 0x990951BA, 0x076DC419, 0x706AF48F,
-      0xE963A535, 0x9E6495A3, 0x0eDB8832, 0x79DCB8A4, 0xE0D5E91E, 0x97D2D988,
-      0x09B64C2B, 0x7EB17CBD, 0xE7B82D07, 0x90BF1D91, 0x1DB71064, 0x6AB020F2,
-      0xF3B97148, 0x84BE41DE, 0x1ADAD47D, 0x6DDDE4EB, 0xF4D4B551, 0x83D385C7,
-      0x136C9856, 0x646BA8C0, 0xFD62F97A, 0x8A65C9EC, 0x14015C4F, 0x63066CD9,
-      0xFA0F3D63, 0x8D080DF5, 0x3B6E20C8, 0x4C69105E, 0xD56041E4, 0xA2677172,
-      0x3C03E4D1, 0x4B04D447, 0xD20D85FD, 0xA50AB56B, 0x35B5A8FA, 0x42B2986C,
-      0xDBBBC9D6, 0xACBCF940, 0x32D86CE3, 0x45DF5C75, 0xDCD60DCF, 0xABD13D59,
-      0x26D930AC, 0x51DE003A, 0xC8D75180, 0xBFD06116, 0x21B4F4B5, 0x56B3C423,
-      0xCFBA9599, 0xB8BDA50F, 0x2802B89E, 0x5F058808, 0xC60CD9B2, 0xB10BE924,
-      0x2F6F7C87, 0x58684C11, 0xC1611DAB, 0xB6662D3D, 0x76DC4190, 0x01DB7106,
-      0x98D220BC, 0xEFD5102A, 0x71B18589, 0x06B6B51F, 0x9FBFE4A5, 0xE8B8D433,
-      0x7807C9A2, 0x0F00F934, 0x9609A88E, 0xE10E9818, 0x7F6A0DBB, 0x086D3D2D,
-      0x91646C97, 0xE6635C01, 0x6B6B51F4, 0x1C6C6162, 0x856530D8, 0xF262004E,
-      0x6C0695ED, 0x1B01A57B, 0x8208F4C1, 0xF50FC457, 0x65B0D9C6, 0x12B7E950,
-      0x8BBEB8EA, 0xFCB9887C, 0x62DD1DDF, 0x15DA2D49, 0x8CD37CF3, 0xFBD44C65,
-      0x4DB26158, 0x3AB551CE, 0xA3BC0074, 0xD4BB30E2, 0x4ADFA541, 0x3DD895D7,
-      0xA4D1C46D, 0xD3D6F4FB, 0x4369E96A, 0x346ED9FC, 0xAD678846, 0xDA60B8D0,
-      0x44042D73, 0x33031DE5, 0xAA0A4C5F, 0xDD0D7CC9, 0x5005713C, 0x270241AA,
-      0xBE0B1010, 0xC90C2086, 0x5768B525, 0x206F85B3, 0xB966D409, 0xCE61E49F,
-      0x5EDEF90E, 0x29D9C998, 0xB0D09822, 0xC7D7A8B4, 0x59B33D17, 0x2EB40D81,
-      0xB7BD5C3B, 0xC0BA6CAD, 0xEDB88320, 0x9ABFB3B6, 0x03B6E20C, 0x74B1D29A,
-      0xEAD54739, 0x9DD277AF, 0x04DB2615, 0x73DC1683, 0xE3630B12, 0x94643B84,
-      0x0D6D6A3E, 0x7A6A5AA8, 0xE40ECF0B, 0x9309FF9D, 0x0A00AE27, 0x7D079EB1,
-      0xF00F9344, 0x8708A3D2, 0x1E01F268, 0x6906C2FE, 0xF762575D, 0x806567CB,
-      0x196C3671, 0x6E6B06E7, 0xFED41B76, 0x89D32BE0, 0x10DA7A5A, 0x67DD4ACC,
-      0xF9B9DF6F, 0x8EBEEFF9, 0x17B7BE43, 0x60B08ED5, 0xD6D6A3E8, 0xA1D1937E,
-      0x38D8C2C4, 0x4FDFF252, 0xD1BB67F1, 0xA6BC5767, 0x3FB506DD, 0x48B2364B,
-      0xD80D2BDA, 0xAF0A1B4C, 0x36034AF6, 0x41047A60, 0xDF60EFC3, 0xA867DF55,
-      0x316E8EEF, 0x4669BE79, 0xCB61B38C, 0xBC66831A, 0x256FD2A0, 0x5268E236,
-      0xCC0C7795, 0xBB0B4703, 0x220216B9, 0x5505262F, 0xC5BA3BBE, 0xB2BD0B28,
-      0x2BB45A92, 0x5CB36A04, 0xC2D7FFA7, 0xB5D0CF31, 0x2CD99E8B, 0x5BDEAE1D,
-      0x9B64C2B0, 0xEC63F226, 0x756AA39C, 0x026D930A, 0x9C0906A9, 0xEB0E363F,
-      0x72076785, 0x05005713, 0x95BF4A82, 0xE2B87A14, 0x7BB12BAE, 0x0CB61B38,
-      0x92D28E9B, 0xE5D5BE0D, 0x7CDCEFB7, 0x0BDBDF21, 0x86D3D2D4, 0xF1D4E242,
-      0x68DDB3F8, 0x1FDA836E, 0x81BE16CD, 0xF6B9265B, 0x6FB077E1, 0x18B74777,
-      0x88085AE6, 0xFF0F6A70, 0x66063BCA, 0x11010B5C, 0x8F659EFF, 0xF862AE69,
-      0x616BFFD3, 0x166CCF45, 0xA00AE278, 0xD70DD2EE, 0x4E048354, 0x3903B3C2,
-      0xA7672661, 0xD06016F7, 0x4969474D, 0x3E6E77DB, 0xAED16A4A, 0xD9D65ADC,
-      0x40DF0B66, 0x37D83BF0, 0xA9BCAE53, 0xDEBB9EC5, 0x47B2CF7F, 0x30B5FFE9,
-      0xBDBDF21C, 0xCABAC28A, 0x53B39330, 0x24B4A3A6, 0xBAD03605, 0xCDD70693,
-      0x54DE5729, 0x23D967BF, 0xB3667A2E, 0xC4614AB8, 0x5D681B02, 0x2A6F2B94,
-      0xB40BBE37, 0xC30C8EA1, 0x5A05DF1B, 0x2D02EF8D};
-
-  unsigned int crc = ~0u;
-  int i;
-  for (i = 0; i < len; ++i)
-    crc = (crc >> 8) ^ crc_table[buffer[i] ^ (crc & 0xff)];
-  return ~crc;
+    stbiw__zhuff_codes(llen, 286, lcodes);
+    stbiw__zhuff_codes(dlen, 30, dcodes);
+    stbiw__zwrite_symbols(z, llen, lcodes, dlen, dcodes);
+  }
+
+  z->sym_count = 0;
+  z->block_start = z->in_pos;
+  memset(z->lfreq, 0, sizeof(z->lfreq));
+  memset(z->dfreq, 0, sizeof(z->dfreq));
+  return 1;
+}
+
+static void stbiw__zliteral(stbiw__zstate *z, int c) {
+  z->sym_len[z->sym_count] = (unsigned short)c;
+  z->sym_dist[z->sym_count++] = 0;
+  ++z->lfreq[c];
+  ++z->in_pos;
+}
+
+static void stbiw__zmatch(stbiw__zstate *z, int len, int dist) {
+  z->sym_len[z->sym_count] = (unsigned short)len;
+  z->sym_dist[z->sym_count++] = (unsigned short)dist;
+  ++z->lfreq[257 + z->lcode[len]];
+  ++z->dfreq[stbiw__zdist_code(z, dist)];
+  z->in_pos += len;
+}
+
+static int stbiw__zinsert(stbiw__zstate *z, const unsigned char *data,
+                          int pos) {
+  unsigned int h = stbiw__zhash(data + pos);
+  int cand = z->head[h];
+  z->prev[pos & stbiw__ZWMASK] = cand;
+  z->head[h] = pos;
+  return cand;
+}
+
+// longest match at 'pos' along the chain starting at 'cand'; returns the
+// length if it beats 'best_len', 0 otherwise
+static int stbiw__zlongest(const stbiw__zstate *z, const unsigned char *data,
+                           int pos, int end, int cand, int chain, int nice,
+                           int best_len, int *best_dist) {
+  const unsigned char *scan = data + pos;
+  int limit = end - pos < stbiw__ZMAX_MATCH ? end - pos : stbiw__ZMAX_MATCH;
+  int min_pos = pos > stbiw__ZWINDOW ? pos - stbiw__ZWINDOW : 0;
+  int found = 0;
+  if (nice > limit) nice = limit;
+  if (best_len >= limit) return 0;
+  while (cand >= min_pos && chain-- > 0) {
+    const unsigned char *m = data + cand;
+    if (m[best_len] == scan[best_len] && m[0] == scan[0] && m[1] == scan[1]) {
+      int len = stbiw__zlib_countm(m, scan, limit);
+      if (len > best_len) {
+        best_len = found = len;
+        *best_dist = pos - cand;
+        if (len >= nice) break;
+      }
+    }
+    if (z->prev[cand & stbiw__ZWMASK] >= cand) break;
+    cand = z->prev[cand & stbiw__ZWMASK];
+  }
+  return found;
 }
 
+// levels 1-3: take the first acceptable match, only index short matches.
+// Level 1 also probes less often the longer it goes without a match, so
+// incompressible stretches cost little more than a copy.
+static int stbiw__zdeflate_fast(stbiw__zstate *z, const unsigned char *data,
+                                int end, int final) {
+  const stbiw__zconfig *cfg = &stbiw__zconfigs[z->level];
+  int pos = z->in_pos, misses = 0;
+  while (pos < end) {
+    int len = 0, dist = 0;
+    if (pos + stbiw__ZMIN_MATCH <= end) {
+      int cand = stbiw__zinsert(z, data, pos);
+      if (cand >= 0)
+        len = stbiw__zlongest(z, data, pos, end, cand, cfg->max_chain,
+                              cfg->nice_length, stbiw__ZMIN_MATCH - 1, &dist);
+      if (len == stbiw__ZMIN_MATCH && dist > stbiw__ZTOO_FAR) len = 0;
+    }
+    if (len) {
+      stbiw__zmatch(z, len, dist);
+      if (len <= cfg->max_lazy) {
+        int stop = pos + len;
+        for (++pos; pos < stop; ++pos)
+          if (pos + stbiw__ZMIN_MATCH <= end) stbiw__zinsert(z, data, pos);
+      }
+      pos = z->in_pos;
+      misses = 0;
+    } else if (z->level == 1 && misses >= 32) {
+      int step = misses >> 5, room = stbiw__ZMAX_SYMS - z->sym_count;
+      if (step > room) step = room;
+      if (step > end - pos) step = end - pos;
+      while (step--) stbiw__zliteral(z, data[pos++]);
+      ++misses;
+    } else {
+      stbiw__zliteral(z, data[pos++]);
+      ++misses;
+    }
+    if (z->sym_count == stbiw__ZMAX_SYMS && !stbiw__zflush_block(z, data, 0))
+      return 0;
+  }
+  return stbiw__zflush_block(z, data, final);
+}
+
+// levels 4-9: defer each match by one byte in case the next one is longer
+static int stbiw__zdeflate_lazy(stbiw__zstate *z, const unsigned char *data,
+                                int end, int final) {
+  const stbiw__zconfig *cfg = &stbiw__zconfigs[z->level];
+  int pos = z->in_pos, prev_len = 0, prev_dist = 0, pending = 0;
+  while (pos < end) {
+    int len = 0, dist = 0, cand = -1;
+    if (pos + stbiw__ZMIN_MATCH <= end) cand = stbiw__zinsert(z, data, pos);
+    if (cand >= 0 && prev_len < cfg->max_lazy) {
+      int chain = prev_len >= cfg->good_length ? cfg->max_chain >> 2
+                                                : cfg->max_chain;
+      len = stbiw__zlongest(
+          z, data, pos, end, cand, chain, cfg->nice_length,
+          prev_len > stbiw__ZMIN_MATCH - 1 ? prev_len : stbiw__ZMIN_MATCH - 1,
+          &dist);
+      if (len == stbiw__ZMIN_MATCH && dist > stbiw__ZTOO_FAR) len = 0;
+    }
+    if (prev_len >= stbiw__ZMIN_MATCH && len <= prev_len) {
+      int stop = pos - 1 + prev_len;
+      stbiw__zmatch(z, prev_len, prev_dist);
+      for (++pos; pos < stop; ++pos)
+        if (pos + stbiw__ZMIN_MATCH <= end) stbiw__zinsert(z, data, pos);
+      pending = 0;
+      prev_len = 0;
+    } else {
+      if (pending) stbiw__zliteral(z, data[pos - 1]);
+      pending = 1;
+      prev_len = len;
+      prev_dist = dist;
+      ++pos;
+    }
+    if (z->sym_count == stbiw__ZMAX_SYMS && !stbiw__zflush_block(z, data, 0))
+      return 0;
+  }
+  if (pending) stbiw__zliteral(z, data[pos - 1]);
+  return stbiw__zflush_block(z, data, final);
+}
+
+static void stbiw__zfree(stbiw__zstate *z) {
+  STBIW_FREE(z->head);
+  STBIW_FREE(z->prev);
+  STBIW_FREE(z->sym_len);
+  STBIW_FREE(z->sym_dist);
+}
+
+static int stbiw__zinit(stbiw__zstate *z, int level, int out_cap) {
+  int i, j;
+  memset(z, 0, sizeof(*z));
+  z->level = level < 0 ? 0 : level > 9 ? 9 : level;
+  z->out_cap = out_cap;
+  z->out = (unsigned char *)STBIW_MALLOC(out_cap);
+  if (z->level) {
+    z->head = (int *)STBIW_MALLOC(stbiw__ZHASH_SIZE * sizeof(int));
+    z->prev = (int *)STBIW_MALLOC(stbiw__ZWINDOW * sizeof(int));
+    z->sym_len = (unsigned short *)STBIW_MALLOC(stbiw__ZMAX_SYMS *
+                                                sizeof(unsigned short));
+    z->sym_dist = (unsigned short *)STBIW_MALLOC(stbiw__ZMAX_SYMS *
+                                                 sizeof(unsigned short));
+    if (!z->out || !z->head || !z->prev || !z->sym_len || !z->sym_dist) {
+      stbiw__zfree(z);
+      STBIW_FREE(z->out);
+      return 0;
+    }
+    memset(z->head, 0xff, stbiw__ZHASH_SIZE * sizeof(int));
+    for (i = 0; i < 29; ++i)
+      for (j = stbiw__zlengthc[i]; j < stbiw__zlengthc[i + 1] && j <= 258; ++j)
+        z->lcode[j] = (unsigned char)i;
+    for (i = 0; i < 30; ++i)
+      for (j = stbiw__zdistc[i]; j < stbiw__zdistc[i + 1]; ++j)
+        z->dcode[j <= 256 ? j - 1 : 256 + ((j - 1) >> 7)] = (unsigned char)i;
+  }
+  return z->out != NULL;
+}
+
+// compresses data[start,end) as raw deflate blocks; bytes from 'dict_start'
+// onwards are visible to the matcher as history
+static int stbiw__zdeflate(stbiw__zstate *z, const unsigned char *data,
+                           int dict_start, int start, int end, int final) {
+  int pos;
+  if (z->level == 0) {
+    int len = end - start;
+    if (!stbiw__zreserve(z, len + 5 * (len / 65535 + 1) + 1)) return 0;
+    stbiw__zwrite_stored(z, data, start, end, final);
+    return 1;
+  }
+  for (pos = dict_start; pos < start; ++pos)
+    if (pos + stbiw__ZMIN_MATCH <= end) stbiw__zinsert(z, data, pos);
+  z->block_start = z->in_pos = start;
+  if (!(z->level <= 3 ? stbiw__zdeflate_fast(z, data, end, final)
+                      : stbiw__zdeflate_lazy(z, data, end, final)))
+    return 0;
+  if (final) stbiw__zalign(z);
+  return 1;
+}
+
+static unsigned int stbiw__adler32(unsigned int adler,
+                                   const unsigned char *data, int data_len) {
+  unsigned int s1 = adler & 0xffff, s2 = adler >> 16;
+  int i, j = 0, blocklen = (int)(data_len % 5552);
+  while (j < data_len) {
+    for (i = 0; i < blocklen; ++i) s1 += data[j + i], s2 += s1;
+    s1 %= 65521, s2 %= 65521;
+    j += blocklen;
+    blocklen = 5552;
+  }
+  return (s2 << 16) | s1;
+}
+
+static void stbiw__zlib_header(unsigned char *out, int level) {
+  int flevel = level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3;
+  out[0] = 0x78;  // DEFLATE 32K window
+  out[1] =        // FLEVEL, FCHECK
+      STBIW_UCHAR((flevel << 6) + 31 - ((0x78 << 8) + (flevel << 6)) % 31);
+}
+
+// 'quality' is the zlib compression level, 0 (store) to 9 (smallest)
+STBIWDEF unsigned char *stbi_zlib_compress(unsigned char *data, int data_len,
+                                           int *out_len, int quality) {
+  stbiw__zstate z;
+  unsigned int adler;
+
+  // worst case is all stored blocks; the rest covers headers and padding
+  if (!stbiw__zinit(&z, quality, data_len + (data_len >> 11) + 64)) return 0;
+  stbiw__zlib_header(z.out, z.level);
+  z.out_len = 2;
+  if (!stbiw__zdeflate(&z, data, 0, 0, data_len, 1) ||
+      !stbiw__zreserve(&z, 4)) {
+    stbiw__zfree(&z);
+    STBIW_FREE(z.out);
+    return 0;
+  }
+  stbiw__zfree(&z);
+
+  adler = stbiw__adler32(1, data, data_len);
+  z.out[z.out_len++] = STBIW_UCHAR(adler >> 24);
+  z.out[z.out_len++] = STBIW_UCHAR(adler >> 16);
+  z.out[z.out_len++] = STBIW_UCHAR(adler >> 8);
+  z.out[z.out_len++] = STBIW_UCHAR(adler);
+  *out_len = z.out_len;
+  return z.out;
+}
+
+// Large inputs are compressed pigz-style: the data is cut into fixed-size
+// chunks, each chunk is deflated independently with the 32K of data before
+// it as its dictionary and ends in a sync flush, and the byte-aligned results
+// are concatenated into one zlib stream. The output only depends on the chunk
+// size, not on how many threads did the work.
+#define stbiw__ZCHUNK (256 * 1024)
+
+// chunks cover data[start,end); up to 32K before 'start' is history. The
+// last chunk only ends the zlib stream if 'final' is set.
+typedef struct {
+  const unsigned char *data;
+  int start, end, level, final;
+  unsigned char **out;
+  int *out_len;
+  unsigned int *adler, *crc;
+} stbiw__zchunk_job;
+
+static void stbiw__zchunk_task(void *context, int index) {
+  stbiw__zchunk_job *job = (stbiw__zchunk_job *)context;
+  int start = job->start + index * stbiw__ZCHUNK;
+  int end =
+      job->end - start > stbiw__ZCHUNK ? start + stbiw__ZCHUNK : job->end;
+  int dict_start = start > stbiw__ZWINDOW ? start - stbiw__ZWINDOW : 0;
+  int final = job->final && end == job->end;
+  stbiw__zstate z;
+
+  job->out[index] = NULL;
+  if (!stbiw__zinit(&z, job->level, (end - start) + ((end - start) >> 11) + 64))
+    return;
+  if (!stbiw__zdeflate(&z, job->data, dict_start, start, end, final) ||
+      !stbiw__zreserve(&z, 6)) {
+    stbiw__zfree(&z);
+    STBIW_FREE(z.out);
+    return;
+  }
+  if (!final) {
+    // sync flush: an empty stored block brings the chunk to a byte boundary
+    stbiw__zput(&z, 0, 3);
+    stbiw__zalign(&z);
+    z.out[z.out_len++] = 0x00;
+    z.out[z.out_len++] = 0x00;
+    z.out[z.out_len++] = 0xff;
+    z.out[z.out_len++] = 0xff;
+  }
+  stbiw__zfree(&z);
+  job->out[index] = z.out;
+  job->out_len[index] = z.out_len;
+  job->adler[index] = stbiw__adler32(1, job->data + start, end - start);
+  job->crc[index] = stbi_crc32(0, z.out, z.out_len);
+}
+
+// adler32 of the concatenation, from the adler32s of both parts
+static unsigned int stbiw__adler32_combine(unsigned int adler1,
+                                           unsigned int adler2, int len2) {
+  unsigned int rem = (unsigned int)len2 % 65521;
+  unsigned int s1 = adler1 & 0xffff, s2 = (rem * s1) % 65521;
+  unsigned int sum1 = s1 + (adler2 & 0xffff) + 65521 - 1;
+  unsigned int sum2 = (adler1 >> 16) + (adler2 >> 16) + s2 + 65521 - rem;
+  if (sum1 >= 65521) sum1 -= 65521;
+  if (sum1 >= 65521) sum1 -= 65521;
+  if (sum2 >= 65521 * 2) sum2 -= 65521 * 2;
+  if (sum2 >= 65521) sum2 -= 65521;
+  return (sum2 << 16) | sum1;
+}
+
+#ifndef STBIW_ZLIB_COMPRESS
+
+// also returns the CRC-32 of the zlib stream, which the workers compute on
+// their chunks while the data is still in cache
+static unsigned char *stbiw__zlib_compress_chunked(unsigned char *data,
+                                                   int data_len, int *out_len,
+                                                   int quality,
+                                                   int thread_count,
+                                                   unsigned int *out_crc) {
+  stbiw__zchunk_job job;
+  int i, chunks = (data_len + stbiw__ZCHUNK - 1) / stbiw__ZCHUNK, total = 6;
+  unsigned int adler = 1, crc;
+  unsigned char *out = NULL, *o;
+  void *mem;
+
+  if (chunks <= 1) {
+    out = stbi_zlib_compress(data, data_len, out_len, quality);
+    if (out) *out_crc = stbi_crc32(0, out, *out_len);
+    return out;
+  }
+  mem = STBIW_MALLOC(chunks * (sizeof(unsigned char *) + sizeof(int) * 3));
+  if (!mem) return 0;
+  job.data = data;
+  job.start = 0;
+  job.end = data_len;
+  job.level = quality;
+  job.final = 1;
+  job.out = (unsigned char **)mem;
+  job.out_len = (int *)(job.out + chunks);
+  job.adler = (unsigned int *)(job.out_len + chunks);
+  job.crc = job.adler + chunks;
+  for (i = 0; i < chunks; ++i) job.out[i] = NULL;
+  stbiw__parallel_for(chunks, thread_count, stbiw__zchunk_task, &job);
+
+  for (i = 0; i < chunks; ++i) {
+    if (!job.out[i]) break;
+    total += job.out_len[i];
+  }
+  if (i == chunks) out = (unsigned char *)STBIW_MALLOC(total);
+  if (out) {
+    stbiw__zlib_header(out, quality);
+    crc = stbi_crc32(0, out, 2);
+    o = out + 2;
+    for (i = 0; i < chunks; ++i) {
+      int len = i + 1 < chunks ? stbiw__ZCHUNK : data_len - i * stbiw__ZCHUNK;
+      memcpy(o, job.out[i], job.out_len[i]);
+      o += job.out_len[i];
+      adler = stbiw__adler32_combine(adler, job.adler[i], len);
+      crc = stbi_crc32_combine(crc, job.crc[i], job.out_len[i]);
+    }
+    *o++ = STBIW_UCHAR(adler >> 24);
+    *o++ = STBIW_UCHAR(adler >> 16);
+    *o++ = STBIW_UCHAR(adler >> 8);
+    *o++ = STBIW_UCHAR(adler);
+    *out_crc = stbi_crc32(crc, o - 4, 4);
+    *out_len = total;
+  }
+  for (i = 0; i < chunks; ++i)
+    if (job.out[i]) STBIW_FREE(job.out[i]);
+  STBIW_FREE(mem);
+  return out;
+}
+
+#endif  // STBIW_ZLIB_COMPRESS
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// PNG writer
+//
+
 #define stbiw__wpng4(o, a, b, c, d)                                           \
   ((o)[0] = STBIW_UCHAR(a), (o)[1] = STBIW_UCHAR(b), (o)[2] = STBIW_UCHAR(c), \
    (o)[3] = STBIW_UCHAR(d), (o) += 4)
@@ -943,7 +2113,7 @@ static unsigned int stbiw__crc32(unsigned char *buffer, int len) {
 #define stbiw__wptag(data, s) stbiw__wpng4(data, s[0], s[1], s[2], s[3])
 
 static void stbiw__wpcrc(unsigned char **data, int len) {
-  unsigned int crc = stbiw__crc32(*data - len - 4, len + 4);
+  unsigned int crc = stbi_crc32(0, *data - len - 4, len + 4);
   stbiw__wp32(*data, crc);
 }
 
@@ -954,109 +2124,131 @@ static unsigned char stbiw__paeth(int a, int b, int c) {
   return STBIW_UCHAR(c);
 }
 
-// @OPTIMIZE: provide an option that always forces left-predict or paeth predict
+// applies PNG filter 'type' to one scanline of 'len' bytes; for the first
+// row 'up' points at a row of zeros
+static void stbiw__png_filter_row(const unsigned char *z,
+                                  const unsigned char *up, int n, int len,
+                                  int type, unsigned char *out) {
+  int i;
+  switch (type) {
+    case 0:
+      memcpy(out, z, len);
+      break;
+    case 1:
+      memcpy(out, z, n);
+      for (i = n; i < len; ++i) out[i] = STBIW_UCHAR(z[i] - z[i - n]);
+      break;
+    case 2:
+      for (i = 0; i < len; ++i) out[i] = STBIW_UCHAR(z[i] - up[i]);
+      break;
+    case 3:
+      for (i = 0; i < n; ++i) out[i] = STBIW_UCHAR(z[i] - (up[i] >> 1));
+      for (i = n; i < len; ++i)
+        out[i] = STBIW_UCHAR(z[i] - ((z[i - n] + up[i]) >> 1));
+      break;
+    case 4:
+      for (i = 0; i < n; ++i) out[i] = STBIW_UCHAR(z[i] - up[i]);
+      for (i = n; i < len; ++i)
+        out[i] = STBIW_UCHAR(z[i] - stbiw__paeth(z[i - n], up[i], up[i - n]));
+      break;
+  }
+}
+
+// picks the filter with the smallest sum of absolute (signed) residuals;
+// all five sums are gathered in one pass and only the winner is written
+static void stbiw__png_encode_row(const unsigned char *z,
+                                  const unsigned char *up, int n, int len,
+                                  unsigned char *dst) {
+  int est[5] = {0, 0, 0, 0, 0};
+  int best = 0, i;
+  for (i = 0; i < n; ++i) {
+    est[0] += abs((signed char)z[i]);
+    est[1] += abs((signed char)z[i]);
+    est[2] += abs((signed char)(z[i] - up[i]));
+    est[3] += abs((signed char)(z[i] - (up[i] >> 1)));
+    est[4] += abs((signed char)(z[i] - up[i]));
+  }
+  for (i = n; i < len; ++i) {
+    int x = z[i], a = z[i - n], b = up[i];
+    est[0] += abs((signed char)x);
+    est[1] += abs((signed char)(x - a));
+    est[2] += abs((signed char)(x - b));
+    est[3] += abs((signed char)(x - ((a + b) >> 1)));
+    est[4] += abs((signed char)(x - stbiw__paeth(a, b, up[i - n])));
+  }
+  for (i = 1; i < 5; ++i)
+    if (est[i] < est[best]) best = i;
+  dst[0] = (unsigned char)best;
+  stbiw__png_filter_row(z, up, n, len, best, dst + 1);
+}
+
+#define stbiw__PNG_BAND 16  // rows per filter task
+
+typedef struct {
+  const unsigned char *pixels;
+  const unsigned char *up;  // the row above the first one
+  int stride_bytes, x, y, n;
+  unsigned char *filt;
+} stbiw__png_filter_job;
+
+static void stbiw__png_filter_task(void *context, int band) {
+  stbiw__png_filter_job *job = (stbiw__png_filter_job *)context;
+  int j = band * stbiw__PNG_BAND, len = job->x * job->n;
+  int end = j + stbiw__PNG_BAND < job->y ? j + stbiw__PNG_BAND : job->y;
+  for (; j < end; ++j) {
+    const unsigned char *z = job->pixels + job->stride_bytes * j;
+    stbiw__png_encode_row(z, j ? z - job->stride_bytes : job->up,
+                          job->n, len, job->filt + j * (len + 1));
+  }
+}
+
 unsigned char *stbi_write_png_to_mem(unsigned char *pixels, int stride_bytes,
                                      int x, int y, int n, int *out_len) {
   int ctype[5] = {-1, 0, 4, 2, 6};
   unsigned char sig[8] = {137, 80, 78, 71, 13, 10, 26, 10};
-  unsigned char *out, *o, *filt, *zlib;
-  signed char *line_buffer;
-  int i, j, k, p, zlen;
+  unsigned char *out, *o, *filt, *zlib, *zero_row;
+  stbiw__png_filter_job job;
+  unsigned int zcrc = 0;
+  int zlen;
 
   if (stride_bytes == 0) stride_bytes = x * n;
 
   filt = (unsigned char *)STBIW_MALLOC((x * n + 1) * y);
   if (!filt) return 0;
-  line_buffer = (signed char *)STBIW_MALLOC(x * n);
-  if (!line_buffer) {
+  zero_row = (unsigned char *)STBIW_MALLOC(x * n);
+  if (!zero_row) {
     STBIW_FREE(filt);
     return 0;
   }
-  for (j = 0; j < y; ++j) {
-    static int mapping[] = {0, 1, 2, 3, 4};
-    static int firstmap[] = {0, 1, 0, 5, 6};
-    int *mymap = (j != 0) ? mapping : firstmap;
-    int best = 0, bestval = 0x7fffffff;
-    for (p = 0; p < 2; ++p) {
-      for (k = p ? best : 0; k < 5;
-           ++k) {  // @TODO: clarity: rewrite this to go 0..5, and 'continue'
-                   // the unwanted ones during 2nd pass
-        int type = mymap[k], est = 0;
-        unsigned char *z = pixels + stride_bytes * j;
-        for (i = 0; i < n; ++i) switch (type) {
-            case 0:
-              line_buffer[i] = z[i];
-              break;
-            case 1:
-              line_buffer[i] = z[i];
-              break;
-            case 2:
-              line_buffer[i] = z[i] - z[i - stride_bytes];
-              break;
-            case 3:
-              line_buffer[i] = z[i] - (z[i - stride_bytes] >> 1);
-              break;
-            case 4:
-              line_buffer[i] =
-                  (signed char)(z[i] - stbiw__paeth(0, z[i - stride_bytes], 0));
-              break;
-            case 5:
-              line_buffer[i] = z[i];
-              break;
-            case 6:
-              line_buffer[i] = z[i];
-              break;
-          }
-        for (i = n; i < x * n; ++i) {
-          switch (type) {
-            case 0:
-              line_buffer[i] = z[i];
-              break;
-            case 1:
-              line_buffer[i] = z[i] - z[i - n];
-              break;
-            case 2:
-              line_buffer[i] = z[i] - z[i - stride_bytes];
-              break;
-            case 3:
-              line_buffer[i] = z[i] - ((z[i - n] + z[i - stride_bytes]) >> 1);
-              break;
-            case 4:
-              line_buffer[i] =
-                  z[i] - stbiw__paeth(z[i - n], z[i - stride_bytes],
-                                      z[i - stride_bytes - n]);
-              break;
-            case 5:
-              line_buffer[i] = z[i] - (z[i - n] >> 1);
-              break;
-            case 6:
-              line_buffer[i] = z[i] - stbiw__paeth(z[i - n], 0, 0);
-              break;
-          }
-        }
-        if (p) break;
-        for (i = 0; i < x * n; ++i) est += abs((signed char)line_buffer[i]);
-        if (est < bestval) {
-          bestval = est;
-          best = k;
-        }
-      }
-    }
-    // when we get here, best contains the filter type, and line_buffer contains
-    // the data
-    filt[j * (x * n + 1)] = (unsigned char)best;
-    STBIW_MEMMOVE(filt + j * (x * n + 1) + 1, line_buffer, x * n);
-  }
-  STBIW_FREE(line_buffer);
-  zlib =
-      stbi_zlib_compress(filt, y * (x * n + 1), &zlen,
-                         8);  // increase 8 to get smaller but use more memory
+  memset(zero_row, 0, x * n);
+  job.pixels = pixels;
+  job.up = zero_row;
+  job.stride_bytes = stride_bytes;
+  job.x = x;
+  job.y = y;
+  job.n = n;
+  job.filt = filt;
+  stbiw__parallel_for((y + stbiw__PNG_BAND - 1) / stbiw__PNG_BAND,
+                      stbiw__png_threads(x, y), stbiw__png_filter_task, &job);
+  STBIW_FREE(zero_row);
+#ifdef STBIW_ZLIB_COMPRESS
+  zlib = STBIW_ZLIB_COMPRESS(filt, y * (x * n + 1), &zlen,
+                             stbi_write_png_compression_level);
+  if (zlib) zcrc = stbi_crc32(0, zlib, zlen);
+#else
+  zlib = stbiw__zlib_compress_chunked(filt, y * (x * n + 1), &zlen,
+                                      stbi_write_png_compression_level,
+                                      stbiw__png_threads(x, y), &zcrc);
+#endif
   STBIW_FREE(filt);
   if (!zlib) return 0;
 
   // each tag requires 12 bytes of overhead
   out = (unsigned char *)STBIW_MALLOC(8 + 12 + 13 + 12 + zlen + 12);
-  if (!out) return 0;
+  if (!out) {
+    STBIW_FREE(zlib);
+    return 0;
+  }
   *out_len = 8 + 12 + 13 + 12 + zlen + 12;
 
   o = out;
@@ -1078,7 +2270,9 @@ unsigned char *stbi_write_png_to_mem(unsigned char *pixels, int stride_bytes,
   STBIW_MEMMOVE(o, zlib, zlen);
   o += zlen;
   STBIW_FREE(zlib);
-  stbiw__wpcrc(&o, zlen);
+  // the payload CRC came back with the compressed data
+  zcrc = stbi_crc32_combine(stbi_crc32(0, o - zlen - 4, 4), zcrc, zlen);
+  stbiw__wp32(o, zcrc);
 
   stbiw__wp32(o, 0);
   stbiw__wptag(o, "IEND");
@@ -1098,7 +2292,7 @@ STBIWDEF int stbi_write_png(char const *filename, int x, int y, int comp,
   if (png == NULL) return 0;
   FILE *f;
   errno_t err = fopen_s(&f, filename, "wb");
-  if (!err) {
+  if (err || !f) {
     STBIW_FREE(png);
     return 0;
   }
@@ -1121,6 +2315,372 @@ STBIWDEF int stbi_write_png_to_func(stbi_write_func *func, void *context, int x,
   return 1;
 }
 
+//////////////////////////////////////////////////////////////////////////////
+//
+// Row-streaming writers
+//
+// Rows arrive top to bottom in bands and are encoded as they come in, so an
+// image never has to be held in memory in full. Output is gathered into a
+// 64K buffer on its way to the user's callback. The bottom row is only known
+// at the end, so BMP and TGA streams are stored top-down (negative BMP height,
+// TGA top-left origin).
+//
+// PNG streams filter each band in parallel and collect the filtered rows
+// until stbiw__PNG_STREAM_BATCH deflate chunks are full; the batch is then
+// compressed like stbiw__zlib_compress_chunked() does and written out as one
+// IDAT, keeping the last 32K as history for the next batch. The zlib data is
+// identical to what stbi_write_png_to_func() produces for the same image.
+
+#define stbiw__STREAM_BUF (64 * 1024)
+#define stbiw__PNG_STREAM_BATCH 8  // deflate chunks per IDAT
+
+enum {
+  STBIW__STREAM_PNG,
+  STBIW__STREAM_BMP,
+  STBIW__STREAM_TGA,
+  STBIW__STREAM_HDR
+};
+
+struct stbi_write_stream {
+  stbi__write_context user;  // the caller's callback
+  stbi__write_context s;     // buffers writes on their way to 'user'
+  unsigned char *buf;
+  int buf_len;
+  int format, x, y, comp, row, ok;
+  int pad, rle, has_alpha;  // BMP, TGA
+  unsigned char *scratch;   // HDR component planes, PNG filtered row
+  // PNG: the last row pushed, and the filtered data waiting to be deflated
+  // after 'zbuf_hist' bytes of history
+  unsigned char *prev, *zbuf;
+  int zbuf_len, zbuf_hist, level, threads, started;
+  unsigned int adler;
+};
+
+static void stbiw__stream_flush(stbi_write_stream *st) {
+  if (st->buf_len) st->user.func(st->user.context, st->buf, st->buf_len);
+  st->buf_len = 0;
+}
+
+static void stbiw__stream_write(void *context, void *data, int size) {
+  stbi_write_stream *st = (stbi_write_stream *)context;
+  if (st->buf_len + size > stbiw__STREAM_BUF) {
+    stbiw__stream_flush(st);
+    if (size >= stbiw__STREAM_BUF) {
+      st->user.func(st->user.context, data, size);
+      return;
+    }
+  }
+  memcpy(st->buf + st->buf_len, data, size);
+  st->buf_len += size;
+}
+
+static void stbiw__stream_free(stbi_write_stream *st) {
+  STBIW_FREE(st->buf);
+  STBIW_FREE(st->scratch);
+  STBIW_FREE(st->prev);
+  STBIW_FREE(st->zbuf);
+  STBIW_FREE(st);
+}
+
+static stbi_write_stream *stbiw__stream_alloc(stbi_write_func *func,
+                                              void *context, int format, int x,
+                                              int y, int comp) {
+  stbi_write_stream *st;
+  if (!func || x <= 0 || y <= 0 || comp < 1 || comp > 4) return NULL;
+  st = (stbi_write_stream *)STBIW_MALLOC(sizeof(*st));
+  if (!st) return NULL;
+  memset(st, 0, sizeof(*st));
+  st->buf = (unsigned char *)STBIW_MALLOC(stbiw__STREAM_BUF);
+  if (!st->buf) {
+    STBIW_FREE(st);
+    return NULL;
+  }
+  stbi__start_write_callbacks(&st->user, func, context);
+  stbi__start_write_callbacks(&st->s, stbiw__stream_write, st);
+  st->format = format;
+  st->x = x;
+  st->y = y;
+  st->comp = comp;
+  st->ok = 1;
+  return st;
+}
+
+// deflates everything after the history as one IDAT chunk
+static int stbiw__png_stream_deflate(stbi_write_stream *st, int final) {
+  unsigned char *out[stbiw__PNG_STREAM_BATCH];
+  int out_len[stbiw__PNG_STREAM_BATCH];
+  unsigned int adler[stbiw__PNG_STREAM_BATCH], crc[stbiw__PNG_STREAM_BATCH];
+  unsigned char b[8], *o;
+  stbiw__zchunk_job job;
+  int i, keep, total = 0, ok = 1, end = st->zbuf_len;
+  int chunks = (end - st->zbuf_hist + stbiw__ZCHUNK - 1) / stbiw__ZCHUNK;
+  unsigned int c;
+
+  STBIW_ASSERT(chunks >= 1 && chunks <= stbiw__PNG_STREAM_BATCH);
+  job.data = st->zbuf;
+  job.start = st->zbuf_hist;
+  job.end = end;
+  job.level = st->level;
+  job.final = final;
+  job.out = out;
+  job.out_len = out_len;
+  job.adler = adler;
+  job.crc = crc;
+  for (i = 0; i < chunks; ++i) out[i] = NULL;
+  stbiw__parallel_for(chunks, st->threads, stbiw__zchunk_task, &job);
+  for (i = 0; i < chunks; ++i) {
+    if (!out[i])
+      ok = 0;
+    else
+      total += out_len[i];
+  }
+
+  if (ok) {
+    total += (st->started ? 0 : 2) + (final ? 4 : 0);
+    o = b;
+    stbiw__wp32(o, total);
+    stbiw__wptag(o, "IDAT");
+    st->s.func(st->s.context, b, 8);
+    c = stbi_crc32(0, b + 4, 4);
+    if (!st->started) {
+      stbiw__zlib_header(b, st->level);
+      st->s.func(st->s.context, b, 2);
+      c = stbi_crc32(c, b, 2);
+      st->started = 1;
+    }
+    for (i = 0; i < chunks; ++i) {
+      int len = i + 1 < chunks ? stbiw__ZCHUNK
+                               : end - st->zbuf_hist - i * stbiw__ZCHUNK;
+      st->s.func(st->s.context, out[i], out_len[i]);
+      c = stbi_crc32_combine(c, crc[i], out_len[i]);
+      st->adler = stbiw__adler32_combine(st->adler, adler[i], len);
+    }
+    o = b;
+    if (final) {
+      stbiw__wp32(o, st->adler);
+      c = stbi_crc32(c, b, 4);
+    }
+    stbiw__wp32(o, c);
+    st->s.func(st->s.context, b, (int)(o - b));
+  }
+  for (i = 0; i < chunks; ++i)
+    if (out[i]) STBIW_FREE(out[i]);
+
+  keep = end < stbiw__ZWINDOW ? end : stbiw__ZWINDOW;
+  STBIW_MEMMOVE(st->zbuf, st->zbuf + end - keep, keep);
+  st->zbuf_len = st->zbuf_hist = keep;
+  return ok;
+}
+
+// bytes left before the batch is full
+static int stbiw__png_stream_room(stbi_write_stream *st) {
+  return st->zbuf_hist + stbiw__PNG_STREAM_BATCH * stbiw__ZCHUNK -
+         st->zbuf_len;
+}
+
+static int stbiw__png_stream_append(stbi_write_stream *st,
+                                    const unsigned char *data, int len) {
+  while (len > 0) {
+    int n = stbiw__png_stream_room(st);
+    if (n == 0) {
+      if (!stbiw__png_stream_deflate(st, 0)) return 0;
+      continue;
+    }
+    if (n > len) n = len;
+    memcpy(st->zbuf + st->zbuf_len, data, n);
+    st->zbuf_len += n;
+    data += n;
+    len -= n;
+  }
+  return 1;
+}
+
+static int stbiw__png_stream_rows(stbi_write_stream *st,
+                                  const unsigned char *rows, int count,
+                                  int stride) {
+  int len = st->x * st->comp;
+  stbiw__png_filter_job job;
+
+  while (count > 0) {
+    int fit;
+    // a full batch is only deflated once more data arrives, so the end of
+    // the image always has something left to close the stream with
+    if (!stbiw__png_stream_room(st) && !stbiw__png_stream_deflate(st, 0))
+      return 0;
+    fit = stbiw__png_stream_room(st) / (len + 1);
+    if (fit == 0) {
+      // the row straddles the end of the batch
+      stbiw__png_encode_row(rows, st->prev, st->comp, len, st->scratch);
+      if (!stbiw__png_stream_append(st, st->scratch, len + 1)) return 0;
+      fit = 1;
+    } else {
+      if (fit > count) fit = count;
+      job.pixels = rows;
+      job.up = st->prev;
+      job.stride_bytes = stride;
+      job.x = st->x;
+      job.y = fit;
+      job.n = st->comp;
+      job.filt = st->zbuf + st->zbuf_len;
+      stbiw__parallel_for((fit + stbiw__PNG_BAND - 1) / stbiw__PNG_BAND,
+                          st->threads, stbiw__png_filter_task, &job);
+      st->zbuf_len += fit * (len + 1);
+    }
+    memcpy(st->prev, rows + (fit - 1) * stride, len);
+    rows += fit * stride;
+    count -= fit;
+  }
+  return 1;
+}
+
+STBIWDEF stbi_write_stream *stbi_write_png_begin(stbi_write_func *func,
+                                                 void *context, int x, int y,
+                                                 int comp) {
+  int ctype[5] = {-1, 0, 4, 2, 6};
+  unsigned char sig[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+  unsigned char ihdr[12 + 13], *o = ihdr;
+  stbi_write_stream *st =
+      stbiw__stream_alloc(func, context, STBIW__STREAM_PNG, x, y, comp);
+  if (!st) return NULL;
+
+  st->level = stbi_write_png_compression_level;
+  st->threads = stbiw__png_threads(x, y);
+  st->adler = 1;
+  st->zbuf = (unsigned char *)STBIW_MALLOC(stbiw__ZWINDOW +
+                                          stbiw__PNG_STREAM_BATCH *
+                                              stbiw__ZCHUNK);
+  st->prev = (unsigned char *)STBIW_MALLOC(x * comp);
+  st->scratch = (unsigned char *)STBIW_MALLOC(x * comp + 1);
+  if (!st->zbuf || !st->prev || !st->scratch) {
+    stbiw__stream_free(st);
+    return NULL;
+  }
+  memset(st->prev, 0, x * comp);
+
+  stbiw__wp32(o, 13);
+  stbiw__wptag(o, "IHDR");
+  stbiw__wp32(o, x);
+  stbiw__wp32(o, y);
+  *o++ = 8;
+  *o++ = STBIW_UCHAR(ctype[comp]);
+  *o++ = 0;
+  *o++ = 0;
+  *o++ = 0;
+  stbiw__wpcrc(&o, 13);
+  st->s.func(st->s.context, sig, 8);
+  st->s.func(st->s.context, ihdr, (int)(o - ihdr));
+  return st;
+}
+
+STBIWDEF stbi_write_stream *stbi_write_bmp_begin(stbi_write_func *func,
+                                                 void *context, int x, int y,
+                                                 int comp) {
+  stbi_write_stream *st =
+      stbiw__stream_alloc(func, context, STBIW__STREAM_BMP, x, y, comp);
+  if (!st) return NULL;
+  st->pad = (-x * 3) & 3;
+  stbiw__writef(&st->s,
+                "11 4 22 4"
+                "4 44 22 444444",
+                'B', 'M', 14 + 40 + (stbiw_uint32)(x * 3 + st->pad) * y, 0, 0,
+                14 + 40,                              // file header
+                40, x, -y, 1, 24, 0, 0, 0, 0, 0, 0);  // bitmap header
+  return st;
+}
+
+STBIWDEF stbi_write_stream *stbi_write_tga_begin(stbi_write_func *func,
+                                                 void *context, int x, int y,
+                                                 int comp) {
+  int has_alpha = (comp == 2 || comp == 4);
+  int colorbytes = has_alpha ? comp - 1 : comp;
+  int format = colorbytes < 2 ? 3 : 2;
+  stbi_write_stream *st =
+      stbiw__stream_alloc(func, context, STBIW__STREAM_TGA, x, y, comp);
+  if (!st) return NULL;
+  st->has_alpha = has_alpha;
+  st->rle = stbi_write_tga_with_rle;
+  stbiw__writef(&st->s, "111 221 2222 11", 0, 0, format + (st->rle ? 8 : 0), 0,
+                0, 0, 0, 0, x, y, (colorbytes + has_alpha) * 8,
+                has_alpha * 8 | 0x20);  // top-left origin
+  return st;
+}
+
+STBIWDEF stbi_write_stream *stbi_write_hdr_begin(stbi_write_func *func,
+                                                 void *context, int x, int y,
+                                                 int comp) {
+  stbi_write_stream *st =
+      stbiw__stream_alloc(func, context, STBIW__STREAM_HDR, x, y, comp);
+  if (!st) return NULL;
+  st->scratch = (unsigned char *)STBIW_MALLOC(x * 4);
+  if (!st->scratch) {
+    stbiw__stream_free(st);
+    return NULL;
+  }
+  stbiw__write_hdr_header(&st->s, x, y);
+  return st;
+}
+
+STBIWDEF int stbi_write_push_rows(stbi_write_stream *st, const void *rows,
+                                  int row_count, int stride_in_bytes) {
+  const unsigned char *r = (const unsigned char *)rows;
+  int j;
+
+  if (!st || !st->ok) return 0;
+  if (row_count < 0 || row_count > st->y - st->row || (row_count && !rows)) {
+    st->ok = 0;
+    return 0;
+  }
+  if (stride_in_bytes == 0)
+    stride_in_bytes =
+        st->x * st->comp *
+        (st->format == STBIW__STREAM_HDR ? (int)sizeof(float) : 1);
+
+  switch (st->format) {
+    case STBIW__STREAM_PNG:
+      st->ok = stbiw__png_stream_rows(st, r, row_count, stride_in_bytes);
+      break;
+    case STBIW__STREAM_BMP:
+      for (j = 0; j < row_count; ++j)
+        stbiw__write_pixels(&st->s, -1, 1, st->x, 1, st->comp,
+                            (void *)(r + j * stride_in_bytes), 0, st->pad, 1);
+      break;
+    case STBIW__STREAM_TGA:
+      for (j = 0; j < row_count; ++j) {
+        unsigned char *row = (unsigned char *)r + j * stride_in_bytes;
+        if (st->rle)
+          stbiw__write_tga_rle_row(&st->s, row, st->x, st->comp, st->has_alpha);
+        else
+          stbiw__write_pixels(&st->s, -1, 1, st->x, 1, st->comp, row,
+                              st->has_alpha, 0, 0);
+      }
+      break;
+    case STBIW__STREAM_HDR:
+      for (j = 0; j < row_count; ++j)
+        stbiw__write_hdr_scanline(&st->s, st->x, st->comp, st->scratch,
+                                  (float *)(r + j * stride_in_bytes));
+      break;
+  }
+  st->row += row_count;
+  return st->ok;
+}
+
+STBIWDEF int stbi_write_end(stbi_write_stream *st) {
+  int ok;
+  if (!st) return 0;
+  ok = st->ok && st->row == st->y;
+  if (ok && st->format == STBIW__STREAM_PNG) {
+    unsigned char iend[12], *o = iend;
+    ok = stbiw__png_stream_deflate(st, 1);
+    stbiw__wp32(o, 0);
+    stbiw__wptag(o, "IEND");
+    stbiw__wpcrc(&o, 0);
+    if (ok) st->s.func(st->s.context, iend, 12);
+  }
+  stbiw__stream_flush(st);
+  stbiw__stream_free(st);
+  return ok;
+}
+
 #endif  // STB_IMAGE_WRITE_IMPLEMENTATION
 
 /* Revision history
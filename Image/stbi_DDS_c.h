@@ -4,6 +4,9 @@
 
 #include "image_DXT.h"
 
+#define STBI__DDS_FOURCC(a, b, c, d) \
+  ((a) | ((b) << 8) | ((c) << 16) | ((unsigned int)(d) << 24))
+
 static int stbi__dds_test(stbi__context *s) {
   //	check the magic number
   if (stbi__get8(s) != 'D') {
@@ -43,7 +46,7 @@ int stbi__dds_test_filename(char const *filename) {
   int r;
   FILE *f;
   errno_t err = fopen_s(&f, filename, "rb");
-  if (!err) return 0;
+  if (err) return 0;
   r = stbi__dds_test_file(f);
   if (f) fclose(f);
   return r;
@@ -137,8 +140,7 @@ void stbi_decode_DXT23_alpha_block(unsigned char uncompressed[16 * 4],
   int i, next_bit = 0;
   //	each alpha value gets 4 bits
   for (i = 3; i < 16 * 4; i += 4) {
-    uncompressed[i] = stbi_convert_bit_range(
-        (compressed[next_bit >> 3] >> (next_bit & 7)) & 15, 4, 8);
+    uncompressed[i] = ((compressed[next_bit >> 3] >> (next_bit & 7)) & 15) * 17;
     next_bit += 4;
   }
 }
@@ -295,7 +297,7 @@ int stbi__dds_info_from_path(char const *filename, int *x, int *y, int *comp,
   int res;
   FILE *f;
   errno_t err = fopen_s(&f, filename, "rb");
-  if (!err) return 0;
+  if (err) return 0;
   res = stbi__dds_info_from_file(f, x, y, comp, iscompressed);
   if (f) fclose(f);
   return res;
@@ -313,16 +315,35 @@ int stbi__dds_info_from_file(FILE *f, int *x, int *y, int *comp,
 }
 #endif
 
+/*	reads up to n bytes, as many as the source still has; unlike
+        stbi__getn, a short source still fills the start of buffer	*/
+static int stbi__dds_getn_partial(stbi__context *s, stbi_uc *buffer, int n) {
+  int got = (int)(s->img_buffer_end - s->img_buffer);
+  if (got > n) {
+    got = n;
+  }
+  memcpy(buffer, s->img_buffer, got);
+  s->img_buffer += got;
+  if (s->io.read) {
+    while (got < n) {
+      int count = (s->io.read)(s->io_user_data, (char *)buffer + got, n - got);
+      if (count <= 0) {
+        break;
+      }
+      got += count;
+    }
+  }
+  return got;
+}
+
 static void *stbi__dds_load(stbi__context *s, int *x, int *y, int *comp,
                             int req_comp) {
   //	all variables go up front
   stbi_uc *dds_data = NULL;
-  stbi_uc block[16 * 4];
-  stbi_uc compressed[8];
-  int flags, DXT_family;
+  int flags, DXT_format;
   int has_alpha, has_mipmap;
   int is_compressed, cubemap_faces;
-  int block_pitch, num_blocks;
+  int block_pitch, num_blocks, block_size, face_size, threads;
   DDS_header header = {0};
   int i, sz, cf;
   //	load the header
@@ -367,64 +388,72 @@ static void *stbi__dds_load(stbi__context *s, int *x, int *y, int *comp,
   /*	is this uncompressed?	*/
   if (is_compressed) {
     /*	compressed	*/
-    //	note: header.sPixelFormat.dwFourCC is something like
-    //(('D'<<0)|('X'<<8)|('T'<<16)|('1'<<24))
-    DXT_family = 1 + (header.sPixelFormat.dwFourCC >> 24) - '1';
-    if ((DXT_family < 1) || (DXT_family > 5)) return NULL;
+    switch (header.sPixelFormat.dwFourCC) {
+      case STBI__DDS_FOURCC('D', 'X', 'T', '1'):
+        DXT_format = DDS_FORMAT_DXT1;
+        break;
+      case STBI__DDS_FOURCC('D', 'X', 'T', '2'):
+      case STBI__DDS_FOURCC('D', 'X', 'T', '3'):
+        DXT_format = DDS_FORMAT_DXT3;
+        break;
+      case STBI__DDS_FOURCC('D', 'X', 'T', '4'):
+      case STBI__DDS_FOURCC('D', 'X', 'T', '5'):
+        DXT_format = DDS_FORMAT_DXT5;
+        break;
+      case STBI__DDS_FOURCC('A', 'T', 'I', '1'):
+      case STBI__DDS_FOURCC('B', 'C', '4', 'U'):
+        DXT_format = DDS_FORMAT_BC4;
+        break;
+      case STBI__DDS_FOURCC('A', 'T', 'I', '2'):
+      case STBI__DDS_FOURCC('B', 'C', '5', 'U'):
+        DXT_format = DDS_FORMAT_BC5;
+        break;
+      default:
+        return stbi__errpuc("unknown format", "Unsupported DDS format");
+    }
+    block_size = ((DXT_format == DDS_FORMAT_DXT1) ||
+                  (DXT_format == DDS_FORMAT_BC4))
+                     ? 8
+                     : 16;
     /*	check the expected size...oops, nevermind...
             those non-compliant writers leave
             dwPitchOrLinearSize == 0	*/
+    if (!stbi__mad4sizes_valid(s->img_x, s->img_y, 4, cubemap_faces, 0) ||
+        !stbi__mul2sizes_valid(num_blocks, block_size))
+      return stbi__errpuc("too large", "Image too large to decode");
+    face_size = num_blocks * block_size;
     //	passed all the tests, get the RAM for decoding
     sz = (s->img_x) * (s->img_y) * 4 * cubemap_faces;
-    dds_data = (unsigned char *)malloc(sz);
+    dds_data = (unsigned char *)STBI_MALLOC(sz);
+    if (NULL == dds_data) return stbi__errpuc("outofmem", "Out of memory");
+    threads = stbi__decode_threads(s->img_x, s->img_y);
     /*	do this once for each face	*/
     for (cf = 0; cf < cubemap_faces; ++cf) {
-      //	now read and decode all the blocks
-      for (i = 0; i < num_blocks; ++i) {
-        //	where are we?
-        int bx, by, bw = 4, bh = 4;
-        int ref_x = 4 * (i % block_pitch);
-        int ref_y = 4 * (i / block_pitch);
-        //	get the next block's worth of compressed data, and decompress it
-        if (DXT_family == 1) {
-          //	DXT1
-          stbi__getn(s, compressed, 8);
-          stbi_decode_DXT1_block(block, compressed);
-        } else if (DXT_family < 4) {
-          //	DXT2/3
-          stbi__getn(s, compressed, 8);
-          stbi_decode_DXT23_alpha_block(block, compressed);
-          stbi__getn(s, compressed, 8);
-          stbi_decode_DXT_color_block(block, compressed);
-        } else {
-          //	DXT4/5
-          stbi__getn(s, compressed, 8);
-          stbi_decode_DXT45_alpha_block(block, compressed);
-          stbi__getn(s, compressed, 8);
-          stbi_decode_DXT_color_block(block, compressed);
-        }
-        //	is this a partial block?
-        if (ref_x + 4 > (int)s->img_x) {
-          bw = s->img_x - ref_x;
-        }
-        if (ref_y + 4 > (int)s->img_y) {
-          bh = s->img_y - ref_y;
-        }
-        //	now drop our decompressed data into the buffer
-        for (by = 0; by < bh; ++by) {
-          int idx = 4 * ((ref_y + by + cf * s->img_x) * s->img_x + ref_x);
-          for (bx = 0; bx < bw * 4; ++bx) {
-            dds_data[idx + bx] = block[by * 16 + bx];
-          }
+      const stbi_uc *blocks;
+      stbi_uc *copy = NULL;
+      if (!s->io.read && (s->img_buffer_end - s->img_buffer >= face_size)) {
+        //	in memory already, decode the blocks where they are
+        blocks = s->img_buffer;
+        s->img_buffer += face_size;
+      } else {
+        //	a short file decodes the missing blocks as 0s
+        copy = (stbi_uc *)STBI_MALLOC(face_size);
+        if (NULL == copy) {
+          STBI_FREE(dds_data);
+          return stbi__errpuc("outofmem", "Out of memory");
         }
+        memset(copy, 0, face_size);
+        stbi__dds_getn_partial(s, copy, face_size);
+        blocks = copy;
       }
+      //	rows of blocks are decoded in parallel for big images
+      decode_DXT_image(blocks, DXT_format, s->img_x, s->img_y,
+                       dds_data + (size_t)cf * s->img_x * s->img_y * 4,
+                       threads);
+      STBI_FREE(copy);
       /*	done reading and decoding the main image...
               stbi__skip MIPmaps if present	*/
       if (has_mipmap) {
-        int block_size = 16;
-        if (DXT_family == 1) {
-          block_size = 8;
-        }
         for (i = 1; i < (int)header.dwMipMapCount; ++i) {
           int mx = s->img_x >> (i + 2);
           int my = s->img_y >> (i + 2);
@@ -440,14 +469,13 @@ static void *stbi__dds_load(stbi__context *s, int *x, int *y, int *comp,
     } /* per cubemap face */
   } else {
     /*	uncompressed	*/
-    DXT_family = 0;
     s->img_n = 3;
     if (has_alpha) {
       s->img_n = 4;
     }
     *comp = s->img_n;
     sz = s->img_x * s->img_y * s->img_n * cubemap_faces;
-    dds_data = (unsigned char *)malloc(sz);
+    dds_data = (unsigned char *)STBI_MALLOC(sz);
     /*	do this once for each face	*/
     for (cf = 0; cf < cubemap_faces; ++cf) {
       /*	read the main image for this face	*/
@@ -519,8 +547,19 @@ void *stbi__dds_load_from_path(const char *filename, int *x, int *y, int *comp,
                                int req_comp) {
   void *data;
   FILE *f;
-  errno_t err = fopen_s(&f, filename, "rb");
-  if (!err) return 0;
+  errno_t err;
+#ifndef STBI_NO_MMAP
+  image_file_view view;
+  /*	decode straight out of the mapped file	*/
+  if (stbi__map_file(filename, &view)) {
+    data = stbi__dds_load_from_memory(view.data, (int)view.size, x, y, comp,
+                                     req_comp);
+    image_file_unmap(&view);
+    return data;
+  }
+#endif
+  err = fopen_s(&f, filename, "rb");
+  if (err) return 0;
   data = stbi__dds_load_from_file(f, x, y, comp, req_comp);
   if (f) fclose(f);
   return data;
@@ -43,7 +43,7 @@ int stbi__pkm_test_filename(char const *filename) {
   int r;
   FILE *f;
   errno_t err = fopen_s(&f, filename, "rb");
-  if (!err) return 0;
+  if (err) return 0;
   r = stbi__pkm_test_file(f);
   if (f) fclose(f);
   return r;
@@ -75,9 +75,8 @@ static int stbi__pkm_info(stbi__context *s, int *x, int *y, int *comp) {
   PKMHeader header;
   unsigned int width, height;
 
-  stbi__getn(s, (stbi_uc *)(&header), sizeof(PKMHeader));
-
-  if (0 != strcmp(header.aName, "PKM 10")) {
+  if (!stbi__getn(s, (stbi_uc *)(&header), sizeof(PKMHeader)) ||
+      (0 != memcmp(header.aName, "PKM 10", 6))) {
     stbi__rewind(s);
     return 0;
   }
@@ -113,7 +112,7 @@ int stbi__pkm_info_from_path(char const *filename, int *x, int *y, int *comp) {
   int res;
   FILE *f;
   errno_t err = fopen_s(&f, filename, "rb");
-  if (!err) return 0;
+  if (err) return 0;
   res = stbi__pkm_info_from_file(f, x, y, comp);
   if (f) fclose(f);
   return res;
@@ -141,12 +140,12 @@ static void *stbi__pkm_load(stbi__context *s, int *x, int *y, int *comp,
   unsigned int bpr;
   unsigned int size;
   unsigned int compressedSize;
+  unsigned int decodedComp;
 
   int res;
 
-  stbi__getn(s, (stbi_uc *)(&header), sizeof(PKMHeader));
-
-  if (0 != strcmp(header.aName, "PKM 10")) {
+  if (!stbi__getn(s, (stbi_uc *)(&header), sizeof(PKMHeader)) ||
+      (0 != memcmp(header.aName, "PKM 10", 6))) {
     return NULL;
   }
 
@@ -159,31 +158,34 @@ static void *stbi__pkm_load(stbi__context *s, int *x, int *y, int *comp,
 
   compressedSize = etc1_get_encoded_data_size(width, height);
 
-  pkm_data = (stbi_uc *)malloc(compressedSize);
+  pkm_data = (stbi_uc *)STBI_MALLOC(compressedSize);
   stbi__getn(s, pkm_data, compressedSize);
 
-  bpr = ((width * 3) + align) & ~align;
+  //	RGBA comes straight out of the decoder, no second pass
+  decodedComp = (4 == req_comp) ? 4 : 3;
+  bpr = ((width * decodedComp) + align) & ~align;
   size = bpr * height;
-  pkm_res_data = (stbi_uc *)malloc(size);
+  pkm_res_data = (stbi_uc *)STBI_MALLOC(size);
 
-  res = etc1_decode_image((const etc1_byte *)pkm_data,
-                          (etc1_byte *)pkm_res_data, width, height, 3, bpr);
+  res = etc1_decode_image_rgba((const etc1_byte *)pkm_data,
+                               (etc1_byte *)pkm_res_data, width, height,
+                               decodedComp, bpr);
 
-  free(pkm_data);
+  STBI_FREE(pkm_data);
 
   if (0 == res) {
     if ((req_comp <= 4) && (req_comp >= 1)) {
       //	user has some requirements, meet them
-      if (req_comp != s->img_n) {
-        pkm_res_data = stbi__convert_format(pkm_res_data, s->img_n, req_comp,
-                                            s->img_x, s->img_y);
-        *comp = req_comp;
+      if (req_comp != (int)decodedComp) {
+        pkm_res_data = stbi__convert_format(pkm_res_data, decodedComp,
+                                            req_comp, s->img_x, s->img_y);
       }
+      *comp = req_comp;
     }
 
     return (stbi_uc *)pkm_res_data;
   } else {
-    free(pkm_res_data);
+    STBI_FREE(pkm_res_data);
   }
 
   return NULL;
@@ -201,8 +203,19 @@ void *stbi__pkm_load_from_path(char const *filename, int *x, int *y, int *comp,
                                int req_comp) {
   void *data;
   FILE *f;
-  errno_t err = fopen_s(&f, filename, "rb");
-  if (!err) return 0;
+  errno_t err;
+#ifndef STBI_NO_MMAP
+  image_file_view view;
+  /*	decode straight out of the mapped file	*/
+  if (stbi__map_file(filename, &view)) {
+    data = stbi__pkm_load_from_memory(view.data, (int)view.size, x, y, comp,
+                                     req_comp);
+    image_file_unmap(&view);
+    return data;
+  }
+#endif
+  err = fopen_s(&f, filename, "rb");
+  if (err) return 0;
   data = stbi__pkm_load_from_file(f, x, y, comp, req_comp);
   if (f) fclose(f);
   return data;
@@ -28,7 +28,7 @@ int stbi__pvr_test_filename(char const *filename) {
   int r;
   FILE *f;
   errno_t err = fopen_s(&f, filename, "rb");
-  if (!err) return 0;
+  if (err) return 0;
   r = stbi__pvr_test_file(f);
   if (f) fclose(f);
   return r;
@@ -142,7 +142,7 @@ int stbi__pvr_info_from_path(char const *filename, int *x, int *y, int *comp,
   int res;
   FILE *f;
   errno_t err = fopen_s(&f, filename, "rb");
-  if (!err) return 0;
+  if (err) return 0;
   res = stbi__pvr_info_from_file(f, x, y, comp, iscompressed);
   if (f) fclose(f);
   return res;
@@ -853,15 +853,15 @@ static void *stbi__pvr_load(stbi__context *s, int *x, int *y, int *comp,
   levelSize = (s->img_x * s->img_y * header.dwBitCount + 7) / 8;
 
   // get the raw data
-  pvr_data = (stbi_uc *)malloc(levelSize);
+  pvr_data = (stbi_uc *)STBI_MALLOC(levelSize);
   stbi__getn(s, pvr_data, levelSize);
 
   // if compressed decompress as RGBA
   if (iscompressed) {
-    pvr_res_data = (stbi_uc *)malloc(s->img_x * s->img_y * 4);
+    pvr_res_data = (stbi_uc *)STBI_MALLOC(s->img_x * s->img_y * 4);
     Decompress((AMTC_BLOCK_STRUCT *)pvr_data, bitmode, s->img_x, s->img_y, 1,
                (unsigned char *)pvr_res_data);
-    free(pvr_data);
+    STBI_FREE(pvr_data);
   } else {
     // otherwise use the raw data
     pvr_res_data = pvr_data;
@@ -891,11 +891,21 @@ void *stbi__pvr_load_from_path(char const *filename, int *x, int *y, int *comp,
                                int req_comp) {
   void *data;
   FILE *f;
-  errno_t err = fopen_s(&f, filename, "rb");
-  if (!err) return 0;
-  if (!f) return NULL;
+  errno_t err;
+#ifndef STBI_NO_MMAP
+  image_file_view view;
+  /*	decode straight out of the mapped file	*/
+  if (stbi__map_file(filename, &view)) {
+    data = stbi__pvr_load_from_memory(view.data, (int)view.size, x, y, comp,
+                                     req_comp);
+    image_file_unmap(&view);
+    return data;
+  }
+#endif
+  err = fopen_s(&f, filename, "rb");
+  if (err) return 0;
   data = stbi__pvr_load_from_file(f, x, y, comp, req_comp);
-  fclose(f);
+  if (f) fclose(f);
   return data;
 }
 #endif